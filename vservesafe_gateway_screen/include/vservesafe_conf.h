@@ -24,18 +24,322 @@
 #define VSERVESAFE_DEBUG_MQTT (1)
 #endif
 
+// Default tag store capacity; can be changed at run time up to
+// TAG_STORE_MAX_CAPACITY
 #ifndef MAX_TAGS_REMEMBER
-#define MAX_TAGS_REMEMBER (16)
+#define MAX_TAGS_REMEMBER (256)
 #endif
 
+#ifndef TAG_STORE_MAX_CAPACITY
+#define TAG_STORE_MAX_CAPACITY (4096)
+#endif
+
+// Tags per PSRAM slab chunk (power of two)
+#ifndef TAG_STORE_CHUNK_TAGS
+#define TAG_STORE_CHUNK_TAGS (64)
+#endif
+
+#ifndef MAX_TAG_HOLDERS
+#define MAX_TAG_HOLDERS (16)
+#endif
+
+// Recently evicted MACs kept to count re-admissions
+#ifndef MAX_EVICTED_REMEMBER
+#define MAX_EVICTED_REMEMBER (64)
+#endif
+
+// VSERVESAFE_EVICT_LRU, VSERVESAFE_EVICT_LOWEST_RSSI or
+// VSERVESAFE_EVICT_LRU_KEEP_NOTIFY; can be changed at run time
+#ifndef VSERVESAFE_EVICTION_POLICY
+#define VSERVESAFE_EVICTION_POLICY (VSERVESAFE_EVICT_LRU)
+#endif
+
+// Tags with alarm thresholds, pushed by the server (PSRAM)
 #ifndef MAX_NOTIFY_REMEMBER
-#define MAX_NOTIFY_REMEMBER (64)
+#define MAX_NOTIFY_REMEMBER (1024)
+#endif
+
+// Pushed threshold changes waiting for the ingest task, which applies at most
+// TAG_NOTIFY_BATCH of them per store lock hold
+#ifndef TAG_NOTIFY_QUEUE_LENGTH
+#define TAG_NOTIFY_QUEUE_LENGTH (128)
+#endif
+
+#ifndef TAG_NOTIFY_BATCH
+#define TAG_NOTIFY_BATCH (32)
+#endif
+
+// Encrypted MiBeacon tags with a bindkey
+#ifndef MAX_BINDKEYS_REMEMBER
+#define MAX_BINDKEYS_REMEMBER (64)
+#endif
+
+// Frames waiting for the decrypt worker (power of two); further frames are
+// dropped
+#ifndef MIBEACON_DECRYPT_QUEUE_LENGTH
+#define MIBEACON_DECRYPT_QUEUE_LENGTH (16)
+#endif
+
+#ifndef MIBEACON_DECRYPT_TASK_STACK
+#define MIBEACON_DECRYPT_TASK_STACK (4096)
+#endif
+
+#ifndef MIBEACON_DECRYPT_TASK_PRIORITY
+#define MIBEACON_DECRYPT_TASK_PRIORITY (2)
+#endif
+
+#ifndef MIBEACON_DECRYPT_TASK_CORE
+#define MIBEACON_DECRYPT_TASK_CORE (1)
+#endif
+
+// Decoded adverts waiting for the ingest task (power of two); further adverts
+// are dropped
+#ifndef TAG_INGEST_QUEUE_LENGTH
+#define TAG_INGEST_QUEUE_LENGTH (128)
+#endif
+
+#ifndef TAG_INGEST_TASK_STACK
+#define TAG_INGEST_TASK_STACK (4096)
+#endif
+
+#ifndef TAG_INGEST_TASK_PRIORITY
+#define TAG_INGEST_TASK_PRIORITY (3)
+#endif
+
+#ifndef TAG_INGEST_TASK_CORE
+#define TAG_INGEST_TASK_CORE (1)
+#endif
+
+// Readers see the tag table through snapshots the ingest task republishes
+// at most this often (ms) while it changes
+#ifndef TAG_SNAPSHOT_INTERVAL
+#define TAG_SNAPSHOT_INTERVAL (200)
+#endif
+
+// VSERVESAFE_SCAN_POLICY_FIXED or VSERVESAFE_SCAN_POLICY_ADAPTIVE; the BLE
+// scan window moves between SCAN_WINDOW_MIN and SCAN_WINDOW_MAX ms of every
+// SCAN_INTERVAL_MS, the rest is left to Wi-Fi
+#ifndef VSERVESAFE_SCAN_POLICY
+#define VSERVESAFE_SCAN_POLICY (VSERVESAFE_SCAN_POLICY_ADAPTIVE)
+#endif
+
+#ifndef SCAN_INTERVAL_MS
+#define SCAN_INTERVAL_MS (100)
+#endif
+
+#ifndef SCAN_WINDOW_MIN
+#define SCAN_WINDOW_MIN (20)
+#endif
+
+#ifndef SCAN_WINDOW_MAX
+#define SCAN_WINDOW_MAX (99)
+#endif
+
+#ifndef SCAN_WINDOW_STEP
+#define SCAN_WINDOW_STEP (10)
+#endif
+
+// Unpublished samples at which the scanner yields airtime to Wi-Fi, and the
+// widest window allowed while they wait
+#ifndef SCAN_BACKLOG_HIGH
+#define SCAN_BACKLOG_HIGH (8)
+#endif
+
+#ifndef SCAN_WINDOW_SHARED
+#define SCAN_WINDOW_SHARED (60)
+#endif
+
+// Bloom filter allowlist of registered tag MACs (bits, power of two, and hash
+// functions); 32768 bits keep false positives near 0.05% at 2000 tags
+#ifndef TAG_ALLOWLIST_BITS
+#define TAG_ALLOWLIST_BITS (32768)
+#endif
+
+#ifndef TAG_ALLOWLIST_HASHES
+#define TAG_ALLOWLIST_HASHES (8)
+#endif
+
+// Allowlist and name cache changes are written to flash once they have
+// settled this long
+#ifndef TAG_ALLOWLIST_SAVE_DELAY
+#define TAG_ALLOWLIST_SAVE_DELAY (10000)
+#endif
+
+// Passive scanning sends no scan requests; names come from the name cache,
+// filled by short active windows and name config records
+#ifndef VSERVESAFE_ACTIVE_SCAN
+#define VSERVESAFE_ACTIVE_SCAN (0)
+#endif
+
+#ifndef TAG_NAME_LENGTH
+#define TAG_NAME_LENGTH (20)
+#endif
+
+#ifndef TAG_NAME_CACHE_SIZE
+#define TAG_NAME_CACHE_SIZE (256)
+#endif
+
+// While tags have no name, an active window this long opens at most once per
+// interval
+#ifndef NAME_WINDOW_DURATION
+#define NAME_WINDOW_DURATION (3000)
+#endif
+
+#ifndef NAME_WINDOW_INTERVAL
+#define NAME_WINDOW_INTERVAL (60000)
+#endif
+
+// Recent samples kept per tag in PSRAM: TAG_HISTORY_LENGTH periods of
+// TAG_HISTORY_PERIOD ms for up to TAG_HISTORY_TAGS tags (about 260 bytes a
+// tag). A tag not heard for TAG_HISTORY_STALE periods gives up its history to
+// a new tag first.
+#ifndef TAG_HISTORY_TAGS
+#define TAG_HISTORY_TAGS (1024)
+#endif
+
+#ifndef TAG_HISTORY_LENGTH
+#define TAG_HISTORY_LENGTH (120)
+#endif
+
+#ifndef TAG_HISTORY_PERIOD
+#define TAG_HISTORY_PERIOD (60000)
+#endif
+
+#ifndef TAG_HISTORY_STALE
+#define TAG_HISTORY_STALE (5)
+#endif
+
+// Filter accept list entries the BLE controller holds; longer selected tag
+// lists are filtered by the host instead
+#ifndef BLE_ACCEPT_LIST_SIZE
+#define BLE_ACCEPT_LIST_SIZE (12)
 #endif
 
 #ifndef TAG_ONLINE_TIEMOUT
 #define TAG_ONLINE_TIEMOUT (60000)
 #endif
 
+// Presence timer wheel: TAG_PRESENCE_WHEEL_SLOTS buckets of TAG_PRESENCE_TICK
+// ms. A tag goes offline at most one tick after TAG_ONLINE_TIEMOUT expires.
+#ifndef TAG_PRESENCE_TICK
+#define TAG_PRESENCE_TICK (1000)
+#endif
+
+#ifndef TAG_PRESENCE_WHEEL_SLOTS
+#define TAG_PRESENCE_WHEEL_SLOTS (64)
+#endif
+
+// Online/offline events waiting for the uplink; more are dropped
+#ifndef TAG_PRESENCE_QUEUE_LENGTH
+#define TAG_PRESENCE_QUEUE_LENGTH (256)
+#endif
+
+// Alarm defaults, changed at run time by the alarm gateway config record. A
+// limit must stay crossed for TAG_ALARM_DWELL ms before the alarm is raised,
+// so a door opened for a moment does not raise one; it clears once the
+// temperature is TAG_ALARM_HYSTERESIS hundredths of a degree back inside, and
+// no new alarm is raised for TAG_ALARM_REARM ms after that.
+#ifndef TAG_ALARM_HYSTERESIS
+#define TAG_ALARM_HYSTERESIS (50)
+#endif
+
+#ifndef TAG_ALARM_DWELL
+#define TAG_ALARM_DWELL (120000)
+#endif
+
+#ifndef TAG_ALARM_REARM
+#define TAG_ALARM_REARM (300000)
+#endif
+
+// Raised/cleared alarm events waiting for the uplink; more are dropped
+#ifndef TAG_ALARM_QUEUE_LENGTH
+#define TAG_ALARM_QUEUE_LENGTH (64)
+#endif
+
+// Alert rules pushed by the server (rule gateway config records), each an
+// expression compiled to at most TAG_RULE_CODE_LENGTH bytes of bytecode.
+// MAX_TAG_RULES is at most 32, a bit per rule in each tag record.
+#ifndef MAX_TAG_RULES
+#define MAX_TAG_RULES (32)
+#endif
+
+#ifndef TAG_RULE_NAME_LENGTH
+#define TAG_RULE_NAME_LENGTH (15)
+#endif
+
+#ifndef TAG_RULE_CODE_LENGTH
+#define TAG_RULE_CODE_LENGTH (48)
+#endif
+
+#ifndef TAG_RULE_STACK_DEPTH
+#define TAG_RULE_STACK_DEPTH (8)
+#endif
+
+// Rules reading the offline time are also run on every tag this often, as
+// a silent tag sends no sample to run them
+#ifndef TAG_RULE_SWEEP_INTERVAL
+#define TAG_RULE_SWEEP_INTERVAL (10000)
+#endif
+
+// Rules starting/stopping to hold, waiting for the uplink; more are dropped
+#ifndef TAG_RULE_QUEUE_LENGTH
+#define TAG_RULE_QUEUE_LENGTH (64)
+#endif
+
+// LEDC channel and tone driving the buzzer
+#ifndef BUZZER_LEDC_CHANNEL
+#define BUZZER_LEDC_CHANNEL (4)
+#endif
+
+#ifndef BUZZER_LEDC_FREQUENCY
+#define BUZZER_LEDC_FREQUENCY (2700)
+#endif
+
+#ifndef BUZZER_LEDC_RESOLUTION
+#define BUZZER_LEDC_RESOLUTION (8)
+#endif
+
+// Half of (1 << resolution): a square wave at BUZZER_LEDC_FREQUENCY. Fully
+// on would hold the pin high, which a passive buzzer does not sound.
+#ifndef BUZZER_LEDC_DUTY
+#define BUZZER_LEDC_DUTY (1 << (BUZZER_LEDC_RESOLUTION - 1))
+#endif
+
+// The task switching the buzzer on pattern edges sleeps between them; it
+// runs above the loop and the ingest task so the cadence does not jitter
+#ifndef BUZZER_TASK_STACK
+#define BUZZER_TASK_STACK (2048)
+#endif
+
+#ifndef BUZZER_TASK_PRIORITY
+#define BUZZER_TASK_PRIORITY (4)
+#endif
+
+#ifndef BUZZER_TASK_CORE
+#define BUZZER_TASK_CORE (1)
+#endif
+
+// Adverts repeating the stored frame counter within this window are copies
+// of the same sample
+#ifndef TAG_DUPLICATE_WINDOW
+#define TAG_DUPLICATE_WINDOW (30000)
+#endif
+
+// Tag RSSI min/max span the current and the previous window
+#ifndef TAG_SIGNAL_WINDOW
+#define TAG_SIGNAL_WINDOW (60000)
+#endif
+
+// Gateway health published to gwinfo_<gateway MAC>
+#ifndef HEALTH_PUBLISH_INTERVAL
+#define HEALTH_PUBLISH_INTERVAL (60000)
+#endif
+
+// Show each tag's advert loss instead of its MAC on the home tiles
+#ifndef VSERVESAFE_TILE_SHOW_LOSS
+#define VSERVESAFE_TILE_SHOW_LOSS (0)
+#endif
+
 #ifndef VSERVESAFE_ALLOW_EEPROM
 #define VSERVESAFE_ALLOW_EEPROM (1)
 #endif
@@ -44,6 +348,18 @@
 #define VSERVESAFE_FAKE_MQTT (0)
 #endif
 
+// Largest MQTT message, topic included, sent or received; the client drops
+// larger ones
+#ifndef VSERVESAFE_MQTT_BUFFER_SIZE
+#define VSERVESAFE_MQTT_BUFFER_SIZE (640)
+#endif
+
+// Chunks of a versioned gateway config (GatewayConfigChunks), each up to
+// VSERVESAFE_MQTT_BUFFER_SIZE bytes; buffered in PSRAM and kept in flash
+#ifndef VSERVESAFE_CONFIG_MAX_CHUNKS
+#define VSERVESAFE_CONFIG_MAX_CHUNKS (128)
+#endif
+
 #define SSID_MAXLENGTH (32)
 #define WIFIPW_MAXLENGTH (64)
 
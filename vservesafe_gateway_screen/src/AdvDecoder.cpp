@@ -0,0 +1,339 @@
+#include "AdvDecoder.h"
+#include "MiBeacon.h"
+
+static inline uint16_t readU16LE(const uint8_t *p)
+{
+  return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static inline uint16_t readU16BE(const uint8_t *p)
+{
+  return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static inline void resetReading(AdvReading &out, uint8_t format)
+{
+  out.mac = MAC_KEY_EMPTY;
+  out.tempCenti = 0;
+  out.humidCenti = 0;
+  out.battMv = 0;
+  out.battPercent = 0;
+  out.counter = 0;
+  out.flag = 0;
+  out.fields = 0;
+  out.format = format;
+}
+
+// pvvx custom format (0x181A, 15 bytes, little endian):
+// mac[6] reversed, temp int16 0.01 C, humid uint16 0.01 %, batt mV uint16,
+// batt %, counter, flags
+struct AdvFormatPvvx
+{
+  static const uint16_t UUID = ADV_UUID_ENVIRONMENTAL_SENSING;
+  static const uint8_t MIN_LEN = 15;
+  static const uint8_t MAX_LEN = 15;
+
+  static bool decode(const uint8_t *data, size_t len, AdvReading &out)
+  {
+    resetReading(out, VSERVESAFE_ADV_PVVX);
+    out.mac = macKeyFromLE(data);
+    out.tempCenti = (int16_t)readU16LE(data + 6);
+    out.humidCenti = readU16LE(data + 8);
+    out.battMv = readU16LE(data + 10);
+    out.battPercent = data[12];
+    out.counter = data[13];
+    out.flag = data[14];
+    out.fields = ADV_READING_TEMP | ADV_READING_HUMID | ADV_READING_BATT_MV |
+                 ADV_READING_BATT_PERCENT | ADV_READING_COUNTER;
+    return true;
+  }
+};
+
+// ATC1441 format (0x181A, 13 bytes, big endian):
+// mac[6], temp int16 0.1 C, humid %, batt %, batt mV uint16, frame counter
+struct AdvFormatAtc1441
+{
+  static const uint16_t UUID = ADV_UUID_ENVIRONMENTAL_SENSING;
+  static const uint8_t MIN_LEN = 13;
+  static const uint8_t MAX_LEN = 13;
+
+  static bool decode(const uint8_t *data, size_t len, AdvReading &out)
+  {
+    resetReading(out, VSERVESAFE_ADV_ATC1441);
+    out.mac = macKeyFromBE(data);
+    out.tempCenti = (int16_t)readU16BE(data + 6) * 10;
+    out.humidCenti = data[8] * 100;
+    out.battPercent = data[9];
+    out.battMv = readU16BE(data + 10);
+    out.counter = data[12];
+    out.fields = ADV_READING_TEMP | ADV_READING_HUMID | ADV_READING_BATT_MV |
+                 ADV_READING_BATT_PERCENT | ADV_READING_COUNTER;
+    return true;
+  }
+};
+
+// BTHome v2 (0xFCD2): device info byte, then (object id, value) pairs in
+// ascending id order. Encrypted frames are not decoded.
+struct AdvFormatBTHomeV2
+{
+  static const uint16_t UUID = ADV_UUID_BTHOME;
+  static const uint8_t MIN_LEN = 1;
+  static const uint8_t MAX_LEN = 0xFF;
+
+  static const uint8_t DEVICE_INFO_ENCRYPTED = 0x01;
+  static const uint8_t DEVICE_INFO_VERSION_SHIFT = 5;
+
+  // Value size of an object id, 0 if unknown (stops decoding) or 0xFF if the
+  // value is length prefixed
+  static uint8_t objectSize(uint8_t id)
+  {
+    switch (id)
+    {
+    case 0x00: // packet id
+    case 0x01: // battery %
+    case 0x09: // count
+    case 0x0F:
+    case 0x10:
+    case 0x11:
+    case 0x2E: // humidity %
+    case 0x2F:
+    case 0x3A:
+    case 0x46:
+    case 0x57:
+    case 0x58:
+    case 0x59:
+    case 0x60:
+      return 1;
+    case 0x02: // temperature 0.01 C
+    case 0x03: // humidity 0.01 %
+    case 0x06:
+    case 0x07:
+    case 0x08:
+    case 0x0C: // voltage mV
+    case 0x0D:
+    case 0x0E:
+    case 0x12:
+    case 0x13:
+    case 0x14:
+    case 0x3C:
+    case 0x3D:
+    case 0x3F:
+    case 0x40:
+    case 0x41:
+    case 0x43:
+    case 0x44:
+    case 0x45: // temperature 0.1 C
+    case 0x47:
+    case 0x48:
+    case 0x49:
+    case 0x4A: // voltage 0.1 V
+    case 0x51:
+    case 0x52:
+    case 0x56:
+    case 0x5A:
+    case 0x5D:
+    case 0x5E:
+    case 0x5F:
+    case 0xF0:
+      return 2;
+    case 0x04:
+    case 0x05:
+    case 0x0A:
+    case 0x0B:
+    case 0x42:
+    case 0x4B:
+    case 0xF2:
+      return 3;
+    case 0x3E:
+    case 0x4C:
+    case 0x4D:
+    case 0x4E:
+    case 0x4F:
+    case 0x50:
+    case 0x55:
+    case 0x5B:
+    case 0x5C:
+    case 0xF1:
+      return 4;
+    case 0x53:
+    case 0x54:
+      return 0xFF;
+    default:
+      if (id >= 0x15 && id <= 0x2D) // binary sensors
+      {
+        return 1;
+      }
+      return 0;
+    }
+  }
+
+  static bool decode(const uint8_t *data, size_t len, AdvReading &out)
+  {
+    resetReading(out, VSERVESAFE_ADV_BTHOME_V2);
+    uint8_t deviceInfo = data[0];
+    if ((deviceInfo & DEVICE_INFO_ENCRYPTED) || (deviceInfo >> DEVICE_INFO_VERSION_SHIFT) != 2)
+    {
+      return false;
+    }
+
+    size_t pos = 1;
+    while (pos < len)
+    {
+      uint8_t id = data[pos++];
+      uint8_t size = objectSize(id);
+      if (size == 0xFF && pos < len)
+      {
+        size = data[pos++];
+      }
+      if (size == 0 || size == 0xFF || pos + size > len)
+      {
+        break;
+      }
+
+      const uint8_t *value = data + pos;
+      switch (id)
+      {
+      case 0x00:
+        out.counter = value[0];
+        out.fields |= ADV_READING_COUNTER;
+        break;
+      case 0x01:
+        out.battPercent = value[0];
+        out.fields |= ADV_READING_BATT_PERCENT;
+        break;
+      case 0x02:
+        out.tempCenti = (int16_t)readU16LE(value);
+        out.fields |= ADV_READING_TEMP;
+        break;
+      case 0x45:
+        out.tempCenti = (int16_t)readU16LE(value) * 10;
+        out.fields |= ADV_READING_TEMP;
+        break;
+      case 0x03:
+        out.humidCenti = readU16LE(value);
+        out.fields |= ADV_READING_HUMID;
+        break;
+      case 0x2E:
+        out.humidCenti = value[0] * 100;
+        out.fields |= ADV_READING_HUMID;
+        break;
+      case 0x0C:
+        out.battMv = readU16LE(value);
+        out.fields |= ADV_READING_BATT_MV;
+        break;
+      case 0x4A:
+        out.battMv = readU16LE(value) * 100;
+        out.fields |= ADV_READING_BATT_MV;
+        break;
+      }
+      pos += size;
+    }
+    return (out.fields & (ADV_READING_TEMP | ADV_READING_HUMID)) != 0;
+  }
+};
+
+// Xiaomi MiBeacon (0xFE95) with plain objects; encrypted frames need a
+// bindkey and are decrypted by MiTagScanner instead
+struct AdvFormatMiBeacon
+{
+  static const uint16_t UUID = ADV_UUID_MIBEACON;
+  static const uint8_t MIN_LEN = 5;
+  static const uint8_t MAX_LEN = MIBEACON_MAX_FRAME;
+
+  static bool decode(const uint8_t *data, size_t len, AdvReading &out)
+  {
+    resetReading(out, VSERVESAFE_ADV_MIBEACON);
+    MiBeaconFrame frame;
+    if (!parseMiBeacon(data, len, frame) || frame.encrypted || !frame.objects)
+    {
+      return false;
+    }
+    if (frame.macLE)
+    {
+      out.mac = macKeyFromLE(frame.macLE);
+    }
+    out.counter = frame.counter;
+    out.fields = ADV_READING_COUNTER;
+    return decodeMiBeaconObjects(frame.objects, frame.objectsLen, out);
+  }
+};
+
+#define ADV_DECODER_ENTRY(FORMAT) {FORMAT::UUID, FORMAT::MIN_LEN, FORMAT::MAX_LEN, FORMAT::decode}
+
+// Each entry calls its format's decode directly, so dispatch is one scan of
+// this short table
+static const AdvDecoderEntry ADV_DECODERS[] = {
+    ADV_DECODER_ENTRY(AdvFormatPvvx),
+    ADV_DECODER_ENTRY(AdvFormatAtc1441),
+    ADV_DECODER_ENTRY(AdvFormatBTHomeV2),
+    ADV_DECODER_ENTRY(AdvFormatMiBeacon),
+};
+
+static const size_t ADV_DECODERS_COUNT = sizeof(ADV_DECODERS) / sizeof(ADV_DECODERS[0]);
+
+const AdvDecoderEntry *findAdvDecoder(uint16_t uuid16, size_t len)
+{
+  for (size_t i = 0; i < ADV_DECODERS_COUNT; i++)
+  {
+    const AdvDecoderEntry &entry = ADV_DECODERS[i];
+    if (entry.uuid16 == uuid16 && len >= entry.minLen && len <= entry.maxLen)
+    {
+      return &entry;
+    }
+  }
+  return NULL;
+}
+
+bool decodeServiceData(uint16_t uuid16, const uint8_t *data, size_t len, AdvReading &out)
+{
+  const AdvDecoderEntry *entry = findAdvDecoder(uuid16, len);
+  return entry && entry->decode(data, len, out);
+}
+
+bool decodeAdvertPayload(const uint8_t *payload, size_t len, AdvReading &out)
+{
+  size_t pos = 0;
+  while (pos + 1 < len)
+  {
+    uint8_t fieldLen = payload[pos];
+    if (fieldLen == 0 || pos + 1 + fieldLen > len)
+    {
+      break;
+    }
+
+    // fieldLen covers the type byte; 16-bit service data starts with the UUID
+    if (payload[pos + 1] == ADV_AD_TYPE_SERVICE_DATA16 && fieldLen >= 3)
+    {
+      const uint8_t *field = payload + pos + 2;
+      if (decodeServiceData(readU16LE(field), field + 2, fieldLen - 3, out))
+      {
+        return true;
+      }
+    }
+    pos += 1 + fieldLen;
+  }
+  return false;
+}
+
+bool findServiceData16(const uint8_t *payload, size_t len, uint16_t uuid16, const uint8_t *&data, size_t &dataLen)
+{
+  size_t pos = 0;
+  while (pos + 1 < len)
+  {
+    uint8_t fieldLen = payload[pos];
+    if (fieldLen == 0 || pos + 1 + fieldLen > len)
+    {
+      break;
+    }
+
+    const uint8_t *field = payload + pos + 2;
+    if (payload[pos + 1] == ADV_AD_TYPE_SERVICE_DATA16 && fieldLen >= 3 && readU16LE(field) == uuid16)
+    {
+      data = field + 2;
+      dataLen = fieldLen - 3;
+      return true;
+    }
+    pos += 1 + fieldLen;
+  }
+  return false;
+}
@@ -0,0 +1,64 @@
+#ifndef __VSERVESAFE_ADV_DECODER__
+#define __VSERVESAFE_ADV_DECODER__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "MacIndex.h"
+
+#define ADV_UUID_ENVIRONMENTAL_SENSING (0x181A)
+#define ADV_UUID_BTHOME (0xFCD2)
+
+#define ADV_AD_TYPE_SERVICE_DATA16 (0x16)
+
+typedef enum
+{
+    VSERVESAFE_ADV_PVVX,
+    VSERVESAFE_ADV_ATC1441,
+    VSERVESAFE_ADV_BTHOME_V2,
+    VSERVESAFE_ADV_MIBEACON,
+} coldsenses_adv_format;
+
+#define ADV_READING_TEMP (1 << 0)
+#define ADV_READING_HUMID (1 << 1)
+#define ADV_READING_BATT_MV (1 << 2)
+#define ADV_READING_BATT_PERCENT (1 << 3)
+#define ADV_READING_COUNTER (1 << 4)
+
+// Common reading filled by every decoder. Values are fixed point and only the
+// fields flagged in `fields` are set; `mac` is MAC_KEY_EMPTY when the frame
+// does not carry one (use the advertiser address instead).
+typedef struct
+{
+    mac_key_t mac;
+    int16_t tempCenti;
+    uint16_t humidCenti;
+    uint16_t battMv;
+    uint8_t battPercent;
+    uint8_t counter;
+    uint8_t flag;
+    uint8_t fields;
+    uint8_t format;
+} AdvReading;
+
+typedef bool (*adv_decode_fn)(const uint8_t *data, size_t len, AdvReading &out);
+
+typedef struct
+{
+    uint16_t uuid16;
+    uint8_t minLen;
+    uint8_t maxLen;
+    adv_decode_fn decode;
+} AdvDecoderEntry;
+
+// Decoder for a 16-bit service UUID and service data length (UUID excluded),
+// or NULL if no registered format matches
+const AdvDecoderEntry *findAdvDecoder(uint16_t uuid16, size_t len);
+bool decodeServiceData(uint16_t uuid16, const uint8_t *data, size_t len, AdvReading &out);
+// Walk the AD structures of a raw advert and decode the first service data
+// a registered format accepts. Decoders read the payload in place.
+bool decodeAdvertPayload(const uint8_t *payload, size_t len, AdvReading &out);
+// Find the 16-bit UUID service data for uuid16 in a raw advert; data points
+// into the payload, after the UUID
+bool findServiceData16(const uint8_t *payload, size_t len, uint16_t uuid16, const uint8_t *&data, size_t &dataLen);
+
+#endif
@@ -1,291 +1,1711 @@
 #include "BLE.h"
 
-std::string prettyMacAddress(std::string rawMacAddress)
+#include <ctype.h>
+#include <new>
+#include <string.h>
+#include "hal/HalMemory.h"
+#include "hal/HalStorage.h"
+
+#define TAG_ALLOWLIST_PATH ("/allowlist.bin")
+#define TAG_NAMES_PATH ("/names.bin")
+
+// Copied into the decrypt queue so the worker never touches NimBLE objects
+typedef struct
+{
+  uint8_t bindKey[MIBEACON_BINDKEY_SIZE];
+  uint8_t frame[MIBEACON_MAX_FRAME];
+  uint8_t frameLen;
+  uint8_t macLE[6];
+  uint8_t counter;
+  int8_t rssi;
+  uint32_t ts;
+  char name[TAG_NAME_LENGTH + 1];
+} MiBeaconJob;
+
+std::string prettyMacAddress(mac_key_t mac)
+{
+  char buffer[18];
+  int len = 0;
+  for (int i = 0; i < 6; i++)
+  {
+    uint8_t b = mac >> (8 * (5 - i));
+    len += snprintf(buffer + len, sizeof(buffer) - len, i > 0 ? ":%02x" : "%02x", b);
+  }
+  return buffer;
+}
+
+// Read a file saved by savePersisted into target (tag allowlist, name cache)
+template <typename T>
+static bool loadPersisted(const char *path, T &target)
+{
+  size_t size = target.serializedSize();
+  uint8_t *buffer = (uint8_t *)halAllocLarge(size);
+  bool isLoaded = buffer && halStorageBegin() && target.deserialize(buffer, halStorageRead(path, buffer, size));
+  halFree(buffer);
+  return isLoaded;
+}
+
+// Copy under the lock, write to flash without it
+template <typename T>
+static void savePersisted(const char *path, T &source, SemaphoreHandle_t lock, bool &dirty)
+{
+  size_t size = source.serializedSize();
+  uint8_t *buffer = halStorageBegin() ? (uint8_t *)halAllocLarge(size) : NULL;
+  if (!buffer)
+  {
+    return;
+  }
+  xSemaphoreTake(lock, portMAX_DELAY);
+  size_t len = source.serialize(buffer);
+  dirty = false;
+  xSemaphoreGive(lock);
+
+  if (!halStorageWrite(path, buffer, len))
+  {
+    Serial.print("Save error: ");
+    Serial.println(path);
+  }
+  halFree(buffer);
+}
+
+NimBLEUUID MiTagScanner::TARGET_UUID = NimBLEUUID("181a");
+
+void MiTagScanner::init(int tagCapacity)
+{
+  if (!this->_tagStore.begin(tagCapacity))
+  {
+    Serial.println("Tag store init error");
+  }
+  this->_tagStore.setProtectCallback(_isNotifyProtected, this);
+  this->_tagStore.setPresenceCallback(_onTagPresence, this);
+
+  if (!this->_allowList.begin())
+  {
+    Serial.println("Tag allowlist init error");
+  }
+  if (loadPersisted(TAG_ALLOWLIST_PATH, this->_allowList))
+  {
+    this->_allowListActive = this->_allowList.count() > 0;
+    Serial.printf("Tag allowlist loaded: %u tags\n", this->_allowList.count());
+  }
+  if (!this->_history.begin())
+  {
+    Serial.println("Tag history init error");
+  }
+  this->_notifyDataArr = (MiTagNotifyData *)halAllocLarge(MAX_NOTIFY_REMEMBER * sizeof(MiTagNotifyData));
+  this->_notifyOffline = (bool *)halAllocLarge(MAX_NOTIFY_REMEMBER * sizeof(bool));
+  void *notifyIndex = halAllocLarge(sizeof(MacIndex<MAX_NOTIFY_REMEMBER>));
+  this->_notifyIndex = notifyIndex ? new (notifyIndex) MacIndex<MAX_NOTIFY_REMEMBER>() : NULL;
+  if (!this->_notifyDataArr || !this->_notifyOffline || !this->_notifyIndex)
+  {
+    // All or none, so the index alone tells whether limits can be kept
+    halFree(this->_notifyDataArr);
+    halFree(this->_notifyOffline);
+    halFree(notifyIndex);
+    this->_notifyDataArr = NULL;
+    this->_notifyOffline = NULL;
+    this->_notifyIndex = NULL;
+    Serial.println("Tag thresholds init error");
+  }
+  if (!this->_names.begin())
+  {
+    Serial.println("Tag name cache init error");
+  }
+  if (loadPersisted(TAG_NAMES_PATH, this->_names))
+  {
+    Serial.printf("Tag names loaded: %d\n", this->_names.count());
+  }
+
+  if (!this->_admission.begin())
+  {
+    Serial.println("Tag admission init error");
+  }
+  // Before the scan starts, so the first adverts see the loaded allowlist
+  this->_publishAdmission();
+
+  this->_storeLock = xSemaphoreCreateMutex();
+  this->_decryptQueue = xQueueCreate(MIBEACON_DECRYPT_QUEUE_LENGTH, sizeof(MiBeaconJob));
+  xTaskCreatePinnedToCore(_ingestLoop, "tag_ingest", TAG_INGEST_TASK_STACK, this, TAG_INGEST_TASK_PRIORITY,
+                          &this->_ingestTask, TAG_INGEST_TASK_CORE);
+  xTaskCreatePinnedToCore(_decryptTask, "mibeacon_decrypt", MIBEACON_DECRYPT_TASK_STACK, this,
+                          MIBEACON_DECRYPT_TASK_PRIORITY, NULL, MIBEACON_DECRYPT_TASK_CORE);
+
+#ifdef CONFIG_IDF_TARGET_ESP32
+  // Must be set before the controller starts
+  NimBLEDevice::setScanFilterMode(BLE_SCAN_DUPL_TYPE_DATA_DEVICE);
+#endif
+  BLEDevice::init("");
+  this->_pBLEScan = BLEDevice::getScan();
+  // Decode each advert as it arrives; NimBLE keeps no result list
+  this->_pBLEScan->setAdvertisedDeviceCallbacks(this, true);
+  this->_pBLEScan->setMaxResults(0);
+  this->_pBLEScan->setActiveScan(VSERVESAFE_ACTIVE_SCAN);
+  this->_scanScheduler.begin(VSERVESAFE_SCAN_POLICY, SCAN_WINDOW_MAX);
+  this->_applyScanParams();
+  this->_pBLEScan->start(0, nullptr, false);
+}
+
+void MiTagScanner::clearTagsResults()
+{
+  xSemaphoreTake(this->_storeLock, portMAX_DELAY);
+  this->_clearMiTagData();
+  xSemaphoreGive(this->_storeLock);
+}
+
+void MiTagScanner::onResult(NimBLEAdvertisedDevice *advertisedDevice)
+{
+  this->_advertCount += 1;
+  this->_advertTotal += 1;
+
+  if (!this->_acceptAdvertiser(macKeyFromLE(advertisedDevice->getAddress().getNative())))
+  {
+    return;
+  }
+
+  const uint8_t *payload = advertisedDevice->getPayload();
+  size_t payloadLength = advertisedDevice->getPayloadLength();
+#if VSERVESAFE_DEBUG_BLE
+  _debugBLEData(payload, payloadLength);
+#endif
+
+  AdvReading reading;
+  if (!decodeAdvertPayload(payload, payloadLength, reading))
+  {
+    const uint8_t *miBeacon;
+    size_t miBeaconLength;
+    if (findServiceData16(payload, payloadLength, ADV_UUID_MIBEACON, miBeacon, miBeaconLength))
+    {
+      this->_queueMiBeacon(advertisedDevice, miBeacon, miBeaconLength);
+    }
+    return;
+  }
+  if (reading.mac == MAC_KEY_EMPTY)
+  {
+    reading.mac = macKeyFromLE(advertisedDevice->getAddress().getNative());
+  }
+
+  TagIngestEvent event;
+  event.reading = reading;
+  event.ts = millis();
+  event.rssi = advertisedDevice->getRSSI();
+  event.isCopy = false;
+  event.name[0] = '\0';
+  // Only scan responses carry a name, so most adverts skip the copy
+  if (advertisedDevice->haveName())
+  {
+    strncpy(event.name, advertisedDevice->getName().c_str(), TAG_NAME_LENGTH);
+    event.name[TAG_NAME_LENGTH] = '\0';
+  }
+  // Never block the host task; a full ring drops the advert
+  if (this->_advertRing.push(event))
+  {
+    xTaskNotifyGive(this->_ingestTask);
+  }
+}
+
+// Host task. Checks the published admission copy, never the store lock.
+bool MiTagScanner::_acceptAdvertiser(mac_key_t address)
+{
+  const TagAdmission *admission = this->_admission.acquire();
+  bool isAccepted = true;
+  if (admission->allowListActive && !admission->allowList.mayContain(address))
+  {
+    this->_allowListRejected += 1;
+    isAccepted = false;
+  }
+  else if (admission->hostFilter && admission->hostIndex->find(address) == -1)
+  {
+    this->_hostFiltered += 1;
+    isAccepted = false;
+  }
+  this->_admission.release(admission);
+  return isAccepted;
+}
+
+void MiTagScanner::_queueMiBeacon(NimBLEAdvertisedDevice *advertisedDevice, const uint8_t *data, size_t len)
+{
+  MiBeaconFrame frame;
+  if (len > MIBEACON_MAX_FRAME || !parseMiBeacon(data, len, frame) || !frame.encrypted)
+  {
+    return;
+  }
+
+  MiBeaconJob job;
+  memcpy(job.macLE, frame.macLE ? frame.macLE : advertisedDevice->getAddress().getNative(), sizeof(job.macLE));
+  mac_key_t mac = macKeyFromLE(job.macLE);
+  job.counter = frame.counter;
+  job.rssi = advertisedDevice->getRSSI();
+  job.ts = millis();
+
+  const TagAdmission *admission = this->_admission.acquire();
+  int keyIndex = admission->bindKeys ? admission->bindKeys->find(mac) : -1;
+  if (keyIndex != -1)
+  {
+    memcpy(job.bindKey, admission->bindKeys->keyAt(keyIndex), sizeof(job.bindKey));
+  }
+  this->_admission.release(admission);
+  if (keyIndex == -1)
+  {
+    this->_miBeaconNoKey += 1;
+    return;
+  }
+
+  memcpy(job.frame, data, len);
+  job.frameLen = len;
+  job.name[0] = '\0';
+  if (advertisedDevice->haveName())
+  {
+    strncpy(job.name, advertisedDevice->getName().c_str(), TAG_NAME_LENGTH);
+    job.name[TAG_NAME_LENGTH] = '\0';
+  }
+  // Never block the host task; a full queue drops the frame
+  if (xQueueSend(this->_decryptQueue, &job, 0) == pdTRUE)
+  {
+    this->_miBeaconQueued += 1;
+  }
+  else
+  {
+    this->_miBeaconDropped += 1;
+  }
+}
+
+void MiTagScanner::_decryptTask(void *arg)
+{
+  MiTagScanner *scanner = (MiTagScanner *)arg;
+  MiBeaconJob job;
+  while (true)
+  {
+    if (xQueueReceive(scanner->_decryptQueue, &job, portMAX_DELAY) != pdTRUE)
+    {
+      continue;
+    }
+
+    // Copies of a frame that was already decrypted skip the AES; they only
+    // refresh last-seen, which is done here rather than through the ring
+    xSemaphoreTake(scanner->_storeLock, portMAX_DELAY);
+    bool isCopy = scanner->_refreshDuplicate(macKeyFromLE(job.macLE), job.counter, job.rssi, job.ts);
+    if (isCopy)
+    {
+      scanner->_miBeaconStats.copies += 1;
+    }
+    xSemaphoreGive(scanner->_storeLock);
+    if (isCopy)
+    {
+      continue;
+    }
+
+    TagIngestEvent event;
+    bool isDecrypted = decryptMiBeacon(job.bindKey, job.frame, job.frameLen, job.macLE, event.reading);
+    if (isDecrypted)
+    {
+      event.ts = job.ts;
+      event.rssi = job.rssi;
+      // Several copies can be queued before the first one is stored; the
+      // ingest task drops the later ones
+      event.isCopy = false;
+      memcpy(event.name, job.name, sizeof(event.name));
+      // Wait for the ingest task rather than drop a frame already paid for;
+      // meanwhile the host task drops new frames at the full queue
+      while (scanner->_decryptRing.size() >= scanner->_decryptRing.capacity())
+      {
+        xTaskNotifyGive(scanner->_ingestTask);
+        vTaskDelay(1);
+      }
+      scanner->_decryptRing.push(event);
+      xTaskNotifyGive(scanner->_ingestTask);
+    }
+
+    xSemaphoreTake(scanner->_storeLock, portMAX_DELAY);
+    if (isDecrypted)
+    {
+      scanner->_miBeaconStats.decrypted += 1;
+    }
+    else
+    {
+      scanner->_miBeaconStats.authFailed += 1;
+    }
+    xSemaphoreGive(scanner->_storeLock);
+  }
+}
+
+// Sole writer of tag samples and of the snapshots: woken by the producers,
+// stores what they decoded
+void MiTagScanner::_ingestLoop(void *arg)
+{
+  MiTagScanner *scanner = (MiTagScanner *)arg;
+  TickType_t publishTick = xTaskGetTickCount();
+  while (true)
+  {
+    // Also wakes to publish changes made by config
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(TAG_SNAPSHOT_INTERVAL));
+    while (scanner->_drainIngest())
+    {
+    }
+    scanner->_applyNotifyUpdates();
+    if (scanner->_admissionDirty)
+    {
+      xSemaphoreTake(scanner->_storeLock, portMAX_DELAY);
+      scanner->_publishAdmission();
+      xSemaphoreGive(scanner->_storeLock);
+    }
+
+    if (xTaskGetTickCount() - publishTick >= pdMS_TO_TICKS(TAG_SNAPSHOT_INTERVAL))
+    {
+      publishTick = xTaskGetTickCount();
+      xSemaphoreTake(scanner->_storeLock, portMAX_DELAY);
+      scanner->_tagStore.expirePresence(millis());
+      scanner->_sweepRules(millis());
+      scanner->_publishSnapshot();
+      xSemaphoreGive(scanner->_storeLock);
+    }
+  }
+}
+
+// Stores at most one ring's worth of events per lock hold so readers are not
+// starved during a burst. Returns true if more are waiting.
+bool MiTagScanner::_drainIngest()
+{
+  TagIngestEvent event;
+  int n = 0;
+  xSemaphoreTake(this->_storeLock, portMAX_DELAY);
+  while (n < TAG_INGEST_QUEUE_LENGTH && (this->_advertRing.pop(event) || this->_decryptRing.pop(event)))
+  {
+    this->_ingest(event);
+    n += 1;
+  }
+  xSemaphoreGive(this->_storeLock);
+  return n == TAG_INGEST_QUEUE_LENGTH;
+}
+
+// Store lock held
+void MiTagScanner::_ingest(TagIngestEvent &event)
+{
+  AdvReading &reading = event.reading;
+  // Tags resend each sample several times; copies only refresh last-seen
+  bool isDuplicate = (event.isCopy || (reading.fields & ADV_READING_COUNTER)) &&
+                     this->_refreshDuplicate(reading.mac, reading.counter, event.rssi, event.ts);
+  if (!isDuplicate && !event.isCopy)
+  {
+    this->_storeReading(reading, event.name, event.rssi, event.ts);
+  }
+}
+
+void MiTagScanner::scan()
+{
+  uint32_t nAdvert = this->_advertCount.exchange(0);
+
+  Serial.print("Adverts received: ");
+  Serial.println(nAdvert);
+  Serial.print("Tags found: ");
+  Serial.println(this->getTagsCount());
+  MiTagEvictionStats evictionStats = this->getEvictionStats();
+  if (evictionStats.evictions > 0 || evictionStats.rejections > 0)
+  {
+    Serial.printf("Evictions: %u Readmissions: %u Rejections: %u\n", evictionStats.evictions,
+                  evictionStats.readmissions, evictionStats.rejections);
+  }
+  MiTagIngestStats ingestStats = this->getIngestStats();
+  Serial.printf("New samples: %u Duplicates: %u Queue dropped: %u\n", ingestStats.newSamples,
+                ingestStats.duplicates, ingestStats.queueDropped);
+  if (this->_scanFilterDirty)
+  {
+    this->_applyScanFilter();
+  }
+  uint32_t now = millis();
+  xSemaphoreTake(this->_storeLock, portMAX_DELAY);
+  bool isAllowListDue = this->_allowListDirty && now - this->_allowListChangeTs >= TAG_ALLOWLIST_SAVE_DELAY;
+  bool isNamesDue = this->_namesDirty && now - this->_namesChangeTs >= TAG_ALLOWLIST_SAVE_DELAY;
+  xSemaphoreGive(this->_storeLock);
+  if (isAllowListDue)
+  {
+    savePersisted(TAG_ALLOWLIST_PATH, this->_allowList, this->_storeLock, this->_allowListDirty);
+  }
+  if (isNamesDue)
+  {
+    savePersisted(TAG_NAMES_PATH, this->_names, this->_storeLock, this->_namesDirty);
+  }
+  this->_scheduleNameWindow();
+  this->_applyScanPolicy();
+  if (this->_scanMode == VSERVESAFE_SCANMODE_SELECTED_SCAN)
+  {
+    Serial.printf("Scan filter: %s, host filtered: %u\n", this->_controllerFilter ? "controller" : "host",
+                  this->getHostFilteredCount());
+  }
+  this->_scheduleScan();
+  Serial.printf("Scan window: %u/%u ms\n", this->_scanScheduler.getWindowMs(), this->_scanScheduler.getIntervalMs());
+  Serial.println("Scan done!");
+
+  // Restart if the host stopped scanning (e.g. after a controller reset)
+  if (!this->_pBLEScan->isScanning())
+  {
+    this->_pBLEScan->start(0, nullptr, false);
+  }
+}
+
+// Feed the scheduler what was heard since the previous scan() and restart the
+// scan if the window changed
+void MiTagScanner::_scheduleScan()
+{
+  ScanSchedulerInput input = {};
+  uint32_t now = millis();
+
+  xSemaphoreTake(this->_storeLock, portMAX_DELAY);
+  input.newSamples = this->_ingestStats.newSamples - this->_scheduledIngest.newSamples;
+  input.duplicates = this->_ingestStats.duplicates - this->_scheduledIngest.duplicates;
+  this->_scheduledIngest = this->_ingestStats;
+  int tagsCount = this->_tagStore.count();
+  for (int i = 0; i < tagsCount; i++)
+  {
+    MiTagData *tagData = this->_tagStore.at(i);
+    if (!tagData->online)
+    {
+      continue;
+    }
+    input.knownTags += 1;
+    TagReceptionStats &reception = this->_tagStore.stateAt(i)->reception;
+    if (reception.intervalMs > 0 && now - reception.lastSampleTs > 2 * reception.intervalMs)
+    {
+      input.overdueTags += 1;
+    }
+  }
+  xSemaphoreGive(this->_storeLock);
+  input.uplinkBacklog = this->_uplinkBacklog;
+
+  if (this->_scanScheduler.update(input))
+  {
+    this->_pBLEScan->stop();
+    this->_applyScanParams();
+    this->_pBLEScan->start(0, nullptr, false);
+  }
+}
+
+void MiTagScanner::_applyScanParams()
+{
+  this->_pBLEScan->setInterval(this->_scanScheduler.getIntervalMs());
+  this->_pBLEScan->setWindow(this->_scanScheduler.getWindowMs());
+}
+
+// Program the controller for the scan mode. The accept list can only be
+// changed while the scan is stopped.
+void MiTagScanner::_applyScanFilter()
+{
+  this->_pBLEScan->stop();
+  while (NimBLEDevice::getWhiteListCount() > 0)
+  {
+    NimBLEDevice::whiteListRemove(NimBLEDevice::getWhiteListAddress(0));
+  }
+
+  xSemaphoreTake(this->_storeLock, portMAX_DELAY);
+  this->_scanFilterDirty = false;
+  bool isSelected = this->_scanMode == VSERVESAFE_SCANMODE_SELECTED_SCAN;
+  bool useController = isSelected && this->_notifyCount > 0 && this->_notifyCount <= BLE_ACCEPT_LIST_SIZE;
+  for (int i = 0; useController && i < this->_notifyCount; i++)
+  {
+    uint8_t address[6];
+    macKeyToLE(this->_notifyDataArr[i].mac, address);
+    useController = NimBLEDevice::whiteListAdd(NimBLEAddress(address));
+  }
+  if (!useController)
+  {
+    // The controller may hold fewer entries than expected
+    while (NimBLEDevice::getWhiteListCount() > 0)
+    {
+      NimBLEDevice::whiteListRemove(NimBLEDevice::getWhiteListAddress(0));
+    }
+  }
+  this->_controllerFilter = useController;
+  this->_hostFilter = isSelected && !useController;
+  this->_invalidateAdmission();
+  xSemaphoreGive(this->_storeLock);
+
+  this->_pBLEScan->setFilterPolicy(useController ? BLE_HCI_SCAN_FILT_USE_WL : BLE_HCI_SCAN_FILT_NO_WL);
+  // Copies of a sample are only needed for RSSI outside the selected mode
+  this->_pBLEScan->setDuplicateFilter(isSelected);
+  this->_pBLEScan->start(0, nullptr, false);
+}
+
+// While active tags have no name, switch to an active scan for
+// NAME_WINDOW_DURATION at most every NAME_WINDOW_INTERVAL so their scan
+// responses fill the name cache
+void MiTagScanner::_scheduleNameWindow()
+{
+  if (VSERVESAFE_ACTIVE_SCAN)
+  {
+    return;
+  }
+
+  uint32_t now = millis();
+  if (this->_nameWindowOpen)
+  {
+    if (now - this->_nameWindowTs >= NAME_WINDOW_DURATION)
+    {
+      this->_nameWindowOpen = false;
+      this->_pBLEScan->stop();
+      this->_pBLEScan->setActiveScan(false);
+      this->_pBLEScan->start(0, nullptr, false);
+    }
+    return;
+  }
+
+  int unnamedTags = this->getUnnamedTagCount();
+  if (unnamedTags > 0 && (this->_nameWindows == 0 || now - this->_nameWindowTs >= NAME_WINDOW_INTERVAL))
+  {
+    Serial.printf("Name window for %d tags\n", unnamedTags);
+    this->_nameWindowOpen = true;
+    this->_nameWindowTs = now;
+    this->_nameWindows += 1;
+    this->_pBLEScan->stop();
+    this->_pBLEScan->setActiveScan(true);
+    this->_pBLEScan->start(0, nullptr, false);
+  }
+}
+
+int MiTagScanner::getTagsCount()
+{
+  xSemaphoreTake(this->_storeLock, portMAX_DELAY);
+  int tagsCount = this->_tagStore.count();
+  xSemaphoreGive(this->_storeLock);
+  return tagsCount;
+}
+
+int MiTagScanner::getActiveTagCount()
+{
+  const TagSnapshot *snapshot = this->acquireSnapshot();
+  int onlines = snapshot->onlineCount;
+  this->releaseSnapshot(snapshot);
+  return onlines;
+}
+
+const TagSnapshot *MiTagScanner::acquireSnapshot()
+{
+  return this->_snapshots.acquire();
+}
+
+void MiTagScanner::releaseSnapshot(const TagSnapshot *snapshot)
+{
+  this->_snapshots.release(snapshot);
+}
+
+bool MiTagScanner::isSnapshotCurrent()
+{
+  xSemaphoreTake(this->_storeLock, portMAX_DELAY);
+  bool isCurrent = this->_snapshotRevision == this->_revision && !this->_snapshotStale;
+  xSemaphoreGive(this->_storeLock);
+  return isCurrent;
+}
+
+// Copy the tag table into a free snapshot buffer and publish it. Store lock
+// held, ingest task only.
+void MiTagScanner::_publishSnapshot()
+{
+  if (this->_snapshotRevision == this->_revision && !this->_snapshotStale)
+  {
+    return;
+  }
+
+  int tagsCount = this->_tagStore.count();
+  // Readers still hold the other buffers; try again next time
+  TagSnapshot *snapshot = this->_snapshots.beginWrite(tagsCount);
+  if (!snapshot)
+  {
+    return;
+  }
+  for (int i = 0; i < tagsCount; i++)
+  {
+    snapshot->tags[i] = *this->_tagStore.at(i);
+  }
+  snapshot->count = tagsCount;
+  snapshot->onlineCount = this->_tagStore.onlineCount();
+  snapshot->revision = this->_revision;
+  this->_snapshots.publish(snapshot);
+  this->_snapshotRevision = this->_revision;
+  this->_snapshotStale = false;
+}
+
+bool MiTagScanner::isAdmissionCurrent()
+{
+  return !this->_admissionDirty;
+}
+
+// Store lock held; wakes the ingest task to publish the change
+void MiTagScanner::_invalidateAdmission()
+{
+  this->_admissionDirty = true;
+  if (this->_ingestTask)
+  {
+    xTaskNotifyGive(this->_ingestTask);
+  }
+}
+
+// Copy what the host task checks into a free admission buffer and publish it.
+// Store lock held, ingest task only (or init before the scan starts).
+void MiTagScanner::_publishAdmission()
+{
+  if (!this->_admissionDirty)
+  {
+    return;
+  }
+  // Readers still hold the other buffers; try again next time
+  TagAdmission *admission = this->_admission.beginWrite();
+  if (!admission)
+  {
+    return;
+  }
+  admission->allowListActive = this->_allowListActive;
+  admission->allowList.copyFrom(this->_allowList);
+  admission->hostFilter = this->_hostFilter;
+  if (this->_hostFilter && this->_notifyIndex)
+  {
+    *admission->hostIndex = *this->_notifyIndex;
+  }
+  *admission->bindKeys = this->_bindKeys;
+  this->_admission.publish(admission);
+  this->_admissionDirty = false;
+}
+
+bool MiTagScanner::isTagActive(MiTagData *tagData)
+{
+  return tagData && tagData->online;
+}
+
+bool MiTagScanner::pollAlarmEvent(TagAlarmEvent &event)
+{
+  return this->_alarmEvents.pop(event);
+}
+
+bool MiTagScanner::peekAlarmEvent(TagAlarmEvent &event)
+{
+  return this->_alarmEvents.peek(event);
+}
+
+uint32_t MiTagScanner::getAlarmEventsDropped()
+{
+  return this->_alarmEvents.dropped();
+}
+
+MiTagAlarmCounts MiTagScanner::getAlarmCounts()
+{
+  xSemaphoreTake(this->_storeLock, portMAX_DELAY);
+  MiTagAlarmCounts counts = this->_alarmCounts;
+  xSemaphoreGive(this->_storeLock);
+  return counts;
+}
+
+bool MiTagScanner::pollPresenceEvent(TagPresenceEvent &event)
+{
+  return this->_presenceEvents.pop(event);
+}
+
+bool MiTagScanner::peekPresenceEvent(TagPresenceEvent &event)
+{
+  return this->_presenceEvents.peek(event);
+}
+
+uint32_t MiTagScanner::getPresenceEventsDropped()
+{
+  return this->_presenceEvents.dropped();
+}
+
+bool MiTagScanner::isMiTagDataValid(std::string &rawData)
+{
+  return findAdvDecoder(ADV_UUID_ENVIRONMENTAL_SENSING, rawData.length()) != NULL;
+}
+
+// True if the tag already holds this sample. Store lock held.
+bool MiTagScanner::_isStoredSample(mac_key_t mac, uint8_t counter, uint32_t ts)
+{
+  int index = this->_tagStore.find(mac);
+  if (index == -1)
+  {
+    return false;
+  }
+
+  MiTagData *data = this->_tagStore.at(index);
+  // A tag silent for longer than the window may repeat a counter for a new
+  // sample. Events from the two rings can arrive slightly out of order, so ts
+  // may be older than the stored one.
+  return data->counter == counter && data->sampleSeq != 0 && (int32_t)(ts - data->ts) <= TAG_DUPLICATE_WINDOW;
+}
+
+// Store lock held
+bool MiTagScanner::_refreshDuplicate(mac_key_t mac, uint8_t counter, int rssi, uint32_t ts)
+{
+  if (!this->_isStoredSample(mac, counter, ts))
+  {
+    return false;
+  }
+
+  int index = this->_tagStore.find(mac);
+  MiTagData *data = this->_tagStore.at(index);
+  // A copy that arrives after a newer event leaves last seen and the signal
+  // window alone, which would otherwise restart from the older ts
+  if ((int32_t)(ts - data->ts) > 0)
+  {
+    data->ts = ts;
+    data->rssi = rssi;
+    trackTagSignal(data->signal, rssi, ts);
+  }
+  this->_tagStore.touch(index);
+  this->_ingestStats.duplicates += 1;
+  return true;
+}
+
+// Degrees per minute from the stored temperature to a new one, each sample
+// moving the rate a quarter of the way so one noisy reading does not swing it
+static void trackTagRate(MiTagData &data, int16_t tempCenti, uint32_t ts)
+{
+  uint32_t elapsed = ts - data.tempTs;
+  if (data.tempCenti == TAG_TEMP_NONE || elapsed < 1000)
+  {
+    return;
+  }
+  int64_t rate = (int64_t)(tempCenti - data.tempCenti) * 60000 / elapsed;
+  if (data.rateCenti != TAG_RATE_NONE)
+  {
+    rate = (3 * data.rateCenti + rate) / 4;
+  }
+  data.rateCenti = rate > INT16_MAX ? INT16_MAX : rate < -INT16_MAX ? -INT16_MAX : (int16_t)rate;
+}
+
+// Fields the reading does not carry keep their stored value (MiBeacon sends
+// temperature, humidity and battery in separate frames). Store lock held.
+void MiTagScanner::_storeReading(AdvReading &reading, const char *name, int rssi, uint32_t ts)
+{
+  MiTagData data;
+  int index = this->_tagStore.find(reading.mac);
+  if (index != -1)
+  {
+    data = *this->_tagStore.at(index);
+    trackTagSignal(data.signal, rssi, ts);
+  }
+  else
+  {
+    data.tempCenti = TAG_TEMP_NONE;
+    data.tempTs = 0;
+    data.rateCenti = TAG_RATE_NONE;
+    data.ruleActive = 0;
+    data.humidCenti = TAG_HUMID_NONE;
+    data.battMv = 0;
+    data.battPercent = 0;
+    data.counter = 0;
+    data.flag = 0;
+    data.sampleSeq = 0;
+    data.publishedSeq = 0;
+    data.historySlot = -1;
+    resetTagSignal(data.signal, rssi, ts);
+  }
+  uint8_t lastCounter = data.counter;
+
+  data.mac = reading.mac;
+  data.ts = ts;
+  data.rssi = rssi;
+  // Also picks up a name learned before or after the tag was stored
+  data.nameSlot = this->_names.findSlot(reading.mac);
+  // Being heard resets the offline time
+  tag_rule_inputs_t changed = 1 << VSERVESAFE_RULE_VAR_OFFLINE;
+  if (reading.fields & ADV_READING_TEMP)
+  {
+    trackTagRate(data, reading.tempCenti, ts);
+    data.tempCenti = reading.tempCenti;
+    data.tempTs = ts;
+    changed |= 1 << VSERVESAFE_RULE_VAR_TEMP | 1 << VSERVESAFE_RULE_VAR_RATE;
+  }
+  if (reading.fields & ADV_READING_HUMID)
+  {
+    data.humidCenti = reading.humidCenti;
+    changed |= 1 << VSERVESAFE_RULE_VAR_HUMID;
+  }
+  if (reading.fields & ADV_READING_BATT_MV)
+  {
+    data.battMv = reading.battMv;
+    changed |= 1 << VSERVESAFE_RULE_VAR_BATT;
+  }
+  if (reading.fields & ADV_READING_BATT_PERCENT)
+  {
+    data.battPercent = reading.battPercent;
+    changed |= 1 << VSERVESAFE_RULE_VAR_BATT_PERCENT;
+  }
+  if (reading.fields & ADV_READING_COUNTER)
+  {
+    data.counter = reading.counter;
+  }
+  data.flag = reading.flag;
+  data.sampleSeq += 1;
+
+  int slot = this->_tagStore.upsert(data);
+  if (slot == -1)
+  {
+    // Full and nothing may be evicted (counted as a rejection): the sample
+    // leaves no trace
+    return;
+  }
+  MiTagData &stored = *this->_tagStore.at(slot);
+  MiTagState &state = *this->_tagStore.stateAt(slot);
+  if (index == -1)
+  {
+    memset(&state.reception, 0, sizeof(state.reception));
+    resetTagAlarm(state.alarm);
+  }
+  if (reading.fields & ADV_READING_COUNTER)
+  {
+    if (state.reception.received > 0)
+    {
+      trackTagReception(state.reception, lastCounter, reading.counter, ts);
+    }
+    else
+    {
+      resetTagReception(state.reception, ts);
+    }
+  }
+  if (name[0] != '\0' && this->_names.set(reading.mac, name))
+  {
+    this->_namesDirty = true;
+    this->_namesChangeTs = ts;
+    stored.nameSlot = this->_names.findSlot(reading.mac);
+  }
+  this->_trackAlarm(slot);
+  this->_rules.evaluate(stored, changed, ts, _onTagRule, this);
+  stored.historySlot = this->_history.append(stored.historySlot, stored.mac, ts, stored.tempCenti, stored.humidCenti);
+  this->_ingestStats.newSamples += 1;
+  this->_revision += 1;
+}
+
+bool MiTagScanner::_isNotifyProtected(void *context, mac_key_t mac)
+{
+  return ((MiTagScanner *)context)->findTagNotifyData(mac) != -1;
+}
+
+// Store lock held
+void MiTagScanner::_onTagPresence(void *context, MiTagData *tagData, bool isOnline)
 {
-  String buffer = "";
-  for (int i = 0; i < 6; i++)
+  MiTagScanner *scanner = (MiTagScanner *)context;
+  TagPresenceEvent event = {tagData->mac, tagData->ts, isOnline};
+  scanner->_presenceEvents.push(event);
+  // A tag with thresholds counts as offline until it is heard again, also
+  // once it has left the table
+  int notifyIndex = scanner->findTagNotifyData(tagData->mac);
+  if (notifyIndex != -1 && scanner->_notifyOffline[notifyIndex] == isOnline)
   {
-    if (i > 0)
-    {
-      buffer += ":";
-    }
-    uint8_t b = rawMacAddress[i];
-    if (b < 0x10)
-    {
-      buffer += '0';
-    }
-    buffer += String(b, 16);
+    scanner->_notifyOffline[notifyIndex] = !isOnline;
+    scanner->_alarmCounts.offline += isOnline ? -1 : 1;
   }
-  return buffer.c_str();
+  // Readers see the flag through the next snapshot
+  scanner->_revision += 1;
 }
 
-NimBLEUUID MiTagScanner::TARGET_UUID = NimBLEUUID("181a");
+// Store lock held
+void MiTagScanner::_onTagRule(void *context, MiTagData *tagData, int rule, bool isActive)
+{
+  MiTagScanner *scanner = (MiTagScanner *)context;
+  TagRuleEvent event;
+  event.mac = tagData->mac;
+  event.ts = tagData->ts;
+  strncpy(event.name, scanner->_rules.name(rule), TAG_RULE_NAME_LENGTH);
+  event.name[TAG_RULE_NAME_LENGTH] = '\0';
+  event.isActive = isActive;
+  scanner->_ruleEvents.push(event);
+  scanner->_revision += 1;
+}
 
-void MiTagScanner::init()
+// After a rule was set or removed. Store lock held.
+void MiTagScanner::_evaluateRuleOnTags(int rule)
 {
-  BLEDevice::init("");
-  this->_pBLEScan = BLEDevice::getScan();
-  this->_pBLEScan->setActiveScan(true);
-  this->_pBLEScan->setInterval(100);
-  this->_pBLEScan->setWindow(99);
-  this->_pBLEScan->start(0, nullptr, false);
+  uint32_t now = millis();
+  int tagsCount = this->_tagStore.count();
+  for (int i = 0; i < tagsCount; i++)
+  {
+    this->_rules.evaluateRule(*this->_tagStore.at(i), rule, now, _onTagRule, this);
+  }
 }
 
-void MiTagScanner::clearTagsResults()
+// A silent tag sends no sample to run its offline time rules. Store lock
+// held.
+void MiTagScanner::_sweepRules(uint32_t now)
 {
-  this->_tagsCount = 0;
+  if (now - this->_ruleSweepTs < TAG_RULE_SWEEP_INTERVAL)
+  {
+    return;
+  }
+  this->_ruleSweepTs = now;
+  int tagsCount = this->_tagStore.count();
+  for (int i = 0; i < tagsCount; i++)
+  {
+    this->_rules.evaluate(*this->_tagStore.at(i), 1 << VSERVESAFE_RULE_VAR_OFFLINE, now, _onTagRule, this);
+  }
 }
 
-void MiTagScanner::scan()
+bool MiTagScanner::setTagRule(const char *name, mac_key_t scope, const char *expression, size_t len)
 {
-  BLEScanResults foundDevices = this->_pBLEScan->getResults();
-  int nDevice = foundDevices.getCount();
-  for (int i = 0; i < nDevice; i++)
+  TagRuleProgram program;
+  if (!compileTagRule(expression, len, program))
   {
-    NimBLEAdvertisedDevice device = foundDevices.getDevice(i);
+    return false;
+  }
+  xSemaphoreTake(this->_storeLock, portMAX_DELAY);
+  int rule = this->_rules.set(name, scope, program);
+  if (rule != -1)
+  {
+    this->_evaluateRuleOnTags(rule);
+  }
+  xSemaphoreGive(this->_storeLock);
+  return rule != -1;
+}
 
-    std::string rawData = device.getServiceData(TARGET_UUID);
-#if VSERVESAFE_DEBUG_BLE
-    _debugBLEData(rawData);
-#endif
+bool MiTagScanner::removeTagRule(const char *name)
+{
+  xSemaphoreTake(this->_storeLock, portMAX_DELAY);
+  int rule = this->_rules.remove(name);
+  if (rule != -1)
+  {
+    this->_evaluateRuleOnTags(rule);
+  }
+  xSemaphoreGive(this->_storeLock);
+  return rule != -1;
+}
 
-    if (this->isMiTagDataValid(rawData))
+void MiTagScanner::clearTagRules()
+{
+  xSemaphoreTake(this->_storeLock, portMAX_DELAY);
+  uint32_t used = this->_rules.usedMask();
+  this->_rules.clear();
+  for (int rule = 0; rule < MAX_TAG_RULES; rule++)
+  {
+    if (used & (1UL << rule))
     {
-      MiTagData data;
-      data.name = device.getName();
-      data.ts = millis();
-      this->_parseRawDataTo(rawData, data);
-      this->_addMiTagData(data);
+      this->_evaluateRuleOnTags(rule);
     }
   }
+  xSemaphoreGive(this->_storeLock);
+}
 
-  Serial.print("Devices found: ");
-  Serial.println(nDevice);
-  Serial.print("Tags found: ");
-  Serial.println(this->_tagsCount);
-  Serial.println("Scan done!");
+int MiTagScanner::getTagRuleCount()
+{
+  xSemaphoreTake(this->_storeLock, portMAX_DELAY);
+  int count = this->_rules.count();
+  xSemaphoreGive(this->_storeLock);
+  return count;
+}
 
-  this->_pBLEScan->clearResults();
-  // this->_pBLEScan->start(0, nullptr, false);
+bool MiTagScanner::pollRuleEvent(TagRuleEvent &event)
+{
+  return this->_ruleEvents.pop(event);
 }
 
-int MiTagScanner::getTagsCount()
+bool MiTagScanner::peekRuleEvent(TagRuleEvent &event)
 {
-  return this->_tagsCount;
+  return this->_ruleEvents.peek(event);
 }
 
-int MiTagScanner::getActiveTagCount()
+uint32_t MiTagScanner::getRuleEventsDropped()
 {
-  int onlines = 0;
-  for (int i = 0; i < this->_tagsCount; i++)
+  return this->_ruleEvents.dropped();
+}
+
+void MiTagScanner::_clearMiTagData()
+{
+  this->_tagStore.clear();
+  if (this->_notifyOffline)
   {
-    if (isTagActive(getTagDataAt(i)))
-    {
-      onlines += 1;
-    }
+    memset(this->_notifyOffline, 0, this->_notifyCount * sizeof(bool));
   }
+  memset(&this->_alarmCounts, 0, sizeof(this->_alarmCounts));
+  this->_revision += 1;
+}
 
-  return onlines;
+bool MiTagScanner::setTagCapacity(int tagCapacity)
+{
+  xSemaphoreTake(this->_storeLock, portMAX_DELAY);
+  bool isSet = this->_tagStore.setCapacity(tagCapacity);
+  // A smaller table may have dropped tags with a raised alarm
+  this->_recountAlarms();
+  this->_revision += 1;
+  xSemaphoreGive(this->_storeLock);
+  return isSet;
+}
+
+int MiTagScanner::getTagCapacity()
+{
+  return this->_tagStore.getCapacity();
+}
+
+// Includes the snapshot buffers, history and notify limits
+TagStoreMemoryUsage MiTagScanner::getTagStoreMemoryUsage()
+{
+  xSemaphoreTake(this->_storeLock, portMAX_DELAY);
+  TagStoreMemoryUsage usage = this->_tagStore.getMemoryUsage();
+  usage.largeBytes += this->_snapshots.getMemoryUsage() + this->_history.getMemoryUsage();
+  if (this->_notifyIndex)
+  {
+    usage.largeBytes += MAX_NOTIFY_REMEMBER * (sizeof(MiTagNotifyData) + sizeof(bool)) +
+                        sizeof(MacIndex<MAX_NOTIFY_REMEMBER>);
+  }
+  xSemaphoreGive(this->_storeLock);
+  return usage;
+}
+
+void MiTagScanner::setEvictionPolicy(coldsenses_eviction_policy policy)
+{
+  xSemaphoreTake(this->_storeLock, portMAX_DELAY);
+  this->_tagStore.setEvictionPolicy(policy);
+  xSemaphoreGive(this->_storeLock);
+}
+
+coldsenses_eviction_policy MiTagScanner::getEvictionPolicy()
+{
+  return this->_tagStore.getEvictionPolicy();
+}
+
+MiTagEvictionStats MiTagScanner::getEvictionStats()
+{
+  xSemaphoreTake(this->_storeLock, portMAX_DELAY);
+  MiTagEvictionStats stats = this->_tagStore.getEvictionStats();
+  xSemaphoreGive(this->_storeLock);
+  return stats;
+}
+
+MiTagIngestStats MiTagScanner::getIngestStats()
+{
+  xSemaphoreTake(this->_storeLock, portMAX_DELAY);
+  MiTagIngestStats stats = this->_ingestStats;
+  xSemaphoreGive(this->_storeLock);
+  stats.queueDropped = this->_advertRing.dropped() + this->_decryptRing.dropped();
+  return stats;
+}
+
+uint32_t MiTagScanner::getIngestPending()
+{
+  // The ingest task holds the lock from pop to store, so nothing is in flight
+  xSemaphoreTake(this->_storeLock, portMAX_DELAY);
+  uint32_t pending = this->_advertRing.size() + this->_decryptRing.size();
+  xSemaphoreGive(this->_storeLock);
+  return pending;
 }
 
-int MiTagScanner::findTagData(std::string &rawMacAddress)
+uint32_t MiTagScanner::getAdvertTotal()
 {
-  for (int i = 0; i < this->_tagsCount; i++)
+  return this->_advertTotal.load();
+}
+
+MiTagReceptionSummary MiTagScanner::getReceptionSummary()
+{
+  MiTagReceptionSummary summary = {};
+  uint64_t intervalSum = 0;
+  int intervalTags = 0;
+
+  xSemaphoreTake(this->_storeLock, portMAX_DELAY);
+  int tagsCount = this->_tagStore.count();
+  for (int i = 0; i < tagsCount; i++)
   {
-    if (rawMacAddress == this->_tags[i].rawMacAddress)
+    TagReceptionStats &reception = this->_tagStore.stateAt(i)->reception;
+    if (reception.received == 0)
+    {
+      continue;
+    }
+
+    summary.tags += 1;
+    summary.received += reception.received;
+    summary.expected += reception.expected;
+    summary.missed += reception.missed;
+    if (reception.intervalMs > 0)
+    {
+      intervalSum += reception.intervalMs;
+      intervalTags += 1;
+    }
+    for (int j = 0; j < TAG_RECEPTION_BUCKETS; j++)
     {
-      return i;
+      summary.interArrival[j] += reception.interArrival[j];
     }
   }
-  return -1;
+  xSemaphoreGive(this->_storeLock);
+
+  summary.intervalMs = intervalTags > 0 ? intervalSum / intervalTags : 0;
+  return summary;
+}
+
+void MiTagScanner::setScanPolicy(coldsenses_scan_policy policy)
+{
+  this->_requestedScanPolicy.store(policy);
+}
+
+coldsenses_scan_policy MiTagScanner::getScanPolicy()
+{
+  return (coldsenses_scan_policy)this->_requestedScanPolicy.load();
 }
 
-MiTagData *MiTagScanner::getTagDataAt(int i)
+// Restart the scan with the policy config asked for, if it changed. Only the
+// scan task stops and starts the scan, so this runs there.
+void MiTagScanner::_applyScanPolicy()
 {
-  if (i < 0 || i >= this->_tagsCount)
+  coldsenses_scan_policy policy = (coldsenses_scan_policy)this->_requestedScanPolicy.load();
+  if (policy == this->_scanScheduler.getPolicy())
   {
-    return NULL;
+    return;
   }
-  return &(this->_tags[i]);
+  // Adaptive starts from the current window
+  uint16_t windowMs = policy == VSERVESAFE_SCAN_POLICY_FIXED ? SCAN_WINDOW_MAX : this->_scanScheduler.getWindowMs();
+  this->_scanScheduler.begin(policy, windowMs);
+  this->_pBLEScan->stop();
+  this->_applyScanParams();
+  this->_pBLEScan->start(0, nullptr, false);
 }
 
-bool MiTagScanner::isTagActive(MiTagData *tagData)
+int MiTagScanner::getScanDutyPercent()
 {
-  return tagData && (millis() - (*tagData).ts) <= TAG_ONLINE_TIEMOUT;
+  return this->_scanScheduler.getDutyPercent();
 }
 
-bool MiTagScanner::isMiTagDataValid(std::string &rawData)
+void MiTagScanner::setUplinkBacklog(int pending)
 {
-  return rawData.length() == 15;
+  this->_uplinkBacklog = pending;
 }
 
-void MiTagScanner::_addMiTagData(MiTagData &tagData)
+void MiTagScanner::setScanMode(coldsenses_scan_mode mode)
 {
-  int index = this->findTagData(tagData.rawMacAddress);
-  if (index != -1)
+  if (mode == this->_scanMode)
   {
-    this->_tags[index] = tagData;
     return;
   }
+  this->_scanMode = mode;
+  this->_applyScanFilter();
+}
+
+coldsenses_scan_mode MiTagScanner::getScanMode()
+{
+  return this->_scanMode;
+}
+
+bool MiTagScanner::isControllerFiltering()
+{
+  return this->_controllerFilter;
+}
+
+uint32_t MiTagScanner::getHostFilteredCount()
+{
+  return this->_hostFiltered.load();
+}
+
+void MiTagScanner::allowTag(mac_key_t mac)
+{
+  xSemaphoreTake(this->_storeLock, portMAX_DELAY);
+  this->_allowList.add(mac);
+  this->_allowListActive = true;
+  this->_allowListDirty = true;
+  this->_allowListChangeTs = millis();
+  this->_invalidateAdmission();
+  xSemaphoreGive(this->_storeLock);
+}
+
+void MiTagScanner::clearAllowList()
+{
+  xSemaphoreTake(this->_storeLock, portMAX_DELAY);
+  this->_allowList.clear();
+  this->_allowListActive = false;
+  this->_allowListDirty = true;
+  this->_allowListChangeTs = millis();
+  this->_invalidateAdmission();
+  xSemaphoreGive(this->_storeLock);
+}
+
+uint32_t MiTagScanner::getAllowListCount()
+{
+  xSemaphoreTake(this->_storeLock, portMAX_DELAY);
+  uint32_t count = this->_allowList.count();
+  xSemaphoreGive(this->_storeLock);
+  return count;
+}
 
-  if (this->_tagsCount < MAX_TAGS_REMEMBER)
+uint32_t MiTagScanner::getAllowListRejected()
+{
+  return this->_allowListRejected.load();
+}
+
+void MiTagScanner::setTagName(mac_key_t mac, const char *name)
+{
+  xSemaphoreTake(this->_storeLock, portMAX_DELAY);
+  if (this->_names.set(mac, name))
   {
-    this->_tags[this->_tagsCount] = tagData;
-    this->_tagsCount += 1;
-    return;
+    this->_namesDirty = true;
+    this->_namesChangeTs = millis();
+  }
+  int index = this->_tagStore.find(mac);
+  if (index != -1)
+  {
+    this->_tagStore.at(index)->nameSlot = this->_names.findSlot(mac);
+    this->_revision += 1;
   }
+  xSemaphoreGive(this->_storeLock);
+}
+
+void MiTagScanner::getTagName(MiTagData *tagData, char *name)
+{
+  xSemaphoreTake(this->_storeLock, portMAX_DELAY);
+  const char *pooled = this->_names.nameAt(tagData->nameSlot, tagData->mac);
+  strncpy(name, pooled ? pooled : "", TAG_NAME_LENGTH);
+  name[TAG_NAME_LENGTH] = '\0';
+  xSemaphoreGive(this->_storeLock);
+}
 
-  int targetIndex = -1;
-  uint32_t tsPrev = 0;
-  for (int i = 0; i < this->_tagsCount; i++)
+bool MiTagScanner::getTagReception(MiTagData *tagData, TagReceptionStats &reception)
+{
+  xSemaphoreTake(this->_storeLock, portMAX_DELAY);
+  MiTagState *state = this->_tagStore.stateAt(this->_tagStore.find(tagData->mac));
+  if (state)
   {
-    if (this->_tags[i].ts > tsPrev)
-    {
-      tsPrev = this->_tags[i].ts;
-      targetIndex = i;
-    }
+    reception = state->reception;
   }
+  xSemaphoreGive(this->_storeLock);
+  return state != NULL;
+}
 
-  if (targetIndex != -1)
+int MiTagScanner::getTagHistory(MiTagData *tagData, uint32_t fromTs, uint32_t toTs, TagHistorySample *samples,
+                                int maxSamples)
+{
+  xSemaphoreTake(this->_storeLock, portMAX_DELAY);
+  int n = this->_history.read(tagData->historySlot, tagData->mac, fromTs, toTs, samples, maxSamples);
+  xSemaphoreGive(this->_storeLock);
+  return n;
+}
+
+int MiTagScanner::getTagNameCount()
+{
+  xSemaphoreTake(this->_storeLock, portMAX_DELAY);
+  int count = this->_names.count();
+  xSemaphoreGive(this->_storeLock);
+  return count;
+}
+
+int MiTagScanner::getUnnamedTagCount()
+{
+  int unnamedTags = 0;
+  xSemaphoreTake(this->_storeLock, portMAX_DELAY);
+  int tagsCount = this->_tagStore.count();
+  for (int i = 0; i < tagsCount; i++)
   {
-    this->_tags[targetIndex] = tagData;
+    MiTagData *tagData = this->_tagStore.at(i);
+    if (tagData->online && !this->_names.nameAt(tagData->nameSlot, tagData->mac))
+    {
+      unnamedTags += 1;
+    }
   }
+  xSemaphoreGive(this->_storeLock);
+  return unnamedTags;
 }
 
-void MiTagScanner::_clearMiTagData()
+uint32_t MiTagScanner::getNameWindowCount()
+{
+  return this->_nameWindows;
+}
+
+uint32_t MiTagScanner::getRevision()
+{
+  return this->_revision.load();
+}
+
+bool MiTagScanner::isTagDirty(MiTagData *tagData)
 {
-  this->_tagsCount = 0;
+  return tagData && tagData->sampleSeq != tagData->publishedSeq;
 }
 
-void MiTagScanner::_parseRawDataTo(std::string &rawData, MiTagData &to)
+void MiTagScanner::markTagPublished(mac_key_t mac, uint32_t sampleSeq)
 {
-  to.rawMacAddress = "";
-  for (int i = 5; i >= 0; i--)
+  xSemaphoreTake(this->_storeLock, portMAX_DELAY);
+  int index = this->_tagStore.find(mac);
+  if (index != -1)
   {
-    to.rawMacAddress += rawData[i];
+    this->_tagStore.at(index)->publishedSeq = sampleSeq;
+    this->_snapshotStale = true;
   }
+  xSemaphoreGive(this->_storeLock);
+}
+
+bool MiTagScanner::setBindKey(mac_key_t mac, const uint8_t *bindKey)
+{
+  xSemaphoreTake(this->_storeLock, portMAX_DELAY);
+  bool isSet = this->_bindKeys.set(mac, bindKey);
+  this->_invalidateAdmission();
+  xSemaphoreGive(this->_storeLock);
+  return isSet;
+}
 
-  int tempRaw = rawData[6] + (rawData[7] << 8);
-  to.tempC = tempRaw / 100.0;
+bool MiTagScanner::removeBindKey(mac_key_t mac)
+{
+  xSemaphoreTake(this->_storeLock, portMAX_DELAY);
+  bool isRemoved = this->_bindKeys.remove(mac);
+  this->_invalidateAdmission();
+  xSemaphoreGive(this->_storeLock);
+  return isRemoved;
+}
 
-  int humidRaw = rawData[8] + (rawData[9] << 8);
-  to.humidRH = humidRaw / 100.0;
+int MiTagScanner::getBindKeyCount()
+{
+  return this->_bindKeys.count();
+}
 
-  to.battMv = rawData[10] + (rawData[11] << 8);
-  to.battPercent = rawData[12];
-  to.counter = rawData[13];
-  to.flag = rawData[14];
+MiBeaconStats MiTagScanner::getMiBeaconStats()
+{
+  xSemaphoreTake(this->_storeLock, portMAX_DELAY);
+  MiBeaconStats stats = this->_miBeaconStats;
+  xSemaphoreGive(this->_storeLock);
+  stats.queued = this->_miBeaconQueued.load();
+  stats.dropped = this->_miBeaconDropped.load();
+  stats.noKey = this->_miBeaconNoKey.load();
+  return stats;
 }
 
 int MiTagScanner::getTagNotifyDataCount()
 {
-  return this->_notifyCount;
+  xSemaphoreTake(this->_storeLock, portMAX_DELAY);
+  int count = this->_notifyCount;
+  xSemaphoreGive(this->_storeLock);
+  return count;
 }
 
 void MiTagScanner::addTagNotifyData(MiTagNotifyData &notifyData)
 {
-  for (int i = 0; i < this->_notifyCount; i++)
+  xSemaphoreTake(this->_storeLock, portMAX_DELAY);
+  this->_setNotifyData(notifyData);
+  xSemaphoreGive(this->_storeLock);
+}
+
+void MiTagScanner::clearTagNotifyDataResults()
+{
+  xSemaphoreTake(this->_storeLock, portMAX_DELAY);
+  this->_clearNotifyData();
+  xSemaphoreGive(this->_storeLock);
+}
+
+bool MiTagScanner::queueTagNotifyData(MiTagNotifyData &notifyData)
+{
+  MiTagNotifyUpdate update = {notifyData, VSERVESAFE_NOTIFY_SET};
+  return this->_queueNotifyUpdate(update);
+}
+
+bool MiTagScanner::queueRemoveTagNotifyData(mac_key_t mac)
+{
+  MiTagNotifyUpdate update = {};
+  update.data.mac = mac;
+  update.op = VSERVESAFE_NOTIFY_REMOVE;
+  return this->_queueNotifyUpdate(update);
+}
+
+bool MiTagScanner::queueClearTagNotifyData()
+{
+  MiTagNotifyUpdate update = {};
+  update.op = VSERVESAFE_NOTIFY_CLEAR;
+  return this->_queueNotifyUpdate(update);
+}
+
+uint32_t MiTagScanner::getTagNotifyPending()
+{
+  // Batches are popped and applied under the lock
+  xSemaphoreTake(this->_storeLock, portMAX_DELAY);
+  uint32_t pending = this->_notifyRing.size();
+  xSemaphoreGive(this->_storeLock);
+  return pending;
+}
+
+uint32_t MiTagScanner::getTagNotifyDropped()
+{
+  return this->_notifyRing.dropped();
+}
+
+// Never waits: the caller is the MQTT task, which must keep the connection
+// serviced
+bool MiTagScanner::_queueNotifyUpdate(MiTagNotifyUpdate &update)
+{
+  if (!this->_notifyRing.push(update))
   {
-    if (notifyData.rawMacAddress == this->_notifyDataArr[i].rawMacAddress)
+    return false;
+  }
+  xTaskNotifyGive(this->_ingestTask);
+  return true;
+}
+
+// Ingest task only. Each batch is applied under one short lock hold; the
+// table is consistent between batches, just not complete yet.
+void MiTagScanner::_applyNotifyUpdates()
+{
+  MiTagNotifyUpdate update;
+  bool isMore = this->_notifyRing.size() > 0;
+  while (isMore)
+  {
+    int n = 0;
+    xSemaphoreTake(this->_storeLock, portMAX_DELAY);
+    while (n < TAG_NOTIFY_BATCH && this->_notifyRing.pop(update))
     {
-      this->_notifyDataArr[i] = notifyData;
-      return;
+      if (update.op == VSERVESAFE_NOTIFY_SET)
+      {
+        this->_setNotifyData(update.data);
+      }
+      else if (update.op == VSERVESAFE_NOTIFY_REMOVE)
+      {
+        this->_removeNotifyData(update.data.mac);
+      }
+      else
+      {
+        this->_clearNotifyData();
+      }
+      n += 1;
+    }
+    xSemaphoreGive(this->_storeLock);
+    isMore = n == TAG_NOTIFY_BATCH;
+    if (isMore)
+    {
+      // Between batches, let other lock holders (BLE host, UI) in
+      vTaskDelay(0);
     }
   }
+}
 
-  if (this->_notifyCount < MAX_NOTIFY_REMEMBER)
+// Store lock held
+void MiTagScanner::_setNotifyData(MiTagNotifyData &notifyData)
+{
+  int index = this->findTagNotifyData(notifyData.mac);
+  if (index != -1)
+  {
+    MiTagNotifyData &stored = this->_notifyDataArr[index];
+    // Retained limits arrive again on every reconnect; keep the alarm state
+    if (stored.isNotify == notifyData.isNotify && stored.lowCenti == notifyData.lowCenti &&
+        stored.highCenti == notifyData.highCenti)
+    {
+      return;
+    }
+    stored = notifyData;
+  }
+  else if (this->_notifyIndex && this->_notifyCount < MAX_NOTIFY_REMEMBER)
   {
+    MiTagData *tagData = this->_tagStore.at(this->_tagStore.find(notifyData.mac));
+    bool isOffline = tagData && !tagData->online;
     this->_notifyDataArr[this->_notifyCount] = notifyData;
+    this->_notifyOffline[this->_notifyCount] = isOffline;
+    this->_alarmCounts.offline += isOffline;
+    this->_notifyIndex->insert(notifyData.mac, this->_notifyCount);
     this->_notifyCount += 1;
+    this->_scanFilterDirty = true;
+    this->_invalidateAdmission();
+  }
+  else
+  {
     return;
   }
+  this->_refreshNotifyResult(notifyData.mac);
+  this->_revision += 1;
 }
 
-void MiTagScanner::clearTagNotifyDataResults()
+// Store lock held. The last entry moves into the hole to keep them dense.
+void MiTagScanner::_removeNotifyData(mac_key_t mac)
 {
-  this->_notifyCount = 0;
+  int index = this->findTagNotifyData(mac);
+  if (index == -1)
+  {
+    return;
+  }
+  int last = this->_notifyCount - 1;
+  this->_notifyIndex->erase(mac);
+  this->_alarmCounts.offline -= this->_notifyOffline[index];
+  if (index != last)
+  {
+    this->_notifyDataArr[index] = this->_notifyDataArr[last];
+    this->_notifyOffline[index] = this->_notifyOffline[last];
+    this->_notifyIndex->insert(this->_notifyDataArr[index].mac, index);
+  }
+  this->_notifyCount -= 1;
+  this->_refreshNotifyResult(mac);
+  this->_revision += 1;
+  this->_scanFilterDirty = true;
+  this->_invalidateAdmission();
 }
 
-int MiTagScanner::findTagNotifyData(std::string &rawMacAddress)
+// Store lock held
+void MiTagScanner::_clearNotifyData()
 {
-  for (int i = 0; i < this->_notifyCount; i++)
+  this->_notifyCount = 0;
+  this->_revision += 1;
+  if (this->_notifyIndex)
   {
-    if (rawMacAddress == this->_notifyDataArr[i].rawMacAddress)
-    {
-      return i;
-    }
+    this->_notifyIndex->clear();
+  }
+  this->_alarmCounts.offline = 0;
+  this->_scanFilterDirty = true;
+  this->_invalidateAdmission();
+  int tagsCount = this->_tagStore.count();
+  for (int i = 0; i < tagsCount; i++)
+  {
+    this->_resetAlarm(i);
+    this->_tagStore.at(i)->notifyResult = VSERVESAFE_NOTIFY_NODATA;
   }
-  return -1;
 }
 
-bool MiTagScanner::isTagNotifyDataExists(std::string &rawMacAddress)
+int MiTagScanner::findTagNotifyData(mac_key_t mac)
+{
+  return this->_notifyIndex ? this->_notifyIndex->find(mac) : -1;
+}
+
+bool MiTagScanner::isTagNotifyDataExists(mac_key_t mac)
+{
+  xSemaphoreTake(this->_storeLock, portMAX_DELAY);
+  bool isExists = this->findTagNotifyData(mac) != -1;
+  xSemaphoreGive(this->_storeLock);
+  return isExists;
+}
+
+coldsenses_notify_result MiTagScanner::getTagNotifyResult(MiTagData *tagData)
 {
-  return this->findTagNotifyData(rawMacAddress) != -1;
+  return tagData ? (coldsenses_notify_result)tagData->notifyResult : VSERVESAFE_NOTIFY_NODATA;
 }
 
-coldsenses_notify_result MiTagScanner::getTagNotifyResult(std::string &rawMacAddress)
+// Store lock held
+coldsenses_notify_result MiTagScanner::_evalNotifyResult(MiTagData &data, const MiTagState &state)
 {
-  int notifyIndex = this->findTagNotifyData(rawMacAddress);
-  int tagIndex = this->findTagData(rawMacAddress);
-  if (notifyIndex == -1 || tagIndex == -1)
+  int notifyIndex = this->findTagNotifyData(data.mac);
+  if (notifyIndex == -1)
   {
     return VSERVESAFE_NOTIFY_NODATA;
   }
 
-  MiTagData data = this->_tags[tagIndex];
-  MiTagNotifyData notifyData = this->_notifyDataArr[notifyIndex];
-
-  if (!notifyData.isNotify)
+  switch (state.alarm.state)
   {
+  case VSERVESAFE_ALARM_HIGH:
+    return VSERVESAFE_NOTIFY_HIGH;
+  case VSERVESAFE_ALARM_LOW:
+    return VSERVESAFE_NOTIFY_LOW;
+  default:
     return VSERVESAFE_NOTIFY_NORMAL;
   }
-  if (data.tempC >= notifyData.highC)
+}
+
+// Step the tag's alarm with its current sample and queue the edge, if any.
+// Store lock held.
+void MiTagScanner::_trackAlarm(int slot)
+{
+  MiTagData &data = *this->_tagStore.at(slot);
+  MiTagState &state = *this->_tagStore.stateAt(slot);
+  int notifyIndex = this->findTagNotifyData(data.mac);
+  if (notifyIndex != -1 && this->_notifyDataArr[notifyIndex].isNotify)
   {
-    return VSERVESAFE_NOTIFY_HIGH;
+    MiTagNotifyData &notifyData = this->_notifyDataArr[notifyIndex];
+    uint8_t before = state.alarm.state;
+    coldsenses_alarm_edge edge = updateTagAlarm(state.alarm, this->_alarmConfig, data.tempCenti,
+                                                notifyData.lowCenti, notifyData.highCenti, data.ts);
+    if (edge != VSERVESAFE_ALARM_EDGE_NONE)
+    {
+      TagAlarmEvent event = {data.mac, data.ts, data.tempCenti, (uint8_t)edge};
+      this->_alarmEvents.push(event);
+      this->_countAlarmEdge(before, edge);
+    }
+  }
+  data.notifyResult = this->_evalNotifyResult(data, state);
+}
+
+// A raised alarm is cleared, as its thresholds are gone. Store lock held.
+void MiTagScanner::_resetAlarm(int slot)
+{
+  MiTagData &data = *this->_tagStore.at(slot);
+  MiTagState &state = *this->_tagStore.stateAt(slot);
+  if (isTagAlarmRaised(state.alarm))
+  {
+    TagAlarmEvent event = {data.mac, data.ts, data.tempCenti, VSERVESAFE_ALARM_EDGE_CLEAR};
+    this->_alarmEvents.push(event);
+    this->_countAlarmEdge(state.alarm.state, VSERVESAFE_ALARM_EDGE_CLEAR);
   }
-  else if (data.tempC <= notifyData.lowC)
+  resetTagAlarm(state.alarm);
+}
+
+// state is the alarm's state before the edge. Store lock held.
+void MiTagScanner::_countAlarmEdge(uint8_t state, coldsenses_alarm_edge edge)
+{
+  if (edge == VSERVESAFE_ALARM_EDGE_HIGH)
   {
-    return VSERVESAFE_NOTIFY_LOW;
+    this->_alarmCounts.high += 1;
   }
-  else
+  else if (edge == VSERVESAFE_ALARM_EDGE_LOW)
   {
-    return VSERVESAFE_NOTIFY_NORMAL;
+    this->_alarmCounts.low += 1;
+  }
+  else if (edge == VSERVESAFE_ALARM_EDGE_CLEAR)
+  {
+    (state == VSERVESAFE_ALARM_HIGH ? this->_alarmCounts.high : this->_alarmCounts.low) -= 1;
+  }
+}
+
+// Store lock held
+void MiTagScanner::_recountAlarms()
+{
+  this->_alarmCounts.high = 0;
+  this->_alarmCounts.low = 0;
+  int tagsCount = this->_tagStore.count();
+  for (int i = 0; i < tagsCount; i++)
+  {
+    uint8_t state = this->_tagStore.stateAt(i)->alarm.state;
+    this->_alarmCounts.high += state == VSERVESAFE_ALARM_HIGH;
+    this->_alarmCounts.low += state == VSERVESAFE_ALARM_LOW;
   }
 }
 
+// Re-evaluate a stored tag after its thresholds changed: its alarm starts
+// over from the current sample. Store lock held.
+void MiTagScanner::_refreshNotifyResult(mac_key_t mac)
+{
+  int slot = this->_tagStore.find(mac);
+  if (slot != -1)
+  {
+    this->_resetAlarm(slot);
+    this->_trackAlarm(slot);
+  }
+}
+
+void MiTagScanner::setAlarmConfig(TagAlarmConfig &config)
+{
+  xSemaphoreTake(this->_storeLock, portMAX_DELAY);
+  this->_alarmConfig = config;
+  xSemaphoreGive(this->_storeLock);
+}
+
+TagAlarmConfig MiTagScanner::getAlarmConfig()
+{
+  xSemaphoreTake(this->_storeLock, portMAX_DELAY);
+  TagAlarmConfig config = this->_alarmConfig;
+  xSemaphoreGive(this->_storeLock);
+  return config;
+}
+
 std::string MiTagScanner::prettyRawData(std::string &rawData)
 {
-  String buffer = "[";
+  std::string buffer = "[";
   int len = rawData.length();
   for (int i = 0; i < len; i++)
   {
-    if (i > 0)
-    {
-      buffer += ',';
-    }
-    buffer += (int)rawData[i];
+    char num[8];
+    snprintf(num, sizeof(num), i > 0 ? ",%d" : "%d", (int)rawData[i]);
+    buffer += num;
   }
   buffer += ']';
-  return buffer.c_str();
+  return buffer;
 }
 
-std::string MiTagScanner::toRawMacAddress(std::string macAddress)
+mac_key_t MiTagScanner::toMacKey(std::string macAddress)
 {
-  std::string result;
-  for (int i = 0; i < macAddress.length(); i += 2)
+  mac_key_t result = 0;
+  int digits = 0;
+  for (size_t i = 0; i < macAddress.length() && digits < 12; i++)
   {
-    char m = (char)strtol(macAddress.substr(i, 2).c_str(), nullptr, 16);
-    result += m;
+    char c = macAddress[i];
+    if (!isxdigit((unsigned char)c))
+    {
+      continue;
+    }
+    result = (result << 4) | (mac_key_t)(isdigit((unsigned char)c) ? c - '0' : (tolower((unsigned char)c) - 'a' + 10));
+    digits += 1;
   }
   return result;
 }
 
 #if VSERVESAFE_DEBUG_BLE
 
-void MiTagScanner::_debugBLEData(std::string &rawData)
+void MiTagScanner::_debugBLEData(const uint8_t *payload, size_t len)
 {
-  int len = rawData.length();
+  std::string rawData((const char *)payload, len);
   Serial.print("Data: ");
-  Serial.println(MiTagScanner.prettyRawData(rawData).c_str());
+  Serial.println(MiTagScanner::prettyRawData(rawData).c_str());
 }
 #endif
\ No newline at end of file
@@ -2,11 +2,30 @@
 #define __VSERVESAFE_BLE__
 
 #include <Arduino.h>
+#include <atomic>
 #include "vservesafe_conf.h"
 
 #include <NimBLEDevice.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include "AdvDecoder.h"
+#include "MacIndex.h"
+#include "MiBeacon.h"
+#include "ScanScheduler.h"
+#include "TagAdmission.h"
+#include "TagAlarm.h"
+#include "TagAllowList.h"
+#include "TagHistory.h"
+#include "TagIngest.h"
+#include "TagNameCache.h"
+#include "TagPresence.h"
+#include "TagRules.h"
+#include "TagSnapshot.h"
+#include "TagStore.h"
 
-std::string prettyMacAddress(std::string rawMacAddress);
+std::string prettyMacAddress(mac_key_t mac);
 
 typedef enum
 {
@@ -25,62 +44,318 @@ typedef enum
 
 typedef struct
 {
-    uint32_t ts;
-    std::string name;
-    std::string rawMacAddress;
-    double tempC;
-    double humidRH;
-    uint16_t battMv;
-    uint8_t battPercent;
-    uint8_t counter;
-    uint8_t flag;
-} MiTagData;
+    mac_key_t mac;
+    bool isNotify;
+    // Hundredths of a degree, like MiTagData::tempCenti
+    int16_t lowCenti;
+    int16_t highCenti;
+} MiTagNotifyData;
+
+typedef enum
+{
+    VSERVESAFE_NOTIFY_SET,
+    VSERVESAFE_NOTIFY_REMOVE,
+    VSERVESAFE_NOTIFY_CLEAR,
+} coldsenses_notify_op;
 
+// Threshold change queued for the ingest task
 typedef struct
 {
-    std::string rawMacAddress;
-    bool isNotify;
-    double lowC;
-    double highC;
-} MiTagNotifyData;
+    MiTagNotifyData data;
+    uint8_t op;
+} MiTagNotifyUpdate;
+
+typedef SpscRing<MiTagNotifyUpdate, TAG_NOTIFY_QUEUE_LENGTH> TagNotifyRing;
+
+// What the buzzer sounds for
+typedef struct
+{
+    // Tags with a raised high or low alarm
+    uint16_t high;
+    uint16_t low;
+    // Tags with thresholds that went offline and were not heard since
+    uint16_t offline;
+} MiTagAlarmCounts;
+
+// Controller duplicate filter keyed on address and advert data, so a new
+// sample from a tag still gets through
+#define BLE_SCAN_DUPL_TYPE_DATA_DEVICE (2)
 
-class MiTagScanner
+typedef struct
+{
+    uint32_t queued;
+    uint32_t dropped;
+    uint32_t noKey;
+    uint32_t decrypted;
+    uint32_t authFailed;
+    // Queued copies of a frame already stored, not decrypted again
+    uint32_t copies;
+} MiBeaconStats;
+
+class MiTagScanner : public NimBLEAdvertisedDeviceCallbacks
 {
 private:
     BLEScan *_pBLEScan;
-    MiTagData _tags[MAX_TAGS_REMEMBER];
-    int _tagsCount = 0;
-    MiTagNotifyData _notifyDataArr[MAX_NOTIFY_REMEMBER];
+    // Counted on the host task, read by others
+    std::atomic<uint32_t> _advertCount{0};
+    std::atomic<uint32_t> _advertTotal{0};
+    TagStore _tagStore;
+    // Held by writers of the tag store and bindkeys (ingest task, config) and
+    // by readers outside the ingest task
+    SemaphoreHandle_t _storeLock = NULL;
+    // One ring per producer; the ingest task drains both into the tag store
+    TagAdvertRing _advertRing;
+    TagDecryptRing _decryptRing;
+    TaskHandle_t _ingestTask = NULL;
+    // Pushed by store lock holders only, so there is one producer at a time
+    TagPresenceRing _presenceEvents;
+    TagAlarmRing _alarmEvents;
+    TagAlarmConfig _alarmConfig = {TAG_ALARM_HYSTERESIS, TAG_ALARM_DWELL, TAG_ALARM_REARM};
+    // Follows the alarm and presence events as they are queued
+    MiTagAlarmCounts _alarmCounts = {};
+    TagRuleSet _rules;
+    TagRuleRing _ruleEvents;
+    uint32_t _ruleSweepTs = 0;
+    TagSnapshotBuffers _snapshots;
+    uint32_t _snapshotRevision = 0;
+    // Publish state changed without a new revision
+    bool _snapshotStale = false;
+    MiBeaconKeyStore _bindKeys;
+    // Decrypt worker counts, store lock held
+    MiBeaconStats _miBeaconStats = {};
+    // Counted on the host task
+    std::atomic<uint32_t> _miBeaconQueued{0};
+    std::atomic<uint32_t> _miBeaconDropped{0};
+    std::atomic<uint32_t> _miBeaconNoKey{0};
+    // Allowlist, host filter and bindkeys as the host task checks them
+    TagAdmissionBuffers _admission;
+    // Set under the store lock when one of them changes; the ingest task
+    // publishes a new copy
+    std::atomic<bool> _admissionDirty{true};
+    MiTagIngestStats _ingestStats = {};
+    // Bumped under the store lock on every change readers can see;
+    // getRevision() reads it without the lock
+    std::atomic<uint32_t> _revision{0};
+    QueueHandle_t _decryptQueue = NULL;
+    // Driven by the scan task only
+    ScanScheduler _scanScheduler;
+    // Policy set by config (MQTT task); scan() applies it
+    std::atomic<uint8_t> _requestedScanPolicy{VSERVESAFE_SCAN_POLICY};
+    // Ingest stats at the previous schedule update
+    MiTagIngestStats _scheduledIngest = {};
+    int _uplinkBacklog = 0;
+    coldsenses_scan_mode _scanMode = VSERVESAFE_SCANMODE_ALLSCAN;
+    // Notify list changed since the scan filter was programmed. Written under
+    // the store lock, read by scan() and status getters without it.
+    std::atomic<bool> _scanFilterDirty{false};
+    std::atomic<bool> _controllerFilter{false};
+    // Selected tags did not fit the controller accept list; onResult drops
+    // adverts of other devices
+    bool _hostFilter = false;
+    std::atomic<uint32_t> _hostFiltered{0};
+    TagAllowList _allowList;
+    bool _allowListActive = false;
+    // Changed since last saved to flash
+    bool _allowListDirty = false;
+    uint32_t _allowListChangeTs = 0;
+    std::atomic<uint32_t> _allowListRejected{0};
+    TagNameCache _names;
+    TagHistory _history;
+    bool _namesDirty = false;
+    uint32_t _namesChangeTs = 0;
+    // Active scan opened to learn names of tags heard by the passive scan
+    bool _nameWindowOpen = false;
+    uint32_t _nameWindowTs = 0;
+    uint32_t _nameWindows = 0;
+    // Dense in [0, _notifyCount), in PSRAM with their index
+    MiTagNotifyData *_notifyDataArr = NULL;
+    // Per entry: the tag went offline and was not heard since
+    bool *_notifyOffline = NULL;
+    MacIndex<MAX_NOTIFY_REMEMBER> *_notifyIndex = NULL;
     int _notifyCount = 0;
+    // Pushed by the config task, applied by the ingest task
+    TagNotifyRing _notifyRing;
 
-    void _addMiTagData(MiTagData &tagData);
+    bool _refreshDuplicate(mac_key_t mac, uint8_t counter, int rssi, uint32_t ts);
+    bool _isStoredSample(mac_key_t mac, uint8_t counter, uint32_t ts);
+    static void _ingestLoop(void *arg);
+    bool _drainIngest();
+    void _ingest(TagIngestEvent &event);
+    void _publishSnapshot();
+    void _invalidateAdmission();
+    void _publishAdmission();
+    void _storeReading(AdvReading &reading, const char *name, int rssi, uint32_t ts);
+    void _queueMiBeacon(NimBLEAdvertisedDevice *advertisedDevice, const uint8_t *data, size_t len);
+    static void _decryptTask(void *arg);
+    static bool _isNotifyProtected(void *context, mac_key_t mac);
+    static void _onTagPresence(void *context, MiTagData *tagData, bool isOnline);
+    static void _onTagRule(void *context, MiTagData *tagData, int rule, bool isActive);
+    void _evaluateRuleOnTags(int rule);
+    void _sweepRules(uint32_t now);
+    void _scheduleScan();
+    void _applyScanParams();
+    void _applyScanPolicy();
+    void _applyScanFilter();
+    bool _acceptAdvertiser(mac_key_t address);
+    void _scheduleNameWindow();
     void _clearMiTagData();
-    void _parseRawDataTo(std::string &rawData, MiTagData &to);
+    void _setNotifyData(MiTagNotifyData &notifyData);
+    void _removeNotifyData(mac_key_t mac);
+    void _clearNotifyData();
+    void _applyNotifyUpdates();
+    bool _queueNotifyUpdate(MiTagNotifyUpdate &update);
+    // Store lock held
+    int findTagNotifyData(mac_key_t mac);
+    coldsenses_notify_result _evalNotifyResult(MiTagData &data, const MiTagState &state);
+    void _trackAlarm(int slot);
+    void _resetAlarm(int slot);
+    void _countAlarmEdge(uint8_t state, coldsenses_alarm_edge edge);
+    void _recountAlarms();
+    void _refreshNotifyResult(mac_key_t mac);
 #if VSERVESAFE_DEBUG_BLE
-    void _debugBLEData(std::string &rawData);
+    void _debugBLEData(const uint8_t *payload, size_t len);
 #endif
 
 public:
     static NimBLEUUID TARGET_UUID;
     static std::string prettyRawData(std::string &rawData);
-    static std::string toRawMacAddress(std::string macAddress);
+    static mac_key_t toMacKey(std::string macAddress);
 
-    void init();
+    void init(int tagCapacity = MAX_TAGS_REMEMBER);
     void clearTagsResults();
+    void onResult(NimBLEAdvertisedDevice *advertisedDevice);
     void scan();
+    // Consistent copy of the tag table (at most TAG_SNAPSHOT_INTERVAL old)
+    // read without the store lock; release it when done
+    const TagSnapshot *acquireSnapshot();
+    void releaseSnapshot(const TagSnapshot *snapshot);
+    // True once the latest changes are in the published snapshot
+    bool isSnapshotCurrent();
+    // True once allowlist, scan filter and bindkey changes reach the host task
+    bool isAdmissionCurrent();
     int getTagsCount();
+    // Kept up to date by the presence wheel, as of the current snapshot
     int getActiveTagCount();
-    int findTagData(std::string &rawMacAddress);
-    MiTagData *getTagDataAt(int i);
+    int findTagData(mac_key_t mac);
     bool isTagActive(MiTagData *tagData);
+    // Next online/offline transition, oldest first; for a single consumer
+    // task. Transitions are dropped while TAG_PRESENCE_QUEUE_LENGTH wait.
+    bool pollPresenceEvent(TagPresenceEvent &event);
+    // The event pollPresenceEvent returns next, left queued until it is sent
+    bool peekPresenceEvent(TagPresenceEvent &event);
+    uint32_t getPresenceEventsDropped();
+    // True if a registered 0x181A format accepts service data of this length
     bool isMiTagDataValid(std::string &rawData);
 
+    bool setTagCapacity(int tagCapacity);
+    int getTagCapacity();
+    TagStoreMemoryUsage getTagStoreMemoryUsage();
+    void setEvictionPolicy(coldsenses_eviction_policy policy);
+    coldsenses_eviction_policy getEvictionPolicy();
+    MiTagEvictionStats getEvictionStats();
+    MiTagIngestStats getIngestStats();
+    // Adverts decoded but not stored yet
+    uint32_t getIngestPending();
+    uint32_t getAdvertTotal();
+    MiTagReceptionSummary getReceptionSummary();
+
+    // Taken up by the next scan()
+    void setScanPolicy(coldsenses_scan_policy policy);
+    coldsenses_scan_policy getScanPolicy();
+    int getScanDutyPercent();
+    // Samples the uplink has not published yet; a backlog narrows the scan
+    // window to give Wi-Fi more airtime
+    void setUplinkBacklog(int pending);
+
+    // In VSERVESAFE_SCANMODE_SELECTED_SCAN only tags on the notify list are
+    // scanned: by the controller accept list and duplicate filter while the
+    // list fits BLE_ACCEPT_LIST_SIZE, by the host otherwise
+    void setScanMode(coldsenses_scan_mode mode);
+    coldsenses_scan_mode getScanMode();
+    bool isControllerFiltering();
+    uint32_t getHostFilteredCount();
+
+    // Tags registered for this site. Once any is added, adverts from other
+    // addresses are dropped before they are parsed. Kept in flash.
+    void allowTag(mac_key_t mac);
+    void clearAllowList();
+    uint32_t getAllowListCount();
+    uint32_t getAllowListRejected();
+
+    // Names are cached per MAC and kept in flash, as passive scans (the
+    // default) do not get them from scan responses
+    void setTagName(mac_key_t mac, const char *name);
+    // Copies the tag name (TAG_NAME_LENGTH + 1 bytes), empty if it has none
+    void getTagName(MiTagData *tagData, char *name);
+    // Reception of a stored tag; false if it left the table
+    bool getTagReception(MiTagData *tagData, TagReceptionStats &reception);
+    int getTagNameCount();
+    // Samples of the last TAG_HISTORY_LENGTH periods with a ts in
+    // [fromTs, toTs], oldest first; returns the number written
+    int getTagHistory(MiTagData *tagData, uint32_t fromTs, uint32_t toTs, TagHistorySample *samples,
+                      int maxSamples);
+    int getUnnamedTagCount();
+    uint32_t getNameWindowCount();
+
+    // Changes whenever tags are added, updated with a new sample or removed
+    uint32_t getRevision();
+    // True if the tag has a sample that has not been published yet
+    bool isTagDirty(MiTagData *tagData);
+    void markTagPublished(mac_key_t mac, uint32_t sampleSeq);
+
+    // Encrypted MiBeacon tags are decoded once their bindkey is set
+    bool setBindKey(mac_key_t mac, const uint8_t *bindKey);
+    bool removeBindKey(mac_key_t mac);
+    int getBindKeyCount();
+    MiBeaconStats getMiBeaconStats();
+
     int getTagNotifyDataCount();
     void addTagNotifyData(MiTagNotifyData &notifyData);
     void clearTagNotifyDataResults();
-    int findTagNotifyData(std::string &rawMacAddress);
-    bool isTagNotifyDataExists(std::string &rawMacAddress);
-    coldsenses_notify_result getTagNotifyResult(std::string &rawMacAddress);
+    // Server pushed thresholds are queued and applied by the ingest task a
+    // batch at a time, so a large set neither holds the store lock for long
+    // nor stalls the caller's task on it. For one producer task (the MQTT
+    // client); returns false, and counts the drop, if the queue is full.
+    bool queueTagNotifyData(MiTagNotifyData &notifyData);
+    bool queueRemoveTagNotifyData(mac_key_t mac);
+    bool queueClearTagNotifyData();
+    // Queued threshold changes not applied yet
+    uint32_t getTagNotifyPending();
+    uint32_t getTagNotifyDropped();
+    bool isTagNotifyDataExists(mac_key_t mac);
+    // Kept in the tag record, evaluated when a sample or its thresholds
+    // arrive; O(1), e.g. on a snapshot record. HIGH or LOW only while the
+    // tag's alarm is raised.
+    coldsenses_notify_result getTagNotifyResult(MiTagData *tagData);
+
+    // Hysteresis, dwell and re-arm of every tag's alarm; a change applies
+    // from the next sample
+    void setAlarmConfig(TagAlarmConfig &config);
+    TagAlarmConfig getAlarmConfig();
+    // Next raised/cleared alarm, oldest first; for a single consumer task.
+    // Changing or removing a raised tag's thresholds clears its alarm.
+    bool pollAlarmEvent(TagAlarmEvent &event);
+    // The event pollAlarmEvent returns next, left queued until it is sent
+    bool peekAlarmEvent(TagAlarmEvent &event);
+    uint32_t getAlarmEventsDropped();
+    // Kept up to date as alarm and presence events are queued; O(1)
+    MiTagAlarmCounts getAlarmCounts();
+
+    // Alert rules (see compileTagRule) for all tags (scope MAC_KEY_EMPTY) or
+    // one tag. A sample runs only its tag's rules that read a value it
+    // changed; rules reading the offline time also run every
+    // TAG_RULE_SWEEP_INTERVAL. Setting a rule runs it on every stored tag.
+    // Returns false if the expression does not compile or the set is full.
+    bool setTagRule(const char *name, mac_key_t scope, const char *expression, size_t len);
+    bool removeTagRule(const char *name);
+    void clearTagRules();
+    int getTagRuleCount();
+    // Next rule starting or stopping to hold for a tag, oldest first; for a
+    // single consumer task
+    bool pollRuleEvent(TagRuleEvent &event);
+    // The event pollRuleEvent returns next, left queued until it is sent
+    bool peekRuleEvent(TagRuleEvent &event);
+    uint32_t getRuleEventsDropped();
 };
 
 #endif
\ No newline at end of file
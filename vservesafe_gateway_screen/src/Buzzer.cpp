@@ -0,0 +1,97 @@
+#include "Buzzer.h"
+
+#include "hal/HalBuzzer.h"
+
+// Alternating on/off durations (ms), starting on; repeated
+static const uint16_t BUZZER_OFFLINE_STEPS[] = {50, 9950};
+static const uint16_t BUZZER_LOW_STEPS[] = {400, 1600};
+static const uint16_t BUZZER_HIGH_STEPS[] = {100, 100, 100, 100, 100, 1000};
+
+typedef struct
+{
+  const uint16_t *steps;
+  uint8_t count;
+} BuzzerPattern;
+
+static const BuzzerPattern BUZZER_PATTERNS[] = {
+    {NULL, 0},
+    {BUZZER_OFFLINE_STEPS, sizeof(BUZZER_OFFLINE_STEPS) / sizeof(BUZZER_OFFLINE_STEPS[0])},
+    {BUZZER_LOW_STEPS, sizeof(BUZZER_LOW_STEPS) / sizeof(BUZZER_LOW_STEPS[0])},
+    {BUZZER_HIGH_STEPS, sizeof(BUZZER_HIGH_STEPS) / sizeof(BUZZER_HIGH_STEPS[0])},
+};
+
+AlarmBuzzer::AlarmBuzzer()
+{
+  this->_pattern.store(VSERVESAFE_BUZZER_OFF);
+}
+
+bool AlarmBuzzer::begin(int gpio)
+{
+  if (!halBuzzerBegin(gpio))
+  {
+    return false;
+  }
+  return xTaskCreatePinnedToCore(_sequenceTask, "buzzer", BUZZER_TASK_STACK, this, BUZZER_TASK_PRIORITY,
+                                 &this->_task, BUZZER_TASK_CORE) == pdPASS;
+}
+
+void AlarmBuzzer::play(coldsenses_buzzer_pattern pattern)
+{
+  if (this->_pattern.exchange(pattern) != pattern && this->_task)
+  {
+    xTaskNotifyGive(this->_task);
+  }
+}
+
+coldsenses_buzzer_pattern AlarmBuzzer::getPattern()
+{
+  return (coldsenses_buzzer_pattern)this->_pattern.load();
+}
+
+// Sole owner of the output. Woken by play() when the cadence changes, else
+// only on the next edge.
+void AlarmBuzzer::_sequenceTask(void *arg)
+{
+  AlarmBuzzer *buzzer = (AlarmBuzzer *)arg;
+  uint8_t playing = VSERVESAFE_BUZZER_OFF;
+  uint8_t step = 0;
+  TickType_t edgeTick = xTaskGetTickCount();
+  halBuzzerOutput(false);
+  while (true)
+  {
+    uint8_t pattern = buzzer->_pattern.load();
+    if (pattern != playing)
+    {
+      playing = pattern;
+      step = 0;
+      edgeTick = xTaskGetTickCount();
+      if (playing == VSERVESAFE_BUZZER_OFF)
+      {
+        halBuzzerOutput(false);
+      }
+    }
+    if (playing == VSERVESAFE_BUZZER_OFF)
+    {
+      ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+      continue;
+    }
+
+    TickType_t now = xTaskGetTickCount();
+    if ((int32_t)(edgeTick - now) > 0)
+    {
+      ulTaskNotifyTake(pdTRUE, edgeTick - now);
+      continue;
+    }
+
+    const BuzzerPattern &cadence = BUZZER_PATTERNS[playing];
+    halBuzzerOutput(step % 2 == 0);
+    edgeTick += pdMS_TO_TICKS(cadence.steps[step]);
+    // Held off past the next edge: restart the schedule from now rather than
+    // catching up with a burst of short beeps
+    if ((int32_t)(edgeTick - now) <= 0)
+    {
+      edgeTick = now + pdMS_TO_TICKS(cadence.steps[step]);
+    }
+    step = (step + 1) % cadence.count;
+  }
+}
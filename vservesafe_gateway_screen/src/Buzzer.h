@@ -0,0 +1,44 @@
+#ifndef __VSERVESAFE_BUZZER__
+#define __VSERVESAFE_BUZZER__
+
+#include <stdint.h>
+#include <atomic>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "vservesafe_conf.h"
+
+// Cadences, most urgent last
+typedef enum
+{
+    VSERVESAFE_BUZZER_OFF,
+    // A tag silent past TAG_ONLINE_TIEMOUT: a short chirp every 10 s
+    VSERVESAFE_BUZZER_OFFLINE,
+    // Below the low limit: one long beep every 2 s
+    VSERVESAFE_BUZZER_LOW,
+    // Above the high limit: three quick beeps every 1.5 s
+    VSERVESAFE_BUZZER_HIGH,
+} coldsenses_buzzer_pattern;
+
+// Plays a cadence on the buzzer until told otherwise. A task of its own
+// switches the output on each edge and sleeps in between, so the cadence
+// does not follow how long loop() blocks and costs nothing between edges.
+// Edges are kept on an absolute schedule, so they do not drift either.
+class AlarmBuzzer
+{
+private:
+    TaskHandle_t _task = NULL;
+    std::atomic<uint8_t> _pattern;
+
+    static void _sequenceTask(void *arg);
+
+public:
+    AlarmBuzzer();
+
+    bool begin(int gpio);
+    // Starts the cadence from its first beep; the same cadence again keeps
+    // playing where it is
+    void play(coldsenses_buzzer_pattern pattern);
+    coldsenses_buzzer_pattern getPattern();
+};
+
+#endif
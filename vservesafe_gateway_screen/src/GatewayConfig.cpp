@@ -0,0 +1,657 @@
+#include "GatewayConfig.h"
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hal/HalMemory.h"
+#include "hal/HalStorage.h"
+
+#define GATEWAY_CONFIG_PATH ("/gwconfig.bin")
+#define GATEWAY_CONFIG_MAGIC (0x47434647)
+
+// A threshold update takes at least a comma and a 12 digit MAC, so a chunk
+// applied once the queue is empty always fits in it
+static_assert(VSERVESAFE_MQTT_BUFFER_SIZE / 13 <= TAG_NOTIFY_QUEUE_LENGTH,
+              "a config chunk can carry more limits than TAG_NOTIFY_QUEUE_LENGTH");
+
+// Saved config: this header, then per chunk a uint16_t length and its bytes
+typedef struct
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t chunkCount;
+} GatewayConfigHeader;
+
+static int hexValue(char c)
+{
+  if (c >= '0' && c <= '9')
+  {
+    return c - '0';
+  }
+  c = tolower((unsigned char)c);
+  if (c >= 'a' && c <= 'f')
+  {
+    return c - 'a' + 10;
+  }
+  return -1;
+}
+
+static bool parseHexBytes(const char *text, size_t len, uint8_t *out, size_t outLen)
+{
+  if (len != outLen * 2)
+  {
+    return false;
+  }
+  for (size_t i = 0; i < outLen; i++)
+  {
+    int high = hexValue(text[i * 2]);
+    int low = hexValue(text[i * 2 + 1]);
+    if (high < 0 || low < 0)
+    {
+      return false;
+    }
+    out[i] = (uint8_t)((high << 4) | low);
+  }
+  return true;
+}
+
+static bool parseMacKey(const char *text, size_t len, mac_key_t &out)
+{
+  std::string macAddress(text, len);
+  int digits = 0;
+  for (size_t i = 0; i < len; i++)
+  {
+    if (isxdigit((unsigned char)text[i]))
+    {
+      digits += 1;
+    }
+    else if (text[i] != ':' && text[i] != '-')
+    {
+      return false;
+    }
+  }
+  if (digits != 12)
+  {
+    return false;
+  }
+  out = MiTagScanner::toMacKey(macAddress);
+  return true;
+}
+
+// Degrees with up to two decimals, e.g. "-2.5", to hundredths
+static bool parseCenti(const char *text, size_t len, int16_t &out)
+{
+  size_t pos = 0;
+  bool isNegative = len > 0 && text[0] == '-';
+  if (isNegative)
+  {
+    pos += 1;
+  }
+  int32_t centi = 0;
+  int digits = 0;
+  int decimals = -1;
+  for (; pos < len; pos++)
+  {
+    if (text[pos] == '.' && decimals < 0)
+    {
+      decimals = 0;
+      continue;
+    }
+    if (!isdigit((unsigned char)text[pos]) || decimals >= 2 || centi > 100000)
+    {
+      return false;
+    }
+    centi = centi * 10 + (text[pos] - '0');
+    digits += 1;
+    if (decimals >= 0)
+    {
+      decimals += 1;
+    }
+  }
+  for (int i = decimals < 0 ? 0 : decimals; i < 2; i++)
+  {
+    centi *= 10;
+  }
+  centi = isNegative ? -centi : centi;
+  if (digits == 0 || centi < -INT16_MAX || centi > INT16_MAX)
+  {
+    return false;
+  }
+  out = (int16_t)centi;
+  return true;
+}
+
+// "<low>,<high>" and the rest of the value after it
+static bool parseLimits(const char *value, size_t valueLen, MiTagNotifyData &notifyData, size_t &restPos)
+{
+  const char *comma1 = (const char *)memchr(value, ',', valueLen);
+  if (!comma1)
+  {
+    return false;
+  }
+  size_t highPos = comma1 - value + 1;
+  const char *comma2 = (const char *)memchr(value + highPos, ',', valueLen - highPos);
+  size_t highEnd = comma2 ? comma2 - value : valueLen;
+  if (!parseCenti(value, comma1 - value, notifyData.lowCenti) ||
+      !parseCenti(value + highPos, highEnd - highPos, notifyData.highCenti) ||
+      notifyData.lowCenti >= notifyData.highCenti)
+  {
+    return false;
+  }
+  notifyData.isNotify = true;
+  restPos = comma2 ? highEnd + 1 : valueLen;
+  return true;
+}
+
+static bool parseUnsigned(const char *text, size_t len, uint32_t &out)
+{
+  std::string value(text, len);
+  char *end;
+  unsigned long number = strtoul(value.c_str(), &end, 10);
+  if (value.empty() || !isdigit((unsigned char)value[0]) || *end != '\0' || number > UINT32_MAX)
+  {
+    return false;
+  }
+  out = number;
+  return true;
+}
+
+// Whole seconds, at most a day, to ms
+static bool parseSeconds(const char *text, size_t len, uint32_t &outMs)
+{
+  std::string value(text, len);
+  char *end;
+  long seconds = strtol(value.c_str(), &end, 10);
+  if (value.empty() || *end != '\0' || seconds < 0 || seconds > 86400)
+  {
+    return false;
+  }
+  outMs = seconds * 1000;
+  return true;
+}
+
+static bool parseRuleName(const char *text, size_t len, char *name)
+{
+  if (len == 0 || len > TAG_RULE_NAME_LENGTH)
+  {
+    return false;
+  }
+  for (size_t i = 0; i < len; i++)
+  {
+    if (!isalnum((unsigned char)text[i]) && text[i] != '_' && text[i] != '-')
+    {
+      return false;
+    }
+    name[i] = text[i];
+  }
+  name[len] = '\0';
+  return true;
+}
+
+static bool applyRecord(MiTagScanner &scanner, const char *name, size_t nameLen, const char *value, size_t valueLen)
+{
+  if (nameLen == 7 && strncmp(name, "bindkey", nameLen) == 0)
+  {
+    const char *comma = (const char *)memchr(value, ',', valueLen);
+    mac_key_t mac;
+    uint8_t bindKey[MIBEACON_BINDKEY_SIZE];
+    if (!comma || !parseMacKey(value, comma - value, mac) ||
+        !parseHexBytes(comma + 1, valueLen - (comma - value) - 1, bindKey, sizeof(bindKey)))
+    {
+      return false;
+    }
+    return scanner.setBindKey(mac, bindKey);
+  }
+
+  if (nameLen == 9 && strncmp(name, "unbindkey", nameLen) == 0)
+  {
+    mac_key_t mac;
+    return parseMacKey(value, valueLen, mac) && scanner.removeBindKey(mac);
+  }
+
+  if (nameLen == 8 && strncmp(name, "capacity", nameLen) == 0)
+  {
+    std::string text(value, valueLen);
+    char *end;
+    long capacity = strtol(text.c_str(), &end, 10);
+    if (text.empty() || *end != '\0' || capacity < 1 || capacity > TAG_STORE_MAX_CAPACITY)
+    {
+      return false;
+    }
+    return scanner.setTagCapacity(capacity);
+  }
+
+  if (nameLen == 5 && strncmp(name, "allow", nameLen) == 0)
+  {
+    // Comma separated, so one message carries many MACs
+    size_t pos = 0;
+    int allowed = 0;
+    while (pos < valueLen)
+    {
+      const char *comma = (const char *)memchr(value + pos, ',', valueLen - pos);
+      size_t end = comma ? comma - value : valueLen;
+      mac_key_t mac;
+      if (!parseMacKey(value + pos, end - pos, mac))
+      {
+        return false;
+      }
+      scanner.allowTag(mac);
+      allowed += 1;
+      pos = end + 1;
+    }
+    return allowed > 0;
+  }
+
+  if (nameLen == 9 && strncmp(name, "allowlist", nameLen) == 0)
+  {
+    if (valueLen == 5 && strncmp(value, "clear", valueLen) == 0)
+    {
+      scanner.clearAllowList();
+      return true;
+    }
+    return false;
+  }
+
+  if (nameLen == 4 && strncmp(name, "name", nameLen) == 0)
+  {
+    const char *comma = (const char *)memchr(value, ',', valueLen);
+    mac_key_t mac;
+    size_t tagNameLen = comma ? valueLen - (comma - value) - 1 : 0;
+    if (!comma || !parseMacKey(value, comma - value, mac) || tagNameLen == 0 || tagNameLen > TAG_NAME_LENGTH)
+    {
+      return false;
+    }
+    std::string tagName(comma + 1, tagNameLen);
+    scanner.setTagName(mac, tagName.c_str());
+    return true;
+  }
+
+  if (nameLen == 5 && strncmp(name, "limit", nameLen) == 0)
+  {
+    const char *comma = (const char *)memchr(value, ',', valueLen);
+    MiTagNotifyData notifyData;
+    size_t limitsPos = comma ? comma - value + 1 : 0;
+    size_t restPos;
+    if (!comma || !parseMacKey(value, comma - value, notifyData.mac) ||
+        !parseLimits(value + limitsPos, valueLen - limitsPos, notifyData, restPos) ||
+        restPos != valueLen - limitsPos)
+    {
+      return false;
+    }
+    return scanner.queueTagNotifyData(notifyData);
+  }
+
+  if (nameLen == 6 && strncmp(name, "limits", nameLen) == 0)
+  {
+    if (valueLen == 5 && strncmp(value, "clear", valueLen) == 0)
+    {
+      return scanner.queueClearTagNotifyData();
+    }
+
+    // One range for many tags, e.g. all tags of a cold room
+    MiTagNotifyData notifyData;
+    size_t pos;
+    if (!parseLimits(value, valueLen, notifyData, pos))
+    {
+      return false;
+    }
+    int queued = 0;
+    while (pos < valueLen)
+    {
+      const char *comma = (const char *)memchr(value + pos, ',', valueLen - pos);
+      size_t end = comma ? comma - value : valueLen;
+      if (!parseMacKey(value + pos, end - pos, notifyData.mac) || !scanner.queueTagNotifyData(notifyData))
+      {
+        return false;
+      }
+      queued += 1;
+      pos = end + 1;
+    }
+    return queued > 0;
+  }
+
+  if (nameLen == 7 && strncmp(name, "unlimit", nameLen) == 0)
+  {
+    mac_key_t mac;
+    if (!parseMacKey(value, valueLen, mac))
+    {
+      return false;
+    }
+    return scanner.queueRemoveTagNotifyData(mac);
+  }
+
+  if (nameLen == 5 && strncmp(name, "alarm", nameLen) == 0)
+  {
+    const char *comma1 = (const char *)memchr(value, ',', valueLen);
+    const char *comma2 = comma1 ? (const char *)memchr(comma1 + 1, ',', valueLen - (comma1 - value) - 1) : NULL;
+    TagAlarmConfig config;
+    if (!comma2 || !parseCenti(value, comma1 - value, config.hysteresisCenti) || config.hysteresisCenti < 0 ||
+        !parseSeconds(comma1 + 1, comma2 - comma1 - 1, config.dwellMs) ||
+        !parseSeconds(comma2 + 1, valueLen - (comma2 - value) - 1, config.rearmMs))
+    {
+      return false;
+    }
+    scanner.setAlarmConfig(config);
+    return true;
+  }
+
+  if (nameLen == 4 && strncmp(name, "rule", nameLen) == 0)
+  {
+    const char *comma1 = (const char *)memchr(value, ',', valueLen);
+    const char *comma2 = comma1 ? (const char *)memchr(comma1 + 1, ',', valueLen - (comma1 - value) - 1) : NULL;
+    char ruleName[TAG_RULE_NAME_LENGTH + 1];
+    mac_key_t scope = MAC_KEY_EMPTY;
+    size_t scopeLen = comma2 ? comma2 - comma1 - 1 : 0;
+    if (!comma2 || !parseRuleName(value, comma1 - value, ruleName) ||
+        !((scopeLen == 1 && comma1[1] == '*') || parseMacKey(comma1 + 1, scopeLen, scope)))
+    {
+      return false;
+    }
+    return scanner.setTagRule(ruleName, scope, comma2 + 1, valueLen - (comma2 - value) - 1);
+  }
+
+  if (nameLen == 6 && strncmp(name, "unrule", nameLen) == 0)
+  {
+    char ruleName[TAG_RULE_NAME_LENGTH + 1];
+    return parseRuleName(value, valueLen, ruleName) && scanner.removeTagRule(ruleName);
+  }
+
+  if (nameLen == 5 && strncmp(name, "rules", nameLen) == 0)
+  {
+    if (valueLen == 5 && strncmp(value, "clear", valueLen) == 0)
+    {
+      scanner.clearTagRules();
+      return true;
+    }
+    return false;
+  }
+
+  if (nameLen == 4 && strncmp(name, "scan", nameLen) == 0)
+  {
+    if (valueLen == 5 && strncmp(value, "fixed", valueLen) == 0)
+    {
+      scanner.setScanPolicy(VSERVESAFE_SCAN_POLICY_FIXED);
+      return true;
+    }
+    if (valueLen == 8 && strncmp(value, "adaptive", valueLen) == 0)
+    {
+      scanner.setScanPolicy(VSERVESAFE_SCAN_POLICY_ADAPTIVE);
+      return true;
+    }
+    return false;
+  }
+
+  return false;
+}
+
+String buildGatewayConfigTopic(String &deviceMAC)
+{
+  String topic = "gwcfg_";
+  topic += deviceMAC;
+  return topic;
+}
+
+int applyGatewayConfig(MiTagScanner &scanner, const char *payload, size_t len)
+{
+  int applied = 0;
+  size_t pos = 0;
+  while (pos < len)
+  {
+    size_t end = pos;
+    while (end < len && payload[end] != '\n' && payload[end] != ';')
+    {
+      end += 1;
+    }
+
+    size_t recordEnd = end;
+    while (recordEnd > pos && isspace((unsigned char)payload[recordEnd - 1]))
+    {
+      recordEnd -= 1;
+    }
+    while (pos < recordEnd && isspace((unsigned char)payload[pos]))
+    {
+      pos += 1;
+    }
+
+    const char *record = payload + pos;
+    const char *colon = (const char *)memchr(record, ':', recordEnd - pos);
+    if (colon && applyRecord(scanner, record, colon - record, colon + 1, payload + recordEnd - colon - 1))
+    {
+      applied += 1;
+    }
+    pos = end + 1;
+  }
+  return applied;
+}
+
+GatewayConfigChunks::~GatewayConfigChunks()
+{
+  this->end();
+}
+
+bool GatewayConfigChunks::begin()
+{
+  if (this->_chunks)
+  {
+    return true;
+  }
+  this->_chunks = (char *)halAllocLarge(VSERVESAFE_CONFIG_MAX_CHUNKS * VSERVESAFE_MQTT_BUFFER_SIZE);
+  memset(this->_chunkLens, 0, sizeof(this->_chunkLens));
+  memset(this->_chunkVersions, 0, sizeof(this->_chunkVersions));
+  return this->_chunks != nullptr;
+}
+
+void GatewayConfigChunks::end()
+{
+  halFree(this->_chunks);
+  this->_chunks = nullptr;
+  this->_version = 0;
+  this->_chunkCount = 0;
+  this->_nextChunk = -1;
+}
+
+char *GatewayConfigChunks::_chunkAt(int index)
+{
+  return this->_chunks + index * VSERVESAFE_MQTT_BUFFER_SIZE;
+}
+
+bool GatewayConfigChunks::restore()
+{
+  size_t size =
+      sizeof(GatewayConfigHeader) + VSERVESAFE_CONFIG_MAX_CHUNKS * (sizeof(uint16_t) + VSERVESAFE_MQTT_BUFFER_SIZE);
+  uint8_t *buffer = this->_chunks && halStorageBegin() ? (uint8_t *)halAllocLarge(size) : NULL;
+  if (!buffer)
+  {
+    return false;
+  }
+  size_t len = halStorageRead(GATEWAY_CONFIG_PATH, buffer, size);
+  GatewayConfigHeader header;
+  bool isLoaded = len >= sizeof(header);
+  if (isLoaded)
+  {
+    memcpy(&header, buffer, sizeof(header));
+    isLoaded = header.magic == GATEWAY_CONFIG_MAGIC && header.version != 0 && header.chunkCount >= 1 &&
+               header.chunkCount <= VSERVESAFE_CONFIG_MAX_CHUNKS;
+  }
+  size_t pos = sizeof(header);
+  for (uint32_t i = 0; isLoaded && i < header.chunkCount; i++)
+  {
+    uint16_t chunkLen;
+    isLoaded = pos + sizeof(chunkLen) <= len;
+    if (isLoaded)
+    {
+      memcpy(&chunkLen, buffer + pos, sizeof(chunkLen));
+      pos += sizeof(chunkLen);
+      isLoaded = chunkLen <= VSERVESAFE_MQTT_BUFFER_SIZE && pos + chunkLen <= len;
+    }
+    if (isLoaded)
+    {
+      memcpy(this->_chunkAt(i), buffer + pos, chunkLen);
+      this->_chunkLens[i] = chunkLen;
+      this->_chunkVersions[i] = header.version;
+      pos += chunkLen;
+    }
+  }
+  halFree(buffer);
+  if (!isLoaded)
+  {
+    return false;
+  }
+
+  // Applied again by poll(); a broker copy of the same version, delivered
+  // meanwhile, is then skipped
+  this->_version = header.version;
+  this->_chunkCount = header.chunkCount;
+  this->_nextChunk = -1;
+  this->_startIfComplete();
+  return true;
+}
+
+void GatewayConfigChunks::_save()
+{
+  size_t size = sizeof(GatewayConfigHeader);
+  for (int i = 0; i < this->_chunkCount; i++)
+  {
+    size += sizeof(uint16_t) + this->_chunkLens[i];
+  }
+  uint8_t *buffer = halStorageBegin() ? (uint8_t *)halAllocLarge(size) : NULL;
+  if (!buffer)
+  {
+    return;
+  }
+  GatewayConfigHeader header = {GATEWAY_CONFIG_MAGIC, this->_version, (uint32_t)this->_chunkCount};
+  memcpy(buffer, &header, sizeof(header));
+  size_t pos = sizeof(header);
+  for (int i = 0; i < this->_chunkCount; i++)
+  {
+    memcpy(buffer + pos, &this->_chunkLens[i], sizeof(uint16_t));
+    pos += sizeof(uint16_t);
+    memcpy(buffer + pos, this->_chunkAt(i), this->_chunkLens[i]);
+    pos += this->_chunkLens[i];
+  }
+  if (!halStorageWrite(GATEWAY_CONFIG_PATH, buffer, pos))
+  {
+    Serial.print("Save error: ");
+    Serial.println(GATEWAY_CONFIG_PATH);
+  }
+  halFree(buffer);
+}
+
+void GatewayConfigChunks::_startIfComplete()
+{
+  if (this->_nextChunk != -1 || this->_version == 0 || this->_version == this->_appliedVersion)
+  {
+    return;
+  }
+  for (int i = 0; i < this->_chunkCount; i++)
+  {
+    if (this->_chunkVersions[i] != this->_version)
+    {
+      return;
+    }
+  }
+  this->_nextChunk = 0;
+}
+
+int GatewayConfigChunks::receive(MiTagScanner &scanner, const String &configTopic, const String &topic,
+                                 const char *payload, size_t len)
+{
+  size_t headerEnd = 0;
+  while (headerEnd < len && payload[headerEnd] != '\n' && payload[headerEnd] != ';')
+  {
+    headerEnd += 1;
+  }
+  size_t valueEnd = headerEnd;
+  while (valueEnd > 0 && isspace((unsigned char)payload[valueEnd - 1]))
+  {
+    valueEnd -= 1;
+  }
+
+  if (topic == configTopic)
+  {
+    if (valueEnd < 7 || strncmp(payload, "config:", 7) != 0)
+    {
+      return applyGatewayConfig(scanner, payload, len);
+    }
+    const char *comma = (const char *)memchr(payload + 7, ',', valueEnd - 7);
+    uint32_t version;
+    uint32_t chunkCount;
+    if (!this->_chunks || !comma || !parseUnsigned(payload + 7, comma - payload - 7, version) ||
+        !parseUnsigned(comma + 1, payload + valueEnd - comma - 1, chunkCount) || version == 0 ||
+        chunkCount < 1 || chunkCount > VSERVESAFE_CONFIG_MAX_CHUNKS)
+    {
+      return 0;
+    }
+    if (version != this->_version)
+    {
+      // The new version replaces the one being applied
+      this->_nextChunk = -1;
+    }
+    this->_version = version;
+    this->_chunkCount = chunkCount;
+    this->_startIfComplete();
+    return 0;
+  }
+
+  // <configTopic>/<index>
+  const char *chunkTopic = topic.c_str();
+  size_t baseLen = configTopic.length();
+  uint32_t index;
+  uint32_t version;
+  if (!this->_chunks || topic.length() <= baseLen + 1 || strncmp(chunkTopic, configTopic.c_str(), baseLen) != 0 ||
+      chunkTopic[baseLen] != '/' || !parseUnsigned(chunkTopic + baseLen + 1, topic.length() - baseLen - 1, index) ||
+      index >= VSERVESAFE_CONFIG_MAX_CHUNKS || len > VSERVESAFE_MQTT_BUFFER_SIZE || valueEnd < 6 ||
+      strncmp(payload, "chunk:", 6) != 0 || !parseUnsigned(payload + 6, valueEnd - 6, version) || version == 0)
+  {
+    return 0;
+  }
+  if (this->_nextChunk != -1 && version != this->_version && (int)index >= this->_nextChunk &&
+      (int)index < this->_chunkCount)
+  {
+    // Would overwrite a chunk still to be applied; its version's manifest
+    // starts it again
+    this->_nextChunk = -1;
+  }
+  memcpy(this->_chunkAt(index), payload, len);
+  this->_chunkLens[index] = len;
+  this->_chunkVersions[index] = version;
+  this->_startIfComplete();
+  return 0;
+}
+
+int GatewayConfigChunks::poll(MiTagScanner &scanner)
+{
+  if (this->_nextChunk == -1 || scanner.getTagNotifyPending() > 0)
+  {
+    return 0;
+  }
+
+  // Skip the chunk:<version> record
+  const char *chunk = this->_chunkAt(this->_nextChunk);
+  size_t len = this->_chunkLens[this->_nextChunk];
+  size_t pos = 0;
+  while (pos < len && chunk[pos] != '\n' && chunk[pos] != ';')
+  {
+    pos += 1;
+  }
+  int applied = pos < len ? applyGatewayConfig(scanner, chunk + pos + 1, len - pos - 1) : 0;
+
+  this->_nextChunk += 1;
+  if (this->_nextChunk == this->_chunkCount)
+  {
+    this->_nextChunk = -1;
+    this->_appliedVersion = this->_version;
+    this->_save();
+  }
+  return applied;
+}
+
+bool GatewayConfigChunks::isApplying()
+{
+  return this->_nextChunk != -1;
+}
+
+uint32_t GatewayConfigChunks::getAppliedVersion()
+{
+  return this->_appliedVersion;
+}
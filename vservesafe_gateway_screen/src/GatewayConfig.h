@@ -0,0 +1,87 @@
+#ifndef __VSERVESAFE_GATEWAY_CONFIG__
+#define __VSERVESAFE_GATEWAY_CONFIG__
+
+#include <Arduino.h>
+#include "BLE.h"
+
+// Config records pushed to the "gwcfg_<gateway MAC>" topic, one per line (or
+// separated by ';'), in the same "name:value" style as tag payloads:
+//   bindkey:<tag MAC>,<32 hex digits>
+//   unbindkey:<tag MAC>
+//   capacity:<tags>
+//   scan:fixed|adaptive
+//   allow:<tag MAC>[,<tag MAC>...]
+//   allowlist:clear
+//   name:<tag MAC>,<name>
+//   limit:<tag MAC>,<low>,<high>
+//   limits:<low>,<high>,<tag MAC>[,<tag MAC>...]
+//   unlimit:<tag MAC>
+//   limits:clear
+//   alarm:<hysteresis>,<dwell s>,<re-arm s>
+//   rule:<name>,<tag MAC>|*,<expression>
+//   unrule:<name>
+//   rules:clear
+// Limits are in degrees with up to two decimals; the tag alarms at or
+// outside them. They are applied by the ingest task in batches. The alarm
+// record sets, for all tags, how long a limit must stay crossed before the
+// alarm is raised, how far (degrees) back inside it clears and how long after
+// that it cannot be raised again. A rule (see compileTagRule) is for one tag
+// or, with *, for all; its name is letters, digits, '_' and '-'.
+//
+// A message holds at most VSERVESAFE_MQTT_BUFFER_SIZE bytes, topic included,
+// and a retained topic keeps only its last message. A config is therefore
+// published as a version split into chunks, each retained on its own topic,
+// and a manifest naming the version:
+//   gwcfg_<gateway MAC>/<index>  chunk:<version>, then records; index from 0
+//   gwcfg_<gateway MAC>          config:<version>,<chunk count>
+// Each version is the whole config, so it should start with the clear
+// records. It is applied once every chunk of the version the manifest names
+// is in, and kept in flash so it is applied again at start. Records sent to
+// gwcfg_<gateway MAC> without a manifest are applied as they come and not
+// kept.
+String buildGatewayConfigTopic(String &deviceMAC);
+// Returns the number of records applied; unknown or malformed records, and
+// limits the scanner's queue has no room for, are skipped
+int applyGatewayConfig(MiTagScanner &scanner, const char *payload, size_t len);
+
+// Collects the chunks of config versions from the MQTT task and applies a
+// complete one, a chunk at a time
+class GatewayConfigChunks
+{
+private:
+    // VSERVESAFE_CONFIG_MAX_CHUNKS payloads in PSRAM
+    char *_chunks = nullptr;
+    uint16_t _chunkLens[VSERVESAFE_CONFIG_MAX_CHUNKS];
+    uint32_t _chunkVersions[VSERVESAFE_CONFIG_MAX_CHUNKS];
+    // Named by the latest manifest
+    uint32_t _version = 0;
+    int _chunkCount = 0;
+    uint32_t _appliedVersion = 0;
+    // Next chunk of _version to apply, -1 when none is being applied
+    int _nextChunk = -1;
+
+    char *_chunkAt(int index);
+    void _startIfComplete();
+    void _save();
+
+public:
+    ~GatewayConfigChunks();
+
+    bool begin();
+    void end();
+    // Loads the version applied last from flash; poll() applies it again
+    bool restore();
+    // A message on the config topics (subscribe to configTopic and
+    // configTopic/+). Records without a manifest are applied at once and
+    // counted in the result; manifests and chunks wait for poll().
+    int receive(MiTagScanner &scanner, const String &configTopic, const String &topic, const char *payload,
+                size_t len);
+    // Applies the next chunk of a complete version once the scanner has taken
+    // the limits of the previous one; returns the records applied. Call on
+    // the task that calls receive().
+    int poll(MiTagScanner &scanner);
+    bool isApplying();
+    uint32_t getAppliedVersion();
+};
+
+#endif
@@ -0,0 +1,265 @@
+#include "GatewayOptions.h"
+
+#include <EEPROM.h>
+
+String wifiSSID = "";
+String wifiPassword = "";
+double gpsLatitude = 15.8700;
+double gpsLongitude = 100.9925;
+bool buzzerEnable;
+
+String inputTemp;
+String optionWifiSSID;
+String optionWifiPassword;
+double optionGpsLat;
+double optionGpsLng;
+bool optionBuzzerEnable;
+
+#if VSERVESAFE_ALLOW_EEPROM
+static void migrateEEPROMDataVersion();
+#if VSERVESAFE_DEBUG_EEPROM
+static void _displayOptionValues();
+#endif
+#endif
+
+#if VSERVESAFE_ALLOW_EEPROM
+void initEEPROM()
+{
+  if (!EEPROM.begin(EEPROM_TOTAL_BYTES))
+  {
+    Serial.println("EEPROM init error");
+    return;
+  }
+
+  uint64_t header = EEPROM.readULong64(EEPROM_HEADER_ADDR);
+
+#if VSERVESAFE_DEBUG_EEPROM
+  Serial.print("EEPROM header: ");
+  Serial.println(EEPROM_HEADER_KEY);
+  Serial.print("Actual: ");
+  Serial.println(header);
+  Serial.print("Equal?: ");
+  Serial.println(header == EEPROM_HEADER_KEY ? "T" : "F");
+#endif
+
+  if (header != EEPROM_HEADER_KEY)
+  {
+#if VSERVESAFE_DEBUG_EEPROM
+    Serial.println("Create New EEPROM Save");
+#endif
+    EEPROM.writeULong64(EEPROM_HEADER_ADDR, EEPROM_HEADER_KEY);
+    EEPROM.writeUShort(EEPROM_VERSION_ADDR, VSERVESAFE_GATEWAY_VERSION);
+    EEPROM.writeString(EEPROM_SSID_ADDR, wifiSSID);
+    EEPROM.writeString(EEPROM_WIFIPW_ADDR, wifiPassword);
+    EEPROM.writeDouble(EEPROM_GPSLAT_ADDR, gpsLatitude);
+    EEPROM.writeDouble(EEPROM_GPSLONG_ADDR, gpsLongitude);
+    EEPROM.writeBool(EEPROM_BUZZER_ENABLE_ADDR, buzzerEnable);
+    EEPROM.commit();
+#if VSERVESAFE_DEBUG_EEPROM
+    Serial.println("EEPROM Saved");
+#endif
+  }
+
+  migrateEEPROMDataVersion();
+
+#if VSERVESAFE_DEBUG_EEPROM
+  Serial.println("Load EEPROM Save");
+#endif
+
+  // Read values
+  wifiSSID = EEPROM.readString(EEPROM_SSID_ADDR);
+  wifiPassword = EEPROM.readString(EEPROM_WIFIPW_ADDR);
+  gpsLatitude = EEPROM.readDouble(EEPROM_GPSLAT_ADDR);
+  gpsLongitude = EEPROM.readDouble(EEPROM_GPSLONG_ADDR);
+  buzzerEnable = EEPROM.readBool(EEPROM_BUZZER_ENABLE_ADDR);
+
+#if VSERVESAFE_DEBUG_EEPROM
+  Serial.println("EEPROM Values");
+  _displayOptionValues();
+#endif
+}
+
+static void migrateEEPROMDataVersion()
+{
+
+#if VSERVESAFE_DEBUG_EEPROM
+  Serial.println("Check EEPROM Save Version");
+#endif
+  uint16_t version = EEPROM.readUShort(EEPROM_VERSION_ADDR);
+
+  if (version < 2)
+  {
+    EEPROM.writeBool(EEPROM_BUZZER_ENABLE_ADDR, buzzerEnable);
+  }
+
+  if (version < VSERVESAFE_GATEWAY_VERSION)
+  {
+    EEPROM.writeUShort(EEPROM_VERSION_ADDR, VSERVESAFE_GATEWAY_VERSION);
+    EEPROM.commit();
+  }
+
+#if VSERVESAFE_DEBUG_EEPROM
+  Serial.println("EEPROM Save Updated");
+#endif
+}
+
+void updateEEPROM()
+{
+#if VSERVESAFE_DEBUG_EEPROM
+  Serial.println("New EEPROM Values");
+  _displayOptionValues();
+#endif
+
+  EEPROM.writeULong64(EEPROM_HEADER_ADDR, EEPROM_HEADER_KEY);
+  EEPROM.writeUShort(EEPROM_VERSION_ADDR, VSERVESAFE_GATEWAY_VERSION);
+  EEPROM.writeString(EEPROM_SSID_ADDR, wifiSSID);
+  EEPROM.writeString(EEPROM_WIFIPW_ADDR, wifiPassword);
+  EEPROM.writeDouble(EEPROM_GPSLAT_ADDR, gpsLatitude);
+  EEPROM.writeDouble(EEPROM_GPSLONG_ADDR, gpsLongitude);
+  EEPROM.writeBool(EEPROM_BUZZER_ENABLE_ADDR, buzzerEnable);
+  EEPROM.commit();
+
+#if VSERVESAFE_DEBUG_EEPROM
+  bool isSuccess = EEPROM.commit();
+  Serial.print("Update EEPROM: ");
+  Serial.println(isSuccess ? "T" : "F");
+#else
+  EEPROM.commit();
+#endif
+}
+#if VSERVESAFE_DEBUG_EEPROM
+static void _displayOptionValues()
+{
+  Serial.print("wifiSSID: ");
+  Serial.println(wifiSSID);
+  Serial.print("wifiPassword: ");
+  Serial.println(wifiPassword);
+  Serial.print("gpsLatitude: ");
+  Serial.println(gpsLatitude);
+  Serial.print("gpsLongitude: ");
+  Serial.println(gpsLongitude);
+  Serial.print("buzzerEnable: ");
+  Serial.println(buzzerEnable ? "true" : "false");
+}
+#endif
+
+#endif
+
+bool isOptionDirty(coldsenses_input_target target)
+{
+  switch (target)
+  {
+  case VSERVESAFE_TARGET_WIFI_SSID:
+    return !wifiSSID.equals(optionWifiSSID);
+  case VSERVESAFE_TARGET_WIFI_PASSWORD:
+    return !wifiPassword.equals(optionWifiPassword);
+  case VSERVESAFE_TARGET_GPS_LATITUDE:
+    return gpsLatitude != optionGpsLat;
+  case VSERVESAFE_TARGET_GPS_LONGITUDE:
+    return gpsLongitude != optionGpsLng;
+  case VSERVESAFE_TARGET_ALARM_BUZZER:
+    return buzzerEnable != optionBuzzerEnable;
+  case VSERVESAFE_NO_TARGET:
+  default:
+    return false;
+  }
+}
+
+bool isOptionsDirty()
+{
+  return isOptionDirty(VSERVESAFE_TARGET_WIFI_SSID) || isOptionDirty(VSERVESAFE_TARGET_WIFI_PASSWORD) ||
+         isOptionDirty(VSERVESAFE_TARGET_GPS_LATITUDE) || isOptionDirty(VSERVESAFE_TARGET_GPS_LONGITUDE) ||
+         isOptionDirty(VSERVESAFE_TARGET_ALARM_BUZZER);
+}
+
+bool isOptionValid(coldsenses_input_target target)
+{
+  switch (target)
+  {
+  case VSERVESAFE_TARGET_WIFI_SSID:
+    return optionWifiSSID.length() > 0 && optionWifiSSID.length() <= SSID_MAXLENGTH;
+  case VSERVESAFE_TARGET_WIFI_PASSWORD:
+    return optionWifiPassword.length() <= WIFIPW_MAXLENGTH;
+  case VSERVESAFE_TARGET_GPS_LATITUDE:
+    return optionGpsLat >= -90 && optionGpsLat <= 90;
+  case VSERVESAFE_TARGET_GPS_LONGITUDE:
+    return optionGpsLng >= -180 && optionGpsLng <= 180;
+  case VSERVESAFE_TARGET_ALARM_BUZZER:
+    return true;
+  case VSERVESAFE_NO_TARGET:
+  default:
+    return false;
+  }
+}
+
+bool isOptionsValid()
+{
+  return isOptionValid(VSERVESAFE_TARGET_WIFI_SSID) && isOptionValid(VSERVESAFE_TARGET_WIFI_PASSWORD) &&
+         isOptionValid(VSERVESAFE_TARGET_GPS_LATITUDE) && isOptionValid(VSERVESAFE_TARGET_GPS_LONGITUDE) &&
+         isOptionValid(VSERVESAFE_TARGET_ALARM_BUZZER);
+}
+
+void restoreSaveToOptions()
+{
+  optionWifiSSID = String(wifiSSID);
+  optionWifiPassword = String(wifiPassword);
+  optionGpsLat = gpsLatitude;
+  optionGpsLng = gpsLongitude;
+  optionBuzzerEnable = buzzerEnable;
+}
+
+void commitOptionsToSave()
+{
+  wifiSSID = String(optionWifiSSID);
+  wifiPassword = String(optionWifiPassword);
+  gpsLatitude = optionGpsLat;
+  gpsLongitude = optionGpsLng;
+  buzzerEnable = optionBuzzerEnable;
+
+#if VSERVESAFE_ALLOW_EEPROM
+  updateEEPROM();
+#endif
+}
+
+void restoreOptionToTemp(coldsenses_input_target target)
+{
+  switch (target)
+  {
+  case VSERVESAFE_TARGET_WIFI_SSID:
+    inputTemp = String(optionWifiSSID);
+    break;
+  case VSERVESAFE_TARGET_WIFI_PASSWORD:
+    inputTemp = String(optionWifiPassword);
+    break;
+  case VSERVESAFE_TARGET_GPS_LATITUDE:
+    inputTemp = String(optionGpsLat, 8);
+    break;
+  case VSERVESAFE_TARGET_GPS_LONGITUDE:
+    inputTemp = String(optionGpsLng, 8);
+    break;
+  default:
+    break;
+  }
+}
+
+void applyValueToOption(String value, coldsenses_input_target target)
+{
+
+  switch (target)
+  {
+  case VSERVESAFE_TARGET_WIFI_SSID:
+    optionWifiSSID = String(value);
+    break;
+  case VSERVESAFE_TARGET_WIFI_PASSWORD:
+    optionWifiPassword = String(value);
+    break;
+  case VSERVESAFE_TARGET_GPS_LATITUDE:
+    optionGpsLat = String(value).toDouble();
+    break;
+  case VSERVESAFE_TARGET_GPS_LONGITUDE:
+    optionGpsLng = String(value).toDouble();
+    break;
+  default:
+    break;
+  }
+}
@@ -0,0 +1,46 @@
+#ifndef __VSERVESAFE_OPTIONS__
+#define __VSERVESAFE_OPTIONS__
+
+#include <Arduino.h>
+#include "vservesafe_conf.h"
+
+typedef enum
+{
+  VSERVESAFE_NO_TARGET,
+  VSERVESAFE_TARGET_WIFI_SSID,
+  VSERVESAFE_TARGET_WIFI_PASSWORD,
+  VSERVESAFE_TARGET_GPS_LATITUDE,
+  VSERVESAFE_TARGET_GPS_LONGITUDE,
+  VSERVESAFE_TARGET_ALARM_BUZZER,
+} coldsenses_input_target;
+
+// Saved values
+extern String wifiSSID;
+extern String wifiPassword;
+extern double gpsLatitude;
+extern double gpsLongitude;
+extern bool buzzerEnable;
+
+// Values being edited on the option screen
+extern String inputTemp;
+extern String optionWifiSSID;
+extern String optionWifiPassword;
+extern double optionGpsLat;
+extern double optionGpsLng;
+extern bool optionBuzzerEnable;
+
+#if VSERVESAFE_ALLOW_EEPROM
+void initEEPROM();
+void updateEEPROM();
+#endif
+
+bool isOptionDirty(coldsenses_input_target target);
+bool isOptionsDirty();
+bool isOptionValid(coldsenses_input_target target);
+bool isOptionsValid();
+void restoreSaveToOptions();
+void commitOptionsToSave();
+void restoreOptionToTemp(coldsenses_input_target target);
+void applyValueToOption(String value, coldsenses_input_target target);
+
+#endif
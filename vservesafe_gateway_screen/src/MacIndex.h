@@ -0,0 +1,209 @@
+#ifndef __VSERVESAFE_MAC_INDEX__
+#define __VSERVESAFE_MAC_INDEX__
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Packed 48-bit MAC address, most significant byte first (as printed)
+typedef uint64_t mac_key_t;
+
+#define MAC_KEY_EMPTY ((mac_key_t)0xFFFFFFFFFFFFFFFFULL)
+
+static inline uint32_t hashMacKey(mac_key_t key)
+{
+    key ^= key >> 29;
+    key *= 0xBF58476D1CE4E5B9ULL;
+    key ^= key >> 32;
+    return (uint32_t)key;
+}
+
+// Pack 6 address bytes stored least significant first (NimBLE native order,
+// pvvx frames)
+static inline mac_key_t macKeyFromLE(const uint8_t *bytes)
+{
+    mac_key_t key = 0;
+    for (int i = 5; i >= 0; i--)
+    {
+        key = (key << 8) | bytes[i];
+    }
+    return key;
+}
+
+// Pack 6 address bytes stored as printed
+static inline mac_key_t macKeyFromBE(const uint8_t *bytes)
+{
+    mac_key_t key = 0;
+    for (int i = 0; i < 6; i++)
+    {
+        key = (key << 8) | bytes[i];
+    }
+    return key;
+}
+
+// Unpack to 6 bytes least significant first (NimBLE native order)
+static inline void macKeyToLE(mac_key_t key, uint8_t *bytes)
+{
+    for (int i = 0; i < 6; i++)
+    {
+        bytes[i] = key >> (8 * i);
+    }
+}
+
+static constexpr size_t macIndexTableSize(size_t n, size_t size = 1)
+{
+    return size >= n ? size : macIndexTableSize(n, size << 1);
+}
+
+// Open addressing (linear probing) over a power-of-two table, kept at most
+// half full so probe sequences stay short; erase uses backward shifting so no
+// tombstones build up. TABLE stores the entries and provides
+//   size_t _mask() const                          table size - 1
+//   bool _isEmpty(size_t pos) const
+//   bool _matches(size_t pos, mac_key_t key) const
+//   mac_key_t _keyAt(size_t pos) const            key of a used position
+//   void _move(size_t to, size_t from)
+//   void _setEmpty(size_t pos)
+// to this base, which it befriends.
+template <typename TABLE>
+class MacProbing
+{
+protected:
+    // Position holding key, or the empty position ending its probe
+    size_t _probe(mac_key_t key) const
+    {
+        const TABLE *table = static_cast<const TABLE *>(this);
+        size_t mask = table->_mask();
+        size_t pos = hashMacKey(key) & mask;
+        while (!table->_isEmpty(pos) && !table->_matches(pos, key))
+        {
+            pos = (pos + 1) & mask;
+        }
+        return pos;
+    }
+
+    // Empty a used position, shifting the rest of its cluster into the hole
+    void _eraseAt(size_t pos)
+    {
+        TABLE *table = static_cast<TABLE *>(this);
+        size_t mask = table->_mask();
+        size_t hole = pos;
+        size_t next = (hole + 1) & mask;
+        while (!table->_isEmpty(next))
+        {
+            size_t home = hashMacKey(table->_keyAt(next)) & mask;
+            if (((next - home) & mask) >= ((next - hole) & mask))
+            {
+                table->_move(hole, next);
+                hole = next;
+            }
+            next = (next + 1) & mask;
+        }
+        table->_setEmpty(hole);
+    }
+};
+
+// Fixed-capacity map from MAC key to a slot number in an external array,
+// keeping the full keys in the table
+template <size_t CAPACITY>
+class MacIndex : public MacProbing<MacIndex<CAPACITY> >
+{
+    friend class MacProbing<MacIndex<CAPACITY> >;
+
+private:
+    static const size_t TABLE_SIZE = macIndexTableSize(CAPACITY * 2);
+    static const size_t TABLE_MASK = TABLE_SIZE - 1;
+
+    mac_key_t _keys[TABLE_SIZE];
+    int16_t _values[TABLE_SIZE];
+    size_t _count = 0;
+
+    size_t _mask() const
+    {
+        return TABLE_MASK;
+    }
+
+    bool _isEmpty(size_t pos) const
+    {
+        return this->_keys[pos] == MAC_KEY_EMPTY;
+    }
+
+    bool _matches(size_t pos, mac_key_t key) const
+    {
+        return this->_keys[pos] == key;
+    }
+
+    mac_key_t _keyAt(size_t pos) const
+    {
+        return this->_keys[pos];
+    }
+
+    void _move(size_t to, size_t from)
+    {
+        this->_keys[to] = this->_keys[from];
+        this->_values[to] = this->_values[from];
+    }
+
+    void _setEmpty(size_t pos)
+    {
+        this->_keys[pos] = MAC_KEY_EMPTY;
+    }
+
+public:
+    MacIndex()
+    {
+        this->clear();
+    }
+
+    void clear()
+    {
+        for (size_t i = 0; i < TABLE_SIZE; i++)
+        {
+            this->_keys[i] = MAC_KEY_EMPTY;
+        }
+        this->_count = 0;
+    }
+
+    size_t count() const
+    {
+        return this->_count;
+    }
+
+    int find(mac_key_t key) const
+    {
+        size_t pos = this->_probe(key);
+        return this->_keys[pos] == key ? this->_values[pos] : -1;
+    }
+
+    bool insert(mac_key_t key, int value)
+    {
+        size_t pos = this->_probe(key);
+        if (this->_keys[pos] == key)
+        {
+            this->_values[pos] = value;
+            return true;
+        }
+        if (this->_count >= CAPACITY)
+        {
+            return false;
+        }
+
+        this->_keys[pos] = key;
+        this->_values[pos] = value;
+        this->_count += 1;
+        return true;
+    }
+
+    bool erase(mac_key_t key)
+    {
+        size_t pos = this->_probe(key);
+        if (this->_keys[pos] != key)
+        {
+            return false;
+        }
+        this->_eraseAt(pos);
+        this->_count -= 1;
+        return true;
+    }
+};
+
+#endif
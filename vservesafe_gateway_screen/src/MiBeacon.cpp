@@ -0,0 +1,226 @@
+#include "MiBeacon.h"
+
+#include <string.h>
+#include <mbedtls/ccm.h>
+
+#define MIBEACON_FC_ENCRYPTED (1 << 3)
+#define MIBEACON_FC_MAC_INCLUDED (1 << 4)
+#define MIBEACON_FC_CAPABILITY_INCLUDED (1 << 5)
+#define MIBEACON_FC_OBJECT_INCLUDED (1 << 6)
+#define MIBEACON_CAPABILITY_IO (1 << 5)
+
+#define MIBEACON_EXT_COUNTER_SIZE (3)
+#define MIBEACON_MIC_SIZE (4)
+#define MIBEACON_NONCE_SIZE (12)
+
+static const uint8_t MIBEACON_AAD[] = {0x11};
+
+static inline uint16_t readU16LE(const uint8_t *p)
+{
+  return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+bool parseMiBeacon(const uint8_t *data, size_t len, MiBeaconFrame &out)
+{
+  if (len < 5)
+  {
+    return false;
+  }
+
+  out.frameControl = readU16LE(data);
+  out.productId = readU16LE(data + 2);
+  out.counter = data[4];
+  out.version = out.frameControl >> 12;
+  out.encrypted = (out.frameControl & MIBEACON_FC_ENCRYPTED) != 0;
+  out.macLE = NULL;
+  out.objects = NULL;
+  out.objectsLen = 0;
+
+  size_t pos = 5;
+  if (out.frameControl & MIBEACON_FC_MAC_INCLUDED)
+  {
+    if (pos + 6 > len)
+    {
+      return false;
+    }
+    out.macLE = data + pos;
+    pos += 6;
+  }
+  if (out.frameControl & MIBEACON_FC_CAPABILITY_INCLUDED)
+  {
+    if (pos + 1 > len)
+    {
+      return false;
+    }
+    pos += (data[pos] & MIBEACON_CAPABILITY_IO) ? 2 : 1;
+  }
+  if ((out.frameControl & MIBEACON_FC_OBJECT_INCLUDED) && pos < len)
+  {
+    out.objects = data + pos;
+    out.objectsLen = len - pos;
+  }
+  return pos <= len;
+}
+
+bool decodeMiBeaconObjects(const uint8_t *objects, size_t len, AdvReading &out)
+{
+  size_t pos = 0;
+  while (pos + 3 <= len)
+  {
+    uint16_t id = readU16LE(objects + pos);
+    uint8_t size = objects[pos + 2];
+    const uint8_t *value = objects + pos + 3;
+    pos += 3 + size;
+    if (pos > len)
+    {
+      break;
+    }
+
+    switch (id)
+    {
+    case 0x1004: // temperature 0.1 C
+      if (size == 2)
+      {
+        out.tempCenti = (int16_t)readU16LE(value) * 10;
+        out.fields |= ADV_READING_TEMP;
+      }
+      break;
+    case 0x1006: // humidity 0.1 %
+      if (size == 2)
+      {
+        out.humidCenti = readU16LE(value) * 10;
+        out.fields |= ADV_READING_HUMID;
+      }
+      break;
+    case 0x100A: // battery %
+      if (size >= 1)
+      {
+        out.battPercent = value[0];
+        out.fields |= ADV_READING_BATT_PERCENT;
+      }
+      break;
+    case 0x100D: // temperature + humidity 0.1
+      if (size == 4)
+      {
+        out.tempCenti = (int16_t)readU16LE(value) * 10;
+        out.humidCenti = readU16LE(value + 2) * 10;
+        out.fields |= ADV_READING_TEMP | ADV_READING_HUMID;
+      }
+      break;
+    }
+  }
+  return (out.fields & (ADV_READING_TEMP | ADV_READING_HUMID | ADV_READING_BATT_PERCENT)) != 0;
+}
+
+bool decryptMiBeacon(const uint8_t *bindKey, const uint8_t *data, size_t len, const uint8_t *macLE, AdvReading &out)
+{
+  MiBeaconFrame frame;
+  if (len > MIBEACON_MAX_FRAME || !parseMiBeacon(data, len, frame) || !frame.encrypted || frame.version < 4 ||
+      frame.objectsLen <= MIBEACON_EXT_COUNTER_SIZE + MIBEACON_MIC_SIZE)
+  {
+    return false;
+  }
+  if (frame.macLE)
+  {
+    macLE = frame.macLE;
+  }
+
+  uint8_t plain[MIBEACON_MAX_FRAME];
+  size_t cipherLen = frame.objectsLen - MIBEACON_EXT_COUNTER_SIZE - MIBEACON_MIC_SIZE;
+  if (cipherLen > sizeof(plain))
+  {
+    return false;
+  }
+  const uint8_t *extCounter = frame.objects + cipherLen;
+  const uint8_t *mic = extCounter + MIBEACON_EXT_COUNTER_SIZE;
+
+  // Nonce: address | product id | frame counter | extended counter
+  uint8_t nonce[MIBEACON_NONCE_SIZE];
+  memcpy(nonce, macLE, 6);
+  memcpy(nonce + 6, data + 2, 3);
+  memcpy(nonce + 9, extCounter, MIBEACON_EXT_COUNTER_SIZE);
+
+  mbedtls_ccm_context ccm;
+  mbedtls_ccm_init(&ccm);
+  int err = mbedtls_ccm_setkey(&ccm, MBEDTLS_CIPHER_ID_AES, bindKey, MIBEACON_BINDKEY_SIZE * 8);
+  if (err == 0)
+  {
+    err = mbedtls_ccm_auth_decrypt(&ccm, cipherLen, nonce, sizeof(nonce), MIBEACON_AAD, sizeof(MIBEACON_AAD),
+                                   frame.objects, plain, mic, MIBEACON_MIC_SIZE);
+  }
+  mbedtls_ccm_free(&ccm);
+  if (err != 0)
+  {
+    return false;
+  }
+
+  out.mac = macKeyFromLE(macLE);
+  out.tempCenti = 0;
+  out.humidCenti = 0;
+  out.battMv = 0;
+  out.battPercent = 0;
+  out.counter = frame.counter;
+  out.flag = 0;
+  out.fields = ADV_READING_COUNTER;
+  out.format = VSERVESAFE_ADV_MIBEACON;
+  return decodeMiBeaconObjects(plain, cipherLen, out);
+}
+
+bool MiBeaconKeyStore::set(mac_key_t mac, const uint8_t *key)
+{
+  int i = this->find(mac);
+  if (i == -1)
+  {
+    if (this->_count >= MAX_BINDKEYS_REMEMBER)
+    {
+      return false;
+    }
+    i = this->_count;
+    this->_count += 1;
+    this->_macs[i] = mac;
+    this->_index.insert(mac, i);
+  }
+  memcpy(this->_keys[i], key, MIBEACON_BINDKEY_SIZE);
+  return true;
+}
+
+bool MiBeaconKeyStore::remove(mac_key_t mac)
+{
+  int i = this->find(mac);
+  if (i == -1)
+  {
+    return false;
+  }
+
+  int last = this->_count - 1;
+  this->_index.erase(mac);
+  if (i != last)
+  {
+    memcpy(this->_keys[i], this->_keys[last], MIBEACON_BINDKEY_SIZE);
+    this->_macs[i] = this->_macs[last];
+    this->_index.insert(this->_macs[i], i);
+  }
+  this->_count = last;
+  return true;
+}
+
+void MiBeaconKeyStore::clear()
+{
+  this->_index.clear();
+  this->_count = 0;
+}
+
+int MiBeaconKeyStore::count() const
+{
+  return this->_count;
+}
+
+int MiBeaconKeyStore::find(mac_key_t mac) const
+{
+  return this->_index.find(mac);
+}
+
+const uint8_t *MiBeaconKeyStore::keyAt(int i) const
+{
+  return this->_keys[i];
+}
@@ -0,0 +1,59 @@
+#ifndef __VSERVESAFE_MIBEACON__
+#define __VSERVESAFE_MIBEACON__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "vservesafe_conf.h"
+#include "AdvDecoder.h"
+#include "MacIndex.h"
+
+#define ADV_UUID_MIBEACON (0xFE95)
+
+#define MIBEACON_BINDKEY_SIZE (16)
+// Longest service data body a legacy advert can carry
+#define MIBEACON_MAX_FRAME (27)
+
+typedef struct
+{
+    uint16_t frameControl;
+    uint16_t productId;
+    uint8_t counter;
+    uint8_t version;
+    bool encrypted;
+    // Address bytes as sent (least significant first), or NULL if the frame
+    // does not include them
+    const uint8_t *macLE;
+    // Object data; when encrypted this is cipher text, then the 3-byte
+    // extended counter and the 4-byte MIC
+    const uint8_t *objects;
+    size_t objectsLen;
+} MiBeaconFrame;
+
+// Split a 0xFE95 service data body into its header fields; points into data
+bool parseMiBeacon(const uint8_t *data, size_t len, MiBeaconFrame &out);
+// Decode plain MiBeacon objects (temperature, humidity, battery)
+bool decodeMiBeaconObjects(const uint8_t *objects, size_t len, AdvReading &out);
+// AES-CCM decrypt and decode a v4/v5 frame. macLE is the tag address (least
+// significant byte first) used for the nonce when the frame does not carry it.
+// Frames longer than MIBEACON_MAX_FRAME are rejected.
+bool decryptMiBeacon(const uint8_t *bindKey, const uint8_t *data, size_t len, const uint8_t *macLE, AdvReading &out);
+
+// Bindkeys by tag MAC
+class MiBeaconKeyStore
+{
+private:
+    uint8_t _keys[MAX_BINDKEYS_REMEMBER][MIBEACON_BINDKEY_SIZE];
+    mac_key_t _macs[MAX_BINDKEYS_REMEMBER];
+    MacIndex<MAX_BINDKEYS_REMEMBER> _index;
+    int _count = 0;
+
+public:
+    bool set(mac_key_t mac, const uint8_t *key);
+    bool remove(mac_key_t mac);
+    void clear();
+    int count() const;
+    int find(mac_key_t mac) const;
+    const uint8_t *keyAt(int i) const;
+};
+
+#endif
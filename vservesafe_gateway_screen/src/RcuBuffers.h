@@ -0,0 +1,79 @@
+#ifndef __VSERVESAFE_RCU_BUFFERS__
+#define __VSERVESAFE_RCU_BUFFERS__
+
+#include <atomic>
+
+// N copies of a T published with a single pointer store (RCU style), for
+// one writer. Readers pin the current copy with a reader count and never
+// wait; the writer only refills a copy that is neither current nor pinned.
+// With three copies one is always free while readers pin for short spans.
+template <typename T, int N>
+class RcuBuffers
+{
+private:
+    T _values[N];
+    std::atomic<int> _readers[N];
+    std::atomic<T *> _current;
+
+public:
+    RcuBuffers()
+    {
+        for (int i = 0; i < N; i++)
+        {
+            this->_readers[i].store(0);
+        }
+        this->_current.store(&this->_values[0]);
+    }
+
+    // Owner setup and teardown only, while no reader runs
+    T &at(int i)
+    {
+        return this->_values[i];
+    }
+
+    // Writer only: a copy that is neither current nor pinned, or NULL
+    T *beginWrite()
+    {
+        T *current = this->_current.load();
+        for (int i = 0; i < N; i++)
+        {
+            // Sequentially consistent with acquire(): a reader that pinned
+            // this copy before it stopped being current is seen here
+            if (&this->_values[i] == current || this->_readers[i].load() != 0)
+            {
+                continue;
+            }
+            return &this->_values[i];
+        }
+        return NULL;
+    }
+
+    void publish(T *value)
+    {
+        this->_current.store(value);
+    }
+
+    // Never NULL; the first copy until the first publish
+    const T *acquire()
+    {
+        while (true)
+        {
+            T *value = this->_current.load();
+            std::atomic<int> &readers = this->_readers[value - this->_values];
+            readers.fetch_add(1);
+            // Still current after pinning, so the writer will not reuse it
+            if (this->_current.load() == value)
+            {
+                return value;
+            }
+            readers.fetch_sub(1);
+        }
+    }
+
+    void release(const T *value)
+    {
+        this->_readers[value - this->_values].fetch_sub(1);
+    }
+};
+
+#endif
@@ -0,0 +1,71 @@
+#include "ScanScheduler.h"
+
+#include "vservesafe_conf.h"
+
+void ScanScheduler::begin(coldsenses_scan_policy policy, uint16_t windowMs)
+{
+  this->_policy = policy;
+  this->_intervalMs = SCAN_INTERVAL_MS;
+  this->_windowMs = windowMs < SCAN_INTERVAL_MS ? windowMs : SCAN_INTERVAL_MS - 1;
+}
+
+bool ScanScheduler::update(const ScanSchedulerInput &input)
+{
+  if (this->_policy != VSERVESAFE_SCAN_POLICY_ADAPTIVE)
+  {
+    return false;
+  }
+
+  int window = this->_windowMs;
+  bool backlogged = input.uplinkBacklog >= SCAN_BACKLOG_HIGH;
+  if (input.overdueTags > 0 && input.knownTags > 0)
+  {
+    // Widen faster the larger the share of tags gone quiet
+    window += SCAN_WINDOW_STEP + (SCAN_WINDOW_MAX - SCAN_WINDOW_MIN) * input.overdueTags / input.knownTags / 2;
+  }
+  else if (backlogged)
+  {
+    window /= 2;
+  }
+  else if (input.newSamples > 0 && input.duplicates >= input.newSamples)
+  {
+    // Samples are heard twice or more on average, so part of the window is
+    // redundant
+    window -= SCAN_WINDOW_STEP;
+  }
+
+  // A backed up uplink caps the window even while tags are missing
+  int ceiling = backlogged ? SCAN_WINDOW_SHARED : SCAN_WINDOW_MAX;
+  if (window > ceiling)
+  {
+    window = ceiling;
+  }
+  if (window < SCAN_WINDOW_MIN)
+  {
+    window = SCAN_WINDOW_MIN;
+  }
+
+  bool changed = window != this->_windowMs;
+  this->_windowMs = window;
+  return changed;
+}
+
+coldsenses_scan_policy ScanScheduler::getPolicy()
+{
+  return this->_policy;
+}
+
+uint16_t ScanScheduler::getIntervalMs()
+{
+  return this->_intervalMs;
+}
+
+uint16_t ScanScheduler::getWindowMs()
+{
+  return this->_windowMs;
+}
+
+int ScanScheduler::getDutyPercent()
+{
+  return this->_windowMs * 100 / this->_intervalMs;
+}
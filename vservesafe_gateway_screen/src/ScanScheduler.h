@@ -0,0 +1,46 @@
+#ifndef __VSERVESAFE_SCAN_SCHEDULER__
+#define __VSERVESAFE_SCAN_SCHEDULER__
+
+#include <stdint.h>
+
+typedef enum
+{
+    // Constant window (SCAN_WINDOW_MAX unless set otherwise)
+    VSERVESAFE_SCAN_POLICY_FIXED,
+    // Window follows missed tags, advert redundancy and uplink backlog
+    VSERVESAFE_SCAN_POLICY_ADAPTIVE,
+} coldsenses_scan_policy;
+
+// What the scanner saw since the previous update
+typedef struct
+{
+    // Tag adverts with a new sample and repeated copies of a sample
+    uint32_t newSamples;
+    uint32_t duplicates;
+    // Active tags, and those of them past twice their sample interval
+    int knownTags;
+    int overdueTags;
+    // Samples waiting to be published
+    int uplinkBacklog;
+} ScanSchedulerInput;
+
+// Picks the BLE scan window within a fixed interval. The radio is shared with
+// Wi-Fi, so every ms not spent in the window is Wi-Fi airtime.
+class ScanScheduler
+{
+private:
+    coldsenses_scan_policy _policy;
+    uint16_t _intervalMs;
+    uint16_t _windowMs;
+
+public:
+    void begin(coldsenses_scan_policy policy, uint16_t windowMs);
+    // Returns true if the window changed and the scan must be restarted
+    bool update(const ScanSchedulerInput &input);
+    coldsenses_scan_policy getPolicy();
+    uint16_t getIntervalMs();
+    uint16_t getWindowMs();
+    int getDutyPercent();
+};
+
+#endif
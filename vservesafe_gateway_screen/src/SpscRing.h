@@ -0,0 +1,84 @@
+#ifndef __VSERVESAFE_SPSC_RING__
+#define __VSERVESAFE_SPSC_RING__
+
+#include <stdint.h>
+#include <atomic>
+
+// Lock-free ring for exactly one producer and one consumer task. N must be a
+// power of two. Each side only writes its own index: the producer fills a
+// slot and then publishes it with a release store of _head, the consumer
+// copies it out and then frees it with a release store of _tail, so neither
+// sees a half-written item. A full ring drops the new item.
+template <typename T, uint32_t N>
+class SpscRing
+{
+private:
+    T _items[N];
+    std::atomic<uint32_t> _head;
+    std::atomic<uint32_t> _tail;
+    std::atomic<uint32_t> _dropped;
+
+public:
+    SpscRing() : _head(0), _tail(0), _dropped(0)
+    {
+        static_assert((N & (N - 1)) == 0, "SpscRing length must be a power of two");
+    }
+
+    // Producer only
+    bool push(const T &item)
+    {
+        uint32_t head = this->_head.load(std::memory_order_relaxed);
+        if (head - this->_tail.load(std::memory_order_acquire) >= N)
+        {
+            this->_dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        this->_items[head & (N - 1)] = item;
+        this->_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer only
+    bool pop(T &item)
+    {
+        uint32_t tail = this->_tail.load(std::memory_order_relaxed);
+        if (tail == this->_head.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        item = this->_items[tail & (N - 1)];
+        this->_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer only: the oldest item, left in the ring
+    bool peek(T &item) const
+    {
+        uint32_t tail = this->_tail.load(std::memory_order_relaxed);
+        if (tail == this->_head.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        item = this->_items[tail & (N - 1)];
+        return true;
+    }
+
+    // Approximate when called by neither side
+    uint32_t size() const
+    {
+        uint32_t tail = this->_tail.load(std::memory_order_acquire);
+        return this->_head.load(std::memory_order_acquire) - tail;
+    }
+
+    uint32_t capacity() const
+    {
+        return N;
+    }
+
+    uint32_t dropped() const
+    {
+        return this->_dropped.load(std::memory_order_relaxed);
+    }
+};
+
+#endif
@@ -0,0 +1,97 @@
+#include "TagAdmission.h"
+
+#include <new>
+#include "hal/HalMemory.h"
+
+typedef MacIndex<MAX_NOTIFY_REMEMBER> TagHostIndex;
+
+TagAdmissionBuffers::TagAdmissionBuffers()
+{
+  for (int i = 0; i < TAG_ADMISSION_BUFFERS; i++)
+  {
+    TagAdmission &admission = this->_buffers.at(i);
+    admission.allowListActive = false;
+    admission.hostFilter = false;
+    admission.hostIndex = nullptr;
+    admission.bindKeys = nullptr;
+  }
+}
+
+TagAdmissionBuffers::~TagAdmissionBuffers()
+{
+  this->end();
+}
+
+bool TagAdmissionBuffers::begin()
+{
+  this->end();
+  for (int i = 0; i < TAG_ADMISSION_BUFFERS; i++)
+  {
+    TagAdmission &admission = this->_buffers.at(i);
+    void *hostIndex = halAllocLarge(sizeof(TagHostIndex));
+    void *bindKeys = halAllocLarge(sizeof(MiBeaconKeyStore));
+    admission.hostIndex = hostIndex ? new (hostIndex) TagHostIndex() : nullptr;
+    admission.bindKeys = bindKeys ? new (bindKeys) MiBeaconKeyStore() : nullptr;
+    if (!admission.allowList.begin() || !admission.hostIndex || !admission.bindKeys)
+    {
+      this->end();
+      return false;
+    }
+  }
+  return true;
+}
+
+void TagAdmissionBuffers::end()
+{
+  for (int i = 0; i < TAG_ADMISSION_BUFFERS; i++)
+  {
+    TagAdmission &admission = this->_buffers.at(i);
+    admission.allowListActive = false;
+    admission.hostFilter = false;
+    admission.allowList.end();
+    // Both are trivially destructible
+    halFree(admission.hostIndex);
+    halFree(admission.bindKeys);
+    admission.hostIndex = nullptr;
+    admission.bindKeys = nullptr;
+  }
+}
+
+TagAdmission *TagAdmissionBuffers::beginWrite()
+{
+  TagAdmission *admission = this->_buffers.beginWrite();
+  if (admission && !admission->bindKeys)
+  {
+    return NULL;
+  }
+  return admission;
+}
+
+void TagAdmissionBuffers::publish(TagAdmission *admission)
+{
+  this->_buffers.publish(admission);
+}
+
+const TagAdmission *TagAdmissionBuffers::acquire()
+{
+  return this->_buffers.acquire();
+}
+
+void TagAdmissionBuffers::release(const TagAdmission *admission)
+{
+  this->_buffers.release(admission);
+}
+
+size_t TagAdmissionBuffers::getMemoryUsage()
+{
+  size_t bytes = 0;
+  for (int i = 0; i < TAG_ADMISSION_BUFFERS; i++)
+  {
+    TagAdmission &admission = this->_buffers.at(i);
+    if (admission.bindKeys)
+    {
+      bytes += admission.allowList.getMemoryUsage() + sizeof(TagHostIndex) + sizeof(MiBeaconKeyStore);
+    }
+  }
+  return bytes;
+}
@@ -0,0 +1,53 @@
+#ifndef __VSERVESAFE_TAG_ADMISSION__
+#define __VSERVESAFE_TAG_ADMISSION__
+
+#include <stddef.h>
+#include <stdint.h>
+#include "vservesafe_conf.h"
+#include "RcuBuffers.h"
+#include "MacIndex.h"
+#include "MiBeacon.h"
+#include "TagAllowList.h"
+
+// Current, one still being read and one to write
+#define TAG_ADMISSION_BUFFERS (3)
+
+// Copy of what the BLE host task checks before queueing an advert: the
+// allowlist, the host filter of the selected scan and the bindkeys. Must not
+// be changed once published.
+typedef struct
+{
+    bool allowListActive;
+    TagAllowList allowList;
+    bool hostFilter;
+    // Selected tags; only filled while hostFilter is set
+    MacIndex<MAX_NOTIFY_REMEMBER> *hostIndex;
+    MiBeaconKeyStore *bindKeys;
+} TagAdmission;
+
+// Admission copies published RCU style (RcuBuffers), so the host task never
+// waits on the store lock. Tables live in PSRAM.
+class TagAdmissionBuffers
+{
+private:
+    RcuBuffers<TagAdmission, TAG_ADMISSION_BUFFERS> _buffers;
+
+public:
+    TagAdmissionBuffers();
+    ~TagAdmissionBuffers();
+
+    bool begin();
+    void end();
+
+    // Writer only: a buffer no reader holds, or NULL
+    TagAdmission *beginWrite();
+    void publish(TagAdmission *admission);
+
+    // Never NULL; admits everything until the first publish
+    const TagAdmission *acquire();
+    void release(const TagAdmission *admission);
+
+    size_t getMemoryUsage();
+};
+
+#endif
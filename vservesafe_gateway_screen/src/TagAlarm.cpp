@@ -0,0 +1,102 @@
+#include "TagAlarm.h"
+
+#include "TagData.h"
+
+void resetTagAlarm(TagAlarmState &alarm)
+{
+  alarm.state = VSERVESAFE_ALARM_NORMAL;
+  alarm.sinceTs = 0;
+}
+
+static void enterTagAlarmState(TagAlarmState &alarm, uint8_t state, uint32_t ts)
+{
+  alarm.state = state;
+  alarm.sinceTs = ts;
+}
+
+// A crossed limit starts the dwell; a zero dwell raises at once
+static coldsenses_alarm_edge startTagAlarmDwell(TagAlarmState &alarm, const TagAlarmConfig &config, bool isHigh,
+                                                uint32_t ts)
+{
+  if (config.dwellMs == 0)
+  {
+    enterTagAlarmState(alarm, isHigh ? VSERVESAFE_ALARM_HIGH : VSERVESAFE_ALARM_LOW, ts);
+    return isHigh ? VSERVESAFE_ALARM_EDGE_HIGH : VSERVESAFE_ALARM_EDGE_LOW;
+  }
+  enterTagAlarmState(alarm, isHigh ? VSERVESAFE_ALARM_PENDING_HIGH : VSERVESAFE_ALARM_PENDING_LOW, ts);
+  return VSERVESAFE_ALARM_EDGE_NONE;
+}
+
+coldsenses_alarm_edge updateTagAlarm(TagAlarmState &alarm, const TagAlarmConfig &config, int16_t tempCenti,
+                                     int16_t lowCenti, int16_t highCenti, uint32_t ts)
+{
+  if (tempCenti == TAG_TEMP_NONE)
+  {
+    return VSERVESAFE_ALARM_EDGE_NONE;
+  }
+
+  bool isHigh = tempCenti >= highCenti;
+  bool isLow = tempCenti <= lowCenti;
+  switch (alarm.state)
+  {
+  case VSERVESAFE_ALARM_REARMING:
+    if (ts - alarm.sinceTs < config.rearmMs)
+    {
+      return VSERVESAFE_ALARM_EDGE_NONE;
+    }
+    enterTagAlarmState(alarm, VSERVESAFE_ALARM_NORMAL, ts);
+    // fall through
+  case VSERVESAFE_ALARM_NORMAL:
+    if (isHigh || isLow)
+    {
+      return startTagAlarmDwell(alarm, config, isHigh, ts);
+    }
+    return VSERVESAFE_ALARM_EDGE_NONE;
+
+  case VSERVESAFE_ALARM_PENDING_HIGH:
+  case VSERVESAFE_ALARM_PENDING_LOW:
+  {
+    bool wasHigh = alarm.state == VSERVESAFE_ALARM_PENDING_HIGH;
+    if (!isHigh && !isLow)
+    {
+      // Back inside before the dwell was over, e.g. a door opened briefly
+      enterTagAlarmState(alarm, VSERVESAFE_ALARM_NORMAL, ts);
+      return VSERVESAFE_ALARM_EDGE_NONE;
+    }
+    if (isHigh != wasHigh)
+    {
+      return startTagAlarmDwell(alarm, config, isHigh, ts);
+    }
+    if (ts - alarm.sinceTs < config.dwellMs)
+    {
+      return VSERVESAFE_ALARM_EDGE_NONE;
+    }
+    enterTagAlarmState(alarm, isHigh ? VSERVESAFE_ALARM_HIGH : VSERVESAFE_ALARM_LOW, ts);
+    return isHigh ? VSERVESAFE_ALARM_EDGE_HIGH : VSERVESAFE_ALARM_EDGE_LOW;
+  }
+
+  case VSERVESAFE_ALARM_HIGH:
+    if ((int32_t)tempCenti >= (int32_t)highCenti - config.hysteresisCenti)
+    {
+      return VSERVESAFE_ALARM_EDGE_NONE;
+    }
+    enterTagAlarmState(alarm, VSERVESAFE_ALARM_REARMING, ts);
+    return VSERVESAFE_ALARM_EDGE_CLEAR;
+
+  case VSERVESAFE_ALARM_LOW:
+    if ((int32_t)tempCenti <= (int32_t)lowCenti + config.hysteresisCenti)
+    {
+      return VSERVESAFE_ALARM_EDGE_NONE;
+    }
+    enterTagAlarmState(alarm, VSERVESAFE_ALARM_REARMING, ts);
+    return VSERVESAFE_ALARM_EDGE_CLEAR;
+  }
+
+  resetTagAlarm(alarm);
+  return VSERVESAFE_ALARM_EDGE_NONE;
+}
+
+bool isTagAlarmRaised(const TagAlarmState &alarm)
+{
+  return alarm.state == VSERVESAFE_ALARM_HIGH || alarm.state == VSERVESAFE_ALARM_LOW;
+}
@@ -0,0 +1,68 @@
+#ifndef __VSERVESAFE_TAG_ALARM__
+#define __VSERVESAFE_TAG_ALARM__
+
+#include <stdint.h>
+#include "vservesafe_conf.h"
+#include "MacIndex.h"
+#include "SpscRing.h"
+
+typedef enum
+{
+    VSERVESAFE_ALARM_NORMAL,
+    // Outside a limit, waiting for the dwell time
+    VSERVESAFE_ALARM_PENDING_HIGH,
+    VSERVESAFE_ALARM_PENDING_LOW,
+    VSERVESAFE_ALARM_HIGH,
+    VSERVESAFE_ALARM_LOW,
+    // Just cleared; no new alarm until the re-arm delay is over
+    VSERVESAFE_ALARM_REARMING,
+} coldsenses_alarm_state;
+
+typedef enum
+{
+    VSERVESAFE_ALARM_EDGE_NONE,
+    VSERVESAFE_ALARM_EDGE_HIGH,
+    VSERVESAFE_ALARM_EDGE_LOW,
+    VSERVESAFE_ALARM_EDGE_CLEAR,
+} coldsenses_alarm_edge;
+
+typedef struct
+{
+    // An alarm clears once the temperature is this far back inside its limit
+    int16_t hysteresisCenti;
+    // Time a limit must stay crossed before the alarm is raised
+    uint32_t dwellMs;
+    // Time after an alarm clears before another can be raised
+    uint32_t rearmMs;
+} TagAlarmConfig;
+
+// Alarm state of one tag, kept in its record
+typedef struct
+{
+    // When the current state was entered
+    uint32_t sinceTs;
+    uint8_t state;
+} TagAlarmState;
+
+// An alarm was raised or cleared
+typedef struct
+{
+    mac_key_t mac;
+    // Sample that caused it
+    uint32_t ts;
+    int16_t tempCenti;
+    uint8_t edge;
+} TagAlarmEvent;
+
+typedef SpscRing<TagAlarmEvent, TAG_ALARM_QUEUE_LENGTH> TagAlarmRing;
+
+void resetTagAlarm(TagAlarmState &alarm);
+// Step the state machine with a new sample taken at ts; O(1). A limit is
+// crossed at or beyond it, as for coldsenses_notify_result. Returns the edge
+// the sample caused, if any: HIGH or LOW when an alarm is raised, CLEAR when
+// one ends. A sample without a temperature changes nothing.
+coldsenses_alarm_edge updateTagAlarm(TagAlarmState &alarm, const TagAlarmConfig &config, int16_t tempCenti,
+                                     int16_t lowCenti, int16_t highCenti, uint32_t ts);
+bool isTagAlarmRaised(const TagAlarmState &alarm);
+
+#endif
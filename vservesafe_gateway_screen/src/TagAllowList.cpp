@@ -0,0 +1,161 @@
+#include "TagAllowList.h"
+
+#include <string.h>
+#include "hal/HalMemory.h"
+
+#define TAG_ALLOWLIST_BYTES (TAG_ALLOWLIST_BITS / 8)
+#define TAG_ALLOWLIST_MAGIC (0x57414C41) // "ALAW"
+
+typedef struct
+{
+  uint32_t magic;
+  uint32_t bits;
+  uint32_t count;
+  uint32_t hashes;
+} TagAllowListHeader;
+
+// Two halves of a 64-bit mix, combined as h1 + i * h2 (Kirsch-Mitzenmacher)
+static inline uint64_t allowListHash(mac_key_t mac)
+{
+  mac ^= mac >> 30;
+  mac *= 0xBF58476D1CE4E5B9ULL;
+  mac ^= mac >> 27;
+  mac *= 0x94D049BB133111EBULL;
+  mac ^= mac >> 31;
+  return mac;
+}
+
+TagAllowList::~TagAllowList()
+{
+  this->end();
+}
+
+bool TagAllowList::begin()
+{
+  this->end();
+  this->_bits = (uint8_t *)halAllocLarge(TAG_ALLOWLIST_BYTES);
+  if (!this->_bits)
+  {
+    return false;
+  }
+  this->clear();
+  return true;
+}
+
+void TagAllowList::end()
+{
+  halFree(this->_bits);
+  this->_bits = nullptr;
+  this->_count = 0;
+}
+
+void TagAllowList::clear()
+{
+  if (this->_bits)
+  {
+    memset(this->_bits, 0, TAG_ALLOWLIST_BYTES);
+  }
+  this->_count = 0;
+}
+
+void TagAllowList::add(mac_key_t mac)
+{
+  if (!this->_bits)
+  {
+    return;
+  }
+  uint64_t hash = allowListHash(mac);
+  uint32_t h1 = (uint32_t)hash;
+  uint32_t h2 = (uint32_t)(hash >> 32) | 1;
+  bool isNew = false;
+  for (uint32_t i = 0; i < TAG_ALLOWLIST_HASHES; i++)
+  {
+    uint32_t bit = (h1 + i * h2) & (TAG_ALLOWLIST_BITS - 1);
+    uint8_t mask = 1 << (bit & 7);
+    isNew |= !(this->_bits[bit >> 3] & mask);
+    this->_bits[bit >> 3] |= mask;
+  }
+  // Re-sent MACs (and false positives) are not counted again
+  if (isNew)
+  {
+    this->_count += 1;
+  }
+}
+
+bool TagAllowList::mayContain(mac_key_t mac) const
+{
+  if (!this->_bits)
+  {
+    return false;
+  }
+  uint64_t hash = allowListHash(mac);
+  uint32_t h1 = (uint32_t)hash;
+  uint32_t h2 = (uint32_t)(hash >> 32) | 1;
+  for (uint32_t i = 0; i < TAG_ALLOWLIST_HASHES; i++)
+  {
+    uint32_t bit = (h1 + i * h2) & (TAG_ALLOWLIST_BITS - 1);
+    if (!(this->_bits[bit >> 3] & (1 << (bit & 7))))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+uint32_t TagAllowList::count() const
+{
+  return this->_count;
+}
+
+void TagAllowList::copyFrom(const TagAllowList &other)
+{
+  if (!this->_bits || !other._bits)
+  {
+    return;
+  }
+  memcpy(this->_bits, other._bits, TAG_ALLOWLIST_BYTES);
+  this->_count = other._count;
+}
+
+size_t TagAllowList::getMemoryUsage() const
+{
+  return this->_bits ? TAG_ALLOWLIST_BYTES : 0;
+}
+
+size_t TagAllowList::serializedSize() const
+{
+  return sizeof(TagAllowListHeader) + TAG_ALLOWLIST_BYTES;
+}
+
+size_t TagAllowList::serialize(uint8_t *out) const
+{
+  TagAllowListHeader header = {TAG_ALLOWLIST_MAGIC, TAG_ALLOWLIST_BITS, this->_count, TAG_ALLOWLIST_HASHES};
+  memcpy(out, &header, sizeof(header));
+  if (this->_bits)
+  {
+    memcpy(out + sizeof(header), this->_bits, TAG_ALLOWLIST_BYTES);
+  }
+  else
+  {
+    memset(out + sizeof(header), 0, TAG_ALLOWLIST_BYTES);
+  }
+  return this->serializedSize();
+}
+
+bool TagAllowList::deserialize(const uint8_t *in, size_t len)
+{
+  TagAllowListHeader header;
+  if (!this->_bits || len != this->serializedSize())
+  {
+    return false;
+  }
+  memcpy(&header, in, sizeof(header));
+  if (header.magic != TAG_ALLOWLIST_MAGIC || header.bits != TAG_ALLOWLIST_BITS ||
+      header.hashes != TAG_ALLOWLIST_HASHES)
+  {
+    return false;
+  }
+  memcpy(this->_bits, in + sizeof(header), TAG_ALLOWLIST_BYTES);
+  this->_count = header.count;
+  return true;
+}
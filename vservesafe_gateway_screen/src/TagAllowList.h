@@ -0,0 +1,39 @@
+#ifndef __VSERVESAFE_TAG_ALLOW_LIST__
+#define __VSERVESAFE_TAG_ALLOW_LIST__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "vservesafe_conf.h"
+#include "MacIndex.h"
+
+// Bloom filter of the tag MACs a site registered. TAG_ALLOWLIST_BITS bits in
+// PSRAM hold thousands of MACs; a MAC never added is rejected except for a
+// small false-positive rate, and MACs cannot be removed one by one.
+class TagAllowList
+{
+private:
+    uint8_t *_bits = nullptr;
+    uint32_t _count = 0;
+
+public:
+    ~TagAllowList();
+
+    bool begin();
+    void end();
+    void clear();
+    void add(mac_key_t mac);
+    // Both lists must have begun
+    void copyFrom(const TagAllowList &other);
+    // False only for MACs that were never added
+    bool mayContain(mac_key_t mac) const;
+    // Distinct MACs added (approximate); an empty list allows every tag
+    uint32_t count() const;
+    size_t getMemoryUsage() const;
+
+    // Header and bits as stored; deserialize rejects a different geometry
+    size_t serializedSize() const;
+    size_t serialize(uint8_t *out) const;
+    bool deserialize(const uint8_t *in, size_t len);
+};
+
+#endif
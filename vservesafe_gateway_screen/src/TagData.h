@@ -0,0 +1,97 @@
+#ifndef __VSERVESAFE_TAG_DATA__
+#define __VSERVESAFE_TAG_DATA__
+
+#include <stdint.h>
+#include "MacIndex.h"
+#include "TagAlarm.h"
+#include "TagReception.h"
+#include "TagSignal.h"
+
+#define TAG_TEMP_NONE (INT16_MIN)
+#define TAG_HUMID_NONE (UINT16_MAX)
+#define TAG_RATE_NONE (INT16_MIN)
+
+typedef enum
+{
+    VSERVESAFE_EVICT_LRU,
+    VSERVESAFE_EVICT_LOWEST_RSSI,
+    VSERVESAFE_EVICT_LRU_KEEP_NOTIFY,
+} coldsenses_eviction_policy;
+
+// Temperature and humidity are fixed point (hundredths), as the decoders
+// deliver them; no floating point is needed to store, compare or format them.
+// Fields are ordered largest first so the record has no padding holes.
+typedef struct
+{
+    mac_key_t mac;
+    uint32_t ts;
+    // Bumped for every new sample; a tag is dirty until publishedSeq catches up
+    uint32_t sampleSeq;
+    uint32_t publishedSeq;
+    // When tempCenti last came in
+    uint32_t tempTs;
+    // Bit per TagRuleSet rule that holds for the tag
+    uint32_t ruleActive;
+    // TAG_TEMP_NONE / TAG_HUMID_NONE until the tag sends one
+    int16_t tempCenti;
+    uint16_t humidCenti;
+    // Hundredths of a degree per minute, smoothed over the last samples;
+    // TAG_RATE_NONE until two temperatures came in
+    int16_t rateCenti;
+    uint16_t battMv;
+    // Name pool slot (MiTagScanner::getTagName), -1 if unnamed
+    int16_t nameSlot;
+    // History ring slot (MiTagScanner::getTagHistory), -1 if none
+    int16_t historySlot;
+    uint8_t battPercent;
+    uint8_t counter;
+    uint8_t flag;
+    // coldsenses_notify_result of the alarm state and thresholds
+    uint8_t notifyResult;
+    // Last advert's RSSI; signal holds the smoothed value and recent range
+    int8_t rssi;
+    // Heard within TAG_ONLINE_TIEMOUT; kept by the tag store
+    bool online;
+    TagSignalStats signal;
+} MiTagData;
+
+// Snapshots copy every record, so it must stay within one cache line
+static_assert(sizeof(MiTagData) <= 64, "MiTagData grew past 64 bytes");
+
+// Bookkeeping of a tag that only the ingest side reads, kept by the tag store
+// beside its record (TagStore::stateAt) rather than in it
+typedef struct
+{
+    TagReceptionStats reception;
+    // Debounced against the thresholds, see updateTagAlarm
+    TagAlarmState alarm;
+} MiTagState;
+
+typedef struct
+{
+    uint32_t evictions;
+    uint32_t readmissions;
+    uint32_t rejections;
+} MiTagEvictionStats;
+
+typedef struct
+{
+    uint32_t newSamples;
+    uint32_t duplicates;
+    // Dropped because the ingest task fell behind
+    uint32_t queueDropped;
+} MiTagIngestStats;
+
+// Reception of all tags with a frame counter
+typedef struct
+{
+    int tags;
+    uint32_t received;
+    uint32_t expected;
+    uint32_t missed;
+    // Mean of the tags' sample intervals, in ms
+    uint32_t intervalMs;
+    uint32_t interArrival[TAG_RECEPTION_BUCKETS];
+} MiTagReceptionSummary;
+
+#endif
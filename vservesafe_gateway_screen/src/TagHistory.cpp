@@ -0,0 +1,217 @@
+#include "TagHistory.h"
+
+#include <string.h>
+#include "TagData.h"
+#include "hal/HalMemory.h"
+
+#define TAG_HISTORY_NONE (INT16_MIN)
+#define TAG_HISTORY_DELTA_MAX (127)
+
+static int16_t centiToDeci(int32_t centi)
+{
+  return (int16_t)((centi + (centi >= 0 ? 5 : -5)) / 10);
+}
+
+static void resetRing(TagHistoryRing &ring, mac_key_t mac)
+{
+  ring.mac = mac;
+  ring.lastPeriod = 0;
+  ring.lastTempDeci = TAG_HISTORY_NONE;
+  ring.lastHumidDeci = TAG_HISTORY_NONE;
+  ring.newest = TAG_HISTORY_LENGTH - 1;
+  ring.count = 0;
+}
+
+static void pushEntry(TagHistoryRing &ring)
+{
+  ring.newest = (ring.newest + 1) % TAG_HISTORY_LENGTH;
+  if (ring.count < TAG_HISTORY_LENGTH)
+  {
+    ring.count += 1;
+  }
+  ring.tempDelta[ring.newest] = TAG_HISTORY_GAP;
+  ring.humidDelta[ring.newest] = TAG_HISTORY_GAP;
+}
+
+// Set one field of the newest entry to value (tenths)
+static void setField(int8_t &delta, int16_t &last, int16_t value)
+{
+  // Value before this entry: the entry may already hold a sample of the
+  // same period
+  int16_t prev = delta == TAG_HISTORY_GAP ? last : last - delta;
+  if (prev == TAG_HISTORY_NONE)
+  {
+    delta = 0;
+    last = value;
+    return;
+  }
+
+  int32_t change = value - prev;
+  if (change > TAG_HISTORY_DELTA_MAX)
+  {
+    change = TAG_HISTORY_DELTA_MAX;
+  }
+  if (change < -TAG_HISTORY_DELTA_MAX)
+  {
+    change = -TAG_HISTORY_DELTA_MAX;
+  }
+  delta = (int8_t)change;
+  last = prev + change;
+}
+
+TagHistory::~TagHistory()
+{
+  this->end();
+}
+
+bool TagHistory::begin()
+{
+  this->end();
+  this->_rings = (TagHistoryRing *)halAllocLarge(sizeof(TagHistoryRing) * TAG_HISTORY_TAGS);
+  this->clear();
+  return this->_rings != nullptr;
+}
+
+void TagHistory::end()
+{
+  halFree(this->_rings);
+  this->_rings = nullptr;
+}
+
+void TagHistory::clear()
+{
+  for (int i = 0; this->_rings && i < TAG_HISTORY_TAGS; i++)
+  {
+    resetRing(this->_rings[i], MAC_KEY_EMPTY);
+  }
+  this->_next = 0;
+}
+
+int TagHistory::_claim(mac_key_t mac, uint32_t period)
+{
+  int slot = this->_next;
+  for (int i = 0; i < TAG_HISTORY_TAGS; i++)
+  {
+    int candidate = (this->_next + i) % TAG_HISTORY_TAGS;
+    TagHistoryRing &ring = this->_rings[candidate];
+    if (ring.count == 0 || period - ring.lastPeriod >= TAG_HISTORY_STALE)
+    {
+      slot = candidate;
+      break;
+    }
+  }
+  this->_next = (slot + 1) % TAG_HISTORY_TAGS;
+  resetRing(this->_rings[slot], mac);
+  return slot;
+}
+
+int TagHistory::append(int slot, mac_key_t mac, uint32_t ts, int16_t tempCenti, uint16_t humidCenti)
+{
+  if (!this->_rings)
+  {
+    return -1;
+  }
+
+  uint32_t period = ts / TAG_HISTORY_PERIOD;
+  if (slot < 0 || slot >= TAG_HISTORY_TAGS || this->_rings[slot].mac != mac)
+  {
+    slot = this->_claim(mac, period);
+  }
+
+  TagHistoryRing &ring = this->_rings[slot];
+  // Also restarts after the millis() wrap
+  if (ring.count == 0 || period < ring.lastPeriod || period - ring.lastPeriod >= TAG_HISTORY_LENGTH)
+  {
+    resetRing(ring, mac);
+    pushEntry(ring);
+  }
+  else
+  {
+    // Periods without a sample stay as gaps
+    for (uint32_t p = ring.lastPeriod; p < period; p++)
+    {
+      pushEntry(ring);
+    }
+  }
+  ring.lastPeriod = period;
+
+  if (tempCenti != TAG_TEMP_NONE)
+  {
+    setField(ring.tempDelta[ring.newest], ring.lastTempDeci, centiToDeci(tempCenti));
+  }
+  if (humidCenti != TAG_HUMID_NONE)
+  {
+    setField(ring.humidDelta[ring.newest], ring.lastHumidDeci, centiToDeci(humidCenti));
+  }
+  return slot;
+}
+
+int TagHistory::read(int slot, mac_key_t mac, uint32_t fromTs, uint32_t toTs, TagHistorySample *samples,
+                     int maxSamples) const
+{
+  if (!this->_rings || slot < 0 || slot >= TAG_HISTORY_TAGS || maxSamples <= 0)
+  {
+    return 0;
+  }
+  const TagHistoryRing &ring = this->_rings[slot];
+  if (ring.mac != mac || ring.count == 0)
+  {
+    return 0;
+  }
+
+  uint32_t oldestPeriod = ring.lastPeriod - (ring.count - 1);
+  uint32_t from = fromTs / TAG_HISTORY_PERIOD;
+  uint32_t to = toTs / TAG_HISTORY_PERIOD;
+  if (from < oldestPeriod)
+  {
+    from = oldestPeriod;
+  }
+  if (to > ring.lastPeriod)
+  {
+    to = ring.lastPeriod;
+  }
+  if (from > to)
+  {
+    return 0;
+  }
+  if (to - from + 1 > (uint32_t)maxSamples)
+  {
+    from = to - maxSamples + 1;
+  }
+
+  // Walk back from the newest values, undoing each delta
+  int16_t temp = ring.lastTempDeci;
+  int16_t humid = ring.lastHumidDeci;
+  int index = ring.newest;
+  for (uint32_t period = ring.lastPeriod; period >= from; period--)
+  {
+    int8_t tempDelta = ring.tempDelta[index];
+    int8_t humidDelta = ring.humidDelta[index];
+    if (period <= to)
+    {
+      TagHistorySample &sample = samples[period - from];
+      sample.ts = period * TAG_HISTORY_PERIOD;
+      sample.tempCenti = tempDelta == TAG_HISTORY_GAP ? TAG_TEMP_NONE : temp * 10;
+      sample.humidCenti = humidDelta == TAG_HISTORY_GAP ? TAG_HUMID_NONE : humid * 10;
+    }
+    if (tempDelta != TAG_HISTORY_GAP)
+    {
+      temp -= tempDelta;
+    }
+    if (humidDelta != TAG_HISTORY_GAP)
+    {
+      humid -= humidDelta;
+    }
+    index = index > 0 ? index - 1 : TAG_HISTORY_LENGTH - 1;
+    if (period == 0)
+    {
+      break;
+    }
+  }
+  return to - from + 1;
+}
+
+size_t TagHistory::getMemoryUsage() const
+{
+  return this->_rings ? sizeof(TagHistoryRing) * TAG_HISTORY_TAGS : 0;
+}
@@ -0,0 +1,70 @@
+#ifndef __VSERVESAFE_TAG_HISTORY__
+#define __VSERVESAFE_TAG_HISTORY__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "vservesafe_conf.h"
+#include "MacIndex.h"
+
+// Delta of a minute without a value for that field
+#define TAG_HISTORY_GAP (INT8_MIN)
+
+typedef struct
+{
+    // millis() at the start of the sample's period
+    uint32_t ts;
+    // TAG_TEMP_NONE / TAG_HUMID_NONE for a period without a sample
+    int16_t tempCenti;
+    uint16_t humidCenti;
+} TagHistorySample;
+
+// One tag's last TAG_HISTORY_LENGTH periods. Each entry holds the change in
+// tenths since the previous entry with a value, so a sample takes two bytes;
+// only the newest values are kept whole. A change larger than a delta holds
+// is clamped and caught up by the next entries.
+typedef struct
+{
+    mac_key_t mac;
+    // Period (ts / TAG_HISTORY_PERIOD) of the newest entry
+    uint32_t lastPeriod;
+    // Newest value in tenths, or TAG_HISTORY_NONE before the first one
+    int16_t lastTempDeci;
+    int16_t lastHumidDeci;
+    uint16_t newest;
+    uint16_t count;
+    int8_t tempDelta[TAG_HISTORY_LENGTH];
+    int8_t humidDelta[TAG_HISTORY_LENGTH];
+} TagHistoryRing;
+
+// History rings of up to TAG_HISTORY_TAGS tags in one PSRAM slab. Tags keep
+// the slot number (like name pool slots) and a slot is checked against the
+// MAC, so a reused slot reads as empty. A new tag takes the next slot that is
+// empty or was not written for TAG_HISTORY_STALE periods, else the oldest
+// claimed one.
+class TagHistory
+{
+private:
+    TagHistoryRing *_rings = nullptr;
+    int _next = 0;
+
+    int _claim(mac_key_t mac, uint32_t period);
+
+public:
+    ~TagHistory();
+
+    bool begin();
+    void end();
+    void clear();
+    // Record the tag's current values for the period of ts, replacing an
+    // earlier sample of the same period. O(1) unless periods were skipped.
+    // Returns the tag's slot, which may differ from the one passed in.
+    int append(int slot, mac_key_t mac, uint32_t ts, int16_t tempCenti, uint16_t humidCenti);
+    // Samples with a period in [fromTs, toTs], oldest first, at most
+    // maxSamples (the newest ones); cost grows with the distance from the
+    // newest entry to fromTs. Returns the number written.
+    int read(int slot, mac_key_t mac, uint32_t fromTs, uint32_t toTs, TagHistorySample *samples,
+             int maxSamples) const;
+    size_t getMemoryUsage() const;
+};
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef __VSERVESAFE_TAG_INGEST__
+#define __VSERVESAFE_TAG_INGEST__
+
+#include <stdint.h>
+#include "vservesafe_conf.h"
+#include "AdvDecoder.h"
+#include "SpscRing.h"
+
+// Decoded advert handed by a producer (NimBLE host task, decrypt worker) to
+// the ingest task, the only writer of tag samples
+typedef struct
+{
+    AdvReading reading;
+    uint32_t ts;
+    int8_t rssi;
+    // A copy of a sample already sent; only refreshes last-seen and RSSI
+    bool isCopy;
+    char name[TAG_NAME_LENGTH + 1];
+} TagIngestEvent;
+
+typedef SpscRing<TagIngestEvent, TAG_INGEST_QUEUE_LENGTH> TagAdvertRing;
+typedef SpscRing<TagIngestEvent, MIBEACON_DECRYPT_QUEUE_LENGTH> TagDecryptRing;
+
+#endif
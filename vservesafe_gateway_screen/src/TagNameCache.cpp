@@ -0,0 +1,138 @@
+#include "TagNameCache.h"
+
+#include <string.h>
+#include "hal/HalMemory.h"
+
+#define TAG_NAME_CACHE_MAGIC (0x4D414E54) // "TNAM"
+
+typedef struct
+{
+  uint32_t magic;
+  uint32_t count;
+  uint32_t nameLength;
+} TagNameCacheHeader;
+
+TagNameCache::~TagNameCache()
+{
+  this->end();
+}
+
+bool TagNameCache::begin()
+{
+  this->end();
+  this->_entries = (TagNameEntry *)halAllocLarge(sizeof(TagNameEntry) * TAG_NAME_CACHE_SIZE);
+  return this->_entries != nullptr;
+}
+
+void TagNameCache::end()
+{
+  halFree(this->_entries);
+  this->_entries = nullptr;
+  this->clear();
+}
+
+void TagNameCache::clear()
+{
+  this->_index.clear();
+  this->_count = 0;
+  this->_next = 0;
+}
+
+bool TagNameCache::set(mac_key_t mac, const char *name)
+{
+  if (!this->_entries || name[0] == '\0')
+  {
+    return false;
+  }
+
+  int i = this->_index.find(mac);
+  if (i != -1)
+  {
+    if (strncmp(this->_entries[i].name, name, TAG_NAME_LENGTH) == 0)
+    {
+      return false;
+    }
+  }
+  else
+  {
+    i = this->_next;
+    this->_next = (this->_next + 1) % TAG_NAME_CACHE_SIZE;
+    if (this->_count < TAG_NAME_CACHE_SIZE)
+    {
+      this->_count += 1;
+    }
+    else
+    {
+      this->_index.erase(this->_entries[i].mac);
+    }
+    this->_entries[i].mac = mac;
+    this->_index.insert(mac, i);
+  }
+  strncpy(this->_entries[i].name, name, TAG_NAME_LENGTH);
+  this->_entries[i].name[TAG_NAME_LENGTH] = '\0';
+  return true;
+}
+
+int TagNameCache::findSlot(mac_key_t mac) const
+{
+  return this->_index.find(mac);
+}
+
+const char *TagNameCache::nameAt(int slot, mac_key_t mac) const
+{
+  if (slot < 0 || slot >= this->_count || this->_entries[slot].mac != mac)
+  {
+    return NULL;
+  }
+  return this->_entries[slot].name;
+}
+
+int TagNameCache::count() const
+{
+  return this->_count;
+}
+
+size_t TagNameCache::serializedSize() const
+{
+  return sizeof(TagNameCacheHeader) + sizeof(TagNameEntry) * TAG_NAME_CACHE_SIZE;
+}
+
+// Entries are written oldest first so a reload keeps the replacement order
+size_t TagNameCache::serialize(uint8_t *out) const
+{
+  TagNameCacheHeader header = {TAG_NAME_CACHE_MAGIC, (uint32_t)this->_count, TAG_NAME_LENGTH};
+  memcpy(out, &header, sizeof(header));
+  size_t len = sizeof(header);
+  int first = this->_count < TAG_NAME_CACHE_SIZE ? 0 : this->_next;
+  for (int i = 0; i < this->_count; i++)
+  {
+    memcpy(out + len, &this->_entries[(first + i) % TAG_NAME_CACHE_SIZE], sizeof(TagNameEntry));
+    len += sizeof(TagNameEntry);
+  }
+  return len;
+}
+
+bool TagNameCache::deserialize(const uint8_t *in, size_t len)
+{
+  TagNameCacheHeader header;
+  if (!this->_entries || len < sizeof(header))
+  {
+    return false;
+  }
+  memcpy(&header, in, sizeof(header));
+  if (header.magic != TAG_NAME_CACHE_MAGIC || header.nameLength != TAG_NAME_LENGTH ||
+      header.count > TAG_NAME_CACHE_SIZE || len < sizeof(header) + header.count * sizeof(TagNameEntry))
+  {
+    return false;
+  }
+
+  this->clear();
+  for (uint32_t i = 0; i < header.count; i++)
+  {
+    TagNameEntry entry;
+    memcpy(&entry, in + sizeof(header) + i * sizeof(TagNameEntry), sizeof(entry));
+    entry.name[TAG_NAME_LENGTH] = '\0';
+    this->set(entry.mac, entry.name);
+  }
+  return true;
+}
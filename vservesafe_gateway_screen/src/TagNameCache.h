@@ -0,0 +1,46 @@
+#ifndef __VSERVESAFE_TAG_NAME_CACHE__
+#define __VSERVESAFE_TAG_NAME_CACHE__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "vservesafe_conf.h"
+#include "MacIndex.h"
+
+typedef struct
+{
+    mac_key_t mac;
+    char name[TAG_NAME_LENGTH + 1];
+} TagNameEntry;
+
+// Interned tag names in fixed-size slots keyed by MAC, learned from scan
+// responses or pushed by the server, so a passive scan can still label tags.
+// Tags keep only the slot number. Slots live in PSRAM; once full the oldest
+// is reused, and a slot reused for another MAC reads as no name.
+class TagNameCache
+{
+private:
+    TagNameEntry *_entries = nullptr;
+    MacIndex<TAG_NAME_CACHE_SIZE> _index;
+    int _count = 0;
+    int _next = 0;
+
+public:
+    ~TagNameCache();
+
+    bool begin();
+    void end();
+    void clear();
+    // Returns true if the stored name changed
+    bool set(mac_key_t mac, const char *name);
+    // -1 if the tag has no name
+    int findSlot(mac_key_t mac) const;
+    // NULL unless the slot holds the name of mac
+    const char *nameAt(int slot, mac_key_t mac) const;
+    int count() const;
+
+    size_t serializedSize() const;
+    size_t serialize(uint8_t *out) const;
+    bool deserialize(const uint8_t *in, size_t len);
+};
+
+#endif
@@ -0,0 +1,66 @@
+#include "TagOrder.h"
+
+// Whole dBm from -TAG_ORDER_RSSI_LEVELS + 1 up to 0 each get a bucket
+#define TAG_ORDER_RSSI_LEVELS (128)
+// Notify data (selected scan) x active
+#define TAG_ORDER_GROUPS (4)
+
+// Tags with notify data first (selected scan), then active tags, then the
+// stronger smoothed signal; lower keys are shown first
+static int tagOrderKey(MiTagScanner &scanner, coldsenses_scan_mode scanMode, MiTagData *tagData)
+{
+  int group = 0;
+  if (scanMode == VSERVESAFE_SCANMODE_SELECTED_SCAN &&
+      scanner.getTagNotifyResult(tagData) == VSERVESAFE_NOTIFY_NODATA)
+  {
+    group += 2;
+  }
+  if (!scanner.isTagActive(tagData))
+  {
+    group += 1;
+  }
+
+  int level = -tagSignalRssi(tagData->signal);
+  if (level < 0)
+  {
+    level = 0;
+  }
+  if (level >= TAG_ORDER_RSSI_LEVELS)
+  {
+    level = TAG_ORDER_RSSI_LEVELS - 1;
+  }
+  return group * TAG_ORDER_RSSI_LEVELS + level;
+}
+
+// Counting sort on the key: two passes over the tags, so O(n) however many
+// are stored. Tags with the same key keep their snapshot order.
+int orderTagsForHome(MiTagScanner &scanner, const TagSnapshot *snapshot, coldsenses_scan_mode scanMode,
+                     MiTagData **orderedTagData)
+{
+  // Off the UI task's stack; only the UI orders tags
+  static uint16_t starts[TAG_ORDER_GROUPS * TAG_ORDER_RSSI_LEVELS];
+  for (int i = 0; i < TAG_ORDER_GROUPS * TAG_ORDER_RSSI_LEVELS; i++)
+  {
+    starts[i] = 0;
+  }
+
+  int actualCount = snapshot->count;
+  for (int i = 0; i < actualCount; i++)
+  {
+    starts[tagOrderKey(scanner, scanMode, &snapshot->tags[i])] += 1;
+  }
+  uint16_t pos = 0;
+  for (int i = 0; i < TAG_ORDER_GROUPS * TAG_ORDER_RSSI_LEVELS; i++)
+  {
+    uint16_t count = starts[i];
+    starts[i] = pos;
+    pos += count;
+  }
+  for (int i = 0; i < actualCount; i++)
+  {
+    MiTagData *tagData = &snapshot->tags[i];
+    orderedTagData[starts[tagOrderKey(scanner, scanMode, tagData)]++] = tagData;
+  }
+
+  return actualCount;
+}
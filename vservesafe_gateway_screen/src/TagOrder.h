@@ -0,0 +1,12 @@
+#ifndef __VSERVESAFE_TAG_ORDER__
+#define __VSERVESAFE_TAG_ORDER__
+
+#include "BLE.h"
+
+// Fill orderedTagData with the snapshot's tags in home-screen order and return
+// the number of entries written. orderedTagData must hold snapshot->count
+// items, which point into the snapshot.
+int orderTagsForHome(MiTagScanner &scanner, const TagSnapshot *snapshot, coldsenses_scan_mode scanMode,
+                     MiTagData **orderedTagData);
+
+#endif
@@ -0,0 +1,152 @@
+#include "TagPayload.h"
+
+int formatCenti(char *buffer, size_t size, int32_t centi, int decimals)
+{
+  // Hundredths per printed step, and steps per unit
+  static const uint32_t STEP[] = {100, 10, 1};
+  static const uint32_t UNIT[] = {1, 10, 100};
+  if (decimals < 0)
+  {
+    decimals = 0;
+  }
+  if (decimals > 2)
+  {
+    decimals = 2;
+  }
+
+  uint32_t magnitude = centi < 0 ? 0 - (uint32_t)centi : (uint32_t)centi;
+  uint32_t steps = (magnitude + STEP[decimals] / 2) / STEP[decimals];
+  // No "-0.0" once rounded
+  const char *sign = centi < 0 && steps > 0 ? "-" : "";
+  if (decimals == 0)
+  {
+    return snprintf(buffer, size, "%s%u", sign, (unsigned)steps);
+  }
+  return snprintf(buffer, size, "%s%u.%0*u", sign, (unsigned)(steps / UNIT[decimals]), decimals,
+                  (unsigned)(steps % UNIT[decimals]));
+}
+
+String tagMacAddressKey(MiTagData &tagData)
+{
+  char macAddress[13];
+  snprintf(macAddress, sizeof(macAddress), "%012llX", (unsigned long long)tagData.mac);
+  return macAddress;
+}
+
+String buildTagTopic(MiTagData &tagData)
+{
+  String topic = "push_";
+  topic += tagMacAddressKey(tagData);
+  return topic;
+}
+
+String buildTagPayload(MiTagData &tagData)
+{
+  char value[12];
+  String payload = "temp:";
+  if (tagData.tempCenti == TAG_TEMP_NONE)
+  {
+    payload.concat("-");
+  }
+  else
+  {
+    formatCenti(value, sizeof(value), tagData.tempCenti, 2);
+    payload.concat(value);
+  }
+  payload.concat(",humid:");
+  if (tagData.humidCenti == TAG_HUMID_NONE)
+  {
+    payload.concat("-");
+  }
+  else
+  {
+    formatCenti(value, sizeof(value), tagData.humidCenti, 2);
+    payload.concat(value);
+  }
+  payload.concat(",rssi:");
+  payload.concat(tagSignalRssi(tagData.signal));
+  payload.concat(",rssimin:");
+  payload.concat(tagSignalMin(tagData.signal));
+  payload.concat(",rssimax:");
+  payload.concat(tagSignalMax(tagData.signal));
+  return payload;
+}
+
+String buildPresenceTopic(TagPresenceEvent &event)
+{
+  char topic[24];
+  snprintf(topic, sizeof(topic), "presence_%012llX", (unsigned long long)event.mac);
+  return topic;
+}
+
+String buildPresencePayload(TagPresenceEvent &event)
+{
+  return event.isOnline ? "online:1" : "online:0";
+}
+
+String buildAlarmTopic(TagAlarmEvent &event)
+{
+  char topic[24];
+  snprintf(topic, sizeof(topic), "alarm_%012llX", (unsigned long long)event.mac);
+  return topic;
+}
+
+String buildAlarmPayload(TagAlarmEvent &event)
+{
+  String payload = "alarm:";
+  payload.concat(event.edge == VSERVESAFE_ALARM_EDGE_HIGH  ? "high"
+                 : event.edge == VSERVESAFE_ALARM_EDGE_LOW ? "low"
+                                                           : "clear");
+  if (event.tempCenti != TAG_TEMP_NONE)
+  {
+    char value[12];
+    formatCenti(value, sizeof(value), event.tempCenti, 2);
+    payload.concat(",temp:");
+    payload.concat(value);
+  }
+  return payload;
+}
+
+String buildRuleTopic(TagRuleEvent &event)
+{
+  char topic[24];
+  snprintf(topic, sizeof(topic), "rule_%012llX", (unsigned long long)event.mac);
+  return topic;
+}
+
+String buildRulePayload(TagRuleEvent &event)
+{
+  String payload = "rule:";
+  payload.concat(event.name);
+  payload.concat(event.isActive ? ",active:1" : ",active:0");
+  return payload;
+}
+
+String buildHealthPayload(MiTagScanner &scanner)
+{
+  MiTagIngestStats ingestStats = scanner.getIngestStats();
+  MiTagEvictionStats evictionStats = scanner.getEvictionStats();
+  MiBeaconStats miBeaconStats = scanner.getMiBeaconStats();
+  MiTagReceptionSummary reception = scanner.getReceptionSummary();
+
+  char buffer[320];
+  int len = snprintf(buffer, sizeof(buffer),
+                     "tags:%d,active:%d,adverts:%u,new:%u,dup:%u,missed:%u,loss:%.2f,interval:%u,iat:",
+                     scanner.getTagsCount(), scanner.getActiveTagCount(), scanner.getAdvertTotal(),
+                     ingestStats.newSamples, ingestStats.duplicates, reception.missed,
+                     reception.expected > 0 ? reception.missed * 100.0 / reception.expected : 0.0,
+                     reception.intervalMs);
+  for (int i = 0; i < TAG_RECEPTION_BUCKETS && len < (int)sizeof(buffer); i++)
+  {
+    len += snprintf(buffer + len, sizeof(buffer) - len, i > 0 ? "/%u" : "%u", reception.interArrival[i]);
+  }
+  if (len < (int)sizeof(buffer))
+  {
+    snprintf(buffer + len, sizeof(buffer) - len,
+             ",evict:%u,decrypted:%u,dropped:%u,duty:%d,blocked:%u,qdrop:%u,pdrop:%u,ndrop:%u,adrop:%u,rdrop:%u",
+             evictionStats.evictions, miBeaconStats.decrypted, miBeaconStats.dropped, scanner.getScanDutyPercent(),
+             scanner.getAllowListRejected(), ingestStats.queueDropped, scanner.getPresenceEventsDropped(),
+             scanner.getTagNotifyDropped(), scanner.getAlarmEventsDropped(), scanner.getRuleEventsDropped());
+  }
+  return buffer;
+}
@@ -0,0 +1,24 @@
+#ifndef __VSERVESAFE_TAG_PAYLOAD__
+#define __VSERVESAFE_TAG_PAYLOAD__
+
+#include <Arduino.h>
+#include "BLE.h"
+
+// Write a hundredths value with 0-2 decimals, rounded half away from zero,
+// e.g. -1234 with 1 decimal is "-12.3". Integer math only.
+int formatCenti(char *buffer, size_t size, int32_t centi, int decimals);
+
+String tagMacAddressKey(MiTagData &tagData);
+String buildTagTopic(MiTagData &tagData);
+String buildTagPayload(MiTagData &tagData);
+// Online/offline transitions go to presence_<MAC> as "online:1" / "online:0"
+String buildPresenceTopic(TagPresenceEvent &event);
+String buildPresencePayload(TagPresenceEvent &event);
+String buildAlarmTopic(TagAlarmEvent &event);
+String buildAlarmPayload(TagAlarmEvent &event);
+String buildRuleTopic(TagRuleEvent &event);
+String buildRulePayload(TagRuleEvent &event);
+// Gateway health for the gwinfo topic, same "name:value" style
+String buildHealthPayload(MiTagScanner &scanner);
+
+#endif
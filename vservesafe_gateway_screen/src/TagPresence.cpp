@@ -0,0 +1,223 @@
+#include "TagPresence.h"
+
+#include "hal/HalMemory.h"
+
+// _prev of a slot that is in no bucket
+#define TAG_PRESENCE_UNARMED (-2)
+
+// First tick at or after ms, so a slot never fires early
+static uint32_t tickAtOrAfter(uint32_t ms)
+{
+  return ms / TAG_PRESENCE_TICK + (ms % TAG_PRESENCE_TICK != 0);
+}
+
+static uint32_t bucketOf(uint32_t tick)
+{
+  return tick % TAG_PRESENCE_WHEEL_SLOTS;
+}
+
+TagPresenceWheel::TagPresenceWheel()
+{
+  this->clear();
+}
+
+TagPresenceWheel::~TagPresenceWheel()
+{
+  this->end();
+}
+
+bool TagPresenceWheel::begin(size_t capacity)
+{
+  this->end();
+  this->_next = (int16_t *)halAllocInternal(capacity * sizeof(int16_t));
+  this->_prev = (int16_t *)halAllocInternal(capacity * sizeof(int16_t));
+  this->_expiry = (uint32_t *)halAllocInternal(capacity * sizeof(uint32_t));
+  if (!this->_next || !this->_prev || !this->_expiry)
+  {
+    this->end();
+    return false;
+  }
+  this->_capacity = capacity;
+  this->clear();
+  return true;
+}
+
+bool TagPresenceWheel::resize(size_t capacity)
+{
+  int16_t *next = (int16_t *)halAllocInternal(capacity * sizeof(int16_t));
+  int16_t *prev = (int16_t *)halAllocInternal(capacity * sizeof(int16_t));
+  uint32_t *expiry = (uint32_t *)halAllocInternal(capacity * sizeof(uint32_t));
+  if (!next || !prev || !expiry)
+  {
+    halFree(next);
+    halFree(prev);
+    halFree(expiry);
+    return false;
+  }
+
+  size_t keep = capacity < this->_capacity ? capacity : this->_capacity;
+  for (size_t i = 0; i < capacity; i++)
+  {
+    next[i] = i < keep ? this->_next[i] : -1;
+    prev[i] = i < keep ? this->_prev[i] : TAG_PRESENCE_UNARMED;
+    expiry[i] = i < keep ? this->_expiry[i] : 0;
+  }
+
+  halFree(this->_next);
+  halFree(this->_prev);
+  halFree(this->_expiry);
+  this->_next = next;
+  this->_prev = prev;
+  this->_expiry = expiry;
+  this->_capacity = capacity;
+  return true;
+}
+
+void TagPresenceWheel::end()
+{
+  halFree(this->_next);
+  halFree(this->_prev);
+  halFree(this->_expiry);
+  this->_next = nullptr;
+  this->_prev = nullptr;
+  this->_expiry = nullptr;
+  this->_capacity = 0;
+  this->clear();
+}
+
+size_t TagPresenceWheel::getCapacity() const
+{
+  return this->_capacity;
+}
+
+void TagPresenceWheel::clear()
+{
+  for (int i = 0; i < TAG_PRESENCE_WHEEL_SLOTS; i++)
+  {
+    this->_buckets[i] = -1;
+  }
+  for (size_t i = 0; i < this->_capacity; i++)
+  {
+    this->_prev[i] = TAG_PRESENCE_UNARMED;
+  }
+  this->_armed = 0;
+}
+
+bool TagPresenceWheel::isArmed(int slot) const
+{
+  return this->_prev[slot] != TAG_PRESENCE_UNARMED;
+}
+
+// A slot already due is moved to the next tick to be walked, so its bucket
+// always follows from its expiry
+void TagPresenceWheel::_link(int slot)
+{
+  uint32_t tick = tickAtOrAfter(this->_expiry[slot]);
+  if ((int32_t)(tick - this->_tick) <= 0)
+  {
+    tick = this->_tick + 1;
+    this->_expiry[slot] = tick * TAG_PRESENCE_TICK;
+  }
+  int16_t &head = this->_buckets[bucketOf(tick)];
+  this->_next[slot] = head;
+  this->_prev[slot] = -1;
+  if (head != -1)
+  {
+    this->_prev[head] = slot;
+  }
+  head = slot;
+}
+
+void TagPresenceWheel::arm(int slot, uint32_t expiryTs)
+{
+  this->_expiry[slot] = expiryTs;
+  this->_link(slot);
+  this->_armed += 1;
+}
+
+void TagPresenceWheel::disarm(int slot)
+{
+  if (!this->isArmed(slot))
+  {
+    return;
+  }
+
+  int16_t next = this->_next[slot];
+  int16_t prev = this->_prev[slot];
+  if (next != -1)
+  {
+    this->_prev[next] = prev;
+  }
+  if (prev != -1)
+  {
+    this->_next[prev] = next;
+  }
+  else
+  {
+    this->_buckets[bucketOf(tickAtOrAfter(this->_expiry[slot]))] = next;
+  }
+  this->_prev[slot] = TAG_PRESENCE_UNARMED;
+  this->_armed -= 1;
+}
+
+void TagPresenceWheel::moveSlot(int from, int to)
+{
+  int16_t next = this->_next[from];
+  int16_t prev = this->_prev[from];
+  this->_next[to] = next;
+  this->_prev[to] = prev;
+  this->_expiry[to] = this->_expiry[from];
+  this->_prev[from] = TAG_PRESENCE_UNARMED;
+  if (prev == TAG_PRESENCE_UNARMED)
+  {
+    return;
+  }
+
+  if (next != -1)
+  {
+    this->_prev[next] = to;
+  }
+  if (prev != -1)
+  {
+    this->_next[prev] = to;
+  }
+  else
+  {
+    this->_buckets[bucketOf(tickAtOrAfter(this->_expiry[to]))] = to;
+  }
+}
+
+int TagPresenceWheel::armedCount() const
+{
+  return this->_armed;
+}
+
+void TagPresenceWheel::advance(uint32_t now, tag_presence_expire_cb cb, void *context)
+{
+  uint32_t nowTick = now / TAG_PRESENCE_TICK;
+  uint32_t ticks = nowTick - this->_tick;
+  // After a long pause every bucket is walked once
+  if (ticks > TAG_PRESENCE_WHEEL_SLOTS)
+  {
+    ticks = TAG_PRESENCE_WHEEL_SLOTS;
+  }
+  // Set first so a slot re-armed by the callback lands in a bucket ahead
+  uint32_t firstTick = nowTick - ticks + 1;
+  this->_tick = nowTick;
+
+  for (uint32_t i = 0; i < ticks; i++)
+  {
+    int16_t slot = this->_buckets[bucketOf(firstTick + i)];
+    while (slot != -1)
+    {
+      // The callback may re-arm this slot at the head of any bucket
+      int16_t next = this->_next[slot];
+      if ((int32_t)(now - this->_expiry[slot]) >= 0)
+      {
+        this->disarm(slot);
+        cb(context, slot, now);
+      }
+      slot = next;
+    }
+  }
+}
@@ -0,0 +1,68 @@
+#ifndef __VSERVESAFE_TAG_PRESENCE__
+#define __VSERVESAFE_TAG_PRESENCE__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "vservesafe_conf.h"
+#include "MacIndex.h"
+#include "SpscRing.h"
+
+// A tag came online (first sample after being offline) or went offline (not
+// heard for TAG_ONLINE_TIEMOUT, or dropped from the tag table)
+typedef struct
+{
+    mac_key_t mac;
+    // millis() when the tag was last heard
+    uint32_t ts;
+    bool isOnline;
+} TagPresenceEvent;
+
+typedef SpscRing<TagPresenceEvent, TAG_PRESENCE_QUEUE_LENGTH> TagPresenceRing;
+
+// Called for each slot whose expiry has passed, after it was disarmed; it may
+// arm the slot again
+typedef void (*tag_presence_expire_cb)(void *context, int slot, uint32_t now);
+
+// Hashed timer wheel over tag slot numbers. Each armed slot is linked into
+// the bucket of its expiry tick, so arming and disarming are O(1) and
+// advancing only visits the buckets of the ticks that passed. Expiries more
+// than a turn of the wheel away wait in their bucket until their turn.
+class TagPresenceWheel
+{
+private:
+    int16_t *_next = nullptr;
+    int16_t *_prev = nullptr;
+    uint32_t *_expiry = nullptr;
+    size_t _capacity = 0;
+    int16_t _buckets[TAG_PRESENCE_WHEEL_SLOTS];
+    // Last tick advanced to
+    uint32_t _tick = 0;
+    int _armed = 0;
+
+    void _link(int slot);
+
+public:
+    TagPresenceWheel();
+    ~TagPresenceWheel();
+
+    // Links are kept in internal RAM; armed slots are dropped
+    bool begin(size_t capacity);
+    // Reallocate keeping armed slots; they must be below the new capacity
+    bool resize(size_t capacity);
+    void end();
+    size_t getCapacity() const;
+    void clear();
+
+    bool isArmed(int slot) const;
+    // Arm a disarmed slot to expire at expiryTs (millis)
+    void arm(int slot, uint32_t expiryTs);
+    void disarm(int slot);
+    // Renumber an armed slot, keeping its expiry
+    void moveSlot(int from, int to);
+    int armedCount() const;
+    // Fire every slot that expired by now. The caller re-checks its own
+    // state, so a slot fired early by millis() wrapping is simply re-armed.
+    void advance(uint32_t now, tag_presence_expire_cb cb, void *context);
+};
+
+#endif
@@ -0,0 +1,150 @@
+#include "TagRecency.h"
+
+#include "hal/HalMemory.h"
+
+TagRecencyList::~TagRecencyList()
+{
+  this->end();
+}
+
+bool TagRecencyList::begin(size_t capacity)
+{
+  this->end();
+  this->_newer = (int16_t *)halAllocInternal(capacity * sizeof(int16_t));
+  this->_older = (int16_t *)halAllocInternal(capacity * sizeof(int16_t));
+  if (!this->_newer || !this->_older)
+  {
+    this->end();
+    return false;
+  }
+  this->_capacity = capacity;
+  return true;
+}
+
+bool TagRecencyList::resize(size_t capacity)
+{
+  int16_t *newer = (int16_t *)halAllocInternal(capacity * sizeof(int16_t));
+  int16_t *older = (int16_t *)halAllocInternal(capacity * sizeof(int16_t));
+  if (!newer || !older)
+  {
+    halFree(newer);
+    halFree(older);
+    return false;
+  }
+
+  size_t keep = capacity < this->_capacity ? capacity : this->_capacity;
+  for (size_t i = 0; i < keep; i++)
+  {
+    newer[i] = this->_newer[i];
+    older[i] = this->_older[i];
+  }
+
+  halFree(this->_newer);
+  halFree(this->_older);
+  this->_newer = newer;
+  this->_older = older;
+  this->_capacity = capacity;
+  return true;
+}
+
+void TagRecencyList::end()
+{
+  halFree(this->_newer);
+  halFree(this->_older);
+  this->_newer = nullptr;
+  this->_older = nullptr;
+  this->_capacity = 0;
+  this->clear();
+}
+
+size_t TagRecencyList::getCapacity() const
+{
+  return this->_capacity;
+}
+
+void TagRecencyList::clear()
+{
+  this->_newest = -1;
+  this->_oldest = -1;
+}
+
+void TagRecencyList::unlink(int slot)
+{
+  int16_t newer = this->_newer[slot];
+  int16_t older = this->_older[slot];
+  if (newer != -1)
+  {
+    this->_older[newer] = older;
+  }
+  else
+  {
+    this->_newest = older;
+  }
+  if (older != -1)
+  {
+    this->_newer[older] = newer;
+  }
+  else
+  {
+    this->_oldest = newer;
+  }
+}
+
+void TagRecencyList::pushNewest(int slot)
+{
+  this->_newer[slot] = -1;
+  this->_older[slot] = this->_newest;
+  if (this->_newest != -1)
+  {
+    this->_newer[this->_newest] = slot;
+  }
+  else
+  {
+    this->_oldest = slot;
+  }
+  this->_newest = slot;
+}
+
+void TagRecencyList::touch(int slot)
+{
+  if (this->_newest == slot)
+  {
+    return;
+  }
+  this->unlink(slot);
+  this->pushNewest(slot);
+}
+
+void TagRecencyList::moveSlot(int from, int to)
+{
+  int16_t newer = this->_newer[from];
+  int16_t older = this->_older[from];
+  this->_newer[to] = newer;
+  this->_older[to] = older;
+  if (newer != -1)
+  {
+    this->_older[newer] = to;
+  }
+  else
+  {
+    this->_newest = to;
+  }
+  if (older != -1)
+  {
+    this->_newer[older] = to;
+  }
+  else
+  {
+    this->_oldest = to;
+  }
+}
+
+int TagRecencyList::oldest() const
+{
+  return this->_oldest;
+}
+
+int TagRecencyList::newerThan(int slot) const
+{
+  return this->_newer[slot];
+}
@@ -0,0 +1,42 @@
+#ifndef __VSERVESAFE_TAG_RECENCY__
+#define __VSERVESAFE_TAG_RECENCY__
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Doubly linked recency list threaded through tag slot numbers. The links live
+// in arrays indexed by slot, so touching or unlinking a slot is O(1) and the
+// least recently heard tag is always at the tail.
+class TagRecencyList
+{
+private:
+    int16_t *_newer = nullptr;
+    int16_t *_older = nullptr;
+    size_t _capacity = 0;
+    int16_t _newest = -1;
+    int16_t _oldest = -1;
+
+public:
+    ~TagRecencyList();
+
+    // Links are kept in internal RAM; existing links are dropped
+    bool begin(size_t capacity);
+    // Reallocate keeping the links; live slots must be below the new capacity
+    bool resize(size_t capacity);
+    void end();
+    size_t getCapacity() const;
+    void clear();
+
+    void unlink(int slot);
+    // Link a slot that is not in the list as the most recent one
+    void pushNewest(int slot);
+    // Move a linked slot to the most recent end
+    void touch(int slot);
+    // Renumber a linked slot, keeping its position in the list
+    void moveSlot(int from, int to);
+
+    int oldest() const;
+    int newerThan(int slot) const;
+};
+
+#endif
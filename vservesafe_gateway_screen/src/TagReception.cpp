@@ -0,0 +1,63 @@
+#include "TagReception.h"
+
+#include <string.h>
+#include "vservesafe_conf.h"
+
+void resetTagReception(TagReceptionStats &stats, uint32_t ts)
+{
+  memset(&stats, 0, sizeof(stats));
+  stats.lastSampleTs = ts;
+  stats.received = 1;
+}
+
+void trackTagReception(TagReceptionStats &stats, uint8_t lastCounter, uint8_t counter, uint32_t ts)
+{
+  uint32_t elapsed = ts - stats.lastSampleTs;
+  stats.lastSampleTs = ts;
+  stats.received += 1;
+
+  // The 8-bit counter can wrap unseen while a tag is offline, and an equal
+  // counter outside the duplicate window says nothing about the gap
+  uint8_t steps = counter - lastCounter;
+  if (elapsed > TAG_ONLINE_TIEMOUT || steps == 0)
+  {
+    return;
+  }
+
+  stats.expected += steps;
+  stats.missed += steps - 1;
+
+  uint32_t intervalMs = elapsed / steps;
+  if (stats.intervalMs == 0)
+  {
+    stats.intervalMs = intervalMs;
+  }
+  else
+  {
+    // EWMA, alpha = 1/8
+    stats.intervalMs = (int32_t)stats.intervalMs + (((int32_t)intervalMs - (int32_t)stats.intervalMs) / 8);
+  }
+
+  uint16_t &bucket = stats.interArrival[tagReceptionBucket(elapsed)];
+  if (bucket < UINT16_MAX)
+  {
+    bucket += 1;
+  }
+}
+
+double tagReceptionLossPercent(const TagReceptionStats &stats)
+{
+  return stats.expected > 0 ? stats.missed * 100.0 / stats.expected : 0.0;
+}
+
+int tagReceptionBucket(uint32_t elapsedMs)
+{
+  int bucket = 0;
+  uint32_t seconds = elapsedMs / 1000;
+  while (seconds > 0 && bucket < TAG_RECEPTION_BUCKETS - 1)
+  {
+    seconds >>= 1;
+    bucket += 1;
+  }
+  return bucket;
+}
@@ -0,0 +1,29 @@
+#ifndef __VSERVESAFE_TAG_RECEPTION__
+#define __VSERVESAFE_TAG_RECEPTION__
+
+#include <stdint.h>
+
+// Inter-arrival buckets: < 1 s, 1-2 s, 2-4 s ... 32-64 s, >= 64 s
+#define TAG_RECEPTION_BUCKETS (8)
+
+// Reception quality of one tag, from gaps in its frame counter between new
+// samples
+typedef struct
+{
+    uint32_t lastSampleTs;
+    uint32_t received;
+    // Samples the tag sent since the first one heard (sum of counter steps)
+    uint32_t expected;
+    uint32_t missed;
+    // Smoothed time between samples the tag sends, in ms
+    uint32_t intervalMs;
+    uint16_t interArrival[TAG_RECEPTION_BUCKETS];
+} TagReceptionStats;
+
+void resetTagReception(TagReceptionStats &stats, uint32_t ts);
+// Account a new sample with frame counter `counter` following `lastCounter`
+void trackTagReception(TagReceptionStats &stats, uint8_t lastCounter, uint8_t counter, uint32_t ts);
+double tagReceptionLossPercent(const TagReceptionStats &stats);
+int tagReceptionBucket(uint32_t elapsedMs);
+
+#endif
@@ -0,0 +1,642 @@
+#include "TagRules.h"
+
+#include <string.h>
+
+static_assert(MAX_TAG_RULES <= 32, "MiTagData::ruleActive holds a bit per rule");
+
+typedef enum
+{
+  TAG_RULE_OP_PUSH,
+  TAG_RULE_OP_LOAD,
+  TAG_RULE_OP_NEG,
+  TAG_RULE_OP_NOT,
+  TAG_RULE_OP_ADD,
+  TAG_RULE_OP_SUB,
+  TAG_RULE_OP_MUL,
+  TAG_RULE_OP_DIV,
+  TAG_RULE_OP_LT,
+  TAG_RULE_OP_LE,
+  TAG_RULE_OP_GT,
+  TAG_RULE_OP_GE,
+  TAG_RULE_OP_EQ,
+  TAG_RULE_OP_NE,
+  TAG_RULE_OP_AND,
+  TAG_RULE_OP_OR,
+} tag_rule_op;
+
+// Comparisons and logic give 1.00 or 0
+#define TAG_RULE_TRUE (100)
+// Numbers are kept in hundredths in an int32_t
+#define TAG_RULE_NUMBER_MAX (20000000)
+// Parentheses and unary operators, bounding the parser's recursion
+#define TAG_RULE_NESTING_MAX (16)
+
+static const char *const TAG_RULE_VAR_NAMES[VSERVESAFE_RULE_VAR_COUNT] = {
+    "temp", "humid", "rate", "batt", "battpct", "offline",
+};
+
+typedef struct
+{
+  const char *text;
+  size_t len;
+  size_t pos;
+  TagRuleProgram *program;
+  int depth;
+  int nesting;
+} TagRuleCompiler;
+
+static bool parseOr(TagRuleCompiler &compiler);
+
+static void skipSpace(TagRuleCompiler &compiler)
+{
+  while (compiler.pos < compiler.len && (compiler.text[compiler.pos] == ' ' || compiler.text[compiler.pos] == '\t'))
+  {
+    compiler.pos += 1;
+  }
+}
+
+// Consumes the token if it is next
+static bool acceptToken(TagRuleCompiler &compiler, const char *token)
+{
+  skipSpace(compiler);
+  size_t tokenLen = strlen(token);
+  if (compiler.len - compiler.pos < tokenLen || strncmp(compiler.text + compiler.pos, token, tokenLen) != 0)
+  {
+    return false;
+  }
+  compiler.pos += tokenLen;
+  return true;
+}
+
+// depthChange is the op's effect on the stack depth
+static bool emit(TagRuleCompiler &compiler, uint8_t op, int depthChange, const uint8_t *operand = NULL,
+                 size_t operandLen = 0)
+{
+  TagRuleProgram &program = *compiler.program;
+  if (program.length + 1 + operandLen > TAG_RULE_CODE_LENGTH)
+  {
+    return false;
+  }
+  compiler.depth += depthChange;
+  if (compiler.depth > TAG_RULE_STACK_DEPTH)
+  {
+    return false;
+  }
+  program.code[program.length++] = op;
+  for (size_t i = 0; i < operandLen; i++)
+  {
+    program.code[program.length++] = operand[i];
+  }
+  return true;
+}
+
+// Up to two decimals, to hundredths
+static bool parseNumber(TagRuleCompiler &compiler)
+{
+  int64_t centi = 0;
+  int digits = 0;
+  int decimals = -1;
+  while (compiler.pos < compiler.len)
+  {
+    char c = compiler.text[compiler.pos];
+    if (c == '.' && decimals < 0)
+    {
+      decimals = 0;
+    }
+    else if (c >= '0' && c <= '9' && decimals < 2 && centi <= TAG_RULE_NUMBER_MAX)
+    {
+      centi = centi * 10 + (c - '0');
+      digits += 1;
+      decimals += decimals >= 0;
+    }
+    else
+    {
+      break;
+    }
+    compiler.pos += 1;
+  }
+  for (int i = decimals < 0 ? 0 : decimals; i < 2; i++)
+  {
+    centi *= 10;
+  }
+  if (digits == 0 || centi > TAG_RULE_NUMBER_MAX * 100)
+  {
+    return false;
+  }
+  uint8_t operand[4] = {(uint8_t)centi, (uint8_t)(centi >> 8), (uint8_t)(centi >> 16), (uint8_t)(centi >> 24)};
+  return emit(compiler, TAG_RULE_OP_PUSH, 1, operand, sizeof(operand));
+}
+
+static bool parseVariable(TagRuleCompiler &compiler)
+{
+  size_t start = compiler.pos;
+  while (compiler.pos < compiler.len && compiler.text[compiler.pos] >= 'a' && compiler.text[compiler.pos] <= 'z')
+  {
+    compiler.pos += 1;
+  }
+  size_t nameLen = compiler.pos - start;
+  for (uint8_t var = 0; var < VSERVESAFE_RULE_VAR_COUNT; var++)
+  {
+    if (strlen(TAG_RULE_VAR_NAMES[var]) == nameLen &&
+        strncmp(compiler.text + start, TAG_RULE_VAR_NAMES[var], nameLen) == 0)
+    {
+      compiler.program->inputs |= 1 << var;
+      return emit(compiler, TAG_RULE_OP_LOAD, 1, &var, 1);
+    }
+  }
+  return false;
+}
+
+static bool parseUnary(TagRuleCompiler &compiler);
+
+static bool parsePrimary(TagRuleCompiler &compiler)
+{
+  if (acceptToken(compiler, "("))
+  {
+    return parseOr(compiler) && acceptToken(compiler, ")");
+  }
+  if (compiler.pos >= compiler.len)
+  {
+    return false;
+  }
+  char c = compiler.text[compiler.pos];
+  if ((c >= '0' && c <= '9') || c == '.')
+  {
+    return parseNumber(compiler);
+  }
+  return parseVariable(compiler);
+}
+
+static bool parseNested(TagRuleCompiler &compiler, bool (*parse)(TagRuleCompiler &compiler))
+{
+  if (compiler.nesting >= TAG_RULE_NESTING_MAX)
+  {
+    return false;
+  }
+  compiler.nesting += 1;
+  bool isParsed = parse(compiler);
+  compiler.nesting -= 1;
+  return isParsed;
+}
+
+static bool parseUnary(TagRuleCompiler &compiler)
+{
+  if (acceptToken(compiler, "-"))
+  {
+    return parseNested(compiler, parseUnary) && emit(compiler, TAG_RULE_OP_NEG, 0);
+  }
+  if (acceptToken(compiler, "!"))
+  {
+    return parseNested(compiler, parseUnary) && emit(compiler, TAG_RULE_OP_NOT, 0);
+  }
+  return parseNested(compiler, parsePrimary);
+}
+
+static bool parseTerm(TagRuleCompiler &compiler)
+{
+  if (!parseUnary(compiler))
+  {
+    return false;
+  }
+  while (true)
+  {
+    uint8_t op;
+    if (acceptToken(compiler, "*"))
+    {
+      op = TAG_RULE_OP_MUL;
+    }
+    else if (acceptToken(compiler, "/"))
+    {
+      op = TAG_RULE_OP_DIV;
+    }
+    else
+    {
+      return true;
+    }
+    if (!parseUnary(compiler) || !emit(compiler, op, -1))
+    {
+      return false;
+    }
+  }
+}
+
+static bool parseSum(TagRuleCompiler &compiler)
+{
+  if (!parseTerm(compiler))
+  {
+    return false;
+  }
+  while (true)
+  {
+    uint8_t op;
+    if (acceptToken(compiler, "+"))
+    {
+      op = TAG_RULE_OP_ADD;
+    }
+    else if (acceptToken(compiler, "-"))
+    {
+      op = TAG_RULE_OP_SUB;
+    }
+    else
+    {
+      return true;
+    }
+    if (!parseTerm(compiler) || !emit(compiler, op, -1))
+    {
+      return false;
+    }
+  }
+}
+
+// At most one comparison per operand, as in "a < b && b < c"
+static bool parseComparison(TagRuleCompiler &compiler)
+{
+  if (!parseSum(compiler))
+  {
+    return false;
+  }
+  // Two character operators first
+  static const char *const TOKENS[] = {"<=", ">=", "==", "!=", "<", ">"};
+  static const uint8_t OPS[] = {TAG_RULE_OP_LE, TAG_RULE_OP_GE, TAG_RULE_OP_EQ,
+                                TAG_RULE_OP_NE, TAG_RULE_OP_LT, TAG_RULE_OP_GT};
+  for (size_t i = 0; i < sizeof(OPS); i++)
+  {
+    if (acceptToken(compiler, TOKENS[i]))
+    {
+      return parseSum(compiler) && emit(compiler, OPS[i], -1);
+    }
+  }
+  return true;
+}
+
+static bool parseAnd(TagRuleCompiler &compiler)
+{
+  if (!parseComparison(compiler))
+  {
+    return false;
+  }
+  while (acceptToken(compiler, "&&"))
+  {
+    if (!parseComparison(compiler) || !emit(compiler, TAG_RULE_OP_AND, -1))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool parseOr(TagRuleCompiler &compiler)
+{
+  if (!parseAnd(compiler))
+  {
+    return false;
+  }
+  while (acceptToken(compiler, "||"))
+  {
+    if (!parseAnd(compiler) || !emit(compiler, TAG_RULE_OP_OR, -1))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool compileTagRule(const char *text, size_t len, TagRuleProgram &program)
+{
+  program.length = 0;
+  program.inputs = 0;
+  TagRuleCompiler compiler = {text, len, 0, &program, 0, 0};
+  if (!parseOr(compiler))
+  {
+    return false;
+  }
+  skipSpace(compiler);
+  return compiler.pos == len && compiler.depth == 1;
+}
+
+static int32_t clampRuleValue(int64_t value)
+{
+  return value > INT32_MAX ? INT32_MAX : value < -INT32_MAX ? -INT32_MAX : (int32_t)value;
+}
+
+bool evalTagRule(const TagRuleProgram &program, const int32_t *values, tag_rule_inputs_t valid)
+{
+  // The compiler bounds the depth
+  int32_t stack[TAG_RULE_STACK_DEPTH];
+  int sp = 0;
+  const uint8_t *code = program.code;
+  for (int pc = 0; pc < program.length;)
+  {
+    uint8_t op = code[pc++];
+    if (op == TAG_RULE_OP_PUSH)
+    {
+      stack[sp++] = (int32_t)(code[pc] | code[pc + 1] << 8 | code[pc + 2] << 16 | (uint32_t)code[pc + 3] << 24);
+      pc += 4;
+      continue;
+    }
+    if (op == TAG_RULE_OP_LOAD)
+    {
+      uint8_t var = code[pc++];
+      if (!(valid & (1 << var)))
+      {
+        return false;
+      }
+      stack[sp++] = values[var];
+      continue;
+    }
+    if (op == TAG_RULE_OP_NEG)
+    {
+      stack[sp - 1] = -stack[sp - 1];
+      continue;
+    }
+    if (op == TAG_RULE_OP_NOT)
+    {
+      stack[sp - 1] = stack[sp - 1] == 0 ? TAG_RULE_TRUE : 0;
+      continue;
+    }
+
+    int32_t b = stack[--sp];
+    int32_t a = stack[sp - 1];
+    int64_t result;
+    switch (op)
+    {
+    case TAG_RULE_OP_ADD:
+      result = (int64_t)a + b;
+      break;
+    case TAG_RULE_OP_SUB:
+      result = (int64_t)a - b;
+      break;
+    case TAG_RULE_OP_MUL:
+      result = (int64_t)a * b / 100;
+      break;
+    case TAG_RULE_OP_DIV:
+      if (b == 0)
+      {
+        return false;
+      }
+      result = (int64_t)a * 100 / b;
+      break;
+    case TAG_RULE_OP_LT:
+      result = a < b ? TAG_RULE_TRUE : 0;
+      break;
+    case TAG_RULE_OP_LE:
+      result = a <= b ? TAG_RULE_TRUE : 0;
+      break;
+    case TAG_RULE_OP_GT:
+      result = a > b ? TAG_RULE_TRUE : 0;
+      break;
+    case TAG_RULE_OP_GE:
+      result = a >= b ? TAG_RULE_TRUE : 0;
+      break;
+    case TAG_RULE_OP_EQ:
+      result = a == b ? TAG_RULE_TRUE : 0;
+      break;
+    case TAG_RULE_OP_NE:
+      result = a != b ? TAG_RULE_TRUE : 0;
+      break;
+    case TAG_RULE_OP_AND:
+      result = a != 0 && b != 0 ? TAG_RULE_TRUE : 0;
+      break;
+    case TAG_RULE_OP_OR:
+      result = a != 0 || b != 0 ? TAG_RULE_TRUE : 0;
+      break;
+    default:
+      return false;
+    }
+    stack[sp - 1] = clampRuleValue(result);
+  }
+  return sp == 1 && stack[0] != 0;
+}
+
+TagRuleSet::TagRuleSet()
+{
+  this->clear();
+}
+
+void TagRuleSet::clear()
+{
+  for (int i = 0; i < MAX_TAG_RULES; i++)
+  {
+    this->_rules[i].used = false;
+  }
+  for (int i = 0; i < VSERVESAFE_RULE_VAR_COUNT; i++)
+  {
+    this->_inputMasks[i] = 0;
+  }
+  this->_globalMask = 0;
+  this->_scopeIndex.clear();
+  this->_scopeCount = 0;
+}
+
+// Drop the rule from the masks. The last scope moves into an emptied one to
+// keep them dense.
+void TagRuleSet::_unscope(int rule)
+{
+  uint32_t bit = 1UL << rule;
+  this->_globalMask &= ~bit;
+  for (int i = 0; i < VSERVESAFE_RULE_VAR_COUNT; i++)
+  {
+    this->_inputMasks[i] &= ~bit;
+  }
+
+  mac_key_t scope = this->_rules[rule].scope;
+  int slot = scope == MAC_KEY_EMPTY ? -1 : this->_scopeIndex.find(scope);
+  if (slot == -1)
+  {
+    return;
+  }
+  this->_scopeMasks[slot] &= ~bit;
+  if (this->_scopeMasks[slot] != 0)
+  {
+    return;
+  }
+  int last = this->_scopeCount - 1;
+  this->_scopeIndex.erase(scope);
+  if (slot != last)
+  {
+    this->_scopeMacs[slot] = this->_scopeMacs[last];
+    this->_scopeMasks[slot] = this->_scopeMasks[last];
+    this->_scopeIndex.insert(this->_scopeMacs[slot], slot);
+  }
+  this->_scopeCount -= 1;
+}
+
+int TagRuleSet::set(const char *name, mac_key_t scope, const TagRuleProgram &program)
+{
+  int rule = -1;
+  int freeRule = -1;
+  for (int i = 0; i < MAX_TAG_RULES && rule == -1; i++)
+  {
+    if (this->_rules[i].used && strcmp(this->_rules[i].name, name) == 0)
+    {
+      rule = i;
+    }
+    else if (!this->_rules[i].used && freeRule == -1)
+    {
+      freeRule = i;
+    }
+  }
+  if (rule == -1)
+  {
+    rule = freeRule;
+  }
+  if (rule == -1)
+  {
+    return -1;
+  }
+  // Every scope holds a rule, so one is free for the new rule's scope
+  if (this->_rules[rule].used)
+  {
+    this->_unscope(rule);
+  }
+
+  uint32_t bit = 1UL << rule;
+  TagRule &tagRule = this->_rules[rule];
+  strncpy(tagRule.name, name, TAG_RULE_NAME_LENGTH);
+  tagRule.name[TAG_RULE_NAME_LENGTH] = '\0';
+  tagRule.scope = scope;
+  tagRule.program = program;
+  tagRule.used = true;
+
+  for (int i = 0; i < VSERVESAFE_RULE_VAR_COUNT; i++)
+  {
+    if (program.inputs & (1 << i))
+    {
+      this->_inputMasks[i] |= bit;
+    }
+  }
+  if (scope == MAC_KEY_EMPTY)
+  {
+    this->_globalMask |= bit;
+    return rule;
+  }
+  int slot = this->_scopeIndex.find(scope);
+  if (slot == -1)
+  {
+    slot = this->_scopeCount;
+    this->_scopeMacs[slot] = scope;
+    this->_scopeMasks[slot] = 0;
+    this->_scopeIndex.insert(scope, slot);
+    this->_scopeCount += 1;
+  }
+  this->_scopeMasks[slot] |= bit;
+  return rule;
+}
+
+int TagRuleSet::remove(const char *name)
+{
+  for (int i = 0; i < MAX_TAG_RULES; i++)
+  {
+    if (this->_rules[i].used && strcmp(this->_rules[i].name, name) == 0)
+    {
+      this->_unscope(i);
+      this->_rules[i].used = false;
+      return i;
+    }
+  }
+  return -1;
+}
+
+int TagRuleSet::count() const
+{
+  return __builtin_popcount(this->usedMask());
+}
+
+uint32_t TagRuleSet::usedMask() const
+{
+  uint32_t mask = 0;
+  for (int i = 0; i < MAX_TAG_RULES; i++)
+  {
+    mask |= (uint32_t)this->_rules[i].used << i;
+  }
+  return mask;
+}
+
+const char *TagRuleSet::name(int rule) const
+{
+  return this->_rules[rule].name;
+}
+
+uint32_t TagRuleSet::affected(mac_key_t mac, tag_rule_inputs_t changed) const
+{
+  uint32_t mask = this->_globalMask;
+  int slot = this->_scopeCount > 0 ? this->_scopeIndex.find(mac) : -1;
+  if (slot != -1)
+  {
+    mask |= this->_scopeMasks[slot];
+  }
+  uint32_t reading = 0;
+  for (int i = 0; i < VSERVESAFE_RULE_VAR_COUNT; i++)
+  {
+    if (changed & (1 << i))
+    {
+      reading |= this->_inputMasks[i];
+    }
+  }
+  return mask & reading;
+}
+
+tag_rule_inputs_t TagRuleSet::_loadValues(MiTagData &tagData, uint32_t now, int32_t *values) const
+{
+  values[VSERVESAFE_RULE_VAR_TEMP] = tagData.tempCenti;
+  values[VSERVESAFE_RULE_VAR_HUMID] = tagData.humidCenti;
+  values[VSERVESAFE_RULE_VAR_RATE] = tagData.rateCenti;
+  values[VSERVESAFE_RULE_VAR_BATT] = tagData.battMv * 100;
+  values[VSERVESAFE_RULE_VAR_BATT_PERCENT] = tagData.battPercent * 100;
+  values[VSERVESAFE_RULE_VAR_OFFLINE] = (now - tagData.ts) / 10;
+
+  tag_rule_inputs_t valid = 1 << VSERVESAFE_RULE_VAR_OFFLINE;
+  valid |= (tagData.tempCenti != TAG_TEMP_NONE) << VSERVESAFE_RULE_VAR_TEMP;
+  valid |= (tagData.humidCenti != TAG_HUMID_NONE) << VSERVESAFE_RULE_VAR_HUMID;
+  valid |= (tagData.rateCenti != TAG_RATE_NONE) << VSERVESAFE_RULE_VAR_RATE;
+  // Decoders leave 0 for a value the tag does not send
+  valid |= (tagData.battMv != 0) << VSERVESAFE_RULE_VAR_BATT;
+  valid |= (tagData.battPercent != 0) << VSERVESAFE_RULE_VAR_BATT_PERCENT;
+  return valid;
+}
+
+int TagRuleSet::evaluate(MiTagData &tagData, tag_rule_inputs_t changed, uint32_t now, tag_rule_edge_cb cb,
+                         void *context)
+{
+  uint32_t mask = this->affected(tagData.mac, changed);
+  if (mask == 0)
+  {
+    return 0;
+  }
+
+  int32_t values[VSERVESAFE_RULE_VAR_COUNT];
+  tag_rule_inputs_t valid = this->_loadValues(tagData, now, values);
+  int run = 0;
+  while (mask != 0)
+  {
+    int rule = __builtin_ctz(mask);
+    uint32_t bit = 1UL << rule;
+    mask &= ~bit;
+    bool isActive = evalTagRule(this->_rules[rule].program, values, valid);
+    run += 1;
+    if (isActive != ((tagData.ruleActive & bit) != 0))
+    {
+      tagData.ruleActive ^= bit;
+      cb(context, &tagData, rule, isActive);
+    }
+  }
+  return run;
+}
+
+void TagRuleSet::evaluateRule(MiTagData &tagData, int rule, uint32_t now, tag_rule_edge_cb cb, void *context)
+{
+  const TagRule &tagRule = this->_rules[rule];
+  bool isActive = false;
+  if (tagRule.used && (tagRule.scope == MAC_KEY_EMPTY || tagRule.scope == tagData.mac))
+  {
+    int32_t values[VSERVESAFE_RULE_VAR_COUNT];
+    tag_rule_inputs_t valid = this->_loadValues(tagData, now, values);
+    isActive = evalTagRule(tagRule.program, values, valid);
+  }
+  uint32_t bit = 1UL << rule;
+  if (isActive != ((tagData.ruleActive & bit) != 0))
+  {
+    tagData.ruleActive ^= bit;
+    cb(context, &tagData, rule, isActive);
+  }
+}
@@ -0,0 +1,121 @@
+#ifndef __VSERVESAFE_TAG_RULES__
+#define __VSERVESAFE_TAG_RULES__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "vservesafe_conf.h"
+#include "MacIndex.h"
+#include "SpscRing.h"
+#include "TagData.h"
+
+// Values a rule expression can read, all in hundredths like the tag record:
+//   temp     degrees C
+//   humid    % RH
+//   rate     degrees C per minute (smoothed), see MiTagData::rateCenti
+//   batt     battery mV
+//   battpct  battery %
+//   offline  seconds since the tag was last heard
+typedef enum
+{
+    VSERVESAFE_RULE_VAR_TEMP,
+    VSERVESAFE_RULE_VAR_HUMID,
+    VSERVESAFE_RULE_VAR_RATE,
+    VSERVESAFE_RULE_VAR_BATT,
+    VSERVESAFE_RULE_VAR_BATT_PERCENT,
+    VSERVESAFE_RULE_VAR_OFFLINE,
+    VSERVESAFE_RULE_VAR_COUNT,
+} coldsenses_rule_var;
+
+// Bit (1 << var) per coldsenses_rule_var
+typedef uint8_t tag_rule_inputs_t;
+
+#define TAG_RULE_INPUTS_ALL ((tag_rule_inputs_t)((1 << VSERVESAFE_RULE_VAR_COUNT) - 1))
+
+// Expression compiled to postfix bytecode for a small stack machine
+typedef struct
+{
+    uint8_t code[TAG_RULE_CODE_LENGTH];
+    uint8_t length;
+    // Variables the expression reads
+    tag_rule_inputs_t inputs;
+} TagRuleProgram;
+
+// Expressions use the variables above, numbers with up to two decimals,
+// + - * / (unary -), < <= > >= == !=, && || ! and parentheses, e.g.
+//   humid > 85 && temp > 5
+//   rate > 0.5 || batt < 2500
+// Returns false on a syntax error, or if the program does not fit
+// TAG_RULE_CODE_LENGTH / TAG_RULE_STACK_DEPTH.
+bool compileTagRule(const char *text, size_t len, TagRuleProgram &program);
+// True if the rule holds. A rule reading a value the tag has not sent yet,
+// or dividing by zero, does not hold.
+bool evalTagRule(const TagRuleProgram &program, const int32_t *values, tag_rule_inputs_t valid);
+
+// A rule started or stopped holding for a tag
+typedef struct
+{
+    mac_key_t mac;
+    uint32_t ts;
+    char name[TAG_RULE_NAME_LENGTH + 1];
+    bool isActive;
+} TagRuleEvent;
+
+typedef SpscRing<TagRuleEvent, TAG_RULE_QUEUE_LENGTH> TagRuleRing;
+
+typedef void (*tag_rule_edge_cb)(void *context, MiTagData *tagData, int rule, bool isActive);
+
+// Rules by name, each for all tags or for one tag. For every rule the set
+// keeps which variables it reads, so a sample only runs the rules of its tag
+// that read a value the sample changed. Which rules hold for a tag is kept
+// in its record (MiTagData::ruleActive, bit per rule index).
+class TagRuleSet
+{
+private:
+    typedef struct
+    {
+        char name[TAG_RULE_NAME_LENGTH + 1];
+        // MAC_KEY_EMPTY for all tags
+        mac_key_t scope;
+        TagRuleProgram program;
+        bool used;
+    } TagRule;
+
+    TagRule _rules[MAX_TAG_RULES];
+    // Rules for all tags
+    uint32_t _globalMask = 0;
+    // Rules reading each variable
+    uint32_t _inputMasks[VSERVESAFE_RULE_VAR_COUNT];
+    // Rules of single tags, dense in [0, _scopeCount)
+    MacIndex<MAX_TAG_RULES> _scopeIndex;
+    mac_key_t _scopeMacs[MAX_TAG_RULES];
+    uint32_t _scopeMasks[MAX_TAG_RULES];
+    int _scopeCount = 0;
+
+    void _unscope(int rule);
+    tag_rule_inputs_t _loadValues(MiTagData &tagData, uint32_t now, int32_t *values) const;
+
+public:
+    TagRuleSet();
+
+    // Name is up to TAG_RULE_NAME_LENGTH characters. Replaces a rule of the
+    // same name. Returns the rule index, -1 if the set is full.
+    int set(const char *name, mac_key_t scope, const TagRuleProgram &program);
+    // Returns the index the rule had, -1 if there is none
+    int remove(const char *name);
+    void clear();
+    int count() const;
+    // Bit per rule index in use
+    uint32_t usedMask() const;
+    const char *name(int rule) const;
+    // Rules of the tag that read any of the changed variables; O(1)
+    uint32_t affected(mac_key_t mac, tag_rule_inputs_t changed) const;
+    // Run the affected rules on the record and update its ruleActive,
+    // calling cb for each rule that started or stopped holding. Returns the
+    // number of rules run.
+    int evaluate(MiTagData &tagData, tag_rule_inputs_t changed, uint32_t now, tag_rule_edge_cb cb, void *context);
+    // Run one rule on the record, e.g. after it was set; a rule that was
+    // removed or whose scope no longer covers the tag stops holding
+    void evaluateRule(MiTagData &tagData, int rule, uint32_t now, tag_rule_edge_cb cb, void *context);
+};
+
+#endif
@@ -0,0 +1,58 @@
+#include "TagSignal.h"
+
+#include "vservesafe_conf.h"
+
+void resetTagSignal(TagSignalStats &stats, int rssi, uint32_t ts)
+{
+  stats.rssiEwma = (int16_t)(rssi * (1 << TAG_SIGNAL_FRAC_BITS));
+  stats.windowMin = rssi;
+  stats.windowMax = rssi;
+  stats.prevMin = rssi;
+  stats.prevMax = rssi;
+  stats.windowStartTs = ts;
+}
+
+void trackTagSignal(TagSignalStats &stats, int rssi, uint32_t ts)
+{
+  int32_t sample = rssi * (1 << TAG_SIGNAL_FRAC_BITS);
+  stats.rssiEwma = (int16_t)(stats.rssiEwma + ((sample - stats.rssiEwma) / (1 << TAG_SIGNAL_EWMA_SHIFT)));
+
+  uint32_t elapsed = ts - stats.windowStartTs;
+  if (elapsed >= TAG_SIGNAL_WINDOW)
+  {
+    // After a whole silent window the previous one says nothing either
+    stats.prevMin = elapsed >= 2 * TAG_SIGNAL_WINDOW ? rssi : stats.windowMin;
+    stats.prevMax = elapsed >= 2 * TAG_SIGNAL_WINDOW ? rssi : stats.windowMax;
+    stats.windowMin = rssi;
+    stats.windowMax = rssi;
+    stats.windowStartTs = ts;
+    return;
+  }
+
+  if (rssi < stats.windowMin)
+  {
+    stats.windowMin = rssi;
+  }
+  if (rssi > stats.windowMax)
+  {
+    stats.windowMax = rssi;
+  }
+}
+
+int tagSignalRssi(const TagSignalStats &stats)
+{
+  int half = 1 << (TAG_SIGNAL_FRAC_BITS - 1);
+  // Round half away from zero; RSSI is negative
+  return stats.rssiEwma < 0 ? -((-stats.rssiEwma + half) >> TAG_SIGNAL_FRAC_BITS)
+                            : (stats.rssiEwma + half) >> TAG_SIGNAL_FRAC_BITS;
+}
+
+int tagSignalMin(const TagSignalStats &stats)
+{
+  return stats.windowMin < stats.prevMin ? stats.windowMin : stats.prevMin;
+}
+
+int tagSignalMax(const TagSignalStats &stats)
+{
+  return stats.windowMax > stats.prevMax ? stats.windowMax : stats.prevMax;
+}
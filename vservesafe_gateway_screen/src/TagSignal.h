@@ -0,0 +1,31 @@
+#ifndef __VSERVESAFE_TAG_SIGNAL__
+#define __VSERVESAFE_TAG_SIGNAL__
+
+#include <stdint.h>
+
+// Fraction bits of the smoothed RSSI (dBm * 16)
+#define TAG_SIGNAL_FRAC_BITS (4)
+// EWMA alpha = 1 / (1 << TAG_SIGNAL_EWMA_SHIFT)
+#define TAG_SIGNAL_EWMA_SHIFT (3)
+
+// Signal quality of one tag from the RSSI of every advert heard, copies
+// included. Min and max cover the current and the previous TAG_SIGNAL_WINDOW,
+// so each update is O(1).
+typedef struct
+{
+    int16_t rssiEwma;
+    int8_t windowMin;
+    int8_t windowMax;
+    int8_t prevMin;
+    int8_t prevMax;
+    uint32_t windowStartTs;
+} TagSignalStats;
+
+void resetTagSignal(TagSignalStats &stats, int rssi, uint32_t ts);
+void trackTagSignal(TagSignalStats &stats, int rssi, uint32_t ts);
+// Smoothed RSSI rounded to whole dBm
+int tagSignalRssi(const TagSignalStats &stats);
+int tagSignalMin(const TagSignalStats &stats);
+int tagSignalMax(const TagSignalStats &stats);
+
+#endif
@@ -0,0 +1,65 @@
+#include "TagSnapshot.h"
+
+#include "hal/HalMemory.h"
+
+TagSnapshotBuffers::TagSnapshotBuffers()
+{
+  for (int i = 0; i < TAG_SNAPSHOT_BUFFERS; i++)
+  {
+    TagSnapshot &snapshot = this->_buffers.at(i);
+    snapshot.revision = 0;
+    snapshot.count = 0;
+    snapshot.onlineCount = 0;
+    snapshot.tags = nullptr;
+    snapshot.capacity = 0;
+  }
+}
+
+TagSnapshotBuffers::~TagSnapshotBuffers()
+{
+  for (int i = 0; i < TAG_SNAPSHOT_BUFFERS; i++)
+  {
+    halFree(this->_buffers.at(i).tags);
+  }
+}
+
+TagSnapshot *TagSnapshotBuffers::beginWrite(int capacity)
+{
+  TagSnapshot *snapshot = this->_buffers.beginWrite();
+  if (snapshot && snapshot->capacity < capacity)
+  {
+    halFree(snapshot->tags);
+    snapshot->tags = (MiTagData *)halAllocLarge(capacity * sizeof(MiTagData));
+    snapshot->capacity = snapshot->tags ? capacity : 0;
+    if (!snapshot->tags)
+    {
+      return NULL;
+    }
+  }
+  return snapshot;
+}
+
+void TagSnapshotBuffers::publish(TagSnapshot *snapshot)
+{
+  this->_buffers.publish(snapshot);
+}
+
+const TagSnapshot *TagSnapshotBuffers::acquire()
+{
+  return this->_buffers.acquire();
+}
+
+void TagSnapshotBuffers::release(const TagSnapshot *snapshot)
+{
+  this->_buffers.release(snapshot);
+}
+
+size_t TagSnapshotBuffers::getMemoryUsage()
+{
+  size_t bytes = 0;
+  for (int i = 0; i < TAG_SNAPSHOT_BUFFERS; i++)
+  {
+    bytes += this->_buffers.at(i).capacity * sizeof(MiTagData);
+  }
+  return bytes;
+}
@@ -0,0 +1,48 @@
+#ifndef __VSERVESAFE_TAG_SNAPSHOT__
+#define __VSERVESAFE_TAG_SNAPSHOT__
+
+#include <stddef.h>
+#include <stdint.h>
+#include "vservesafe_conf.h"
+#include "RcuBuffers.h"
+#include "TagData.h"
+
+// Current, one still being read and one to write
+#define TAG_SNAPSHOT_BUFFERS (3)
+
+// Immutable copy of the tag table. Records are dense in [0, count) and must
+// not be changed by readers.
+typedef struct
+{
+    // Store revision the copy was taken at
+    uint32_t revision;
+    int count;
+    // Tags with online set
+    int onlineCount;
+    MiTagData *tags;
+    int capacity;
+} TagSnapshot;
+
+// Tag table snapshots published RCU style (RcuBuffers), like the admission
+// copy. The writer skips a publish while no buffer is free. Records live in
+// PSRAM.
+class TagSnapshotBuffers
+{
+private:
+    RcuBuffers<TagSnapshot, TAG_SNAPSHOT_BUFFERS> _buffers;
+
+public:
+    TagSnapshotBuffers();
+    ~TagSnapshotBuffers();
+
+    // Writer only: a free buffer holding at least capacity records, or NULL
+    TagSnapshot *beginWrite(int capacity);
+    void publish(TagSnapshot *snapshot);
+
+    // Never NULL; an empty snapshot until the first publish
+    const TagSnapshot *acquire();
+    void release(const TagSnapshot *snapshot);
+    size_t getMemoryUsage();
+};
+
+#endif
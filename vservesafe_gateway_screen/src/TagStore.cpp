@@ -0,0 +1,580 @@
+#include "TagStore.h"
+
+#include <new>
+#include <utility>
+#include "hal/HalMemory.h"
+
+#define TAG_STORE_INDEX_EMPTY (-1)
+
+static size_t chunkCountFor(int capacity)
+{
+  return (capacity + TAG_STORE_CHUNK_TAGS - 1) / TAG_STORE_CHUNK_TAGS;
+}
+
+static uint16_t fingerprintOf(mac_key_t mac)
+{
+  return hashMacKey(mac) >> 16;
+}
+
+TagSlotIndex::~TagSlotIndex()
+{
+  this->end();
+}
+
+bool TagSlotIndex::begin(int capacity, tag_slot_key_cb keyCb, void *context)
+{
+  this->end();
+  size_t tableSize = macIndexTableSize(capacity * 2);
+  this->_prints = (uint16_t *)halAllocInternal(tableSize * sizeof(uint16_t));
+  this->_slots = (int16_t *)halAllocInternal(tableSize * sizeof(int16_t));
+  if (!this->_prints || !this->_slots)
+  {
+    this->end();
+    return false;
+  }
+  this->_tableMask = tableSize - 1;
+  this->_keyCb = keyCb;
+  this->_keyContext = context;
+  this->clear();
+  return true;
+}
+
+void TagSlotIndex::end()
+{
+  halFree(this->_prints);
+  halFree(this->_slots);
+  this->_prints = nullptr;
+  this->_slots = nullptr;
+  this->_tableMask = 0;
+}
+
+void TagSlotIndex::swap(TagSlotIndex &other)
+{
+  std::swap(this->_prints, other._prints);
+  std::swap(this->_slots, other._slots);
+  std::swap(this->_tableMask, other._tableMask);
+  std::swap(this->_keyCb, other._keyCb);
+  std::swap(this->_keyContext, other._keyContext);
+}
+
+void TagSlotIndex::clear()
+{
+  for (size_t i = 0; i <= this->_tableMask && this->_slots; i++)
+  {
+    this->_slots[i] = TAG_STORE_INDEX_EMPTY;
+  }
+}
+
+size_t TagSlotIndex::getMemoryUsage()
+{
+  return this->_slots ? (this->_tableMask + 1) * (sizeof(uint16_t) + sizeof(int16_t)) : 0;
+}
+
+int TagSlotIndex::find(mac_key_t mac) const
+{
+  if (!this->_slots)
+  {
+    return -1;
+  }
+  return this->_slots[this->_probe(mac)];
+}
+
+void TagSlotIndex::insert(mac_key_t mac, int slot)
+{
+  size_t pos = this->_probe(mac);
+  this->_prints[pos] = fingerprintOf(mac);
+  this->_slots[pos] = slot;
+}
+
+void TagSlotIndex::erase(mac_key_t mac)
+{
+  size_t pos = this->_probe(mac);
+  if (!this->_isEmpty(pos))
+  {
+    this->_eraseAt(pos);
+  }
+}
+
+void TagSlotIndex::moveSlot(mac_key_t mac, int slot)
+{
+  this->_slots[this->_probe(mac)] = slot;
+}
+
+size_t TagSlotIndex::_mask() const
+{
+  return this->_tableMask;
+}
+
+bool TagSlotIndex::_isEmpty(size_t pos) const
+{
+  return this->_slots[pos] == TAG_STORE_INDEX_EMPTY;
+}
+
+bool TagSlotIndex::_matches(size_t pos, mac_key_t key) const
+{
+  return this->_prints[pos] == fingerprintOf(key) && this->_keyCb(this->_keyContext, this->_slots[pos]) == key;
+}
+
+mac_key_t TagSlotIndex::_keyAt(size_t pos) const
+{
+  return this->_keyCb(this->_keyContext, this->_slots[pos]);
+}
+
+void TagSlotIndex::_move(size_t to, size_t from)
+{
+  this->_prints[to] = this->_prints[from];
+  this->_slots[to] = this->_slots[from];
+}
+
+void TagSlotIndex::_setEmpty(size_t pos)
+{
+  this->_slots[pos] = TAG_STORE_INDEX_EMPTY;
+}
+
+TagStore::~TagStore()
+{
+  this->end();
+}
+
+bool TagStore::begin(int capacity)
+{
+  this->end();
+
+  for (int i = 0; i < MAX_EVICTED_REMEMBER; i++)
+  {
+    this->_evictedMacs[i] = MAC_KEY_EMPTY;
+  }
+  this->_evictedIndex.clear();
+  this->_evictedNext = 0;
+
+  if (capacity < 1)
+  {
+    capacity = 1;
+  }
+  if (capacity > TAG_STORE_MAX_CAPACITY)
+  {
+    capacity = TAG_STORE_MAX_CAPACITY;
+  }
+
+  size_t chunkCount = chunkCountFor(capacity);
+  this->_chunks = (MiTagData **)halAllocInternal(chunkCount * sizeof(MiTagData *));
+  if (!this->_chunks || !this->_index.begin(capacity, _macOfSlot, this) || !this->_recency.begin(capacity) ||
+      !this->_presence.begin(capacity))
+  {
+    this->end();
+    return false;
+  }
+  for (size_t i = 0; i < chunkCount; i++)
+  {
+    this->_chunks[i] = nullptr;
+  }
+
+  this->_capacity = capacity;
+  return true;
+}
+
+void TagStore::end()
+{
+  this->_freeSlab();
+  this->_index.end();
+  this->_recency.end();
+  this->_presence.end();
+  this->_capacity = 0;
+  this->_count = 0;
+}
+
+bool TagStore::setCapacity(int capacity)
+{
+  if (capacity < 1)
+  {
+    capacity = 1;
+  }
+  if (capacity > TAG_STORE_MAX_CAPACITY)
+  {
+    capacity = TAG_STORE_MAX_CAPACITY;
+  }
+  if (capacity == this->_capacity)
+  {
+    return true;
+  }
+
+  size_t chunkCount = chunkCountFor(capacity);
+  MiTagData **chunks = (MiTagData **)halAllocInternal(chunkCount * sizeof(MiTagData *));
+  // Freed with the old table on return
+  TagSlotIndex index;
+  if (!chunks || !index.begin(capacity, _macOfSlot, this))
+  {
+    halFree(chunks);
+    return false;
+  }
+
+  while (this->_count > capacity)
+  {
+    int slot = this->_findEvictionTarget();
+    if (slot == -1)
+    {
+      slot = this->_recency.oldest();
+    }
+    this->_evictionStats.evictions += 1;
+    this->_rememberEvicted(this->_slotAt(slot)->mac);
+    this->_removeAt(slot);
+  }
+
+  if (!this->_recency.resize(capacity) || !this->_presence.resize(capacity))
+  {
+    halFree(chunks);
+    return false;
+  }
+
+  // Live slots are below the new capacity, so chunks past it are unused
+  for (int i = chunkCount; i < this->_chunkCount; i++)
+  {
+    for (int j = 0; j < TAG_STORE_CHUNK_TAGS; j++)
+    {
+      this->_chunks[i][j].~MiTagData();
+    }
+    halFree(this->_chunks[i]);
+  }
+  if (this->_chunkCount > (int)chunkCount)
+  {
+    this->_chunkCount = chunkCount;
+  }
+  for (size_t i = 0; i < chunkCount; i++)
+  {
+    chunks[i] = (int)i < this->_chunkCount ? this->_chunks[i] : nullptr;
+  }
+  halFree(this->_chunks);
+  this->_chunks = chunks;
+
+  this->_index.swap(index);
+  for (int i = 0; i < this->_count; i++)
+  {
+    this->_index.insert(this->_slotAt(i)->mac, i);
+  }
+  this->_capacity = capacity;
+  return true;
+}
+
+int TagStore::getCapacity()
+{
+  return this->_capacity;
+}
+
+int TagStore::count()
+{
+  return this->_count;
+}
+
+void TagStore::clear()
+{
+  this->_count = 0;
+  this->_recency.clear();
+  this->_presence.clear();
+  this->_index.clear();
+}
+
+int TagStore::find(mac_key_t mac)
+{
+  return this->_index.find(mac);
+}
+
+MiTagData *TagStore::at(int slot)
+{
+  if (slot < 0 || slot >= this->_count)
+  {
+    return NULL;
+  }
+  return this->_slotAt(slot);
+}
+
+MiTagState *TagStore::stateAt(int slot)
+{
+  if (slot < 0 || slot >= this->_count)
+  {
+    return NULL;
+  }
+  return this->_stateAt(slot);
+}
+
+void TagStore::touch(int slot)
+{
+  if (slot >= 0 && slot < this->_count)
+  {
+    this->_recency.touch(slot);
+    this->_markHeard(slot);
+  }
+}
+
+void TagStore::expirePresence(uint32_t now)
+{
+  this->_presence.advance(now, _onPresenceExpired, this);
+}
+
+int TagStore::onlineCount()
+{
+  return this->_presence.armedCount();
+}
+
+int TagStore::upsert(MiTagData &tagData)
+{
+  if (this->_capacity == 0)
+  {
+    return -1;
+  }
+
+  int slot = this->find(tagData.mac);
+  if (slot != -1)
+  {
+    *this->_slotAt(slot) = tagData;
+    this->_recency.touch(slot);
+    this->_markHeard(slot);
+    return slot;
+  }
+
+  if (this->_count < this->_capacity)
+  {
+    slot = this->_count;
+    if (!this->_ensureSlot(slot))
+    {
+      this->_evictionStats.rejections += 1;
+      return -1;
+    }
+    this->_count += 1;
+  }
+  else
+  {
+    slot = this->_findEvictionTarget();
+    if (slot == -1)
+    {
+      this->_evictionStats.rejections += 1;
+      return -1;
+    }
+
+    mac_key_t evictedMac = this->_slotAt(slot)->mac;
+    this->_dropPresence(slot);
+    this->_index.erase(evictedMac);
+    this->_recency.unlink(slot);
+    this->_evictionStats.evictions += 1;
+    this->_rememberEvicted(evictedMac);
+  }
+
+  if (this->_evictedIndex.erase(tagData.mac))
+  {
+    this->_evictionStats.readmissions += 1;
+  }
+
+  *this->_slotAt(slot) = tagData;
+  this->_index.insert(tagData.mac, slot);
+  this->_recency.pushNewest(slot);
+  this->_markHeard(slot);
+  return slot;
+}
+
+void TagStore::setEvictionPolicy(coldsenses_eviction_policy policy)
+{
+  this->_evictionPolicy = policy;
+}
+
+coldsenses_eviction_policy TagStore::getEvictionPolicy()
+{
+  return this->_evictionPolicy;
+}
+
+void TagStore::setProtectCallback(tag_store_protect_cb cb, void *context)
+{
+  this->_protectCb = cb;
+  this->_protectContext = context;
+}
+
+void TagStore::setPresenceCallback(tag_store_presence_cb cb, void *context)
+{
+  this->_presenceCb = cb;
+  this->_presenceContext = context;
+}
+
+MiTagEvictionStats TagStore::getEvictionStats()
+{
+  return this->_evictionStats;
+}
+
+TagStoreMemoryUsage TagStore::getMemoryUsage()
+{
+  TagStoreMemoryUsage usage;
+  usage.internalBytes = sizeof(*this);
+  usage.internalBytes += chunkCountFor(this->_capacity) * sizeof(MiTagData *);
+  usage.internalBytes += this->_index.getMemoryUsage();
+  usage.internalBytes += this->_recency.getCapacity() * 2 * sizeof(int16_t);
+  usage.internalBytes += this->_presence.getCapacity() * (2 * sizeof(int16_t) + sizeof(uint32_t));
+  usage.largeBytes = this->_chunkCount * TAG_STORE_CHUNK_TAGS * (sizeof(MiTagData) + sizeof(MiTagState));
+  return usage;
+}
+
+MiTagData *TagStore::_slotAt(int slot)
+{
+  return &this->_chunks[slot / TAG_STORE_CHUNK_TAGS][slot % TAG_STORE_CHUNK_TAGS];
+}
+
+// States follow the records in each chunk
+MiTagState *TagStore::_stateAt(int slot)
+{
+  MiTagData *tags = this->_chunks[slot / TAG_STORE_CHUNK_TAGS];
+  return &((MiTagState *)(tags + TAG_STORE_CHUNK_TAGS))[slot % TAG_STORE_CHUNK_TAGS];
+}
+
+bool TagStore::_ensureSlot(int slot)
+{
+  int chunk = slot / TAG_STORE_CHUNK_TAGS;
+  while (this->_chunkCount <= chunk)
+  {
+    // The records, then their states
+    MiTagData *tags = (MiTagData *)halAllocLarge(TAG_STORE_CHUNK_TAGS * (sizeof(MiTagData) + sizeof(MiTagState)));
+    if (!tags)
+    {
+      return false;
+    }
+    for (int i = 0; i < TAG_STORE_CHUNK_TAGS; i++)
+    {
+      new (&tags[i]) MiTagData();
+    }
+    this->_chunks[this->_chunkCount] = tags;
+    this->_chunkCount += 1;
+  }
+  return true;
+}
+
+void TagStore::_freeSlab()
+{
+  for (int i = 0; i < this->_chunkCount; i++)
+  {
+    for (int j = 0; j < TAG_STORE_CHUNK_TAGS; j++)
+    {
+      this->_chunks[i][j].~MiTagData();
+    }
+    halFree(this->_chunks[i]);
+  }
+  halFree(this->_chunks);
+  this->_chunks = nullptr;
+  this->_chunkCount = 0;
+}
+
+mac_key_t TagStore::_macOfSlot(void *context, int slot)
+{
+  return ((TagStore *)context)->_slotAt(slot)->mac;
+}
+
+int TagStore::_findEvictionTarget()
+{
+  switch (this->_evictionPolicy)
+  {
+  case VSERVESAFE_EVICT_LOWEST_RSSI:
+  {
+    int targetIndex = -1;
+    for (int i = 0; i < this->_count; i++)
+    {
+      if (targetIndex == -1 || this->_slotAt(i)->signal.rssiEwma < this->_slotAt(targetIndex)->signal.rssiEwma)
+      {
+        targetIndex = i;
+      }
+    }
+    return targetIndex;
+  }
+  case VSERVESAFE_EVICT_LRU_KEEP_NOTIFY:
+    for (int i = this->_recency.oldest(); i != -1; i = this->_recency.newerThan(i))
+    {
+      if (!this->_protectCb || !this->_protectCb(this->_protectContext, this->_slotAt(i)->mac))
+      {
+        return i;
+      }
+    }
+    return -1;
+  case VSERVESAFE_EVICT_LRU:
+  default:
+    return this->_recency.oldest();
+  }
+}
+
+// Remember recently evicted tags so re-admissions can be counted
+void TagStore::_rememberEvicted(mac_key_t mac)
+{
+  int slot = this->_evictedNext;
+  mac_key_t prevMac = this->_evictedMacs[slot];
+  if (prevMac != MAC_KEY_EMPTY && this->_evictedIndex.find(prevMac) == slot)
+  {
+    this->_evictedIndex.erase(prevMac);
+  }
+  this->_evictedMacs[slot] = mac;
+  this->_evictedIndex.insert(mac, slot);
+  this->_evictedNext = (slot + 1) % MAX_EVICTED_REMEMBER;
+}
+
+// Drop a slot and move the last slot into its place to keep slots dense
+void TagStore::_removeAt(int slot)
+{
+  int last = this->_count - 1;
+  this->_dropPresence(slot);
+  this->_index.erase(this->_slotAt(slot)->mac);
+  this->_recency.unlink(slot);
+
+  if (slot != last)
+  {
+    MiTagData *lastData = this->_slotAt(last);
+    this->_index.moveSlot(lastData->mac, slot);
+    *this->_slotAt(slot) = *lastData;
+    *this->_stateAt(slot) = *this->_stateAt(last);
+    this->_recency.moveSlot(last, slot);
+    this->_presence.moveSlot(last, slot);
+  }
+  this->_count -= 1;
+}
+
+// Arm an offline tag. An online one stays armed for its old expiry; the
+// wheel re-arms it from its new ts when that fires.
+void TagStore::_markHeard(int slot)
+{
+  MiTagData *tagData = this->_slotAt(slot);
+  if (this->_presence.isArmed(slot))
+  {
+    // The record may have been rewritten from an older copy
+    tagData->online = true;
+    return;
+  }
+  this->_presence.arm(slot, tagData->ts + TAG_ONLINE_TIEMOUT);
+  tagData->online = true;
+  if (this->_presenceCb)
+  {
+    this->_presenceCb(this->_presenceContext, tagData, true);
+  }
+}
+
+// Before a tag leaves the table
+void TagStore::_dropPresence(int slot)
+{
+  if (!this->_presence.isArmed(slot))
+  {
+    return;
+  }
+  MiTagData *tagData = this->_slotAt(slot);
+  this->_presence.disarm(slot);
+  tagData->online = false;
+  if (this->_presenceCb)
+  {
+    this->_presenceCb(this->_presenceContext, tagData, false);
+  }
+}
+
+void TagStore::_onPresenceExpired(void *context, int slot, uint32_t now)
+{
+  TagStore *store = (TagStore *)context;
+  MiTagData *tagData = store->_slotAt(slot);
+  // ts may be a little ahead of now if the tag was heard since
+  if ((int32_t)(now - tagData->ts) <= TAG_ONLINE_TIEMOUT)
+  {
+    store->_presence.arm(slot, tagData->ts + TAG_ONLINE_TIEMOUT);
+    return;
+  }
+  tagData->online = false;
+  if (store->_presenceCb)
+  {
+    store->_presenceCb(store->_presenceContext, tagData, false);
+  }
+}
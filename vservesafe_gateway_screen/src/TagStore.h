@@ -0,0 +1,145 @@
+#ifndef __VSERVESAFE_TAG_STORE__
+#define __VSERVESAFE_TAG_STORE__
+
+#include "vservesafe_conf.h"
+#include "MacIndex.h"
+#include "TagData.h"
+#include "TagPresence.h"
+#include "TagRecency.h"
+
+typedef bool (*tag_store_protect_cb)(void *context, mac_key_t mac);
+// A tag's online flag changed; the record is about to be dropped if it left
+// the table
+typedef void (*tag_store_presence_cb)(void *context, MiTagData *tagData, bool isOnline);
+
+// MAC of the record in a slot
+typedef mac_key_t (*tag_slot_key_cb)(void *context, int slot);
+
+// Map from MAC to tag store slot with a runtime capacity. Entries hold a
+// 16-bit fingerprint of the MAC and the slot; the full MAC is only read from
+// the record when the fingerprint matches.
+class TagSlotIndex : public MacProbing<TagSlotIndex>
+{
+    friend class MacProbing<TagSlotIndex>;
+
+private:
+    uint16_t *_prints = nullptr;
+    int16_t *_slots = nullptr;
+    size_t _tableMask = 0;
+    tag_slot_key_cb _keyCb = nullptr;
+    void *_keyContext = nullptr;
+
+    size_t _mask() const;
+    bool _isEmpty(size_t pos) const;
+    bool _matches(size_t pos, mac_key_t key) const;
+    mac_key_t _keyAt(size_t pos) const;
+    void _move(size_t to, size_t from);
+    void _setEmpty(size_t pos);
+
+public:
+    ~TagSlotIndex();
+
+    // Sized for capacity entries, in internal RAM
+    bool begin(int capacity, tag_slot_key_cb keyCb, void *context);
+    void end();
+    void swap(TagSlotIndex &other);
+    void clear();
+    size_t getMemoryUsage();
+
+    int find(mac_key_t mac) const;
+    // The slot's record must already hold mac
+    void insert(mac_key_t mac, int slot);
+    void erase(mac_key_t mac);
+    // Point mac's entry at the slot its record moved to
+    void moveSlot(mac_key_t mac, int slot);
+};
+
+typedef struct
+{
+    size_t internalBytes;
+    size_t largeBytes;
+} TagStoreMemoryUsage;
+
+// Tag table with a runtime capacity. Records live in a slab that grows in
+// TAG_STORE_CHUNK_TAGS chunks in PSRAM; the MAC index (TagSlotIndex), recency
+// links and presence wheel stay in internal RAM.
+// Slots are always dense in [0, count()).
+//
+// A tag is online from the sample that stores or touches it until it has not
+// been heard for TAG_ONLINE_TIEMOUT. Online tags are armed in the presence
+// wheel; a fired slot whose tag was heard meanwhile is re-armed from its ts,
+// so hearing a tag costs nothing and each timeout fires one transition.
+class TagStore
+{
+private:
+    MiTagData **_chunks = nullptr;
+    int _chunkCount = 0;
+    int _capacity = 0;
+    int _count = 0;
+
+    TagSlotIndex _index;
+
+    TagRecencyList _recency;
+    TagPresenceWheel _presence;
+
+    coldsenses_eviction_policy _evictionPolicy = VSERVESAFE_EVICTION_POLICY;
+    MiTagEvictionStats _evictionStats = {};
+    mac_key_t _evictedMacs[MAX_EVICTED_REMEMBER];
+    MacIndex<MAX_EVICTED_REMEMBER> _evictedIndex;
+    int _evictedNext = 0;
+
+    tag_store_protect_cb _protectCb = nullptr;
+    void *_protectContext = nullptr;
+    tag_store_presence_cb _presenceCb = nullptr;
+    void *_presenceContext = nullptr;
+
+    MiTagData *_slotAt(int slot);
+    MiTagState *_stateAt(int slot);
+    bool _ensureSlot(int slot);
+    void _freeSlab();
+    static mac_key_t _macOfSlot(void *context, int slot);
+
+    int _findEvictionTarget();
+    void _rememberEvicted(mac_key_t mac);
+    void _removeAt(int slot);
+    void _markHeard(int slot);
+    void _dropPresence(int slot);
+    static void _onPresenceExpired(void *context, int slot, uint32_t now);
+
+public:
+    ~TagStore();
+
+    bool begin(int capacity);
+    void end();
+    // Grows or shrinks the store; shrinking evicts by the current policy
+    bool setCapacity(int capacity);
+    int getCapacity();
+    int count();
+    // Drops all tags without presence events
+    void clear();
+
+    int find(mac_key_t mac);
+    MiTagData *at(int slot);
+    // Moves with the record; a new tag's state is left for the caller to reset
+    MiTagState *stateAt(int slot);
+    // Insert or update a tag and return its slot, or -1 if the store is full
+    // and nothing may be evicted
+    int upsert(MiTagData &tagData);
+    // Mark a stored tag as just heard (at its ts) without rewriting it
+    void touch(int slot);
+    // Take tags not heard for TAG_ONLINE_TIEMOUT offline
+    void expirePresence(uint32_t now);
+    int onlineCount();
+
+    void setEvictionPolicy(coldsenses_eviction_policy policy);
+    coldsenses_eviction_policy getEvictionPolicy();
+    // Tags for which cb returns true are kept by VSERVESAFE_EVICT_LRU_KEEP_NOTIFY
+    void setProtectCallback(tag_store_protect_cb cb, void *context);
+    // Called on every online/offline transition, including tags going
+    // offline because they were evicted or removed
+    void setPresenceCallback(tag_store_presence_cb cb, void *context);
+    MiTagEvictionStats getEvictionStats();
+    TagStoreMemoryUsage getMemoryUsage();
+};
+
+#endif
@@ -2,6 +2,7 @@
 #define __VSERVESAFE_ENUMS__
 
 #include "ui/ui.h"
+#include "GatewayOptions.h"
 
 typedef enum
 {
@@ -36,16 +37,6 @@ typedef enum
   VSERVESAFE_OPTION_CHECK_VERSION,
 } coldsenses_option;
 
-typedef enum
-{
-  VSERVESAFE_NO_TARGET,
-  VSERVESAFE_TARGET_WIFI_SSID,
-  VSERVESAFE_TARGET_WIFI_PASSWORD,
-  VSERVESAFE_TARGET_GPS_LATITUDE,
-  VSERVESAFE_TARGET_GPS_LONGITUDE,
-  VSERVESAFE_TARGET_ALARM_BUZZER,
-} coldsenses_input_target;
-
 typedef enum
 {
   VSERVESAFE_NO_ACTION,
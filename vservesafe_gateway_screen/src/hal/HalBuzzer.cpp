@@ -0,0 +1,61 @@
+#include "HalBuzzer.h"
+
+#include "vservesafe_conf.h"
+
+#ifdef ARDUINO
+#include <Arduino.h>
+
+bool halBuzzerBegin(int gpio)
+{
+  if (ledcSetup(BUZZER_LEDC_CHANNEL, BUZZER_LEDC_FREQUENCY, BUZZER_LEDC_RESOLUTION) == 0)
+  {
+    return false;
+  }
+  ledcAttachPin(gpio, BUZZER_LEDC_CHANNEL);
+  ledcWrite(BUZZER_LEDC_CHANNEL, 0);
+  return true;
+}
+
+void halBuzzerOutput(bool isOn)
+{
+  ledcWrite(BUZZER_LEDC_CHANNEL, isOn ? BUZZER_LEDC_DUTY : 0);
+}
+#else
+#include <mutex>
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#define NATIVE_BUZZER_EDGES (256)
+
+static std::mutex nativeBuzzerLock;
+static HalNativeBuzzerEdge nativeBuzzerEdges[NATIVE_BUZZER_EDGES];
+static size_t nativeBuzzerEdgeCount = 0;
+
+bool halBuzzerBegin(int gpio)
+{
+  std::lock_guard<std::mutex> lock(nativeBuzzerLock);
+  nativeBuzzerEdgeCount = 0;
+  return true;
+}
+
+void halBuzzerOutput(bool isOn)
+{
+  std::lock_guard<std::mutex> lock(nativeBuzzerLock);
+  if (nativeBuzzerEdgeCount < NATIVE_BUZZER_EDGES)
+  {
+    HalNativeBuzzerEdge &edge = nativeBuzzerEdges[nativeBuzzerEdgeCount++];
+    edge.ms = xTaskGetTickCount();
+    edge.isOn = isOn;
+  }
+}
+
+size_t halNativeBuzzerTakeEdges(HalNativeBuzzerEdge *edges, size_t maxEdges)
+{
+  std::lock_guard<std::mutex> lock(nativeBuzzerLock);
+  size_t count = nativeBuzzerEdgeCount < maxEdges ? nativeBuzzerEdgeCount : maxEdges;
+  memcpy(edges, nativeBuzzerEdges, count * sizeof(HalNativeBuzzerEdge));
+  nativeBuzzerEdgeCount = 0;
+  return count;
+}
+#endif
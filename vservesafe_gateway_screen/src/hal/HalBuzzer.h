@@ -0,0 +1,27 @@
+#ifndef __VSERVESAFE_HAL_BUZZER__
+#define __VSERVESAFE_HAL_BUZZER__
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Buzzer driven by an LEDC channel on the board. The channel makes the tone,
+// a square wave at BUZZER_LEDC_FREQUENCY and BUZZER_LEDC_DUTY, so switching it
+// on or off is one duty write; the cadence is timed in software by the
+// caller. The native build records the switches instead.
+bool halBuzzerBegin(int gpio);
+void halBuzzerOutput(bool isOn);
+
+#ifndef ARDUINO
+typedef struct
+{
+    // xTaskGetTickCount() at the switch
+    uint32_t ms;
+    bool isOn;
+} HalNativeBuzzerEdge;
+
+// Moves the switches recorded since the last call into edges, oldest first;
+// returns the number moved. Switches past maxEdges are dropped.
+size_t halNativeBuzzerTakeEdges(HalNativeBuzzerEdge *edges, size_t maxEdges);
+#endif
+
+#endif
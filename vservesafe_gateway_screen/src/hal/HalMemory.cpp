@@ -0,0 +1,65 @@
+#include "HalMemory.h"
+
+#include <stdlib.h>
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#include <esp_heap_caps.h>
+
+void *halAllocInternal(size_t size)
+{
+  return heap_caps_malloc(size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+}
+
+void *halAllocLarge(size_t size)
+{
+#ifdef BOARD_HAS_PSRAM
+  if (psramFound())
+  {
+    return ps_malloc(size);
+  }
+#endif
+  return malloc(size);
+}
+
+void halFree(void *ptr)
+{
+  heap_caps_free(ptr);
+}
+
+size_t halFreeInternal()
+{
+  return heap_caps_get_free_size(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+}
+
+size_t halFreeLarge()
+{
+  return heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
+}
+#else
+
+void *halAllocInternal(size_t size)
+{
+  return malloc(size);
+}
+
+void *halAllocLarge(size_t size)
+{
+  return malloc(size);
+}
+
+void halFree(void *ptr)
+{
+  free(ptr);
+}
+
+size_t halFreeInternal()
+{
+  return 0;
+}
+
+size_t halFreeLarge()
+{
+  return 0;
+}
+#endif
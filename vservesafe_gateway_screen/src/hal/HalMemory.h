@@ -0,0 +1,15 @@
+#ifndef __VSERVESAFE_HAL_MEMORY__
+#define __VSERVESAFE_HAL_MEMORY__
+
+#include <stddef.h>
+
+// Small, hot structures (indexes) that must stay in internal RAM
+void *halAllocInternal(size_t size);
+// Large slabs; placed in PSRAM when the board has it
+void *halAllocLarge(size_t size);
+void halFree(void *ptr);
+
+size_t halFreeInternal();
+size_t halFreeLarge();
+
+#endif
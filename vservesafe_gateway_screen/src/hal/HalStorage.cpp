@@ -0,0 +1,91 @@
+#include "HalStorage.h"
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#include <SPIFFS.h>
+
+bool halStorageBegin()
+{
+  // Format on first boot
+  return SPIFFS.begin(true);
+}
+
+size_t halStorageRead(const char *path, void *data, size_t size)
+{
+  File file = SPIFFS.open(path, FILE_READ);
+  if (!file)
+  {
+    return 0;
+  }
+  size_t len = file.read((uint8_t *)data, size);
+  file.close();
+  return len;
+}
+
+bool halStorageWrite(const char *path, const void *data, size_t size)
+{
+  File file = SPIFFS.open(path, FILE_WRITE);
+  if (!file)
+  {
+    return false;
+  }
+  bool isWritten = file.write((const uint8_t *)data, size) == size;
+  file.close();
+  return isWritten;
+}
+#else
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+
+static bool nativeStoragePath(const char *path, std::string &out)
+{
+  const char *dir = getenv("NATIVE_STORAGE_DIR");
+  if (!dir)
+  {
+    return false;
+  }
+  out = dir;
+  out += path;
+  return true;
+}
+
+bool halStorageBegin()
+{
+  return getenv("NATIVE_STORAGE_DIR") != NULL;
+}
+
+size_t halStorageRead(const char *path, void *data, size_t size)
+{
+  std::string fullPath;
+  if (!nativeStoragePath(path, fullPath))
+  {
+    return 0;
+  }
+  FILE *file = fopen(fullPath.c_str(), "rb");
+  if (!file)
+  {
+    return 0;
+  }
+  size_t len = fread(data, 1, size, file);
+  fclose(file);
+  return len;
+}
+
+bool halStorageWrite(const char *path, const void *data, size_t size)
+{
+  std::string fullPath;
+  if (!nativeStoragePath(path, fullPath))
+  {
+    return false;
+  }
+  FILE *file = fopen(fullPath.c_str(), "wb");
+  if (!file)
+  {
+    return false;
+  }
+  bool isWritten = fwrite(data, 1, size, file) == size;
+  fclose(file);
+  return isWritten;
+}
+#endif
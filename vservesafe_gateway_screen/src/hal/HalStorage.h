@@ -0,0 +1,13 @@
+#ifndef __VSERVESAFE_HAL_STORAGE__
+#define __VSERVESAFE_HAL_STORAGE__
+
+#include <stddef.h>
+
+// Small files kept across restarts (SPIFFS on the board). The native build
+// keeps them in $NATIVE_STORAGE_DIR and has no storage when it is unset.
+bool halStorageBegin();
+// Reads up to size bytes; returns the number read, 0 if the file is missing
+size_t halStorageRead(const char *path, void *data, size_t size);
+bool halStorageWrite(const char *path, const void *data, size_t size);
+
+#endif
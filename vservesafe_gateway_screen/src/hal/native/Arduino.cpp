@@ -0,0 +1,281 @@
+#include "Arduino.h"
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include <atomic>
+
+// Read by the ingest task as well, like the real millis()
+static std::atomic<uint32_t> fakeMillis(0);
+
+uint32_t millis()
+{
+  return fakeMillis;
+}
+
+void delay(uint32_t ms)
+{
+  fakeMillis += ms;
+}
+
+long random(long howsmall, long howbig)
+{
+  if (howsmall >= howbig)
+  {
+    return howsmall;
+  }
+  return howsmall + (rand() % (howbig - howsmall));
+}
+
+void halNativeSetMillis(uint32_t ms)
+{
+  fakeMillis = ms;
+}
+
+void halNativeAdvanceMillis(uint32_t ms)
+{
+  fakeMillis += ms;
+}
+
+static std::string formatInteger(unsigned long value, bool negative, unsigned char base)
+{
+  if (base < 2 || base > 16)
+  {
+    base = 10;
+  }
+
+  char buffer[sizeof(unsigned long) * 8 + 2];
+  int i = sizeof(buffer) - 1;
+  buffer[i] = '\0';
+  do
+  {
+    buffer[--i] = "0123456789abcdef"[value % base];
+    value /= base;
+  } while (value > 0);
+
+  if (negative)
+  {
+    buffer[--i] = '-';
+  }
+  return std::string(&buffer[i]);
+}
+
+String::String(const char *cstr) : _buffer(cstr ? cstr : "")
+{
+}
+
+String::String(char c) : _buffer(1, c)
+{
+}
+
+String::String(int value, unsigned char base)
+{
+  if (base == 10 && value < 0)
+  {
+    this->_buffer = formatInteger(-(long)value, true, base);
+  }
+  else
+  {
+    this->_buffer = formatInteger((unsigned int)value, false, base);
+  }
+}
+
+String::String(unsigned int value, unsigned char base) : _buffer(formatInteger(value, false, base))
+{
+}
+
+String::String(long value, unsigned char base)
+{
+  if (base == 10 && value < 0)
+  {
+    this->_buffer = formatInteger(-(unsigned long)value, true, base);
+  }
+  else
+  {
+    this->_buffer = formatInteger((unsigned long)value, false, base);
+  }
+}
+
+String::String(unsigned long value, unsigned char base) : _buffer(formatInteger(value, false, base))
+{
+}
+
+String::String(double value, unsigned int decimalPlaces)
+{
+  char buffer[64];
+  snprintf(buffer, sizeof(buffer), "%.*f", (int)decimalPlaces, value);
+  this->_buffer = buffer;
+}
+
+String &String::operator+=(const String &rhs)
+{
+  this->_buffer += rhs._buffer;
+  return *this;
+}
+
+String &String::operator+=(const char *cstr)
+{
+  this->_buffer += cstr;
+  return *this;
+}
+
+String &String::operator+=(char c)
+{
+  this->_buffer += c;
+  return *this;
+}
+
+String &String::operator+=(int value)
+{
+  this->_buffer += String(value)._buffer;
+  return *this;
+}
+
+bool String::operator==(const String &rhs) const
+{
+  return this->_buffer == rhs._buffer;
+}
+
+bool String::operator!=(const String &rhs) const
+{
+  return this->_buffer != rhs._buffer;
+}
+
+bool String::concat(const String &str)
+{
+  this->_buffer += str._buffer;
+  return true;
+}
+
+bool String::concat(const char *cstr)
+{
+  this->_buffer += cstr;
+  return true;
+}
+
+bool String::concat(int value)
+{
+  return this->concat(String(value));
+}
+
+bool String::concat(double value)
+{
+  return this->concat(String(value));
+}
+
+const char *String::c_str() const
+{
+  return this->_buffer.c_str();
+}
+
+unsigned int String::length() const
+{
+  return this->_buffer.length();
+}
+
+bool String::equals(const String &str) const
+{
+  return this->_buffer == str._buffer;
+}
+
+void String::replace(const String &find, const String &replace)
+{
+  if (find._buffer.empty())
+  {
+    return;
+  }
+
+  size_t pos = 0;
+  while ((pos = this->_buffer.find(find._buffer, pos)) != std::string::npos)
+  {
+    this->_buffer.replace(pos, find._buffer.length(), replace._buffer);
+    pos += replace._buffer.length();
+  }
+}
+
+void String::toUpperCase()
+{
+  for (size_t i = 0; i < this->_buffer.length(); i++)
+  {
+    this->_buffer[i] = toupper((unsigned char)this->_buffer[i]);
+  }
+}
+
+double String::toDouble() const
+{
+  return atof(this->_buffer.c_str());
+}
+
+HardwareSerial Serial;
+static bool isSerialEnabled = true;
+
+void halNativeSetSerialEnabled(bool isEnabled)
+{
+  isSerialEnabled = isEnabled;
+}
+
+void HardwareSerial::begin(unsigned long baud)
+{
+}
+
+size_t HardwareSerial::print(const char *str)
+{
+  if (!isSerialEnabled)
+  {
+    return strlen(str);
+  }
+  return fputs(str, stdout) < 0 ? 0 : strlen(str);
+}
+
+size_t HardwareSerial::print(const String &str)
+{
+  return this->print(str.c_str());
+}
+
+size_t HardwareSerial::print(char c)
+{
+  if (!isSerialEnabled)
+  {
+    return 1;
+  }
+  return fputc(c, stdout) == EOF ? 0 : 1;
+}
+
+size_t HardwareSerial::print(int value)
+{
+  return this->print(String(value));
+}
+
+size_t HardwareSerial::print(unsigned int value)
+{
+  return this->print(String(value));
+}
+
+size_t HardwareSerial::print(long value)
+{
+  return this->print(String(value));
+}
+
+size_t HardwareSerial::print(unsigned long value)
+{
+  return this->print(String(value));
+}
+
+size_t HardwareSerial::print(double value, int digits)
+{
+  return this->print(String(value, digits));
+}
+
+size_t HardwareSerial::println()
+{
+  return this->print("\r\n");
+}
+
+size_t HardwareSerial::printf(const char *format, ...)
+{
+  va_list args;
+  va_start(args, format);
+  int n = isSerialEnabled ? vprintf(format, args) : vsnprintf(NULL, 0, format, args);
+  va_end(args);
+  return n < 0 ? 0 : n;
+}
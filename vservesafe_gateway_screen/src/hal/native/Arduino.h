@@ -0,0 +1,87 @@
+#ifndef __VSERVESAFE_HAL_NATIVE_ARDUINO__
+#define __VSERVESAFE_HAL_NATIVE_ARDUINO__
+
+// Host stand-in for the parts of the Arduino core used by the gateway core
+// modules. Only compiled into the `native` env (see platformio.ini).
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+
+#define HIGH 0x1
+#define LOW 0x0
+
+uint32_t millis();
+void delay(uint32_t ms);
+long random(long howsmall, long howbig);
+
+// Fake clock control
+void halNativeSetMillis(uint32_t ms);
+void halNativeAdvanceMillis(uint32_t ms);
+// Serial writes to stdout unless disabled, e.g. under a benchmark reporter
+void halNativeSetSerialEnabled(bool isEnabled);
+
+class String
+{
+private:
+    std::string _buffer;
+
+public:
+    String(const char *cstr = "");
+    String(const String &str) = default;
+    explicit String(char c);
+    String(int value, unsigned char base = 10);
+    String(unsigned int value, unsigned char base = 10);
+    String(long value, unsigned char base = 10);
+    String(unsigned long value, unsigned char base = 10);
+    String(double value, unsigned int decimalPlaces = 2);
+
+    String &operator=(const String &rhs) = default;
+    String &operator+=(const String &rhs);
+    String &operator+=(const char *cstr);
+    String &operator+=(char c);
+    String &operator+=(int value);
+    bool operator==(const String &rhs) const;
+    bool operator!=(const String &rhs) const;
+
+    bool concat(const String &str);
+    bool concat(const char *cstr);
+    bool concat(int value);
+    bool concat(double value);
+
+    const char *c_str() const;
+    unsigned int length() const;
+    bool equals(const String &str) const;
+    void replace(const String &find, const String &replace);
+    void toUpperCase();
+    double toDouble() const;
+};
+
+class HardwareSerial
+{
+public:
+    void begin(unsigned long baud);
+    size_t print(const char *str);
+    size_t print(const String &str);
+    size_t print(char c);
+    size_t print(int value);
+    size_t print(unsigned int value);
+    size_t print(long value);
+    size_t print(unsigned long value);
+    size_t print(double value, int digits = 2);
+    size_t println();
+    template <typename T>
+    size_t println(const T &value)
+    {
+        size_t n = print(value);
+        return n + println();
+    }
+    size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+};
+
+extern HardwareSerial Serial;
+
+#endif
@@ -0,0 +1,78 @@
+#include "EEPROM.h"
+
+EEPROMClass EEPROM;
+
+bool EEPROMClass::begin(size_t size)
+{
+  if (this->_data.size() < size)
+  {
+    this->_data.resize(size, 0xFF);
+  }
+  return true;
+}
+
+bool EEPROMClass::commit()
+{
+  return true;
+}
+
+uint64_t EEPROMClass::readULong64(int address)
+{
+  return this->_read<uint64_t>(address);
+}
+
+uint16_t EEPROMClass::readUShort(int address)
+{
+  return this->_read<uint16_t>(address);
+}
+
+double EEPROMClass::readDouble(int address)
+{
+  return this->_read<double>(address);
+}
+
+bool EEPROMClass::readBool(int address)
+{
+  return this->_read<uint8_t>(address) != 0;
+}
+
+String EEPROMClass::readString(int address)
+{
+  String value = "";
+  for (int i = address; i >= 0 && i < (int)this->_data.size() && this->_data[i] != 0; i++)
+  {
+    value += (char)this->_data[i];
+  }
+  return value;
+}
+
+size_t EEPROMClass::writeULong64(int address, uint64_t value)
+{
+  return this->_write(address, value);
+}
+
+size_t EEPROMClass::writeUShort(int address, uint16_t value)
+{
+  return this->_write(address, value);
+}
+
+size_t EEPROMClass::writeDouble(int address, double value)
+{
+  return this->_write(address, value);
+}
+
+size_t EEPROMClass::writeBool(int address, bool value)
+{
+  return this->_write(address, (uint8_t)(value ? 1 : 0));
+}
+
+size_t EEPROMClass::writeString(int address, String value)
+{
+  size_t length = value.length();
+  if (address < 0 || address + length + 1 > this->_data.size())
+  {
+    return 0;
+  }
+  memcpy(&this->_data[address], value.c_str(), length + 1);
+  return length;
+}
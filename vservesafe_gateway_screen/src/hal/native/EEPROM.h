@@ -0,0 +1,56 @@
+#ifndef __VSERVESAFE_HAL_NATIVE_EEPROM__
+#define __VSERVESAFE_HAL_NATIVE_EEPROM__
+
+// RAM-backed stand-in for the ESP32 EEPROM emulation.
+
+#include <Arduino.h>
+#include <vector>
+
+class EEPROMClass
+{
+private:
+    std::vector<uint8_t> _data;
+
+    template <typename T>
+    T _read(int address)
+    {
+        T value;
+        memset(&value, 0, sizeof(T));
+        if (address >= 0 && address + sizeof(T) <= this->_data.size())
+        {
+            memcpy(&value, &this->_data[address], sizeof(T));
+        }
+        return value;
+    }
+
+    template <typename T>
+    size_t _write(int address, const T &value)
+    {
+        if (address < 0 || address + sizeof(T) > this->_data.size())
+        {
+            return 0;
+        }
+        memcpy(&this->_data[address], &value, sizeof(T));
+        return sizeof(T);
+    }
+
+public:
+    bool begin(size_t size);
+    bool commit();
+
+    uint64_t readULong64(int address);
+    uint16_t readUShort(int address);
+    double readDouble(int address);
+    bool readBool(int address);
+    String readString(int address);
+
+    size_t writeULong64(int address, uint64_t value);
+    size_t writeUShort(int address, uint16_t value);
+    size_t writeDouble(int address, double value);
+    size_t writeBool(int address, bool value);
+    size_t writeString(int address, String value);
+};
+
+extern EEPROMClass EEPROM;
+
+#endif
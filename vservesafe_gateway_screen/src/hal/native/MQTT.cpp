@@ -0,0 +1,135 @@
+#include "MQTT.h"
+
+#include <stdio.h>
+#include <string.h>
+
+MQTTClient::MQTTClient(int bufSize) : _bufSize(bufSize)
+{
+}
+
+bool MQTTClient::connect(const char clientId[], const char username[])
+{
+  this->_connected = true;
+  return true;
+}
+
+bool MQTTClient::publish(const char topic[], const char payload[])
+{
+  if (!this->_connected)
+  {
+    return false;
+  }
+
+  size_t length = strlen(topic) + strlen(payload);
+  if ((int)length > this->_bufSize)
+  {
+    return false;
+  }
+
+  this->_publishCount += 1;
+  this->_publishBytes += length;
+  if (this->_echo)
+  {
+    printf("[mqtt] %s %s\n", topic, payload);
+  }
+  return true;
+}
+
+void MQTTClient::onMessage(MQTTClientCallbackSimple cb)
+{
+  this->_callback = cb;
+}
+
+bool MQTTClient::subscribe(const String &topic)
+{
+  if (!this->_connected)
+  {
+    return false;
+  }
+  this->_subscriptions.push_back(topic);
+  return true;
+}
+
+bool MQTTClient::subscribe(const char topic[])
+{
+  return this->subscribe(String(topic));
+}
+
+bool MQTTClient::loop()
+{
+  return this->_connected;
+}
+
+bool MQTTClient::connected()
+{
+  return this->_connected;
+}
+
+lwmqtt_err_t MQTTClient::lastError()
+{
+  return LWMQTT_SUCCESS;
+}
+
+void MQTTClient::fakeSetEcho(bool echo)
+{
+  this->_echo = echo;
+}
+
+uint32_t MQTTClient::fakePublishCount()
+{
+  return this->_publishCount;
+}
+
+size_t MQTTClient::fakePublishBytes()
+{
+  return this->_publishBytes;
+}
+
+// MQTT topic filter: + matches one level, a trailing # the rest
+static bool isTopicMatch(const char *filter, const char *topic)
+{
+  while (*filter)
+  {
+    if (filter[0] == '#')
+    {
+      return true;
+    }
+    if (filter[0] == '+')
+    {
+      while (*topic && *topic != '/')
+      {
+        topic += 1;
+      }
+      filter += 1;
+    }
+    else if (*filter++ != *topic++)
+    {
+      return false;
+    }
+  }
+  return *topic == '\0';
+}
+
+bool MQTTClient::fakeReceive(const char topic[], const char payload[])
+{
+  if ((int)(strlen(topic) + strlen(payload)) > this->_bufSize)
+  {
+    return false;
+  }
+
+  bool isSubscribed = false;
+  for (size_t i = 0; i < this->_subscriptions.size(); i++)
+  {
+    isSubscribed = isSubscribed || isTopicMatch(this->_subscriptions[i].c_str(), topic);
+  }
+  if (!isSubscribed || !this->_callback)
+  {
+    return false;
+  }
+
+  String topicString(topic);
+
+  String payloadString(payload);
+  this->_callback(topicString, payloadString);
+  return true;
+}
@@ -0,0 +1,53 @@
+#ifndef __VSERVESAFE_HAL_NATIVE_MQTT__
+#define __VSERVESAFE_HAL_NATIVE_MQTT__
+
+// Fake MQTT back end mirroring the subset of 256dpi/MQTT used by the gateway.
+// Published messages are counted and optionally echoed to stdout; incoming
+// messages are delivered with fakeReceive().
+
+#include <Arduino.h>
+#include <vector>
+
+typedef enum
+{
+    LWMQTT_SUCCESS = 0,
+    LWMQTT_NETWORK_FAILED_CONNECT = -3,
+} lwmqtt_err_t;
+
+class MQTTClient;
+typedef void (*MQTTClientCallbackSimple)(String &topic, String &payload);
+
+class MQTTClient
+{
+private:
+    int _bufSize;
+    MQTTClientCallbackSimple _callback = nullptr;
+    std::vector<String> _subscriptions;
+    bool _connected = false;
+    bool _echo = false;
+    uint32_t _publishCount = 0;
+    size_t _publishBytes = 0;
+
+public:
+    MQTTClient(int bufSize = 128);
+
+    bool connect(const char clientId[], const char username[]);
+    bool publish(const char topic[], const char payload[]);
+    void onMessage(MQTTClientCallbackSimple cb);
+    bool subscribe(const String &topic);
+    bool subscribe(const char topic[]);
+    bool loop();
+    bool connected();
+    lwmqtt_err_t lastError();
+
+    // Fake back end only
+    void fakeSetEcho(bool echo);
+    uint32_t fakePublishCount();
+    size_t fakePublishBytes();
+    // Deliver a message as if the broker sent it; ignored unless a
+    // subscription (which may use + and #) matches, or, like the real client,
+    // if topic and payload exceed the buffer
+    bool fakeReceive(const char topic[], const char payload[]);
+};
+
+#endif
@@ -0,0 +1,346 @@
+#include "NimBLEDevice.h"
+#include "vservesafe_conf.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+NimBLEUUID::NimBLEUUID(const std::string &uuid) : _uuid16((uint16_t)strtol(uuid.c_str(), nullptr, 16))
+{
+}
+
+NimBLEUUID::NimBLEUUID(uint16_t uuid16) : _uuid16(uuid16)
+{
+}
+
+uint16_t NimBLEUUID::getUuid16() const
+{
+  return this->_uuid16;
+}
+
+bool NimBLEUUID::operator==(const NimBLEUUID &rhs) const
+{
+  return this->_uuid16 == rhs._uuid16;
+}
+
+bool NimBLEUUID::operator!=(const NimBLEUUID &rhs) const
+{
+  return this->_uuid16 != rhs._uuid16;
+}
+
+NimBLEAddress::NimBLEAddress()
+{
+  memset(this->_address, 0, sizeof(this->_address));
+}
+
+NimBLEAddress::NimBLEAddress(const uint8_t address[6])
+{
+  memcpy(this->_address, address, sizeof(this->_address));
+}
+
+const uint8_t *NimBLEAddress::getNative() const
+{
+  return this->_address;
+}
+
+bool NimBLEAddress::operator==(const NimBLEAddress &rhs) const
+{
+  return memcmp(this->_address, rhs._address, sizeof(this->_address)) == 0;
+}
+
+std::string NimBLEAddress::toString() const
+{
+  // Native order is little endian, as in NimBLE
+  char buffer[18];
+  snprintf(buffer, sizeof(buffer), "%02x:%02x:%02x:%02x:%02x:%02x",
+           this->_address[5], this->_address[4], this->_address[3],
+           this->_address[2], this->_address[1], this->_address[0]);
+  return buffer;
+}
+
+NimBLEAdvertisedDevice::NimBLEAdvertisedDevice() : _rssi(-127)
+{
+}
+
+std::string NimBLEAdvertisedDevice::getName()
+{
+  return this->_name;
+}
+
+bool NimBLEAdvertisedDevice::haveName()
+{
+  return !this->_name.empty();
+}
+
+NimBLEAddress NimBLEAdvertisedDevice::getAddress()
+{
+  return this->_address;
+}
+
+int NimBLEAdvertisedDevice::getRSSI()
+{
+  return this->_rssi;
+}
+
+size_t NimBLEAdvertisedDevice::getServiceDataCount()
+{
+  return this->_serviceData.size();
+}
+
+std::string NimBLEAdvertisedDevice::getServiceData(uint8_t index)
+{
+  if (index >= this->_serviceData.size())
+  {
+    return "";
+  }
+  return this->_serviceData[index];
+}
+
+std::string NimBLEAdvertisedDevice::getServiceData(const NimBLEUUID &uuid)
+{
+  for (size_t i = 0; i < this->_serviceDataUUIDs.size(); i++)
+  {
+    if (this->_serviceDataUUIDs[i] == uuid)
+    {
+      return this->_serviceData[i];
+    }
+  }
+  return "";
+}
+
+NimBLEUUID NimBLEAdvertisedDevice::getServiceDataUUID(uint8_t index)
+{
+  if (index >= this->_serviceDataUUIDs.size())
+  {
+    return NimBLEUUID((uint16_t)0);
+  }
+  return this->_serviceDataUUIDs[index];
+}
+
+uint8_t *NimBLEAdvertisedDevice::getPayload()
+{
+  return this->_payload.data();
+}
+
+size_t NimBLEAdvertisedDevice::getPayloadLength()
+{
+  return this->_payload.size();
+}
+
+void NimBLEAdvertisedDevice::fakeSetName(const std::string &name)
+{
+  this->_name = name;
+}
+
+void NimBLEAdvertisedDevice::fakeSetAddress(const uint8_t address[6])
+{
+  this->_address = NimBLEAddress(address);
+}
+
+void NimBLEAdvertisedDevice::fakeSetRSSI(int rssi)
+{
+  this->_rssi = rssi;
+}
+
+void NimBLEAdvertisedDevice::fakeAddServiceData(const NimBLEUUID &uuid, const std::string &data)
+{
+  this->_serviceDataUUIDs.push_back(uuid);
+  this->_serviceData.push_back(data);
+
+  uint16_t uuid16 = uuid.getUuid16();
+  this->_payload.push_back((uint8_t)(data.length() + 3));
+  this->_payload.push_back(0x16);
+  this->_payload.push_back((uint8_t)(uuid16 & 0xff));
+  this->_payload.push_back((uint8_t)(uuid16 >> 8));
+  this->_payload.insert(this->_payload.end(), data.begin(), data.end());
+}
+
+int NimBLEScanResults::getCount()
+{
+  return this->_devices.size();
+}
+
+NimBLEAdvertisedDevice NimBLEScanResults::getDevice(uint32_t i)
+{
+  if (i >= this->_devices.size())
+  {
+    return NimBLEAdvertisedDevice();
+  }
+  return this->_devices[i];
+}
+
+void NimBLEScan::setAdvertisedDeviceCallbacks(NimBLEAdvertisedDeviceCallbacks *pAdvertisedDeviceCallbacks, bool wantDuplicates)
+{
+  this->_pCallbacks = pAdvertisedDeviceCallbacks;
+}
+
+void NimBLEScan::setMaxResults(uint8_t maxResults)
+{
+  this->_maxResults = maxResults;
+}
+
+void NimBLEScan::setActiveScan(bool active)
+{
+  this->_activeScan = active;
+}
+
+void NimBLEScan::setInterval(uint16_t intervalMSecs)
+{
+  this->_interval = intervalMSecs;
+}
+
+void NimBLEScan::setWindow(uint16_t windowMSecs)
+{
+  this->_window = windowMSecs;
+}
+
+void NimBLEScan::setFilterPolicy(uint8_t filterPolicy)
+{
+  this->_filterPolicy = filterPolicy;
+}
+
+void NimBLEScan::setDuplicateFilter(bool enabled)
+{
+  this->_duplicateFilter = enabled;
+}
+
+bool NimBLEScan::start(uint32_t duration, void (*scanCompleteCB)(NimBLEScanResults), bool is_continue)
+{
+  if (!is_continue)
+  {
+    this->clearResults();
+  }
+  this->_duplicateCache.clear();
+  this->_scanning = true;
+  return true;
+}
+
+void NimBLEScan::stop()
+{
+  this->_scanning = false;
+}
+
+bool NimBLEScan::isScanning()
+{
+  return this->_scanning;
+}
+
+NimBLEScanResults NimBLEScan::getResults()
+{
+  return this->_results;
+}
+
+void NimBLEScan::clearResults()
+{
+  this->_results._devices.clear();
+}
+
+bool NimBLEScan::fakeInject(const NimBLEAdvertisedDevice &device)
+{
+  if (!this->_scanning)
+  {
+    return false;
+  }
+
+  // Controller side: accept list, then duplicates by address and data
+  NimBLEAdvertisedDevice copy = device;
+  if (!this->_activeScan)
+  {
+    // The name comes in the scan response, which a passive scan never asks for
+    copy.fakeSetName("");
+  }
+  if (this->_filterPolicy == BLE_HCI_SCAN_FILT_USE_WL && !NimBLEDevice::onWhiteList(copy.getAddress()))
+  {
+    this->_filtered += 1;
+    return false;
+  }
+  if (this->_duplicateFilter)
+  {
+    std::string key((const char *)copy.getAddress().getNative(), 6);
+    key.append((const char *)copy.getPayload(), copy.getPayloadLength());
+    if (!this->_duplicateCache.insert(key).second)
+    {
+      this->_filtered += 1;
+      return false;
+    }
+  }
+
+  // Same order as NimBLE: results are only kept while below maxResults,
+  // and the callback sees every advert
+  if (this->_maxResults > 0 && (this->_maxResults == 0xFF || this->_results._devices.size() < this->_maxResults))
+  {
+    this->_results._devices.push_back(copy);
+  }
+  if (this->_pCallbacks)
+  {
+    this->_pCallbacks->onResult(&copy);
+  }
+  return true;
+}
+
+uint32_t NimBLEScan::fakeFilteredCount()
+{
+  return this->_filtered;
+}
+
+void NimBLEDevice::init(const std::string &deviceName)
+{
+}
+
+NimBLEScan *NimBLEDevice::getScan()
+{
+  static NimBLEScan scan;
+  return &scan;
+}
+
+// Like the ESP32 controller, the accept list holds BLE_ACCEPT_LIST_SIZE entries
+static std::vector<NimBLEAddress> whiteList;
+
+bool NimBLEDevice::whiteListAdd(const NimBLEAddress &address)
+{
+  if (NimBLEDevice::onWhiteList(address))
+  {
+    return true;
+  }
+  if (whiteList.size() >= BLE_ACCEPT_LIST_SIZE)
+  {
+    return false;
+  }
+  whiteList.push_back(address);
+  return true;
+}
+
+bool NimBLEDevice::whiteListRemove(const NimBLEAddress &address)
+{
+  for (size_t i = 0; i < whiteList.size(); i++)
+  {
+    if (whiteList[i] == address)
+    {
+      whiteList.erase(whiteList.begin() + i);
+      return true;
+    }
+  }
+  return false;
+}
+
+bool NimBLEDevice::onWhiteList(const NimBLEAddress &address)
+{
+  for (size_t i = 0; i < whiteList.size(); i++)
+  {
+    if (whiteList[i] == address)
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+size_t NimBLEDevice::getWhiteListCount()
+{
+  return whiteList.size();
+}
+
+NimBLEAddress NimBLEDevice::getWhiteListAddress(size_t index)
+{
+  return index < whiteList.size() ? whiteList[index] : NimBLEAddress();
+}
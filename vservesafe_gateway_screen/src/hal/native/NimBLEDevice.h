@@ -0,0 +1,150 @@
+#ifndef __VSERVESAFE_HAL_NATIVE_NIMBLE__
+#define __VSERVESAFE_HAL_NATIVE_NIMBLE__
+
+// Fake BLE back end mirroring the subset of the NimBLE-Arduino API used by
+// MiTagScanner. Adverts are injected with NimBLEScan::fakeInject() instead of
+// coming from a radio.
+
+#include <stdint.h>
+#include <set>
+#include <string>
+#include <vector>
+
+#define BLE_HCI_SCAN_FILT_NO_WL (0)
+#define BLE_HCI_SCAN_FILT_USE_WL (1)
+
+class NimBLEUUID
+{
+private:
+    uint16_t _uuid16;
+
+public:
+    NimBLEUUID(const std::string &uuid);
+    NimBLEUUID(uint16_t uuid16);
+
+    uint16_t getUuid16() const;
+    bool operator==(const NimBLEUUID &rhs) const;
+    bool operator!=(const NimBLEUUID &rhs) const;
+};
+
+class NimBLEAddress
+{
+private:
+    uint8_t _address[6];
+
+public:
+    NimBLEAddress();
+    NimBLEAddress(const uint8_t address[6]);
+
+    const uint8_t *getNative() const;
+    std::string toString() const;
+    bool operator==(const NimBLEAddress &rhs) const;
+};
+
+class NimBLEAdvertisedDevice
+{
+private:
+    std::string _name;
+    NimBLEAddress _address;
+    int _rssi;
+    std::vector<NimBLEUUID> _serviceDataUUIDs;
+    std::vector<std::string> _serviceData;
+    std::vector<uint8_t> _payload;
+
+public:
+    NimBLEAdvertisedDevice();
+
+    std::string getName();
+    bool haveName();
+    NimBLEAddress getAddress();
+    int getRSSI();
+    size_t getServiceDataCount();
+    std::string getServiceData(uint8_t index);
+    std::string getServiceData(const NimBLEUUID &uuid);
+    NimBLEUUID getServiceDataUUID(uint8_t index);
+    uint8_t *getPayload();
+    size_t getPayloadLength();
+
+    // Fake back end only
+    void fakeSetName(const std::string &name);
+    void fakeSetAddress(const uint8_t address[6]);
+    void fakeSetRSSI(int rssi);
+    // Also appended to the raw payload as a 16-bit UUID service data AD structure
+    void fakeAddServiceData(const NimBLEUUID &uuid, const std::string &data);
+};
+
+class NimBLEAdvertisedDeviceCallbacks
+{
+public:
+    virtual ~NimBLEAdvertisedDeviceCallbacks() {}
+    virtual void onResult(NimBLEAdvertisedDevice *advertisedDevice) = 0;
+};
+
+class NimBLEScanResults
+{
+private:
+    std::vector<NimBLEAdvertisedDevice> _devices;
+
+public:
+    int getCount();
+    NimBLEAdvertisedDevice getDevice(uint32_t i);
+
+    friend class NimBLEScan;
+};
+
+class NimBLEScan
+{
+private:
+    NimBLEScanResults _results;
+    NimBLEAdvertisedDeviceCallbacks *_pCallbacks = nullptr;
+    uint8_t _maxResults = 0xFF;
+    bool _activeScan = false;
+    uint16_t _interval = 0;
+    uint16_t _window = 0;
+    bool _scanning = false;
+    uint8_t _filterPolicy = BLE_HCI_SCAN_FILT_NO_WL;
+    bool _duplicateFilter = false;
+    // Address and data of adverts already reported since start()
+    std::set<std::string> _duplicateCache;
+    uint32_t _filtered = 0;
+
+public:
+    void setAdvertisedDeviceCallbacks(NimBLEAdvertisedDeviceCallbacks *pAdvertisedDeviceCallbacks, bool wantDuplicates = false);
+    void setMaxResults(uint8_t maxResults);
+    void setActiveScan(bool active);
+    void setInterval(uint16_t intervalMSecs);
+    void setWindow(uint16_t windowMSecs);
+    void setFilterPolicy(uint8_t filterPolicy);
+    void setDuplicateFilter(bool enabled);
+    bool start(uint32_t duration, void (*scanCompleteCB)(NimBLEScanResults), bool is_continue = false);
+    void stop();
+    bool isScanning();
+    NimBLEScanResults getResults();
+    void clearResults();
+
+    // Fake back end only; returns false if the controller filtered it
+    bool fakeInject(const NimBLEAdvertisedDevice &device);
+    uint32_t fakeFilteredCount();
+};
+
+class NimBLEDevice
+{
+public:
+    static void init(const std::string &deviceName);
+    static NimBLEScan *getScan();
+    static bool whiteListAdd(const NimBLEAddress &address);
+    static bool whiteListRemove(const NimBLEAddress &address);
+    static bool onWhiteList(const NimBLEAddress &address);
+    static size_t getWhiteListCount();
+    static NimBLEAddress getWhiteListAddress(size_t index);
+};
+
+#define BLEDevice NimBLEDevice
+#define BLEScan NimBLEScan
+#define BLEScanResults NimBLEScanResults
+#define BLEUUID NimBLEUUID
+#define BLEAddress NimBLEAddress
+#define BLEAdvertisedDevice NimBLEAdvertisedDevice
+#define BLEAdvertisedDeviceCallbacks NimBLEAdvertisedDeviceCallbacks
+
+#endif
@@ -0,0 +1,181 @@
+#include "FreeRTOS.h"
+#include "queue.h"
+#include "semphr.h"
+#include "task.h"
+
+#include <string.h>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct NativeQueue
+{
+  std::mutex lock;
+  std::condition_variable notEmpty;
+  std::condition_variable notFull;
+  std::vector<uint8_t> items;
+  UBaseType_t length;
+  UBaseType_t itemSize;
+  UBaseType_t head;
+  UBaseType_t count;
+};
+
+struct NativeMutex
+{
+  std::timed_mutex lock;
+};
+
+struct NativeTask
+{
+  std::mutex lock;
+  std::condition_variable notified;
+  uint32_t notifyCount;
+};
+
+static thread_local NativeTask *currentTask = nullptr;
+
+template <typename PREDICATE>
+static bool waitFor(std::condition_variable &cond, std::unique_lock<std::mutex> &lock, TickType_t ticks, PREDICATE ready)
+{
+  if (ticks == portMAX_DELAY)
+  {
+    cond.wait(lock, ready);
+    return true;
+  }
+  return cond.wait_for(lock, std::chrono::milliseconds(ticks), ready);
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize)
+{
+  NativeQueue *queue = new NativeQueue();
+  queue->items.resize(length * itemSize);
+  queue->length = length;
+  queue->itemSize = itemSize;
+  queue->head = 0;
+  queue->count = 0;
+  return queue;
+}
+
+void vQueueDelete(QueueHandle_t queue)
+{
+  delete queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticksToWait)
+{
+  std::unique_lock<std::mutex> lock(queue->lock);
+  if (!waitFor(queue->notFull, lock, ticksToWait, [queue]
+               { return queue->count < queue->length; }))
+  {
+    return pdFALSE;
+  }
+
+  UBaseType_t tail = (queue->head + queue->count) % queue->length;
+  memcpy(&queue->items[tail * queue->itemSize], item, queue->itemSize);
+  queue->count += 1;
+  queue->notEmpty.notify_one();
+  return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *buffer, TickType_t ticksToWait)
+{
+  std::unique_lock<std::mutex> lock(queue->lock);
+  if (!waitFor(queue->notEmpty, lock, ticksToWait, [queue]
+               { return queue->count > 0; }))
+  {
+    return pdFALSE;
+  }
+
+  memcpy(buffer, &queue->items[queue->head * queue->itemSize], queue->itemSize);
+  queue->head = (queue->head + 1) % queue->length;
+  queue->count -= 1;
+  queue->notFull.notify_one();
+  return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+  std::lock_guard<std::mutex> lock(queue->lock);
+  return queue->count;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex()
+{
+  return new NativeMutex();
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t semaphore)
+{
+  delete semaphore;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticksToWait)
+{
+  if (ticksToWait == portMAX_DELAY)
+  {
+    semaphore->lock.lock();
+    return pdTRUE;
+  }
+  return semaphore->lock.try_lock_for(std::chrono::milliseconds(ticksToWait)) ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore)
+{
+  semaphore->lock.unlock();
+  return pdTRUE;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t taskCode, const char *name, uint32_t stackDepth,
+                                   void *parameters, UBaseType_t priority, TaskHandle_t *createdTask,
+                                   BaseType_t coreId)
+{
+  // Tasks never end, so the task record is never freed
+  NativeTask *task = new NativeTask();
+  task->notifyCount = 0;
+  std::thread([task, taskCode, parameters]
+              {
+                currentTask = task;
+                taskCode(parameters); })
+      .detach();
+  if (createdTask)
+  {
+    *createdTask = task;
+  }
+  return pdPASS;
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+  std::this_thread::sleep_for(std::chrono::milliseconds(ticks));
+}
+
+TickType_t xTaskGetTickCount()
+{
+  static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+  std::lock_guard<std::mutex> lock(task->lock);
+  task->notifyCount += 1;
+  task->notified.notify_one();
+  return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clearCountOnExit, TickType_t ticksToWait)
+{
+  NativeTask *task = currentTask;
+  std::unique_lock<std::mutex> lock(task->lock);
+  if (!waitFor(task->notified, lock, ticksToWait, [task]
+               { return task->notifyCount > 0; }))
+  {
+    return 0;
+  }
+
+  uint32_t count = task->notifyCount;
+  task->notifyCount = clearCountOnExit ? 0 : count - 1;
+  return count;
+}
@@ -0,0 +1,23 @@
+#ifndef __VSERVESAFE_HAL_NATIVE_FREERTOS__
+#define __VSERVESAFE_HAL_NATIVE_FREERTOS__
+
+// Fake FreeRTOS back end: the queue, mutex and task calls used by the gateway,
+// mapped onto std::thread and friends. Ticks are milliseconds.
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef int32_t BaseType_t;
+typedef uint32_t UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdFALSE ((BaseType_t)0)
+#define pdTRUE ((BaseType_t)1)
+#define pdPASS (pdTRUE)
+#define pdFAIL (pdFALSE)
+#define portMAX_DELAY ((TickType_t)0xFFFFFFFF)
+#define portTICK_PERIOD_MS ((TickType_t)1)
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define tskNO_AFFINITY ((BaseType_t)0x7FFFFFFF)
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef __VSERVESAFE_HAL_NATIVE_FREERTOS_SEMPHR__
+#define __VSERVESAFE_HAL_NATIVE_FREERTOS_SEMPHR__
+
+#include "FreeRTOS.h"
+
+typedef struct NativeMutex *SemaphoreHandle_t;
+
+SemaphoreHandle_t xSemaphoreCreateMutex();
+void vSemaphoreDelete(SemaphoreHandle_t semaphore);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticksToWait);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore);
+
+#endif
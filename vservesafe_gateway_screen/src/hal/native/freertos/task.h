@@ -0,0 +1,20 @@
+#ifndef __VSERVESAFE_HAL_NATIVE_FREERTOS_TASK__
+#define __VSERVESAFE_HAL_NATIVE_FREERTOS_TASK__
+
+#include "FreeRTOS.h"
+
+typedef void (*TaskFunction_t)(void *);
+typedef struct NativeTask *TaskHandle_t;
+
+// Runs the task on a detached thread; stack size, priority and core are ignored
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t taskCode, const char *name, uint32_t stackDepth,
+                                   void *parameters, UBaseType_t priority, TaskHandle_t *createdTask,
+                                   BaseType_t coreId);
+void vTaskDelay(TickType_t ticks);
+// Real time since start, unlike the fake millis()
+TickType_t xTaskGetTickCount();
+// Counting notification of a task created by xTaskCreatePinnedToCore
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+uint32_t ulTaskNotifyTake(BaseType_t clearCountOnExit, TickType_t ticksToWait);
+
+#endif
@@ -0,0 +1,520 @@
+// Host entry point for the `native` env: a smoke run of the gateway core. It
+// replays synthetic sensor adverts through the scan, ingest, alarm, payload
+// and ordering paths using the fake BLE, clock and MQTT back ends, prints what
+// came out, and fails if no sample was published or no alarm was raised.
+// Checks live in test/, timings in src/sim/GatewayBench.cpp.
+//
+//   pio run -e native && .pio/build/native/program [tags] [cycles] [capacity] [limited] [selected]
+//
+// The first `limited` tags get alarm limits some of them cross; with
+// `selected` = 1 the scanner runs in the selected mode and hears only them.
+
+#include <Arduino.h>
+#include <MQTT.h>
+#include <freertos/task.h>
+#include <mbedtls/ccm.h>
+#include <stdio.h>
+#include <vector>
+
+#include "BLE.h"
+#include "Buzzer.h"
+#include "GatewayConfig.h"
+#include "GatewayOptions.h"
+#include "TagHistory.h"
+#include "TagOrder.h"
+#include "TagPayload.h"
+
+#define FAKE_ADVERT_COPIES (3)
+#define FAKE_LOSS_EVERY (10)
+// Phones and other beacons heard every cycle
+#define FAKE_FOREIGN_DEVICES (32)
+// Neighbours' sensors, kept out by the allowlist
+#define FAKE_NEIGHBOUR_TAGS (16)
+#define FAKE_NEIGHBOUR_INDEX (0xF000)
+// Tag MACs per allow or limits record
+#define FAKE_ALLOW_PER_RECORD (16)
+// Tag i reads about 2.0 + i / 10 C, so of the first sixteen the six up to
+// 2.5 C and the six from 3.0 C raise an alarm once the dwell has passed
+#define FAKE_LIMITS "limits:2.5,3,"
+#define FAKE_ALARM_CONFIG "alarm:0.5,10,300\n"
+
+static MiTagScanner miTagScanner;
+static MQTTClient mqttClient(VSERVESAFE_MQTT_BUFFER_SIZE);
+static String deviceMAC = "NATIVE";
+static String gwConfigTopic = buildGatewayConfigTopic(deviceMAC);
+static GatewayConfigChunks gwConfigChunks;
+static uint32_t gwConfigVersion = 0;
+
+static void fakeBindKey(int tagIndex, uint8_t *bindKey)
+{
+  for (int i = 0; i < MIBEACON_BINDKEY_SIZE; i++)
+  {
+    bindKey[i] = (uint8_t)(tagIndex * 7 + i);
+  }
+}
+
+// LYWSD03MMC style v5 frame; temperature, humidity and battery take turns
+static std::string buildFakeMiBeacon(int tagIndex, const uint8_t *address, uint8_t counter, int16_t tempRaw, uint16_t humidRaw)
+{
+  uint8_t objects[4];
+  size_t objectsLen;
+  switch (counter % 3)
+  {
+  case 0:
+    objects[0] = 0x04;
+    objects[1] = 0x10;
+    objects[2] = 2;
+    objects[3] = 0;
+    objectsLen = 5;
+    break;
+  case 1:
+    objects[0] = 0x06;
+    objects[1] = 0x10;
+    objects[2] = 2;
+    objects[3] = 0;
+    objectsLen = 5;
+    break;
+  default:
+    objects[0] = 0x0A;
+    objects[1] = 0x10;
+    objects[2] = 1;
+    objects[3] = 90;
+    objectsLen = 4;
+    break;
+  }
+  uint8_t plain[5];
+  memcpy(plain, objects, 3);
+  uint16_t value = (counter % 3 == 0) ? (uint16_t)(tempRaw / 10) : (uint16_t)(humidRaw / 10);
+  plain[3] = (counter % 3 == 2) ? 90 : (uint8_t)(value & 0xff);
+  plain[4] = (uint8_t)(value >> 8);
+
+  uint8_t header[11] = {0x58, 0x58, 0x5b, 0x05, counter};
+  memcpy(header + 5, address, 6);
+  uint8_t extCounter[3] = {0, 0, 0};
+  uint8_t nonce[12];
+  memcpy(nonce, address, 6);
+  memcpy(nonce + 6, header + 2, 3);
+  memcpy(nonce + 9, extCounter, 3);
+
+  uint8_t bindKey[MIBEACON_BINDKEY_SIZE];
+  fakeBindKey(tagIndex, bindKey);
+  uint8_t cipher[5];
+  uint8_t mic[4];
+  const uint8_t aad[] = {0x11};
+  mbedtls_ccm_context ccm;
+  mbedtls_ccm_init(&ccm);
+  mbedtls_ccm_setkey(&ccm, MBEDTLS_CIPHER_ID_AES, bindKey, 128);
+  mbedtls_ccm_encrypt_and_tag(&ccm, objectsLen, nonce, sizeof(nonce), aad, sizeof(aad), plain, cipher, mic, sizeof(mic));
+  mbedtls_ccm_free(&ccm);
+
+  std::string rawData((const char *)header, sizeof(header));
+  rawData.append((const char *)cipher, objectsLen);
+  rawData.append((const char *)extCounter, sizeof(extCounter));
+  rawData.append((const char *)mic, sizeof(mic));
+  return rawData;
+}
+
+// Tags rotate through the formats: pvvx, ATC1441, BTHome v2 and encrypted
+// MiBeacon
+static void buildFakeAdvert(int tagIndex, uint8_t counter, NimBLEAdvertisedDevice &device)
+{
+  uint8_t address[6] = {(uint8_t)tagIndex, (uint8_t)(tagIndex >> 8), 0x00, 0x38, 0xc1, 0xa4};
+  int16_t tempRaw = 200 + (tagIndex % 50) * 10 + (counter % 7);
+  uint16_t humidRaw = 7000 + (tagIndex % 20) * 50;
+  uint16_t battMv = 2900;
+
+  std::string rawData;
+  NimBLEUUID uuid = MiTagScanner::TARGET_UUID;
+  switch (tagIndex % 4)
+  {
+  case 0:
+    for (int i = 0; i < 6; i++)
+    {
+      rawData += (char)address[i];
+    }
+    rawData += (char)(tempRaw & 0xff);
+    rawData += (char)(tempRaw >> 8);
+    rawData += (char)(humidRaw & 0xff);
+    rawData += (char)(humidRaw >> 8);
+    rawData += (char)(battMv & 0xff);
+    rawData += (char)(battMv >> 8);
+    rawData += (char)90;
+    rawData += (char)counter;
+    rawData += (char)0;
+    break;
+  case 1:
+    for (int i = 5; i >= 0; i--)
+    {
+      rawData += (char)address[i];
+    }
+    rawData += (char)((tempRaw / 10) >> 8);
+    rawData += (char)((tempRaw / 10) & 0xff);
+    rawData += (char)(humidRaw / 100);
+    rawData += (char)90;
+    rawData += (char)(battMv >> 8);
+    rawData += (char)(battMv & 0xff);
+    rawData += (char)counter;
+    break;
+  case 3:
+    uuid = NimBLEUUID((uint16_t)ADV_UUID_MIBEACON);
+    rawData = buildFakeMiBeacon(tagIndex, address, counter, tempRaw, humidRaw);
+    break;
+  default:
+    uuid = NimBLEUUID((uint16_t)ADV_UUID_BTHOME);
+    rawData += (char)0x40;
+    rawData += (char)0x00;
+    rawData += (char)counter;
+    rawData += (char)0x01;
+    rawData += (char)90;
+    rawData += (char)0x02;
+    rawData += (char)(tempRaw & 0xff);
+    rawData += (char)(tempRaw >> 8);
+    rawData += (char)0x03;
+    rawData += (char)(humidRaw & 0xff);
+    rawData += (char)(humidRaw >> 8);
+    rawData += (char)0x0C;
+    rawData += (char)(battMv & 0xff);
+    rawData += (char)(battMv >> 8);
+    break;
+  }
+
+  char name[16];
+  snprintf(name, sizeof(name), "ATC_%02X%02X%02X", address[2], address[1], address[0]);
+
+  device.fakeSetName(name);
+  device.fakeSetAddress(address);
+  // Fading around a fixed path loss per tag
+  device.fakeSetRSSI(-50 - (tagIndex % 40) - ((tagIndex + counter * 3) % 9));
+  device.fakeAddServiceData(uuid, rawData);
+}
+
+static void buildForeignAdvert(int deviceIndex, NimBLEAdvertisedDevice &device)
+{
+  uint8_t address[6] = {(uint8_t)deviceIndex, 0x5a, 0x3c, 0x21, 0x7e, 0x4f};
+  device.fakeSetAddress(address);
+  device.fakeSetRSSI(-70);
+}
+
+static uint32_t pendingDecrypts()
+{
+  MiBeaconStats stats = miTagScanner.getMiBeaconStats();
+  return stats.queued - stats.decrypted - stats.authFailed - stats.copies;
+}
+
+static void onMqttMessage(String &topic, String &payload)
+{
+  gwConfigChunks.receive(miTagScanner, gwConfigTopic, topic, payload.c_str(), payload.length());
+}
+
+// Publishes records, one per line, as the server does: a new version in
+// chunks of whole records that fit the client's buffer, then its manifest.
+// Returns the records applied once the ingest task has taken them all, -1 if
+// a record does not fit a chunk; nChunks is the chunks published.
+static int fakePushConfig(const String &records, int &nChunks)
+{
+  gwConfigVersion += 1;
+  nChunks = 0;
+  const char *pos = records.c_str();
+  while (*pos)
+  {
+    char topic[64];
+    char header[24];
+    snprintf(topic, sizeof(topic), "%s/%d", gwConfigTopic.c_str(), nChunks);
+    snprintf(header, sizeof(header), "chunk:%u\n", gwConfigVersion);
+    size_t room = VSERVESAFE_MQTT_BUFFER_SIZE - strlen(topic) - strlen(header);
+    const char *end = pos;
+    while (*end)
+    {
+      const char *newline = strchr(end, '\n');
+      const char *next = newline ? newline + 1 : end + strlen(end);
+      if ((size_t)(next - pos) > room)
+      {
+        break;
+      }
+      end = next;
+    }
+    if (end == pos)
+    {
+      return -1;
+    }
+
+    std::string chunk = header;
+    chunk.append(pos, end - pos);
+    mqttClient.fakeReceive(topic, chunk.c_str());
+    nChunks += 1;
+    pos = end;
+  }
+
+  char manifest[48];
+  snprintf(manifest, sizeof(manifest), "config:%u,%d", gwConfigVersion, nChunks);
+  mqttClient.fakeReceive(gwConfigTopic.c_str(), manifest);
+
+  // The gateway's loop()
+  int applied = 0;
+  while (gwConfigChunks.isApplying() || miTagScanner.getTagNotifyPending() > 0)
+  {
+    applied += gwConfigChunks.poll(miTagScanner);
+    vTaskDelay(0);
+  }
+  return applied;
+}
+
+int main(int argc, char **argv)
+{
+  int nTags = argc > 1 ? atoi(argv[1]) : MAX_TAGS_REMEMBER;
+  int nCycles = argc > 2 ? atoi(argv[2]) : 10;
+  int capacity = argc > 3 ? atoi(argv[3]) : MAX_TAGS_REMEMBER;
+  int nLimited = argc > 4 ? atoi(argv[4]) : FAKE_ALLOW_PER_RECORD;
+  bool isSelected = argc > 5 && atoi(argv[5]) != 0;
+  if (nTags < 0)
+  {
+    nTags = 0;
+  }
+  if (nCycles < 1)
+  {
+    nCycles = 1;
+  }
+  if (nLimited > nTags)
+  {
+    nLimited = nTags;
+  }
+
+#if VSERVESAFE_ALLOW_EEPROM
+  initEEPROM();
+#endif
+  restoreSaveToOptions();
+
+  miTagScanner.init(capacity);
+  gwConfigChunks.begin();
+  gwConfigChunks.restore();
+  mqttClient.connect("gw-native", "native");
+  mqttClient.fakeSetEcho(getenv("NATIVE_MQTT_ECHO") != NULL);
+  mqttClient.onMessage(onMqttMessage);
+  mqttClient.subscribe(gwConfigTopic);
+  String chunkTopics = gwConfigTopic;
+  chunkTopics += "/+";
+  mqttClient.subscribe(chunkTopics);
+
+  // Provision the MiBeacon tags' bindkeys through the config topics
+  String config;
+  for (int i = 3; i < nTags; i += 4)
+  {
+    uint8_t bindKey[MIBEACON_BINDKEY_SIZE];
+    char record[64];
+    fakeBindKey(i, bindKey);
+    int len = snprintf(record, sizeof(record), "bindkey:A4C13800%02X%02X,", (uint8_t)(i >> 8), (uint8_t)i);
+    for (int j = 0; j < MIBEACON_BINDKEY_SIZE; j++)
+    {
+      len += snprintf(record + len, sizeof(record) - len, "%02x", bindKey[j]);
+    }
+    config += record;
+    config += "\n";
+  }
+
+  // Register this site's tags
+  for (int i = 0; i < nTags; i++)
+  {
+    char mac[24];
+    snprintf(mac, sizeof(mac), "%sA4C13800%02X%02X", i % FAKE_ALLOW_PER_RECORD > 0 ? "," : "allow:",
+             (uint8_t)(i >> 8), (uint8_t)i);
+    config += mac;
+    if ((i + 1) % FAKE_ALLOW_PER_RECORD == 0 || i == nTags - 1)
+    {
+      config += "\n";
+    }
+  }
+
+  // Alarm limits of the first tags, with a dwell the run outlasts
+  config += FAKE_ALARM_CONFIG;
+  for (int i = 0; i < nLimited; i++)
+  {
+    char mac[32];
+    snprintf(mac, sizeof(mac), "%sA4C13800%02X%02X", i % FAKE_ALLOW_PER_RECORD > 0 ? "," : FAKE_LIMITS,
+             (uint8_t)(i >> 8), (uint8_t)i);
+    config += mac;
+    if ((i + 1) % FAKE_ALLOW_PER_RECORD == 0 || i == nLimited - 1)
+    {
+      config += "\n";
+    }
+  }
+  // Fake humidity tops out at 79.5 %RH, in the two tags of every twenty
+  config += "rule:humid,*,humid >= 79\nrule:rising,*,rate > 1\n";
+  int nChunks;
+  int applied = fakePushConfig(config, nChunks);
+  printf("config: %d records in %d chunks of at most %dB\n", applied, nChunks, VSERVESAFE_MQTT_BUFFER_SIZE);
+  if (isSelected)
+  {
+    miTagScanner.setScanMode(VSERVESAFE_SCANMODE_SELECTED_SCAN);
+  }
+  // Provisioning reaches the host task through the ingest task
+  while (!miTagScanner.isAdmissionCurrent())
+  {
+    vTaskDelay(1);
+  }
+
+  NimBLEScan *pBLEScan = NimBLEDevice::getScan();
+  uint32_t presenceEvents[2] = {0, 0};
+  uint32_t alarmEvents[VSERVESAFE_ALARM_EDGE_CLEAR + 1] = {};
+  uint32_t ruleEvents[2] = {0, 0};
+
+  for (int cycle = 0; cycle < nCycles; cycle++)
+  {
+    // Every tag misses about one sample in FAKE_LOSS_EVERY
+    std::vector<NimBLEAdvertisedDevice> devices;
+    for (int i = 0; i < nTags; i++)
+    {
+      if ((i + cycle) % FAKE_LOSS_EVERY != 0 || cycle == 0)
+      {
+        devices.push_back(NimBLEAdvertisedDevice());
+        buildFakeAdvert(i, cycle, devices.back());
+      }
+    }
+    for (int i = 0; i < FAKE_NEIGHBOUR_TAGS; i++)
+    {
+      devices.push_back(NimBLEAdvertisedDevice());
+      buildFakeAdvert(FAKE_NEIGHBOUR_INDEX + i * 4, cycle, devices.back());
+    }
+    for (int i = 0; i < FAKE_FOREIGN_DEVICES; i++)
+    {
+      devices.push_back(NimBLEAdvertisedDevice());
+      buildForeignAdvert(i, devices.back());
+    }
+
+    // Tags send every sample several times
+    for (int copy = 0; copy < FAKE_ADVERT_COPIES; copy++)
+    {
+      for (size_t i = 0; i < devices.size(); i++)
+      {
+        // Pace like a radio would so the bounded decrypt queue and ingest
+        // rings do not drop
+        while (pendingDecrypts() >= MIBEACON_DECRYPT_QUEUE_LENGTH ||
+               miTagScanner.getIngestPending() >= TAG_INGEST_QUEUE_LENGTH)
+        {
+          vTaskDelay(0);
+        }
+        pBLEScan->fakeInject(devices[i]);
+      }
+    }
+    while (pendingDecrypts() > 0 || miTagScanner.getIngestPending() > 0 || !miTagScanner.isSnapshotCurrent())
+    {
+      vTaskDelay(1);
+    }
+
+    miTagScanner.scan();
+
+    const TagSnapshot *snapshot = miTagScanner.acquireSnapshot();
+    int backlog = 0;
+    for (int i = 0; i < snapshot->count; i++)
+    {
+      MiTagData *tagData = &snapshot->tags[i];
+      if (miTagScanner.isTagActive(tagData) && miTagScanner.isTagDirty(tagData))
+      {
+        String topic = buildTagTopic(*tagData);
+        String payload = buildTagPayload(*tagData);
+        if (mqttClient.publish(topic.c_str(), payload.c_str()))
+        {
+          miTagScanner.markTagPublished(tagData->mac, tagData->sampleSeq);
+        }
+        else
+        {
+          backlog += 1;
+        }
+      }
+    }
+    miTagScanner.setUplinkBacklog(backlog);
+    TagPresenceEvent presenceEvent;
+    while (miTagScanner.pollPresenceEvent(presenceEvent))
+    {
+      presenceEvents[presenceEvent.isOnline ? 0 : 1] += 1;
+    }
+    TagAlarmEvent alarmEvent;
+    while (miTagScanner.pollAlarmEvent(alarmEvent))
+    {
+      alarmEvents[alarmEvent.edge] += 1;
+    }
+    TagRuleEvent ruleEvent;
+    while (miTagScanner.pollRuleEvent(ruleEvent))
+    {
+      ruleEvents[ruleEvent.isActive ? 0 : 1] += 1;
+    }
+
+    std::vector<MiTagData *> orderedTagData(snapshot->count);
+    orderTagsForHome(miTagScanner, snapshot, VSERVESAFE_SCANMODE_SELECTED_SCAN, orderedTagData.data());
+    miTagScanner.releaseSnapshot(snapshot);
+
+    halNativeAdvanceMillis(5000);
+  }
+
+  uint32_t published = mqttClient.fakePublishCount();
+  printf("tags=%d cycles=%d stored=%d active=%d published=%u\n", nTags, nCycles, miTagScanner.getTagsCount(),
+         miTagScanner.getActiveTagCount(), published);
+  MiTagAlarmCounts alarmCounts = miTagScanner.getAlarmCounts();
+  printf("alarm events high=%u low=%u clear=%u dropped=%u, buzzer counts high=%u low=%u\n",
+         alarmEvents[VSERVESAFE_ALARM_EDGE_HIGH], alarmEvents[VSERVESAFE_ALARM_EDGE_LOW],
+         alarmEvents[VSERVESAFE_ALARM_EDGE_CLEAR], miTagScanner.getAlarmEventsDropped(), alarmCounts.high,
+         alarmCounts.low);
+
+  // With no more adverts every stored tag goes offline once the ingest task
+  // next expires presence
+  halNativeAdvanceMillis(TAG_ONLINE_TIEMOUT + TAG_PRESENCE_TICK);
+  for (int i = 0; i < 5000 && miTagScanner.getActiveTagCount() > 0; i++)
+  {
+    vTaskDelay(1);
+  }
+  TagPresenceEvent presenceEvent;
+  while (miTagScanner.pollPresenceEvent(presenceEvent))
+  {
+    presenceEvents[presenceEvent.isOnline ? 0 : 1] += 1;
+  }
+  printf("after timeout: active=%d, presence events online=%u offline=%u dropped=%u, buzzer offline=%u\n",
+         miTagScanner.getActiveTagCount(), presenceEvents[0], presenceEvents[1],
+         miTagScanner.getPresenceEventsDropped(), miTagScanner.getAlarmCounts().offline);
+  printf("rules=%d rule events active=%u inactive=%u dropped=%u\n", miTagScanner.getTagRuleCount(), ruleEvents[0],
+         ruleEvents[1], miTagScanner.getRuleEventsDropped());
+  MiTagEvictionStats evictionStats = miTagScanner.getEvictionStats();
+  printf("evictions=%u readmissions=%u rejections=%u\n", evictionStats.evictions,
+         evictionStats.readmissions, evictionStats.rejections);
+  MiTagIngestStats ingestStats = miTagScanner.getIngestStats();
+  printf("adverts=%u newSamples=%u duplicates=%u queueDropped=%u\n", miTagScanner.getAdvertTotal(),
+         ingestStats.newSamples, ingestStats.duplicates, ingestStats.queueDropped);
+  printf("health: %s\n", buildHealthPayload(miTagScanner).c_str());
+  if (isSelected)
+  {
+    printf("scan filter=%s controllerFiltered=%u hostFiltered=%u\n",
+           miTagScanner.isControllerFiltering() ? "controller" : "host", pBLEScan->fakeFilteredCount(),
+           miTagScanner.getHostFilteredCount());
+  }
+  MiBeaconStats miBeaconStats = miTagScanner.getMiBeaconStats();
+  printf("bindkeys=%d mibeacon queued=%u decrypted=%u authFailed=%u copies=%u noKey=%u dropped=%u\n",
+         miTagScanner.getBindKeyCount(), miBeaconStats.queued, miBeaconStats.decrypted, miBeaconStats.authFailed,
+         miBeaconStats.copies, miBeaconStats.noKey, miBeaconStats.dropped);
+
+  const TagSnapshot *snapshot = miTagScanner.acquireSnapshot();
+  if (snapshot->count > 0)
+  {
+    TagHistorySample samples[TAG_HISTORY_LENGTH];
+    int n = miTagScanner.getTagHistory(&snapshot->tags[0], 0, millis(), samples, TAG_HISTORY_LENGTH);
+    printf("history of %012llX: %d periods, newest temp=%d\n", (unsigned long long)snapshot->tags[0].mac, n,
+           n > 0 ? samples[n - 1].tempCenti : 0);
+  }
+  int notifyResults[VSERVESAFE_NOTIFY_LOW + 1] = {};
+  for (int i = 0; i < snapshot->count; i++)
+  {
+    notifyResults[miTagScanner.getTagNotifyResult(&snapshot->tags[i])] += 1;
+  }
+  printf("notify results: nodata=%d normal=%d high=%d low=%d\n", notifyResults[VSERVESAFE_NOTIFY_NODATA],
+         notifyResults[VSERVESAFE_NOTIFY_NORMAL], notifyResults[VSERVESAFE_NOTIFY_HIGH],
+         notifyResults[VSERVESAFE_NOTIFY_LOW]);
+  miTagScanner.releaseSnapshot(snapshot);
+  printf("allowlist=%u blocked=%u\n", miTagScanner.getAllowListCount(), miTagScanner.getAllowListRejected());
+  printf("names cached=%d unnamed=%d windows=%u\n", miTagScanner.getTagNameCount(),
+         miTagScanner.getUnnamedTagCount(), miTagScanner.getNameWindowCount());
+  TagStoreMemoryUsage memoryUsage = miTagScanner.getTagStoreMemoryUsage();
+  printf("capacity=%d internal=%uB large=%uB\n", miTagScanner.getTagCapacity(),
+         (unsigned)memoryUsage.internalBytes, (unsigned)memoryUsage.largeBytes);
+
+  uint32_t raised = alarmEvents[VSERVESAFE_ALARM_EDGE_HIGH] + alarmEvents[VSERVESAFE_ALARM_EDGE_LOW];
+  bool isOk = (nTags == 0 || published > 0) && (nLimited == 0 || raised > 0);
+  printf("smoke: %s\n", isOk ? "OK" : "FAILED");
+  return isOk ? 0 : 1;
+}
@@ -0,0 +1,36 @@
+#ifndef __VSERVESAFE_HAL_NATIVE_MBEDTLS_CCM__
+#define __VSERVESAFE_HAL_NATIVE_MBEDTLS_CCM__
+
+// Fake mbedtls back end: the CCM calls used by the gateway, on a plain
+// software AES-128 (the ESP32 build uses the hardware AES through mbedtls).
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define MBEDTLS_ERR_CCM_BAD_INPUT -0x000D
+#define MBEDTLS_ERR_CCM_AUTH_FAILED -0x000F
+
+typedef enum
+{
+    MBEDTLS_CIPHER_ID_NONE = 0,
+    MBEDTLS_CIPHER_ID_NULL,
+    MBEDTLS_CIPHER_ID_AES,
+} mbedtls_cipher_id_t;
+
+typedef struct
+{
+    uint8_t roundKeys[176];
+    int keySet;
+} mbedtls_ccm_context;
+
+void mbedtls_ccm_init(mbedtls_ccm_context *ctx);
+int mbedtls_ccm_setkey(mbedtls_ccm_context *ctx, mbedtls_cipher_id_t cipher, const unsigned char *key, unsigned int keybits);
+void mbedtls_ccm_free(mbedtls_ccm_context *ctx);
+int mbedtls_ccm_encrypt_and_tag(mbedtls_ccm_context *ctx, size_t length, const unsigned char *iv, size_t iv_len,
+                                const unsigned char *add, size_t add_len, const unsigned char *input,
+                                unsigned char *output, unsigned char *tag, size_t tag_len);
+int mbedtls_ccm_auth_decrypt(mbedtls_ccm_context *ctx, size_t length, const unsigned char *iv, size_t iv_len,
+                             const unsigned char *add, size_t add_len, const unsigned char *input,
+                             unsigned char *output, const unsigned char *tag, size_t tag_len);
+
+#endif
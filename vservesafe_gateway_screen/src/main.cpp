@@ -12,7 +12,13 @@
 #include <WiFiUdp.h>
 
 #include "BLE.h"
+#include "Buzzer.h"
+#include "GatewayConfig.h"
+#include "GatewayOptions.h"
+#include "TagOrder.h"
+#include "TagPayload.h"
 #include "VservesafeEnums.h"
+#include "hal/HalMemory.h"
 
 #define BUZZER_GPIO 33
 
@@ -57,38 +63,26 @@ const esp_timer_create_args_t miscan_timer_args = {
 
 #define WIFI_DELAY (30000)
 #define BLINK_DELAY (2000)
-#define BUZZER_INTERVAL (1000)
-#define BUZZER_BEEP_DURATION (100)
 
-MQTTClient mqttClient((MAX_TAGS_REMEMBER * 40));
+MQTTClient mqttClient(VSERVESAFE_MQTT_BUFFER_SIZE);
 WiFiClient wifiClient;
 WiFiUDP ntpUDP;
 NTPClient timeClient(ntpUDP);
 
 uint32_t blinkLastTs;
 uint32_t wifiLastTs;
-uint32_t alarmLastTs;
 
 String deviceMAC;
-String wifiSSID = "";
-String wifiPassword = "";
-double gpsLatitude = 15.8700;
-double gpsLongitude = 100.9925;
-bool buzzerEnable;
-
-String inputTemp;
-String optionWifiSSID;
-String optionWifiPassword;
-double optionGpsLat;
-double optionGpsLng;
-bool optionBuzzerEnable;
 
 String mqttClientName;
 bool isMqttError;
 coldsenses_scan_mode bleScanMode = VSERVESAFE_SCANMODE_NOSCAN;
 String gwInfoTopic;
+String gwConfigTopic;
 
 MiTagScanner miTagScanner;
+GatewayConfigChunks gwConfigChunks;
+AlarmBuzzer buzzer;
 coldsenses_wifi_state wifiState = VSERVESAFE_WL_WAITING;
 coldsenses_wifi_state prevWifiState = VSERVESAFE_WL_WAITING;
 coldsenses_tag_state tagState = VSERVESAFE_TAG_WAITING;
@@ -96,12 +90,13 @@ coldsenses_mqtt_state mqttState = VSERVESAFE_MQTT_DISCONNECTED;
 coldsenses_mqtt_state prevMqttState = VSERVESAFE_MQTT_DISCONNECTED;
 bool stopAlarmFlag = true;
 bool tagAlarm = false;
+coldsenses_buzzer_pattern alarmPattern = VSERVESAFE_BUZZER_OFF;
 
 bool spinnerHide = false;
 coldsenses_after_alarm_action afterAlarmAction = VSERVESAFE_NO_ACTION;
 coldsenses_input_target inputTarget = VSERVESAFE_NO_TARGET;
 
-ui_coldsenses_tag_holder uiTagHolders[MAX_TAGS_REMEMBER];
+ui_coldsenses_tag_holder uiTagHolders[MAX_TAG_HOLDERS];
 ui_coldsenses_option_holder uiWifiSSIDOptionHolder;
 ui_coldsenses_option_holder uiWifiPasswordOptionHolder;
 ui_coldsenses_option_holder uiGpsLatOptionHolder;
@@ -109,27 +104,22 @@ ui_coldsenses_option_holder uiGpsLngOptionHolder;
 ui_coldsenses_option_holder uiAlarmOptionHolder;
 ui_coldsenses_option_holder uiCheckVersionHolder;
 
-#if VSERVESAFE_ALLOW_EEPROM
-static void initEEPROM();
-static void migrateEEPROMDataVersion();
-static void updateEEPROM();
-#if VSERVESAFE_DEBUG_EEPROM
-static void _displayOptionValues();
-#endif
-#endif
-
 static void beginWifi(String &wifiSSID, String &wifiPassword);
 static void beginMqtt();
-static void emitMqtt(MiTagData &tagData);
+static bool emitMqtt(MiTagData &tagData);
+static bool emitMqttEvent(const String &topic, const String &payload);
+static void onMqttMessage(String &topic, String &payload);
+
+static void onMqttMessage(String &topic, String &payload)
+{
+  int applied = gwConfigChunks.receive(miTagScanner, gwConfigTopic, topic, payload.c_str(), payload.length());
+#if VSERVESAFE_DEBUG_MQTT
+  Serial.print("Config records applied: ");
+  Serial.println(applied);
+#endif
+}
 
-bool isOptionDirty(coldsenses_input_target target);
-bool isOptionsDirty();
-bool isOptionValid(coldsenses_input_target target);
-bool isOptionsValid();
-void restoreSaveToOptions();
 void applySaveOptions();
-void restoreOptionToTemp(coldsenses_input_target target);
-void applyValueToOption(String value, coldsenses_input_target target);
 
 static void initUI();
 static void instanceTagHolderAt(uint8_t i, ui_coldsenses_tag_holder &holder);
@@ -145,8 +135,8 @@ static void ui_event_gps_lng_option(lv_event_t *e);
 static void ui_event_toggle_alarm(lv_event_t *e);
 static void ui_event_check_version_option(lv_event_t *e);
 
-static void stopBuzzer();
-static void alarmBuzzer();
+static coldsenses_buzzer_pattern buzzerPatternFor(const MiTagAlarmCounts &counts, coldsenses_scan_mode scanMode);
+static void updateBuzzer();
 
 void transitionToHomeScreen();
 void transitionToOptionScreen();
@@ -166,7 +156,6 @@ static void updateOptionScreen();
 
 void setup()
 {
-  pinMode(BUZZER_GPIO, OUTPUT);
   Serial.begin(115200);
 
   Serial.print("VSERVESAFE_GATEWAY V.");
@@ -188,11 +177,22 @@ void setup()
 
   gwInfoTopic = "gwinfo_";
   gwInfoTopic += deviceMAC;
+  gwConfigTopic = buildGatewayConfigTopic(deviceMAC);
 
   miTagScanner.init();
+  if (!gwConfigChunks.begin())
+  {
+    Serial.println("Gateway config init error");
+  }
+  gwConfigChunks.restore();
+  if (!buzzer.begin(BUZZER_GPIO))
+  {
+    Serial.println("Buzzer init error");
+  }
   beginWifi(wifiSSID, wifiPassword);
 
   mqttClient.begin(VSERVESAFE_MQTT_SERVER_URL, VSERVESAFE_MQTT_SERVER_PORT, wifiClient);
+  mqttClient.onMessage(onMqttMessage);
 
   // Init LVGL
   lv_init();
@@ -256,6 +256,7 @@ void loop()
 {
   timeClient.update();
   mqttClient.loop();
+  gwConfigChunks.poll(miTagScanner);
 
   prevWifiState = wifiState;
   prevMqttState = mqttState;
@@ -312,6 +313,10 @@ void loop()
   else if (prevMqttState == VSERVESAFE_MQTT_WAITING && isMqttConnected)
   {
     mqttState = VSERVESAFE_MQTT_CONNECTED;
+    mqttClient.subscribe(gwConfigTopic);
+    String chunkTopics = gwConfigTopic;
+    chunkTopics += "/+";
+    mqttClient.subscribe(chunkTopics);
   }
   else if (prevMqttState == VSERVESAFE_MQTT_CONNECTED && !isMqttConnected)
   {
@@ -320,20 +325,6 @@ void loop()
     bleScanMode = VSERVESAFE_SCANMODE_ALLSCAN;
   }
 
-  if (millis() - alarmLastTs >= BUZZER_INTERVAL)
-  {
-    alarmLastTs = millis();
-  }
-
-  if (buzzerEnable && !stopAlarmFlag && tagAlarm && (millis() - alarmLastTs) <= BUZZER_BEEP_DURATION)
-  {
-    alarmBuzzer();
-  }
-  else
-  {
-    stopBuzzer();
-  }
-
   delay(10);
 }
 
@@ -397,34 +388,84 @@ static void mi_scan_task(void *arg)
   // Virtual scan
 #if VSERVESAFE_FAKE_MQTT
   MiTagData _fakeData;
-  _fakeData.rawMacAddress = "";
-  _fakeData.rawMacAddress += 0xa4;
-  _fakeData.rawMacAddress += 0xc1;
-  _fakeData.rawMacAddress += 0x38;
-  _fakeData.rawMacAddress += 0xf4;
-  _fakeData.rawMacAddress += 0x66;
-  _fakeData.rawMacAddress += 0x06;
-  _fakeData.tempC = random(1, 5);
-  _fakeData.humidRH = random(70, 90);
+  _fakeData.mac = 0xa4c138f46606ULL;
+  _fakeData.tempCenti = random(1, 5) * 100;
+  _fakeData.humidCenti = random(70, 90) * 100;
 
   emitMqtt(_fakeData);
 #endif
 
   if (tagState != VSERVESAFE_TAG_WAITING)
   {
+    miTagScanner.setScanMode(bleScanMode);
     miTagScanner.scan();
 
     tagState = VSERVESAFE_TAG_SCANNED;
 
-    int tagsCount = miTagScanner.getTagsCount();
-    for (int i = 0; i < tagsCount; i++)
+    static uint32_t healthLastTs = 0;
+    if (millis() - healthLastTs >= HEALTH_PUBLISH_INTERVAL)
     {
-      MiTagData *tagData = miTagScanner.getTagDataAt(i);
-      if (tagData && miTagScanner.isTagActive(tagData))
+      healthLastTs = millis();
+      String payload = buildHealthPayload(miTagScanner);
+      mqttClient.publish(gwInfoTopic.c_str(), payload.c_str());
+    }
+
+    // Transitions stay queued until sent, so those during an MQTT outage go
+    // out on reconnect
+    TagPresenceEvent presenceEvent;
+    while (miTagScanner.peekPresenceEvent(presenceEvent) &&
+           emitMqttEvent(buildPresenceTopic(presenceEvent), buildPresencePayload(presenceEvent)))
+    {
+      miTagScanner.pollPresenceEvent(presenceEvent);
+    }
+
+    // Edges stay queued until sent, so those fired while MQTT is down go out
+    // on reconnect; the ring drops (and counts) new ones once full
+    TagAlarmEvent alarmEvent;
+    while (miTagScanner.peekAlarmEvent(alarmEvent) &&
+           emitMqttEvent(buildAlarmTopic(alarmEvent), buildAlarmPayload(alarmEvent)))
+    {
+      miTagScanner.pollAlarmEvent(alarmEvent);
+    }
+
+    TagRuleEvent ruleEvent;
+    while (miTagScanner.peekRuleEvent(ruleEvent) &&
+           emitMqttEvent(buildRuleTopic(ruleEvent), buildRulePayload(ruleEvent)))
+    {
+      miTagScanner.pollRuleEvent(ruleEvent);
+    }
+
+    // The scanner counts raised alarms and silent tags as it queues their
+    // events, so this is O(1) and follows them whichever screen is shown
+    coldsenses_buzzer_pattern pattern = buzzerPatternFor(miTagScanner.getAlarmCounts(), bleScanMode);
+    if (pattern != alarmPattern)
+    {
+      alarmPattern = pattern;
+      tagAlarm = pattern == VSERVESAFE_BUZZER_HIGH || pattern == VSERVESAFE_BUZZER_LOW;
+      updateBuzzer();
+    }
+
+    const TagSnapshot *snapshot = miTagScanner.acquireSnapshot();
+    int backlog = 0;
+    for (int i = 0; i < snapshot->count; i++)
+    {
+      // Publish new samples only; a failed publish is retried next cycle
+      MiTagData *tagData = &snapshot->tags[i];
+      if (miTagScanner.isTagActive(tagData) && miTagScanner.isTagDirty(tagData))
       {
-        emitMqtt(*tagData);
+        uint32_t sampleSeq = tagData->sampleSeq;
+        if (emitMqtt(*tagData))
+        {
+          miTagScanner.markTagPublished(tagData->mac, sampleSeq);
+        }
+        else
+        {
+          backlog += 1;
+        }
       }
     }
+    miTagScanner.releaseSnapshot(snapshot);
+    miTagScanner.setUplinkBacklog(backlog);
   }
 }
 
@@ -446,128 +487,6 @@ static void splash_to_home(lv_timer_t *timer)
   transitionToHomeScreen();
 }
 
-#if VSERVESAFE_ALLOW_EEPROM
-static void initEEPROM()
-{
-  if (!EEPROM.begin(EEPROM_TOTAL_BYTES))
-  {
-    Serial.println("EEPROM init error");
-    return;
-  }
-
-  uint64_t header = EEPROM.readULong64(EEPROM_HEADER_ADDR);
-
-#if VSERVESAFE_DEBUG_EEPROM
-  Serial.print("EEPROM header: ");
-  Serial.println(EEPROM_HEADER_KEY);
-  Serial.print("Actual: ");
-  Serial.println(header);
-  Serial.print("Equal?: ");
-  Serial.println(header == EEPROM_HEADER_KEY ? "T" : "F");
-#endif
-
-  if (header != EEPROM_HEADER_KEY)
-  {
-#if VSERVESAFE_DEBUG_EEPROM
-    Serial.println("Create New EEPROM Save");
-#endif
-    EEPROM.writeULong64(EEPROM_HEADER_ADDR, EEPROM_HEADER_KEY);
-    EEPROM.writeUShort(EEPROM_VERSION_ADDR, VSERVESAFE_GATEWAY_VERSION);
-    EEPROM.writeString(EEPROM_SSID_ADDR, wifiSSID);
-    EEPROM.writeString(EEPROM_WIFIPW_ADDR, wifiPassword);
-    EEPROM.writeDouble(EEPROM_GPSLAT_ADDR, gpsLatitude);
-    EEPROM.writeDouble(EEPROM_GPSLONG_ADDR, gpsLongitude);
-    EEPROM.writeBool(EEPROM_BUZZER_ENABLE_ADDR, buzzerEnable);
-    EEPROM.commit();
-#if VSERVESAFE_DEBUG_EEPROM
-    Serial.println("EEPROM Saved");
-#endif
-  }
-
-  migrateEEPROMDataVersion();
-
-#if VSERVESAFE_DEBUG_EEPROM
-  Serial.println("Load EEPROM Save");
-#endif
-
-  // Read values
-  wifiSSID = EEPROM.readString(EEPROM_SSID_ADDR);
-  wifiPassword = EEPROM.readString(EEPROM_WIFIPW_ADDR);
-  gpsLatitude = EEPROM.readDouble(EEPROM_GPSLAT_ADDR);
-  gpsLongitude = EEPROM.readDouble(EEPROM_GPSLONG_ADDR);
-  buzzerEnable = EEPROM.readBool(EEPROM_BUZZER_ENABLE_ADDR);
-
-#if VSERVESAFE_DEBUG_EEPROM
-  Serial.println("EEPROM Values");
-  _displayOptionValues();
-#endif
-}
-
-static void migrateEEPROMDataVersion()
-{
-
-#if VSERVESAFE_DEBUG_EEPROM
-  Serial.println("Check EEPROM Save Version");
-#endif
-  uint16_t version = EEPROM.readUShort(EEPROM_VERSION_ADDR);
-
-  if (version < 2)
-  {
-    EEPROM.writeBool(EEPROM_BUZZER_ENABLE_ADDR, buzzerEnable);
-  }
-
-  if (version < VSERVESAFE_GATEWAY_VERSION)
-  {
-    EEPROM.writeUShort(EEPROM_VERSION_ADDR, VSERVESAFE_GATEWAY_VERSION);
-    EEPROM.commit();
-  }
-
-#if VSERVESAFE_DEBUG_EEPROM
-  Serial.println("EEPROM Save Updated");
-#endif
-}
-
-static void updateEEPROM()
-{
-#if VSERVESAFE_DEBUG_EEPROM
-  Serial.println("New EEPROM Values");
-  _displayOptionValues();
-#endif
-
-  EEPROM.writeULong64(EEPROM_HEADER_ADDR, EEPROM_HEADER_KEY);
-  EEPROM.writeUShort(EEPROM_VERSION_ADDR, VSERVESAFE_GATEWAY_VERSION);
-  EEPROM.writeString(EEPROM_SSID_ADDR, wifiSSID);
-  EEPROM.writeString(EEPROM_WIFIPW_ADDR, wifiPassword);
-  EEPROM.writeDouble(EEPROM_GPSLAT_ADDR, gpsLatitude);
-  EEPROM.writeDouble(EEPROM_GPSLONG_ADDR, gpsLongitude);
-  EEPROM.writeBool(EEPROM_BUZZER_ENABLE_ADDR, buzzerEnable);
-  EEPROM.commit();
-
-#if VSERVESAFE_DEBUG_EEPROM
-  bool isSuccess = EEPROM.commit();
-  Serial.print("Update EEPROM: ");
-  Serial.println(isSuccess ? "T" : "F");
-#else
-  EEPROM.commit();
-#endif
-}
-#if VSERVESAFE_DEBUG_EEPROM
-static void _displayOptionValues()
-{
-  Serial.print("wifiSSID: ");
-  Serial.println(wifiSSID);
-  Serial.print("wifiPassword: ");
-  Serial.println(wifiPassword);
-  Serial.print("gpsLatitude: ");
-  Serial.println(gpsLatitude);
-  Serial.print("gpsLongitude: ");
-  Serial.println(gpsLongitude);
-  Serial.print("buzzerEnable: ");
-  Serial.println(buzzerEnable ? "true" : "false");
-}
-#endif
-
-#endif
 
 static void beginWifi(String &wifiSSID, String &wifiPassword)
 {
@@ -586,33 +505,11 @@ static void beginMqtt()
   mqttClient.connect(mqttClientName.c_str(), deviceMAC.c_str());
 }
 
-static void emitMqtt(MiTagData &tagData)
+static bool emitMqtt(MiTagData &tagData)
 {
-  String topic = "push_";
-  String macAddress = prettyMacAddress(tagData.rawMacAddress).c_str();
-  macAddress.replace(":", "");
-  macAddress.toUpperCase();
-
-  topic += macAddress;
-
-  String payload = "temp:";
-  if (isnan(tagData.tempC))
-  {
-    payload.concat("-");
-  }
-  else
-  {
-    payload.concat(tagData.tempC);
-  }
-  payload.concat(",humid:");
-  if (isnan(tagData.humidRH))
-  {
-    payload.concat("-");
-  }
-  else
-  {
-    payload.concat(tagData.humidRH);
-  }
+  String macAddress = tagMacAddressKey(tagData);
+  String topic = buildTagTopic(tagData);
+  String payload = buildTagPayload(tagData);
 
   bool sentSuccess = mqttClient.publish(topic.c_str(), payload.c_str());
 
@@ -629,131 +526,24 @@ static void emitMqtt(MiTagData &tagData)
   Serial.print(sentSuccess ? "T" : "F");
   Serial.println("]");
 #endif
+  return sentSuccess;
 }
 
-bool isOptionDirty(coldsenses_input_target target)
-{
-  switch (target)
-  {
-  case VSERVESAFE_TARGET_WIFI_SSID:
-    return !wifiSSID.equals(optionWifiSSID);
-  case VSERVESAFE_TARGET_WIFI_PASSWORD:
-    return !wifiPassword.equals(optionWifiPassword);
-  case VSERVESAFE_TARGET_GPS_LATITUDE:
-    return gpsLatitude != optionGpsLat;
-  case VSERVESAFE_TARGET_GPS_LONGITUDE:
-    return gpsLongitude != optionGpsLng;
-  case VSERVESAFE_TARGET_ALARM_BUZZER:
-    return buzzerEnable != optionBuzzerEnable;
-  case VSERVESAFE_NO_TARGET:
-  default:
-    return false;
-  }
-}
-
-bool isOptionsDirty()
+static bool emitMqttEvent(const String &topic, const String &payload)
 {
-  return isOptionDirty(VSERVESAFE_TARGET_WIFI_SSID) || isOptionDirty(VSERVESAFE_TARGET_WIFI_PASSWORD) ||
-         isOptionDirty(VSERVESAFE_TARGET_GPS_LATITUDE) || isOptionDirty(VSERVESAFE_TARGET_GPS_LONGITUDE) ||
-         isOptionDirty(VSERVESAFE_TARGET_ALARM_BUZZER);
-}
-
-bool isOptionValid(coldsenses_input_target target)
-{
-  switch (target)
-  {
-  case VSERVESAFE_TARGET_WIFI_SSID:
-    return optionWifiSSID.length() > 0 && optionWifiSSID.length() <= SSID_MAXLENGTH;
-  case VSERVESAFE_TARGET_WIFI_PASSWORD:
-    return optionWifiPassword.length() <= WIFIPW_MAXLENGTH;
-  case VSERVESAFE_TARGET_GPS_LATITUDE:
-    return optionGpsLat >= -90 && optionGpsLat <= 90;
-  case VSERVESAFE_TARGET_GPS_LONGITUDE:
-    return optionGpsLng >= -180 && optionGpsLng <= 180;
-  case VSERVESAFE_TARGET_ALARM_BUZZER:
-    return true;
-  case VSERVESAFE_NO_TARGET:
-  default:
-    return false;
-  }
-}
-
-bool isOptionsValid()
-{
-  return isOptionValid(VSERVESAFE_TARGET_WIFI_SSID) && isOptionValid(VSERVESAFE_TARGET_WIFI_PASSWORD) &&
-         isOptionValid(VSERVESAFE_TARGET_GPS_LATITUDE) && isOptionValid(VSERVESAFE_TARGET_GPS_LONGITUDE) &&
-         isOptionValid(VSERVESAFE_TARGET_ALARM_BUZZER);
-}
-
-void restoreSaveToOptions()
-{
-  optionWifiSSID = String(wifiSSID);
-  optionWifiPassword = String(wifiPassword);
-  optionGpsLat = gpsLatitude;
-  optionGpsLng = gpsLongitude;
-  optionBuzzerEnable = buzzerEnable;
+  return mqttClient.connected() && mqttClient.publish(topic.c_str(), payload.c_str());
 }
 
 void applySaveOptions()
 {
-
-  wifiSSID = String(optionWifiSSID);
-  wifiPassword = String(optionWifiPassword);
-  gpsLatitude = optionGpsLat;
-  gpsLongitude = optionGpsLng;
-  buzzerEnable = optionBuzzerEnable;
-
-#if VSERVESAFE_ALLOW_EEPROM
-  updateEEPROM();
-#endif
+  commitOptionsToSave();
+  updateBuzzer();
 
   // WiFi.disconnect();
   wifiState = VSERVESAFE_WL_WAITING;
   beginWifi(wifiSSID, wifiPassword);
 }
 
-void restoreOptionToTemp(coldsenses_input_target target)
-{
-  switch (target)
-  {
-  case VSERVESAFE_TARGET_WIFI_SSID:
-    inputTemp = String(optionWifiSSID);
-    break;
-  case VSERVESAFE_TARGET_WIFI_PASSWORD:
-    inputTemp = String(optionWifiPassword);
-    break;
-  case VSERVESAFE_TARGET_GPS_LATITUDE:
-    inputTemp = String(optionGpsLat, 8);
-    break;
-  case VSERVESAFE_TARGET_GPS_LONGITUDE:
-    inputTemp = String(optionGpsLng, 8);
-    break;
-  default:
-    break;
-  }
-}
-
-void applyValueToOption(String value, coldsenses_input_target target)
-{
-
-  switch (target)
-  {
-  case VSERVESAFE_TARGET_WIFI_SSID:
-    optionWifiSSID = String(value);
-    break;
-  case VSERVESAFE_TARGET_WIFI_PASSWORD:
-    optionWifiPassword = String(value);
-    break;
-  case VSERVESAFE_TARGET_GPS_LATITUDE:
-    optionGpsLat = String(value).toDouble();
-    break;
-  case VSERVESAFE_TARGET_GPS_LONGITUDE:
-    optionGpsLng = String(value).toDouble();
-    break;
-  default:
-    break;
-  }
-}
 
 static void initUI()
 {
@@ -761,7 +551,7 @@ static void initUI()
   SpinnerSpin_Animation(ui_TagSpinner, 0);
   lv_label_set_text(ui_TagCountLabel, "");
 
-  for (int i = 0; i < MAX_TAGS_REMEMBER; i++)
+  for (int i = 0; i < MAX_TAG_HOLDERS; i++)
   {
     instanceTagHolderAt(i, uiTagHolders[i]);
     lv_obj_toggle_display(uiTagHolders[i].tag_panel, false);
@@ -1059,14 +849,29 @@ static void ui_event_check_version_option(lv_event_t *e)
   }
 }
 
-static void stopBuzzer()
+// The most urgent cadence over every tag, not only those shown; off unless
+// in selected scan
+static coldsenses_buzzer_pattern buzzerPatternFor(const MiTagAlarmCounts &counts, coldsenses_scan_mode scanMode)
 {
-  digitalWrite(BUZZER_GPIO, LOW);
+  if (scanMode != VSERVESAFE_SCANMODE_SELECTED_SCAN)
+  {
+    return VSERVESAFE_BUZZER_OFF;
+  }
+  if (counts.high > 0)
+  {
+    return VSERVESAFE_BUZZER_HIGH;
+  }
+  if (counts.low > 0)
+  {
+    return VSERVESAFE_BUZZER_LOW;
+  }
+  return counts.offline > 0 ? VSERVESAFE_BUZZER_OFFLINE : VSERVESAFE_BUZZER_OFF;
 }
 
-static void alarmBuzzer()
+// Called when what should sound changes; the buzzer keeps the cadence
+static void updateBuzzer()
 {
-  digitalWrite(BUZZER_GPIO, HIGH);
+  buzzer.play(buzzerEnable && !stopAlarmFlag ? alarmPattern : VSERVESAFE_BUZZER_OFF);
 }
 
 void transitionToHomeScreen()
@@ -1076,6 +881,7 @@ void transitionToHomeScreen()
   lv_label_set_text(ui_TitleLabel, "Home");
 
   stopAlarmFlag = false;
+  updateBuzzer();
 }
 
 void transitionToOptionScreen()
@@ -1086,6 +892,7 @@ void transitionToOptionScreen()
   lv_label_set_text(ui_TitleLabel, "Options");
 
   stopAlarmFlag = true;
+  updateBuzzer();
 }
 
 void transitionToInputScreen()
@@ -1216,64 +1023,51 @@ static void updateHomeScreen()
       spinnerHide = true;
     }
 
-    bool isShouldAlarm = false;
-
-    int tagsCount = miTagScanner.getTagsCount();
-    MiTagData *orderedTagData[tagsCount];
-    int actualCount = 0;
-    for (int i = 0; i < tagsCount; i++)
+    // Rebuild only when the table changed; tags going online or offline
+    // change the revision too
+    static uint32_t lastRevision = 0;
+    static coldsenses_scan_mode lastScanMode = VSERVESAFE_SCANMODE_NOSCAN;
+    const TagSnapshot *snapshot = miTagScanner.acquireSnapshot();
+    uint32_t revision = snapshot->revision;
+    if (revision == lastRevision && bleScanMode == lastScanMode)
     {
-      MiTagData *tagData = miTagScanner.getTagDataAt(i);
-      orderedTagData[i] = tagData;
-      actualCount += 1;
+      miTagScanner.releaseSnapshot(snapshot);
+      return;
     }
-
-    // bubble sort
-    for (int i = 1; i < actualCount; i++)
+    lastRevision = revision;
+    lastScanMode = bleScanMode;
+
+    static MiTagData **orderedTagData = NULL;
+    static int orderedTagCapacity = 0;
+    // The snapshot may predate a capacity change
+    int tagCapacity = miTagScanner.getTagCapacity();
+    if (tagCapacity < snapshot->count)
     {
-      for (int j = 0; j < i; j++)
-      {
-        MiTagData *tagData1 = orderedTagData[j];
-        MiTagData *tagData2 = orderedTagData[i];
-        coldsenses_notify_result tagNotifyResult1 = miTagScanner.getTagNotifyResult((*tagData1).rawMacAddress);
-        coldsenses_notify_result tagNotifyResult2 = miTagScanner.getTagNotifyResult((*tagData2).rawMacAddress);
-        if (bleScanMode == VSERVESAFE_SCANMODE_SELECTED_SCAN && tagNotifyResult1 == VSERVESAFE_NOTIFY_NODATA && tagNotifyResult2 != VSERVESAFE_NOTIFY_NODATA)
-        {
-          orderedTagData[i] = tagData1;
-          orderedTagData[j] = tagData2;
-        }
-        else if (!miTagScanner.isTagActive(tagData1) && miTagScanner.isTagActive(tagData2))
-        {
-          orderedTagData[i] = tagData1;
-          orderedTagData[j] = tagData2;
-        }
-      }
+      tagCapacity = snapshot->count;
     }
-
-    for (int i = 0; i < MAX_TAGS_REMEMBER; i++)
+    if (orderedTagCapacity != tagCapacity)
     {
-      if (i < actualCount && !isShouldAlarm)
+      halFree(orderedTagData);
+      orderedTagData = (MiTagData **)halAllocLarge(tagCapacity * sizeof(MiTagData *));
+      orderedTagCapacity = orderedTagData ? tagCapacity : 0;
+      if (!orderedTagData)
       {
-        coldsenses_notify_result tagNotifyResult = miTagScanner.getTagNotifyResult((*orderedTagData[i]).rawMacAddress);
-        if (bleScanMode == VSERVESAFE_SCANMODE_SELECTED_SCAN && (tagNotifyResult == VSERVESAFE_NOTIFY_HIGH || tagNotifyResult == VSERVESAFE_NOTIFY_LOW))
-        {
-          isShouldAlarm = true;
-        }
+        miTagScanner.releaseSnapshot(snapshot);
+        return;
       }
+    }
+    int actualCount = orderTagsForHome(miTagScanner, snapshot, bleScanMode, orderedTagData);
 
+    for (int i = 0; i < MAX_TAG_HOLDERS; i++)
+    {
       updateTagHolderData(i < actualCount ? orderedTagData[i] : NULL, i);
     }
+    miTagScanner.releaseSnapshot(snapshot);
 
     String textCountDisplay = String(miTagScanner.getActiveTagCount(), 10);
     textCountDisplay += "/";
     textCountDisplay += String(actualCount, 10);
     lv_label_set_text(ui_TagCountLabel, textCountDisplay.c_str());
-
-    tagAlarm = isShouldAlarm;
-    if (!isShouldAlarm)
-    {
-      stopAlarmFlag = false;
-    }
   }
 }
 
@@ -1287,8 +1081,8 @@ static void updateTagHolderData(MiTagData *tagDataRef, int i)
     return;
   }
 
-  MiTagData tagData = (*tagDataRef);
-  coldsenses_notify_result tagNotifyResult = miTagScanner.getTagNotifyResult(tagData.rawMacAddress);
+  MiTagData &tagData = *tagDataRef;
+  coldsenses_notify_result tagNotifyResult = miTagScanner.getTagNotifyResult(tagDataRef);
 
   // if (bleScanMode == VSERVESAFE_SCANMODE_SELECTED_SCAN && tagNotifyResult == VSERVESAFE_NOTIFY_NODATA)
   // {
@@ -1323,10 +1117,44 @@ static void updateTagHolderData(MiTagData *tagDataRef, int i)
   lv_obj_set_style_bg_color(holder.tag_panel, tagColor, LV_PART_MAIN | LV_STATE_DEFAULT);
   lv_obj_set_style_bg_color(holder.inner_panel, innerColor, LV_PART_MAIN | LV_STATE_DEFAULT);
 
-  lv_label_set_text(holder.mac_label, prettyMacAddress(tagData.rawMacAddress).c_str());
-  lv_label_set_text(holder.name_label, tagData.name.c_str());
-  lv_label_set_text(holder.temp_label, String(tagData.tempC, 1).c_str());
-  lv_label_set_text(holder.humid_label, String(tagData.humidRH, 0).c_str());
+#if VSERVESAFE_TILE_SHOW_LOSS
+  String lossText = "loss ";
+  TagReceptionStats reception;
+  if (miTagScanner.getTagReception(&tagData, reception))
+  {
+    lossText += String(tagReceptionLossPercent(reception), 1);
+    lossText += "%";
+  }
+  else
+  {
+    lossText += "-";
+  }
+  lv_label_set_text(holder.mac_label, lossText.c_str());
+#else
+  lv_label_set_text(holder.mac_label, prettyMacAddress(tagData.mac).c_str());
+#endif
+  char name[TAG_NAME_LENGTH + 1];
+  miTagScanner.getTagName(&tagData, name);
+  lv_label_set_text(holder.name_label, name);
+  char value[12];
+  if (tagData.tempCenti == TAG_TEMP_NONE)
+  {
+    strcpy(value, "-");
+  }
+  else
+  {
+    formatCenti(value, sizeof(value), tagData.tempCenti, 1);
+  }
+  lv_label_set_text(holder.temp_label, value);
+  if (tagData.humidCenti == TAG_HUMID_NONE)
+  {
+    strcpy(value, "-");
+  }
+  else
+  {
+    formatCenti(value, sizeof(value), tagData.humidCenti, 0);
+  }
+  lv_label_set_text(holder.humid_label, value);
 }
 
 static void updateOptionScreen()
@@ -0,0 +1,286 @@
+// Host replay of temperature traces through the tag alarm state machine
+// (TagAlarm). Each built-in trace is shaped after a cold room recording: a
+// sample every 10 s with sensor noise and some lost adverts. Prints, per
+// trace, the alarms the plain threshold check would have raised (one per
+// sample crossing a limit) next to the debounced edges, and checks the edges
+// against the ones expected. A recorded trace, one "<seconds>,<degrees>" per
+// line, can be replayed instead.
+//
+//   .pio/build/native_alarmsim/program
+//   .pio/build/native_alarmsim/program <trace.csv> <low> <high> [hysteresis] [dwell s] [re-arm s]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <vector>
+#include "vservesafe_conf.h"
+#include "TagAlarm.h"
+#include "TagData.h"
+
+#define SIM_SAMPLE_MS (10000)
+// One sample in SIM_LOSS_ONE_IN is not heard
+#define SIM_LOSS_ONE_IN (20)
+
+typedef struct
+{
+  uint32_t ts;
+  int16_t tempCenti;
+} SimSample;
+
+typedef struct
+{
+  uint32_t high;
+  uint32_t low;
+  uint32_t cleared;
+} SimEdgeCounts;
+
+typedef struct
+{
+  const char *name;
+  int16_t lowCenti;
+  int16_t highCenti;
+  void (*build)(std::vector<SimSample> &samples);
+  SimEdgeCounts expected;
+} SimTrace;
+
+typedef struct
+{
+  uint32_t seed;
+  uint32_t ms;
+  int32_t levelCenti;
+  int16_t noiseCenti;
+  std::vector<SimSample> *samples;
+} SimTraceBuilder;
+
+static uint32_t simRandom(uint32_t &seed)
+{
+  seed = seed * 1103515245u + 12345u;
+  return seed >> 16;
+}
+
+static void simBegin(SimTraceBuilder &builder, std::vector<SimSample> &samples, int16_t levelCenti,
+                     int16_t noiseCenti)
+{
+  builder.seed = 1;
+  builder.ms = 0;
+  builder.levelCenti = levelCenti;
+  builder.noiseCenti = noiseCenti;
+  builder.samples = &samples;
+}
+
+// Ramp linearly from the current level to toCenti over seconds, sampling
+// every SIM_SAMPLE_MS
+static void simRamp(SimTraceBuilder &builder, uint32_t seconds, int16_t toCenti)
+{
+  uint32_t startMs = builder.ms;
+  int32_t fromCenti = builder.levelCenti;
+  uint32_t durationMs = seconds * 1000;
+  for (uint32_t elapsed = 0; elapsed < durationMs; elapsed += SIM_SAMPLE_MS)
+  {
+    int32_t level = fromCenti + (int32_t)((int64_t)(toCenti - fromCenti) * elapsed / durationMs);
+    int32_t noise = builder.noiseCenti > 0
+                        ? (int32_t)(simRandom(builder.seed) % (2 * builder.noiseCenti + 1)) - builder.noiseCenti
+                        : 0;
+    if (simRandom(builder.seed) % SIM_LOSS_ONE_IN != 0)
+    {
+      SimSample sample = {startMs + elapsed, (int16_t)(level + noise)};
+      builder.samples->push_back(sample);
+    }
+  }
+  builder.ms = startMs + durationMs;
+  builder.levelCenti = toCenti;
+}
+
+static void simHold(SimTraceBuilder &builder, uint32_t seconds)
+{
+  simRamp(builder, seconds, builder.levelCenti);
+}
+
+// 4 C chiller, door opened for about a minute every 15 minutes: the air
+// near the door tag passes 8 C briefly
+static void buildDoorOpenings(std::vector<SimSample> &samples)
+{
+  SimTraceBuilder builder;
+  simBegin(builder, samples, 400, 15);
+  for (int i = 0; i < 8; i++)
+  {
+    simHold(builder, 800);
+    simRamp(builder, 40, 950);
+    simRamp(builder, 60, 400);
+  }
+}
+
+// Compressor fails after 30 minutes; the room warms to 12 C and stays there
+static void buildCompressorFailure(std::vector<SimSample> &samples)
+{
+  SimTraceBuilder builder;
+  simBegin(builder, samples, 400, 15);
+  simHold(builder, 1800);
+  simRamp(builder, 960, 1200);
+  simHold(builder, 3600);
+}
+
+// Room settles just around the high limit for an hour, then recovers
+static void buildHoveringAtLimit(std::vector<SimSample> &samples)
+{
+  SimTraceBuilder builder;
+  simBegin(builder, samples, 400, 25);
+  simHold(builder, 600);
+  simRamp(builder, 600, 810);
+  simHold(builder, 3600);
+  simRamp(builder, 900, 400);
+  simHold(builder, 600);
+}
+
+// Thermostat fault drives the chiller to 1 C for 20 minutes
+static void buildFreezing(std::vector<SimSample> &samples)
+{
+  SimTraceBuilder builder;
+  simBegin(builder, samples, 400, 15);
+  simHold(builder, 1200);
+  simRamp(builder, 600, 100);
+  simHold(builder, 1200);
+  simRamp(builder, 600, 400);
+  simHold(builder, 1200);
+}
+
+// Failing compressor: three excursions back to back. The first raises an
+// alarm; the second comes while it re-arms and is not reported, the third is.
+static void buildRepeatedExcursions(std::vector<SimSample> &samples)
+{
+  SimTraceBuilder builder;
+  simBegin(builder, samples, 400, 15);
+  simHold(builder, 600);
+  for (int i = 0; i < 3; i++)
+  {
+    simRamp(builder, 60, 900);
+    simHold(builder, 240);
+    simRamp(builder, 60, 400);
+  }
+  simHold(builder, 1200);
+}
+
+static const SimTrace SIM_TRACES[] = {
+    {"door openings", 200, 800, buildDoorOpenings, {0, 0, 0}},
+    {"compressor failure", 200, 800, buildCompressorFailure, {1, 0, 0}},
+    {"hovering at limit", 200, 800, buildHoveringAtLimit, {1, 0, 1}},
+    {"freezing", 200, 800, buildFreezing, {0, 1, 1}},
+    {"repeated excursions", 200, 800, buildRepeatedExcursions, {2, 0, 2}},
+};
+
+static const char *edgeName(coldsenses_alarm_edge edge)
+{
+  return edge == VSERVESAFE_ALARM_EDGE_HIGH  ? "high"
+         : edge == VSERVESAFE_ALARM_EDGE_LOW ? "low"
+                                             : "clear";
+}
+
+// Returns the alarms the plain threshold check raises: each sample that
+// crosses a limit after one that did not
+static uint32_t replayTrace(const std::vector<SimSample> &samples, const TagAlarmConfig &config, int16_t lowCenti,
+                            int16_t highCenti, SimEdgeCounts &counts)
+{
+  TagAlarmState alarm;
+  resetTagAlarm(alarm);
+  counts = {0, 0, 0};
+  uint32_t plainAlarms = 0;
+  bool wasCrossed = false;
+  for (size_t i = 0; i < samples.size(); i++)
+  {
+    const SimSample &sample = samples[i];
+    bool isCrossed = sample.tempCenti >= highCenti || sample.tempCenti <= lowCenti;
+    plainAlarms += isCrossed && !wasCrossed;
+    wasCrossed = isCrossed;
+
+    coldsenses_alarm_edge edge = updateTagAlarm(alarm, config, sample.tempCenti, lowCenti, highCenti, sample.ts);
+    if (edge == VSERVESAFE_ALARM_EDGE_NONE)
+    {
+      continue;
+    }
+    counts.high += edge == VSERVESAFE_ALARM_EDGE_HIGH;
+    counts.low += edge == VSERVESAFE_ALARM_EDGE_LOW;
+    counts.cleared += edge == VSERVESAFE_ALARM_EDGE_CLEAR;
+    printf("    %4u:%02u  %-5s %6.2f C\n", sample.ts / 60000, sample.ts / 1000 % 60, edgeName(edge),
+           sample.tempCenti / 100.0);
+  }
+  return plainAlarms;
+}
+
+static bool loadTrace(const char *path, std::vector<SimSample> &samples)
+{
+  FILE *file = fopen(path, "r");
+  if (!file)
+  {
+    return false;
+  }
+  char line[64];
+  while (fgets(line, sizeof(line), file))
+  {
+    double seconds;
+    double degrees;
+    if (sscanf(line, "%lf,%lf", &seconds, &degrees) == 2)
+    {
+      SimSample sample = {(uint32_t)(seconds * 1000), (int16_t)(degrees * 100 + (degrees < 0 ? -0.5 : 0.5))};
+      samples.push_back(sample);
+    }
+  }
+  fclose(file);
+  return true;
+}
+
+int main(int argc, char **argv)
+{
+  TagAlarmConfig config = {TAG_ALARM_HYSTERESIS, TAG_ALARM_DWELL, TAG_ALARM_REARM};
+  if (argc > 4)
+  {
+    config.hysteresisCenti = (int16_t)(atof(argv[4]) * 100);
+  }
+  if (argc > 5)
+  {
+    config.dwellMs = atoi(argv[5]) * 1000;
+  }
+  if (argc > 6)
+  {
+    config.rearmMs = atoi(argv[6]) * 1000;
+  }
+  printf("hysteresis %.2f C, dwell %u s, re-arm %u s\n", config.hysteresisCenti / 100.0, config.dwellMs / 1000,
+         config.rearmMs / 1000);
+
+  if (argc >= 4)
+  {
+    std::vector<SimSample> samples;
+    if (!loadTrace(argv[1], samples))
+    {
+      printf("cannot read %s\n", argv[1]);
+      return 1;
+    }
+    int16_t lowCenti = (int16_t)(atof(argv[2]) * 100);
+    int16_t highCenti = (int16_t)(atof(argv[3]) * 100);
+    printf("%s: %u samples, limits %.2f..%.2f C\n", argv[1], (unsigned)samples.size(), lowCenti / 100.0,
+           highCenti / 100.0);
+    SimEdgeCounts counts;
+    uint32_t plainAlarms = replayTrace(samples, config, lowCenti, highCenti, counts);
+    printf("  plain alarms %u, raised high %u low %u, cleared %u\n", plainAlarms, counts.high, counts.low,
+           counts.cleared);
+    return 0;
+  }
+
+  int failed = 0;
+  for (size_t i = 0; i < sizeof(SIM_TRACES) / sizeof(SIM_TRACES[0]); i++)
+  {
+    const SimTrace &trace = SIM_TRACES[i];
+    std::vector<SimSample> samples;
+    trace.build(samples);
+    printf("%s: %u samples, limits %.2f..%.2f C\n", trace.name, (unsigned)samples.size(), trace.lowCenti / 100.0,
+           trace.highCenti / 100.0);
+    SimEdgeCounts counts;
+    uint32_t plainAlarms = replayTrace(samples, config, trace.lowCenti, trace.highCenti, counts);
+    bool isExpected = counts.high == trace.expected.high && counts.low == trace.expected.low &&
+                      counts.cleared == trace.expected.cleared;
+    printf("  plain alarms %u, raised high %u low %u, cleared %u (expected %u/%u/%u) %s\n", plainAlarms, counts.high,
+           counts.low, counts.cleared, trace.expected.high, trace.expected.low, trace.expected.cleared,
+           isExpected ? "OK" : "FAILED");
+    failed += !isExpected;
+  }
+  return failed > 0 ? 1 : 0;
+}
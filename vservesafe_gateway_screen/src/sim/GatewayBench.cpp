@@ -0,0 +1,888 @@
+// Host benchmarks (Google Benchmark) of the gateway's hot paths: service data
+// decoding per format, MiBeacon decryption, advert parsing and ingest into the
+// tag table, MAC lookup, tag store inserts and lookups with the RAM they take,
+// table reads through snapshots, history rings, presence expiry, alarm limit
+// pushes, alert rules, reading checks and formatting, payload building and
+// home-screen ordering.
+//
+//   .pio/build/native_bench/program [--benchmark_filter=<regex>]
+
+#include <Arduino.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <benchmark/benchmark.h>
+#include "AdvDecoder.h"
+#include "BLE.h"
+#include "GatewayConfig.h"
+#include "MiBeacon.h"
+#include "TagAllowList.h"
+#include "TagHistory.h"
+#include "TagOrder.h"
+#include "TagPayload.h"
+#include "TagRules.h"
+#include "TagSnapshot.h"
+#include "TagStore.h"
+
+#define BENCH_BASE_MAC (0xA4C138000000ULL)
+
+// Same frames as test/test_adv_decoder and test/test_mibeacon
+static const uint8_t PVVX_FRAME[] = {0x06, 0x66, 0xF4, 0x38, 0xC1, 0xA4, 0x29, 0x09,
+                                     0x2E, 0x16, 0x86, 0x0B, 0x57, 0x12, 0x05};
+static const uint8_t ATC1441_FRAME[] = {0xA4, 0xC1, 0x38, 0xF4, 0x66, 0x06, 0x00,
+                                        0xEA, 0x38, 0x57, 0x0B, 0x86, 0x12};
+static const uint8_t BTHOME_FRAME[] = {0x40, 0x00, 0x12, 0x01, 0x57, 0x02, 0x29,
+                                       0x09, 0x03, 0x2E, 0x16, 0x0C, 0x86, 0x0B};
+static const uint8_t MIBEACON_FRAME[] = {0x50, 0x30, 0x5B, 0x05, 0x12, 0x06, 0x66, 0xF4, 0x38,
+                                         0xC1, 0xA4, 0x0D, 0x10, 0x04, 0xEA, 0x00, 0x30, 0x02};
+static const uint8_t BIND_KEY[MIBEACON_BINDKEY_SIZE] = {0xe9, 0xea, 0x89, 0x5f, 0xac, 0x7c, 0xca, 0x6d,
+                                                        0x30, 0x53, 0x24, 0x32, 0xa5, 0x16, 0xf3, 0xa8};
+static const uint8_t MIBEACON_ENCRYPTED_FRAME[] = {0x58, 0x58, 0x5b, 0x05, 0x2a, 0x06, 0x66, 0xf4, 0x38,
+                                                   0xc1, 0xa4, 0xd9, 0x16, 0xe3, 0xfa, 0x14, 0x82, 0xad,
+                                                   0x01, 0x00, 0x00, 0x02, 0xb9, 0x7c, 0xbd};
+
+typedef struct
+{
+  const char *name;
+  uint16_t uuid16;
+  const uint8_t *data;
+  size_t len;
+} BenchFrame;
+
+static const BenchFrame BENCH_FRAMES[] = {
+    {"pvvx", ADV_UUID_ENVIRONMENTAL_SENSING, PVVX_FRAME, sizeof(PVVX_FRAME)},
+    {"atc1441", ADV_UUID_ENVIRONMENTAL_SENSING, ATC1441_FRAME, sizeof(ATC1441_FRAME)},
+    {"bthome_v2", ADV_UUID_BTHOME, BTHOME_FRAME, sizeof(BTHOME_FRAME)},
+    {"mibeacon", ADV_UUID_MIBEACON, MIBEACON_FRAME, sizeof(MIBEACON_FRAME)},
+};
+
+// Its tasks run until exit, so the scanner is never destroyed
+static MiTagScanner &scanner = *new MiTagScanner();
+
+static MiTagData makeTag(int i, uint32_t ts)
+{
+  MiTagData tagData = MiTagData();
+  tagData.mac = BENCH_BASE_MAC + i * 7919;
+  tagData.ts = ts;
+  tagData.tempCenti = 200 + i % 600;
+  tagData.humidCenti = 5000;
+  tagData.battMv = 2950;
+  tagData.battPercent = 87;
+  tagData.rssi = -60 - i % 30;
+  resetTagSignal(tagData.signal, tagData.rssi, ts);
+  return tagData;
+}
+
+// pvvx custom frame, as the native runner sends them
+static void buildAdvert(int tagIndex, uint8_t counter, NimBLEAdvertisedDevice &device)
+{
+  uint8_t address[6] = {(uint8_t)tagIndex, (uint8_t)(tagIndex >> 8), 0x00, 0x38, 0xc1, 0xa4};
+  int16_t tempRaw = 200 + (tagIndex % 50) * 10 + (counter % 7);
+  uint16_t humidRaw = 7000 + (tagIndex % 20) * 50;
+  uint16_t battMv = 2900;
+
+  std::string rawData((const char *)address, sizeof(address));
+  rawData += (char)(tempRaw & 0xff);
+  rawData += (char)(tempRaw >> 8);
+  rawData += (char)(humidRaw & 0xff);
+  rawData += (char)(humidRaw >> 8);
+  rawData += (char)(battMv & 0xff);
+  rawData += (char)(battMv >> 8);
+  rawData += (char)90;
+  rawData += (char)counter;
+  rawData += (char)0;
+
+  device.fakeSetAddress(address);
+  device.fakeSetRSSI(-50 - (tagIndex % 40));
+  device.fakeAddServiceData(MiTagScanner::TARGET_UUID, rawData);
+}
+
+// Pace like a radio would so the ingest rings do not drop
+static void injectAdvert(NimBLEAdvertisedDevice &device)
+{
+  while (scanner.getIngestPending() >= TAG_INGEST_QUEUE_LENGTH)
+  {
+    vTaskDelay(0);
+  }
+  NimBLEDevice::getScan()->fakeInject(device);
+}
+
+// Wait for the ingest task to store every queued advert
+static void waitIngest()
+{
+  while (scanner.getIngestPending() > 0)
+  {
+    vTaskDelay(0);
+  }
+}
+
+static void fillTags(int tags)
+{
+  scanner.clearTagsResults();
+  for (int i = 0; i < tags; i++)
+  {
+    NimBLEAdvertisedDevice device;
+    buildAdvert(i, 0, device);
+    injectAdvert(device);
+  }
+  waitIngest();
+  scanner.scan();
+}
+
+static void BM_DecodeServiceData(benchmark::State &state)
+{
+  const BenchFrame &frame = BENCH_FRAMES[state.range(0)];
+  AdvReading reading;
+  for (auto _ : state)
+  {
+    benchmark::DoNotOptimize(decodeServiceData(frame.uuid16, frame.data, frame.len, reading));
+  }
+  state.SetLabel(frame.name);
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_DecodeServiceData)->DenseRange(0, sizeof(BENCH_FRAMES) / sizeof(BENCH_FRAMES[0]) - 1);
+
+// Items are frames, so items_per_second is frames/s
+static void BM_DecryptMiBeacon(benchmark::State &state)
+{
+  AdvReading reading;
+  for (auto _ : state)
+  {
+    if (!decryptMiBeacon(BIND_KEY, MIBEACON_ENCRYPTED_FRAME, sizeof(MIBEACON_ENCRYPTED_FRAME), NULL, reading))
+    {
+      state.SkipWithError("frame did not decrypt");
+      break;
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_DecryptMiBeacon);
+
+// One scan cycle of adverts from tags already in the table, decoded as the
+// result callback sees them and stored by the ingest task; items are adverts
+static void BM_ScanAdverts(benchmark::State &state)
+{
+  int tags = state.range(0);
+  fillTags(tags);
+  std::vector<NimBLEAdvertisedDevice> devices(tags);
+  uint8_t counter = 0;
+  for (auto _ : state)
+  {
+    state.PauseTiming();
+    counter += 1;
+    for (int i = 0; i < tags; i++)
+    {
+      devices[i] = NimBLEAdvertisedDevice();
+      buildAdvert(i, counter, devices[i]);
+    }
+    state.ResumeTiming();
+    for (int i = 0; i < tags; i++)
+    {
+      injectAdvert(devices[i]);
+    }
+    waitIngest();
+    scanner.scan();
+  }
+  state.SetItemsProcessed(state.iterations() * tags);
+}
+BENCHMARK(BM_ScanAdverts)->Arg(MAX_TAGS_REMEMBER);
+
+// Lookup of a present MAC: the old scan over the table against the index
+template <int N> static void BM_MacLookupLinear(benchmark::State &state)
+{
+  static mac_key_t macs[N];
+  for (int i = 0; i < N; i++)
+  {
+    macs[i] = BENCH_BASE_MAC + i * 7919;
+  }
+  int next = 0;
+  for (auto _ : state)
+  {
+    mac_key_t mac = macs[next];
+    int found = -1;
+    for (int i = 0; i < N; i++)
+    {
+      if (macs[i] == mac)
+      {
+        found = i;
+        break;
+      }
+    }
+    benchmark::DoNotOptimize(found);
+    next = (next + 97) % N;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_TEMPLATE(BM_MacLookupLinear, 16);
+BENCHMARK_TEMPLATE(BM_MacLookupLinear, 256);
+BENCHMARK_TEMPLATE(BM_MacLookupLinear, 1024);
+
+template <int N> static void BM_MacLookupIndex(benchmark::State &state)
+{
+  static MacIndex<N> index;
+  for (int i = 0; i < N; i++)
+  {
+    index.insert(BENCH_BASE_MAC + i * 7919, i);
+  }
+  int next = 0;
+  for (auto _ : state)
+  {
+    benchmark::DoNotOptimize(index.find(BENCH_BASE_MAC + next * 7919));
+    next = (next + 97) % N;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_TEMPLATE(BM_MacLookupIndex, 16);
+BENCHMARK_TEMPLATE(BM_MacLookupIndex, 256);
+BENCHMARK_TEMPLATE(BM_MacLookupIndex, 1024);
+
+// Check of an advertiser that was never registered against an allowlist of
+// that many MACs, as onResult does for neighbours' sensors. fp_% is the share
+// the filter let through.
+static void BM_AllowListLookup(benchmark::State &state)
+{
+  int tags = state.range(0);
+  TagAllowList allowList;
+  allowList.begin();
+  for (int i = 0; i < tags; i++)
+  {
+    allowList.add(BENCH_BASE_MAC + i * 7919);
+  }
+  mac_key_t mac = 0x5C8AB1000000ULL;
+  int64_t falsePositives = 0;
+  for (auto _ : state)
+  {
+    bool isAllowed = allowList.mayContain(mac);
+    benchmark::DoNotOptimize(isAllowed);
+    falsePositives += isAllowed;
+    mac += 1;
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.counters["fp_%"] = falsePositives * 100.0 / state.iterations();
+  state.counters["ram_B"] = allowList.getMemoryUsage();
+}
+BENCHMARK(BM_AllowListLookup)->Arg(500)->Arg(2000)->Arg(4000);
+
+// Fills a store of that capacity from empty; items are inserts. The RAM
+// counters are bytes per tag once it is full.
+static void BM_TagStoreInsert(benchmark::State &state)
+{
+  int tags = state.range(0);
+  TagStoreMemoryUsage usage = {0, 0};
+  for (auto _ : state)
+  {
+    TagStore store;
+    store.begin(tags);
+    for (int i = 0; i < tags; i++)
+    {
+      MiTagData tagData = makeTag(i, 1000 + i);
+      store.upsert(tagData);
+    }
+    usage = store.getMemoryUsage();
+  }
+  state.SetItemsProcessed(state.iterations() * tags);
+  state.counters["internal_B/tag"] = (double)usage.internalBytes / tags;
+  state.counters["large_B/tag"] = (double)usage.largeBytes / tags;
+}
+BENCHMARK(BM_TagStoreInsert)->Arg(100)->Arg(500)->Arg(1000);
+
+static void BM_TagStoreLookup(benchmark::State &state)
+{
+  int tags = state.range(0);
+  TagStore store;
+  store.begin(tags);
+  for (int i = 0; i < tags; i++)
+  {
+    MiTagData tagData = makeTag(i, 1000 + i);
+    store.upsert(tagData);
+  }
+  int next = 0;
+  for (auto _ : state)
+  {
+    benchmark::DoNotOptimize(store.find(BENCH_BASE_MAC + next * 7919));
+    next = (next + 97) % tags;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_TagStoreLookup)->Arg(100)->Arg(500)->Arg(1000);
+
+#define TABLE_BENCH_READERS (2)
+
+// Shared by the reader threads of BM_TableReads; thread 0 sets them up
+static std::vector<MiTagData> benchTable;
+static std::mutex benchTableLock;
+static TagSnapshotBuffers *benchSnapshots;
+static std::atomic<bool> isBenchWriterDone(false);
+static std::thread benchWriter;
+
+// Full-table read passes while a writer changes a record every millisecond,
+// like a busy scan, through snapshots or under a mutex. Mutex readers also
+// exclude each other, so the gap needs several cores. Items are passes.
+template <bool SNAPSHOTS>
+static void BM_TableReads(benchmark::State &state)
+{
+  int tags = state.range(0);
+  if (state.thread_index() == 0)
+  {
+    benchTable.assign(tags, MiTagData());
+    for (int i = 0; i < tags; i++)
+    {
+      benchTable[i] = makeTag(i, 1000 + i);
+    }
+    benchSnapshots = new TagSnapshotBuffers();
+    isBenchWriterDone.store(false);
+    benchWriter = std::thread([tags]
+                              {
+      for (uint32_t n = 0; !isBenchWriterDone.load(); n++)
+      {
+        {
+          std::lock_guard<std::mutex> lock(benchTableLock);
+          benchTable[n % tags].tempCenti += 1;
+          TagSnapshot *snapshot = SNAPSHOTS ? benchSnapshots->beginWrite(tags) : NULL;
+          if (snapshot)
+          {
+            memcpy(snapshot->tags, benchTable.data(), tags * sizeof(MiTagData));
+            snapshot->count = tags;
+            snapshot->revision = n;
+            benchSnapshots->publish(snapshot);
+          }
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      } });
+  }
+
+  int64_t sum = 0;
+  for (auto _ : state)
+  {
+    if (SNAPSHOTS)
+    {
+      const TagSnapshot *snapshot = benchSnapshots->acquire();
+      for (int i = 0; i < snapshot->count; i++)
+      {
+        sum += snapshot->tags[i].tempCenti;
+      }
+      benchSnapshots->release(snapshot);
+      continue;
+    }
+    std::lock_guard<std::mutex> lock(benchTableLock);
+    for (int i = 0; i < tags; i++)
+    {
+      sum += benchTable[i].tempCenti;
+    }
+  }
+  benchmark::DoNotOptimize(sum);
+  state.SetItemsProcessed(state.iterations());
+
+  if (state.thread_index() == 0)
+  {
+    isBenchWriterDone.store(true);
+    benchWriter.join();
+    delete benchSnapshots;
+  }
+}
+BENCHMARK_TEMPLATE(BM_TableReads, true)->Arg(256)->Arg(1024)->Arg(4096)->Threads(TABLE_BENCH_READERS)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_TableReads, false)->Arg(256)->Arg(1024)->Arg(4096)->Threads(TABLE_BENCH_READERS)->UseRealTime();
+
+static void BM_BuildTagPayload(benchmark::State &state)
+{
+  MiTagData tagData = makeTag(1, millis());
+  for (auto _ : state)
+  {
+    String topic = buildTagTopic(tagData);
+    String payload = buildTagPayload(tagData);
+    benchmark::DoNotOptimize(topic.c_str());
+    benchmark::DoNotOptimize(payload.c_str());
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_BuildTagPayload);
+
+// MiTagData before fixed point readings
+typedef struct
+{
+  uint32_t ts;
+  int16_t nameSlot;
+  mac_key_t mac;
+  double tempC;
+  double humidRH;
+  uint16_t battMv;
+  uint8_t battPercent;
+  uint8_t counter;
+  uint8_t flag;
+  int8_t rssi;
+  uint32_t sampleSeq;
+  uint32_t publishedSeq;
+  TagReceptionStats reception;
+  TagSignalStats signal;
+} LegacyTagData;
+
+// A 2..8 C threshold check plus formatting temperature and humidity, with
+// double readings against fixed point ones. Items are records; record_B is
+// the record size.
+template <bool FIXED_POINT>
+static void BM_ReadingCheckFormat(benchmark::State &state)
+{
+  int records = state.range(0);
+  std::vector<LegacyTagData> legacy(records);
+  std::vector<MiTagData> compact(records);
+  for (int i = 0; i < records; i++)
+  {
+    int16_t tempCenti = (int16_t)(i * 37 % 6000 - 2000);
+    uint16_t humidCenti = (uint16_t)(i * 53 % 10000);
+    legacy[i].tempC = tempCenti / 100.0;
+    legacy[i].humidRH = humidCenti / 100.0;
+    compact[i].tempCenti = tempCenti;
+    compact[i].humidCenti = humidCenti;
+  }
+  char value[24];
+  int alarms = 0;
+  for (auto _ : state)
+  {
+    for (int i = 0; i < records; i++)
+    {
+      if (FIXED_POINT)
+      {
+        alarms += compact[i].tempCenti >= 800 || compact[i].tempCenti <= 200;
+        formatCenti(value, sizeof(value), compact[i].tempCenti, 2);
+        formatCenti(value, sizeof(value), compact[i].humidCenti, 2);
+      }
+      else
+      {
+        alarms += legacy[i].tempC >= 8.0 || legacy[i].tempC <= 2.0;
+        snprintf(value, sizeof(value), "%.2f", legacy[i].tempC);
+        snprintf(value, sizeof(value), "%.2f", legacy[i].humidRH);
+      }
+      benchmark::DoNotOptimize(value);
+    }
+  }
+  benchmark::DoNotOptimize(alarms);
+  state.SetItemsProcessed(state.iterations() * records);
+  state.counters["record_B"] = FIXED_POINT ? sizeof(MiTagData) : sizeof(LegacyTagData);
+}
+BENCHMARK_TEMPLATE(BM_ReadingCheckFormat, false)->Arg(4096);
+BENCHMARK_TEMPLATE(BM_ReadingCheckFormat, true)->Arg(4096);
+
+// A snapshot with half the tags stale, so the order has to move them
+static void BM_OrderTagsForHome(benchmark::State &state)
+{
+  int tags = state.range(0);
+  halNativeAdvanceMillis(TAG_ONLINE_TIEMOUT + 1);
+  std::vector<MiTagData> tagData(tags);
+  for (int i = 0; i < tags; i++)
+  {
+    tagData[i] = makeTag(i, i < tags / 2 ? millis() - TAG_ONLINE_TIEMOUT - 1 : millis());
+    tagData[i].online = i >= tags / 2;
+  }
+  TagSnapshot snapshot = {1, tags, tags - tags / 2, tagData.data(), tags};
+  std::vector<MiTagData *> orderedTagData(tags);
+  for (auto _ : state)
+  {
+    benchmark::DoNotOptimize(
+        orderTagsForHome(scanner, &snapshot, VSERVESAFE_SCANMODE_ALLSCAN, orderedTagData.data()));
+  }
+  state.SetItemsProcessed(state.iterations() * tags);
+}
+BENCHMARK(BM_OrderTagsForHome)->Arg(MAX_TAGS_REMEMBER);
+
+// The home screen's previous ordering: bubble sort with a threshold lookup
+// per comparison
+static bool legacyShownBefore(MiTagData *tagData1, MiTagData *tagData2)
+{
+  bool hasNotify1 = scanner.isTagNotifyDataExists(tagData1->mac);
+  bool hasNotify2 = scanner.isTagNotifyDataExists(tagData2->mac);
+  if (hasNotify1 != hasNotify2)
+  {
+    return hasNotify1;
+  }
+  if (tagData1->online != tagData2->online)
+  {
+    return tagData1->online;
+  }
+  return tagData1->signal.rssiEwma > tagData2->signal.rssiEwma;
+}
+
+// One home screen refresh in the selected scan: ordering plus the alarm pass
+// over every tag, with the previous bubble sort and threshold lookups against
+// the counting sort on cached notify results. Items are tags.
+template <bool COUNTING>
+static void BM_HomeRefresh(benchmark::State &state)
+{
+  int tags = state.range(0);
+  std::vector<MiTagData> tagData(tags);
+  for (int i = 0; i < tags; i++)
+  {
+    tagData[i] = makeTag(i, millis());
+    tagData[i].online = i % 7 != 0;
+    tagData[i].notifyResult = i % 3 == 0 ? VSERVESAFE_NOTIFY_NODATA : VSERVESAFE_NOTIFY_NORMAL + i % 3;
+  }
+  TagSnapshot snapshot = {1, tags, tags, tagData.data(), tags};
+  std::vector<MiTagData *> ordered(tags);
+  int alarms = 0;
+  for (auto _ : state)
+  {
+    if (COUNTING)
+    {
+      orderTagsForHome(scanner, &snapshot, VSERVESAFE_SCANMODE_SELECTED_SCAN, ordered.data());
+      for (int i = 0; i < tags; i++)
+      {
+        coldsenses_notify_result result = scanner.getTagNotifyResult(ordered[i]);
+        alarms += result == VSERVESAFE_NOTIFY_HIGH || result == VSERVESAFE_NOTIFY_LOW;
+      }
+      continue;
+    }
+    for (int i = 0; i < tags; i++)
+    {
+      ordered[i] = &tagData[i];
+    }
+    for (int i = 1; i < tags; i++)
+    {
+      for (int j = 0; j < i; j++)
+      {
+        if (legacyShownBefore(ordered[i], ordered[j]))
+        {
+          MiTagData *swapped = ordered[i];
+          ordered[i] = ordered[j];
+          ordered[j] = swapped;
+        }
+      }
+    }
+    for (int i = 0; i < tags; i++)
+    {
+      alarms += scanner.isTagNotifyDataExists(ordered[i]->mac);
+    }
+  }
+  benchmark::DoNotOptimize(alarms);
+  state.SetItemsProcessed(state.iterations() * tags);
+}
+BENCHMARK_TEMPLATE(BM_HomeRefresh, false)->Arg(100)->Arg(1000);
+BENCHMARK_TEMPLATE(BM_HomeRefresh, true)->Arg(100)->Arg(1000);
+
+// One simulated second of a store where every tag is heard every 5 s and
+// one in ten has fallen silent; the adverts are not timed. Items are steps.
+template <bool WHEEL>
+static void BM_PresenceStep(benchmark::State &state)
+{
+  int tags = state.range(0);
+  TagStore store;
+  store.begin(tags);
+  uint32_t now = 1000;
+  int step = 0;
+  int online = 0;
+  for (auto _ : state)
+  {
+    state.PauseTiming();
+    now += 1000;
+    step += 1;
+    for (int i = step % 5; i < tags; i += 5)
+    {
+      if (i % 10 != 0 || step < 120)
+      {
+        MiTagData tagData = makeTag(i, now);
+        store.upsert(tagData);
+      }
+    }
+    state.ResumeTiming();
+    if (WHEEL)
+    {
+      store.expirePresence(now);
+      online = store.onlineCount();
+    }
+    else
+    {
+      online = 0;
+      for (int slot = 0; slot < store.count(); slot++)
+      {
+        online += now - store.at(slot)->ts <= TAG_ONLINE_TIEMOUT;
+      }
+    }
+    benchmark::DoNotOptimize(online);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_TEMPLATE(BM_PresenceStep, true)->Arg(1000)->Arg(4000);
+BENCHMARK_TEMPLATE(BM_PresenceStep, false)->Arg(1000)->Arg(4000);
+
+static const String BENCH_CONFIG_TOPIC = "gwcfg_NATIVE";
+
+// Receives records as one config version in chunks of whole records that fit
+// an MQTT message, then its manifest; returns the time spent receiving
+static double pushConfig(GatewayConfigChunks &chunks, uint32_t version, const String &records)
+{
+  double receiveUs = 0;
+  int chunkCount = 0;
+  const char *pos = records.c_str();
+  while (*pos)
+  {
+    String topic = BENCH_CONFIG_TOPIC;
+    topic += "/";
+    topic += chunkCount;
+    char header[24];
+    snprintf(header, sizeof(header), "chunk:%u\n", version);
+    size_t room = VSERVESAFE_MQTT_BUFFER_SIZE - topic.length() - strlen(header);
+    const char *end = pos;
+    while (*end)
+    {
+      const char *newline = strchr(end, '\n');
+      const char *next = newline ? newline + 1 : end + strlen(end);
+      if ((size_t)(next - pos) > room)
+      {
+        break;
+      }
+      end = next;
+    }
+    std::string chunk = header;
+    chunk.append(pos, end - pos);
+    std::chrono::steady_clock::time_point ts = std::chrono::steady_clock::now();
+    chunks.receive(scanner, BENCH_CONFIG_TOPIC, topic, chunk.c_str(), chunk.length());
+    receiveUs += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - ts).count();
+    chunkCount += 1;
+    pos = end;
+  }
+  char manifest[48];
+  snprintf(manifest, sizeof(manifest), "config:%u,%d", version, chunkCount);
+  std::chrono::steady_clock::time_point ts = std::chrono::steady_clock::now();
+  chunks.receive(scanner, BENCH_CONFIG_TOPIC, BENCH_CONFIG_TOPIC, manifest, strlen(manifest));
+  receiveUs += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - ts).count();
+  return receiveUs;
+}
+
+// A full set of limits pushed as one config version, until the loop and the
+// ingest task have applied all of them; items are limits. callback_us is the
+// part spent in the MQTT callback.
+static void BM_LimitsPush(benchmark::State &state)
+{
+  int limits = state.range(0);
+  String config = "limits:clear\n";
+  for (int i = 0; i < limits; i++)
+  {
+    char record[48];
+    snprintf(record, sizeof(record), "limit:A4C13801%02X%02X,%d.5,%d\n", (uint8_t)(i >> 8), (uint8_t)i, i % 10,
+             i % 10 + 6);
+    config += record;
+  }
+  GatewayConfigChunks chunks;
+  chunks.begin();
+  uint32_t version = 0;
+  double callbackUs = 0;
+  for (auto _ : state)
+  {
+    version += 1;
+    callbackUs += pushConfig(chunks, version, config);
+    // The gateway's loop()
+    while (chunks.isApplying() || scanner.getTagNotifyPending() > 0)
+    {
+      chunks.poll(scanner);
+      vTaskDelay(0);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * limits);
+  state.counters["callback_us"] = callbackUs / state.iterations();
+  state.counters["limits"] = scanner.getTagNotifyDataCount();
+}
+BENCHMARK(BM_LimitsPush)->Arg(1000);
+
+static const int HISTORY_BENCH_TAGS = 1000;
+
+static int16_t historyTemp(int tagIndex, int period)
+{
+  return (int16_t)(-1800 + tagIndex % 50 * 10 + (period * 7 + tagIndex) % 60);
+}
+
+// Fills the rings of HISTORY_BENCH_TAGS tags for twice TAG_HISTORY_LENGTH
+// periods, so appends wrap
+static void fillHistory(TagHistory &history, std::vector<int> &slots)
+{
+  for (int period = 0; period < TAG_HISTORY_LENGTH * 2; period++)
+  {
+    for (int i = 0; i < HISTORY_BENCH_TAGS; i++)
+    {
+      slots[i] = history.append(slots[i], BENCH_BASE_MAC + i, period * TAG_HISTORY_PERIOD, historyTemp(i, period),
+                                (uint16_t)(5000 + period % 100));
+    }
+  }
+}
+
+// Items are appends; the RAM counter is the whole history
+static void BM_HistoryAppend(benchmark::State &state)
+{
+  TagHistory history;
+  history.begin();
+  std::vector<int> slots(HISTORY_BENCH_TAGS, -1);
+  for (auto _ : state)
+  {
+    fillHistory(history, slots);
+  }
+  state.SetItemsProcessed(state.iterations() * HISTORY_BENCH_TAGS * TAG_HISTORY_LENGTH * 2);
+  state.counters["history_B"] = history.getMemoryUsage();
+}
+BENCHMARK(BM_HistoryAppend);
+
+// Reads of the last N periods; items are tags read
+static void BM_HistoryRead(benchmark::State &state)
+{
+  int periods = state.range(0);
+  TagHistory history;
+  history.begin();
+  std::vector<int> slots(HISTORY_BENCH_TAGS, -1);
+  fillHistory(history, slots);
+  uint32_t lastTs = (TAG_HISTORY_LENGTH * 2 - 1) * TAG_HISTORY_PERIOD;
+  uint32_t firstTs = lastTs - (periods - 1) * TAG_HISTORY_PERIOD;
+  TagHistorySample samples[TAG_HISTORY_LENGTH];
+  int next = 0;
+  for (auto _ : state)
+  {
+    benchmark::DoNotOptimize(
+        history.read(slots[next], BENCH_BASE_MAC + next, firstTs, lastTs, samples, TAG_HISTORY_LENGTH));
+    next = (next + 1) % HISTORY_BENCH_TAGS;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_HistoryRead)->Arg(10)->Arg(60)->Arg(TAG_HISTORY_LENGTH);
+
+static const char *const BENCH_RULES[] = {
+    "temp >= 8 || temp <= 2", "humid > 85 && temp > 5", "rate > 0.5 || rate < -0.5",
+    "batt < 2500 || battpct < 10", "offline > 600",
+};
+#define BENCH_RULE_COUNT (int)(sizeof(BENCH_RULES) / sizeof(BENCH_RULES[0]))
+
+typedef enum
+{
+  BENCH_RULES_INCREMENTAL,
+  BENCH_RULES_ALL,
+  BENCH_RULES_PARSED,
+} bench_rules_mode;
+
+static void countRuleEdge(void *context, MiTagData *tagData, int rule, bool isActive)
+{
+  ((uint32_t *)context)[isActive ? 0 : 1] += 1;
+}
+
+// One value per advert, in turn temperature, humidity and battery, as
+// MiBeacon sends them; returns the variables the sample changed
+static tag_rule_inputs_t ruleSample(MiTagData &tagData, int tagIndex, int round, uint32_t now)
+{
+  tag_rule_inputs_t changed = 1 << VSERVESAFE_RULE_VAR_OFFLINE;
+  switch ((tagIndex + round) % 3)
+  {
+  case 0:
+  {
+    int16_t tempCenti = 400 + (tagIndex % 50) * 10 + (round * (tagIndex % 7)) % 300;
+    tagData.rateCenti = tagData.tempCenti == TAG_TEMP_NONE ? TAG_RATE_NONE : tempCenti - tagData.tempCenti;
+    tagData.tempCenti = tempCenti;
+    tagData.tempTs = now;
+    changed |= 1 << VSERVESAFE_RULE_VAR_TEMP | 1 << VSERVESAFE_RULE_VAR_RATE;
+    break;
+  }
+  case 1:
+    tagData.humidCenti = 7000 + (tagIndex % 20) * 100 + round % 7 * 100;
+    changed |= 1 << VSERVESAFE_RULE_VAR_HUMID;
+    break;
+  default:
+    tagData.battMv = 2400 + (tagIndex % 30) * 20;
+    tagData.battPercent = 5 + tagIndex % 90;
+    changed |= 1 << VSERVESAFE_RULE_VAR_BATT | 1 << VSERVESAFE_RULE_VAR_BATT_PERCENT;
+    break;
+  }
+  tagData.ts = now;
+  return changed;
+}
+
+// Parse every expression again and run it, as an interpreter of the text would
+static int evalRulesParsed(MiTagData &tagData, uint32_t *edges)
+{
+  int32_t values[VSERVESAFE_RULE_VAR_COUNT] = {tagData.tempCenti, tagData.humidCenti, tagData.rateCenti,
+                                               tagData.battMv * 100, tagData.battPercent * 100, 0};
+  tag_rule_inputs_t valid = 1 << VSERVESAFE_RULE_VAR_OFFLINE;
+  valid |= (tagData.tempCenti != TAG_TEMP_NONE) << VSERVESAFE_RULE_VAR_TEMP;
+  valid |= (tagData.humidCenti != TAG_HUMID_NONE) << VSERVESAFE_RULE_VAR_HUMID;
+  valid |= (tagData.rateCenti != TAG_RATE_NONE) << VSERVESAFE_RULE_VAR_RATE;
+  valid |= (tagData.battMv != 0) << VSERVESAFE_RULE_VAR_BATT;
+  valid |= (tagData.battPercent != 0) << VSERVESAFE_RULE_VAR_BATT_PERCENT;
+  for (int r = 0; r < BENCH_RULE_COUNT; r++)
+  {
+    TagRuleProgram program;
+    compileTagRule(BENCH_RULES[r], strlen(BENCH_RULES[r]), program);
+    bool isActive = evalTagRule(program, values, valid);
+    uint32_t bit = 1UL << r;
+    if (isActive != ((tagData.ruleActive & bit) != 0))
+    {
+      tagData.ruleActive ^= bit;
+      edges[isActive ? 0 : 1] += 1;
+    }
+  }
+  return BENCH_RULE_COUNT;
+}
+
+// That many tags under five rules for all tags, each getting one sample per
+// round. The rules picked by the variables a sample changed against running
+// all five, and the compiled programs against parsing the expressions every
+// time. Items are samples; rules is the rules run per sample.
+template <bench_rules_mode MODE>
+static void BM_RuleSamples(benchmark::State &state)
+{
+  int nTags = state.range(0);
+  TagRuleSet rules;
+  for (int r = 0; r < BENCH_RULE_COUNT; r++)
+  {
+    TagRuleProgram program;
+    compileTagRule(BENCH_RULES[r], strlen(BENCH_RULES[r]), program);
+    char name[8];
+    snprintf(name, sizeof(name), "r%d", r);
+    rules.set(name, MAC_KEY_EMPTY, program);
+  }
+  std::vector<MiTagData> tags(nTags);
+  for (int i = 0; i < nTags; i++)
+  {
+    memset(&tags[i], 0, sizeof(tags[i]));
+    tags[i].mac = BENCH_BASE_MAC + i;
+    tags[i].tempCenti = TAG_TEMP_NONE;
+    tags[i].rateCenti = TAG_RATE_NONE;
+    tags[i].humidCenti = TAG_HUMID_NONE;
+  }
+  uint32_t edges[2] = {0, 0};
+  uint64_t run = 0;
+  int round = 0;
+  for (auto _ : state)
+  {
+    uint32_t now = round * 5000;
+    for (int i = 0; i < nTags; i++)
+    {
+      tag_rule_inputs_t changed = ruleSample(tags[i], i, round, now);
+      if (MODE == BENCH_RULES_INCREMENTAL)
+      {
+        run += rules.evaluate(tags[i], changed, now, countRuleEdge, edges);
+      }
+      else if (MODE == BENCH_RULES_ALL)
+      {
+        run += rules.evaluate(tags[i], TAG_RULE_INPUTS_ALL, now, countRuleEdge, edges);
+      }
+      else
+      {
+        run += evalRulesParsed(tags[i], edges);
+      }
+    }
+    round += 1;
+  }
+  state.SetItemsProcessed(state.iterations() * nTags);
+  state.counters["rules"] = run / (double)(state.iterations() * nTags);
+  state.counters["edges"] = benchmark::Counter(edges[0] + edges[1], benchmark::Counter::kAvgIterations);
+}
+BENCHMARK_TEMPLATE(BM_RuleSamples, BENCH_RULES_INCREMENTAL)->Arg(1000);
+BENCHMARK_TEMPLATE(BM_RuleSamples, BENCH_RULES_ALL)->Arg(1000);
+BENCHMARK_TEMPLATE(BM_RuleSamples, BENCH_RULES_PARSED)->Arg(1000);
+
+int main(int argc, char **argv)
+{
+  // The scanner logs each scan to Serial
+  halNativeSetSerialEnabled(false);
+  scanner.init();
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv))
+  {
+    return 1;
+  }
+  benchmark::RunSpecifiedBenchmarks();
+  return 0;
+}
@@ -0,0 +1,161 @@
+// Host stress test for the ingest ring: a producer thread pushes
+// TagIngestEvents whose every field is derived from a sequence number, a
+// consumer thread pops them and checks each one is whole and in order. Prints
+// torn or out-of-order events (must be 0), how often the ring was full and
+// the throughput, next to a mutex-guarded ring of the same length.
+//
+//   .pio/build/native_ringstress/program [million events]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include "TagIngest.h"
+
+typedef struct
+{
+  uint32_t pushed;
+  uint32_t popped;
+  // Pushes refused by a full ring
+  uint32_t full;
+  uint32_t torn;
+  uint32_t outOfOrder;
+  double seconds;
+} StressResult;
+
+// Same interface as SpscRing, one lock around both ends
+class MutexRing
+{
+private:
+  TagIngestEvent _items[TAG_INGEST_QUEUE_LENGTH];
+  uint32_t _head = 0;
+  uint32_t _tail = 0;
+  std::mutex _lock;
+
+public:
+  bool push(const TagIngestEvent &item)
+  {
+    std::lock_guard<std::mutex> lock(this->_lock);
+    if (this->_head - this->_tail >= TAG_INGEST_QUEUE_LENGTH)
+    {
+      return false;
+    }
+    this->_items[this->_head % TAG_INGEST_QUEUE_LENGTH] = item;
+    this->_head += 1;
+    return true;
+  }
+
+  bool pop(TagIngestEvent &item)
+  {
+    std::lock_guard<std::mutex> lock(this->_lock);
+    if (this->_head == this->_tail)
+    {
+      return false;
+    }
+    item = this->_items[this->_tail % TAG_INGEST_QUEUE_LENGTH];
+    this->_tail += 1;
+    return true;
+  }
+};
+
+static void fillEvent(uint32_t seq, TagIngestEvent &event)
+{
+  memset(&event, 0, sizeof(event));
+  event.reading.mac = 0xA4C138000000ULL | (seq & 0xFFFFFF);
+  event.reading.tempCenti = (int16_t)seq;
+  event.reading.humidCenti = (uint16_t)(seq >> 3);
+  event.reading.battMv = (uint16_t)(seq * 7);
+  event.reading.counter = (uint8_t)seq;
+  event.reading.fields = ADV_READING_TEMP | ADV_READING_HUMID | ADV_READING_COUNTER;
+  event.ts = seq;
+  event.rssi = -(int8_t)(seq & 0x7F);
+  snprintf(event.name, sizeof(event.name), "T%08X", seq);
+}
+
+static bool isWhole(uint32_t seq, const TagIngestEvent &event)
+{
+  TagIngestEvent expected;
+  fillEvent(seq, expected);
+  return memcmp(&expected, &event, sizeof(event)) == 0;
+}
+
+// The producer retries a full ring (like a radio that keeps sending) and
+// counts each refusal; both sides yield while they wait, so this also runs on
+// a single core
+template <typename RING>
+static StressResult runStress(RING &ring, uint32_t nEvents)
+{
+  StressResult result = {};
+  std::atomic<bool> isDone(false);
+  std::chrono::steady_clock::time_point ts = std::chrono::steady_clock::now();
+
+  std::thread consumer([&]
+                       {
+    TagIngestEvent event;
+    uint32_t expectedTs = 0;
+    while (true)
+    {
+      if (!ring.pop(event))
+      {
+        if (isDone.load(std::memory_order_acquire) && !ring.pop(event))
+        {
+          break;
+        }
+        std::this_thread::yield();
+        continue;
+      }
+      // ts carries the sequence number; the rest must match it
+      if (!isWhole(event.ts, event))
+      {
+        result.torn += 1;
+      }
+      if (event.ts != expectedTs)
+      {
+        result.outOfOrder += 1;
+      }
+      expectedTs = event.ts + 1;
+      result.popped += 1;
+    } });
+
+  TagIngestEvent event;
+  for (uint32_t seq = 0; seq < nEvents; seq++)
+  {
+    fillEvent(seq, event);
+    while (!ring.push(event))
+    {
+      result.full += 1;
+      std::this_thread::yield();
+    }
+    result.pushed += 1;
+  }
+  isDone.store(true, std::memory_order_release);
+  consumer.join();
+
+  result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - ts).count();
+  return result;
+}
+
+static bool printResult(const char *name, const StressResult &result)
+{
+  printf("%-6s pushed=%u popped=%u torn=%u outOfOrder=%u full=%u %.2f Mevents/s\n", name, result.pushed,
+         result.popped, result.torn, result.outOfOrder, result.full,
+         result.seconds > 0 ? result.popped / result.seconds / 1e6 : 0.0);
+  return result.torn == 0 && result.outOfOrder == 0 && result.popped == result.pushed;
+}
+
+int main(int argc, char **argv)
+{
+  double millions = argc > 1 ? atof(argv[1]) : 10;
+  uint32_t nEvents = millions > 0 ? (uint32_t)(millions * 1e6) : 1;
+
+  printf("event=%uB ring=%u events\n", (unsigned)sizeof(TagIngestEvent), TAG_INGEST_QUEUE_LENGTH);
+  static TagAdvertRing spscRing;
+  static MutexRing mutexRing;
+  bool isOk = printResult("spsc", runStress(spscRing, nEvents));
+  isOk = printResult("mutex", runStress(mutexRing, nEvents)) && isOk;
+  printf("%s\n", isOk ? "OK" : "FAILED");
+  return isOk ? 0 : 1;
+}
@@ -0,0 +1,253 @@
+// Host simulator for the BLE scan policies: tags advertising through a shared
+// radio whose time outside the scan window goes to Wi-Fi (background traffic
+// and one MQTT publish per captured sample). Prints, per policy, the share of
+// samples captured against the airtime Wi-Fi got, the BLE traffic on air
+// (adverts, plus scan requests and responses for active scans), the share of
+// captured samples published and how long those publishes waited.
+//
+//   .pio/build/native_scansim/program [tags] [wifi load %] [minutes]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <queue>
+#include <vector>
+#include "vservesafe_conf.h"
+#include "ScanScheduler.h"
+
+// pvvx/ATC defaults: a new sample every 10 s, each advertised 4 times
+#define SIM_SAMPLE_MS (10000)
+#define SIM_ADVERT_MS (2500)
+#define SIM_ADVERT_JITTER_MS (10)
+// Three channels of about 376 us each
+#define SIM_ADVERT_AIRTIME_US (1128)
+// Scan request and response on one channel; the scanner hears nothing else
+// until the exchange is over
+#define SIM_SCAN_EXCHANGE_US (700)
+#define SIM_SCAN_EXCHANGE_MS (1)
+#define SIM_PUBLISH_AIRTIME_MS (3)
+#define SIM_SCHEDULE_MS (5000)
+#define SIM_WARMUP_MS (60000)
+
+typedef struct
+{
+  const char *name;
+  coldsenses_scan_policy policy;
+  uint16_t windowMs;
+  bool activeScan;
+} SimPolicy;
+
+static const SimPolicy SIM_POLICIES[] = {
+    {"fixed 99", VSERVESAFE_SCAN_POLICY_FIXED, 99, true},
+    {"fixed 99", VSERVESAFE_SCAN_POLICY_FIXED, 99, false},
+    {"fixed 50", VSERVESAFE_SCAN_POLICY_FIXED, 50, true},
+    {"fixed 50", VSERVESAFE_SCAN_POLICY_FIXED, 50, false},
+    {"fixed 25", VSERVESAFE_SCAN_POLICY_FIXED, 25, false},
+    {"adaptive", VSERVESAFE_SCAN_POLICY_ADAPTIVE, SCAN_WINDOW_MAX, true},
+    {"adaptive", VSERVESAFE_SCAN_POLICY_ADAPTIVE, SCAN_WINDOW_MAX, false},
+};
+
+typedef struct
+{
+  uint32_t nextAdvertTs;
+  uint32_t sampleSeq;
+  uint32_t heardSeq;
+  uint32_t lastSampleTs;
+  bool heard;
+} SimTag;
+
+typedef struct
+{
+  uint64_t samples;
+  uint64_t captured;
+  uint64_t airUs;
+  uint64_t bleMs;
+  uint64_t wifiMs;
+  uint64_t publishes;
+  uint64_t publishWaitMs;
+  int maxBacklog;
+} SimResult;
+
+typedef std::pair<uint32_t, int> SimEvent;
+
+static uint32_t simRandomState = 1;
+
+static uint32_t simRandom(uint32_t bound)
+{
+  simRandomState = simRandomState * 1103515245 + 12345;
+  return (simRandomState >> 16) % bound;
+}
+
+static SimResult simulate(const SimPolicy &simPolicy, int nTags, int wifiLoadPercent, uint32_t durationMs)
+{
+  SimResult result = {};
+  simRandomState = 1;
+
+  ScanScheduler scheduler;
+  scheduler.begin(simPolicy.policy, simPolicy.windowMs);
+
+  std::vector<SimTag> tags(nTags);
+  std::priority_queue<SimEvent, std::vector<SimEvent>, std::greater<SimEvent> > adverts;
+  for (int i = 0; i < nTags; i++)
+  {
+    tags[i].nextAdvertTs = simRandom(SIM_ADVERT_MS);
+    tags[i].sampleSeq = 0;
+    tags[i].heardSeq = 0;
+    tags[i].lastSampleTs = 0;
+    tags[i].heard = false;
+    adverts.push(SimEvent(tags[i].nextAdvertTs, i));
+  }
+
+  // Adverts overlapping on air are lost (pure ALOHA); an active scan adds
+  // the responses of the adverts it hears
+  double airtimeUs = SIM_ADVERT_AIRTIME_US;
+  if (simPolicy.activeScan)
+  {
+    airtimeUs += SIM_SCAN_EXCHANGE_US * simPolicy.windowMs / (double)SCAN_INTERVAL_MS;
+  }
+  double load = nTags * airtimeUs / (SIM_ADVERT_MS * 1000.0);
+  uint32_t collisionPermille = (uint32_t)((1.0 - 1.0 / (1.0 + 2.0 * load)) * 1000);
+
+  std::queue<uint32_t> publishQueue;
+  uint32_t wifiDebtMs = 0;
+  uint32_t wifiDebtPermille = 0;
+  uint32_t publishLeftMs = 0;
+  uint32_t busyUntilTs = 0;
+  ScanSchedulerInput input = {};
+
+  for (uint32_t ts = 0; ts < durationMs; ts++)
+  {
+    bool measured = ts >= SIM_WARMUP_MS;
+    bool inWindow = ts % scheduler.getIntervalMs() < scheduler.getWindowMs();
+
+    while (!adverts.empty() && adverts.top().first <= ts)
+    {
+      int i = adverts.top().second;
+      adverts.pop();
+      SimTag &tag = tags[i];
+      // Every SIM_SAMPLE_MS / SIM_ADVERT_MS adverts carry a new sample
+      uint32_t seq = ts / SIM_SAMPLE_MS + 1;
+      if (seq != tag.sampleSeq)
+      {
+        tag.sampleSeq = seq;
+        result.samples += measured ? 1 : 0;
+      }
+      result.airUs += measured ? SIM_ADVERT_AIRTIME_US : 0;
+      if (inWindow && ts >= busyUntilTs && simRandom(1000) >= collisionPermille)
+      {
+        if (simPolicy.activeScan)
+        {
+          result.airUs += measured ? SIM_SCAN_EXCHANGE_US : 0;
+          busyUntilTs = ts + SIM_SCAN_EXCHANGE_MS;
+        }
+        if (tag.heardSeq != tag.sampleSeq)
+        {
+          tag.heardSeq = tag.sampleSeq;
+          tag.lastSampleTs = ts;
+          tag.heard = true;
+          result.captured += measured ? 1 : 0;
+          input.newSamples += 1;
+          publishQueue.push(ts);
+        }
+        else
+        {
+          input.duplicates += 1;
+        }
+      }
+      tag.nextAdvertTs = ts + SIM_ADVERT_MS + simRandom(SIM_ADVERT_JITTER_MS);
+      adverts.push(SimEvent(tag.nextAdvertTs, i));
+    }
+
+    // Background Wi-Fi traffic keeps asking for its share of airtime
+    wifiDebtPermille += wifiLoadPercent * 10;
+    wifiDebtMs += wifiDebtPermille / 1000;
+    wifiDebtPermille %= 1000;
+    if (inWindow)
+    {
+      result.bleMs += measured ? 1 : 0;
+    }
+    else
+    {
+      result.wifiMs += measured ? 1 : 0;
+      if (wifiDebtMs > 0)
+      {
+        wifiDebtMs -= 1;
+      }
+      else if (publishLeftMs > 0 || !publishQueue.empty())
+      {
+        if (publishLeftMs == 0)
+        {
+          publishLeftMs = SIM_PUBLISH_AIRTIME_MS;
+        }
+        publishLeftMs -= 1;
+        if (publishLeftMs == 0)
+        {
+          if (publishQueue.front() >= SIM_WARMUP_MS)
+          {
+            result.publishes += 1;
+            result.publishWaitMs += ts - publishQueue.front();
+          }
+          publishQueue.pop();
+        }
+      }
+    }
+    if (measured && (int)publishQueue.size() > result.maxBacklog)
+    {
+      result.maxBacklog = publishQueue.size();
+    }
+
+    if (ts % SIM_SCHEDULE_MS == SIM_SCHEDULE_MS - 1)
+    {
+      for (int i = 0; i < nTags; i++)
+      {
+        if (tags[i].heard && ts - tags[i].lastSampleTs <= TAG_ONLINE_TIEMOUT)
+        {
+          input.knownTags += 1;
+          if (ts - tags[i].lastSampleTs > 2 * SIM_SAMPLE_MS)
+          {
+            input.overdueTags += 1;
+          }
+        }
+      }
+      input.uplinkBacklog = publishQueue.size();
+      scheduler.update(input);
+      input = ScanSchedulerInput();
+    }
+  }
+  return result;
+}
+
+int main(int argc, char **argv)
+{
+  int nTags = argc > 1 ? atoi(argv[1]) : MAX_TAGS_REMEMBER;
+  int wifiLoadPercent = argc > 2 ? atoi(argv[2]) : 20;
+  int minutes = argc > 3 ? atoi(argv[3]) : 10;
+  if (nTags < 1)
+  {
+    nTags = 1;
+  }
+  if (wifiLoadPercent < 0 || wifiLoadPercent > 100)
+  {
+    wifiLoadPercent = 20;
+  }
+  if (minutes < 2)
+  {
+    minutes = 2;
+  }
+
+  printf("tags=%d wifi load=%d%% duration=%d min\n", nTags, wifiLoadPercent, minutes);
+  printf("%-10s %-8s %7s %7s %8s %8s %10s %11s %11s\n", "policy", "scan", "ble", "wifi", "air ms/s", "capture",
+         "published", "publish ms", "max backlog");
+  for (size_t i = 0; i < sizeof(SIM_POLICIES) / sizeof(SIM_POLICIES[0]); i++)
+  {
+    SimResult result = simulate(SIM_POLICIES[i], nTags, wifiLoadPercent, minutes * 60000);
+    uint64_t totalMs = result.bleMs + result.wifiMs;
+    printf("%-10s %-8s %6.1f%% %6.1f%% %8.1f %7.1f%% %9.1f%% %11.0f %11d\n", SIM_POLICIES[i].name,
+           SIM_POLICIES[i].activeScan ? "active" : "passive", result.bleMs * 100.0 / totalMs,
+           result.wifiMs * 100.0 / totalMs, result.airUs / (double)totalMs,
+           result.samples > 0 ? result.captured * 100.0 / result.samples : 0.0,
+           result.captured > 0 ? result.publishes * 100.0 / result.captured : 0.0,
+           result.publishes > 0 ? (double)result.publishWaitMs / result.publishes : 0.0, result.maxBacklog);
+  }
+  return 0;
+}
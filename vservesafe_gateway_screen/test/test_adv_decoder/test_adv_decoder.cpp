@@ -0,0 +1,178 @@
+// Golden frames, one or more per advert format, decoded through the same
+// dispatch the scanner uses
+
+#include <gtest/gtest.h>
+#include <string.h>
+
+#include "AdvDecoder.h"
+#include "MiBeacon.h"
+
+static const mac_key_t GOLDEN_MAC = 0xA4C138F46606ULL;
+
+// pvvx custom: 23.45 C, 56.78 %, 2950 mV, 87 %, counter 0x12, flags 0x05
+static const uint8_t PVVX_FRAME[] = {0x06, 0x66, 0xF4, 0x38, 0xC1, 0xA4, 0x29, 0x09,
+                                     0x2E, 0x16, 0x86, 0x0B, 0x57, 0x12, 0x05};
+// ATC1441: 23.4 C, 56 %, 87 %, 2950 mV, counter 0x12
+static const uint8_t ATC1441_FRAME[] = {0xA4, 0xC1, 0x38, 0xF4, 0x66, 0x06, 0x00,
+                                        0xEA, 0x38, 0x57, 0x0B, 0x86, 0x12};
+// BTHome v2, unencrypted: packet id 0x12, 87 %, 23.45 C, 56.78 %, 2950 mV
+static const uint8_t BTHOME_FRAME[] = {0x40, 0x00, 0x12, 0x01, 0x57, 0x02, 0x29,
+                                       0x09, 0x03, 0x2E, 0x16, 0x0C, 0x86, 0x0B};
+// MiBeacon v3, plain, MAC included: temperature and humidity object (0x100D)
+static const uint8_t MIBEACON_FRAME[] = {0x50, 0x30, 0x5B, 0x05, 0x12, 0x06, 0x66, 0xF4, 0x38,
+                                         0xC1, 0xA4, 0x0D, 0x10, 0x04, 0xEA, 0x00, 0x30, 0x02};
+
+TEST(AdvDecoder, PvvxGoldenFrame)
+{
+  AdvReading reading;
+  ASSERT_TRUE(decodeServiceData(ADV_UUID_ENVIRONMENTAL_SENSING, PVVX_FRAME, sizeof(PVVX_FRAME), reading));
+  EXPECT_EQ(VSERVESAFE_ADV_PVVX, reading.format);
+  EXPECT_EQ(GOLDEN_MAC, reading.mac);
+  EXPECT_EQ(2345, reading.tempCenti);
+  EXPECT_EQ(5678, reading.humidCenti);
+  EXPECT_EQ(2950, reading.battMv);
+  EXPECT_EQ(87, reading.battPercent);
+  EXPECT_EQ(0x12, reading.counter);
+  EXPECT_EQ(0x05, reading.flag);
+  EXPECT_EQ(ADV_READING_TEMP | ADV_READING_HUMID | ADV_READING_BATT_MV | ADV_READING_BATT_PERCENT |
+                ADV_READING_COUNTER,
+            reading.fields);
+}
+
+TEST(AdvDecoder, PvvxNegativeTemperature)
+{
+  uint8_t frame[sizeof(PVVX_FRAME)];
+  memcpy(frame, PVVX_FRAME, sizeof(frame));
+  // -5.25 C
+  frame[6] = 0xF3;
+  frame[7] = 0xFD;
+  AdvReading reading;
+  ASSERT_TRUE(decodeServiceData(ADV_UUID_ENVIRONMENTAL_SENSING, frame, sizeof(frame), reading));
+  EXPECT_EQ(-525, reading.tempCenti);
+}
+
+TEST(AdvDecoder, Atc1441GoldenFrame)
+{
+  AdvReading reading;
+  ASSERT_TRUE(decodeServiceData(ADV_UUID_ENVIRONMENTAL_SENSING, ATC1441_FRAME, sizeof(ATC1441_FRAME), reading));
+  EXPECT_EQ(VSERVESAFE_ADV_ATC1441, reading.format);
+  EXPECT_EQ(GOLDEN_MAC, reading.mac);
+  EXPECT_EQ(2340, reading.tempCenti);
+  EXPECT_EQ(5600, reading.humidCenti);
+  EXPECT_EQ(2950, reading.battMv);
+  EXPECT_EQ(87, reading.battPercent);
+  EXPECT_EQ(0x12, reading.counter);
+}
+
+TEST(AdvDecoder, Atc1441NegativeTemperature)
+{
+  uint8_t frame[sizeof(ATC1441_FRAME)];
+  memcpy(frame, ATC1441_FRAME, sizeof(frame));
+  // -5.2 C
+  frame[6] = 0xFF;
+  frame[7] = 0xCC;
+  AdvReading reading;
+  ASSERT_TRUE(decodeServiceData(ADV_UUID_ENVIRONMENTAL_SENSING, frame, sizeof(frame), reading));
+  EXPECT_EQ(-520, reading.tempCenti);
+}
+
+TEST(AdvDecoder, BTHomeV2GoldenFrame)
+{
+  AdvReading reading;
+  ASSERT_TRUE(decodeServiceData(ADV_UUID_BTHOME, BTHOME_FRAME, sizeof(BTHOME_FRAME), reading));
+  EXPECT_EQ(VSERVESAFE_ADV_BTHOME_V2, reading.format);
+  EXPECT_EQ(MAC_KEY_EMPTY, reading.mac);
+  EXPECT_EQ(2345, reading.tempCenti);
+  EXPECT_EQ(5678, reading.humidCenti);
+  EXPECT_EQ(2950, reading.battMv);
+  EXPECT_EQ(87, reading.battPercent);
+  EXPECT_EQ(0x12, reading.counter);
+}
+
+TEST(AdvDecoder, BTHomeV2TenthsObjects)
+{
+  // 0x45 temperature 0.1 C, 0x2E humidity %
+  const uint8_t frame[] = {0x40, 0x45, 0xEA, 0x00, 0x2E, 0x38};
+  AdvReading reading;
+  ASSERT_TRUE(decodeServiceData(ADV_UUID_BTHOME, frame, sizeof(frame), reading));
+  EXPECT_EQ(2340, reading.tempCenti);
+  EXPECT_EQ(5600, reading.humidCenti);
+}
+
+TEST(AdvDecoder, BTHomeV2RejectsEncryptedAndOtherVersions)
+{
+  uint8_t frame[sizeof(BTHOME_FRAME)];
+  AdvReading reading;
+  memcpy(frame, BTHOME_FRAME, sizeof(frame));
+  frame[0] = 0x41;
+  EXPECT_FALSE(decodeServiceData(ADV_UUID_BTHOME, frame, sizeof(frame), reading));
+  frame[0] = 0x20;
+  EXPECT_FALSE(decodeServiceData(ADV_UUID_BTHOME, frame, sizeof(frame), reading));
+}
+
+TEST(AdvDecoder, BTHomeV2StopsAtUnknownObject)
+{
+  // Temperature, then an unknown id whose size cannot be skipped
+  const uint8_t frame[] = {0x40, 0x02, 0x29, 0x09, 0xEE, 0x01, 0x03, 0x2E, 0x16};
+  AdvReading reading;
+  ASSERT_TRUE(decodeServiceData(ADV_UUID_BTHOME, frame, sizeof(frame), reading));
+  EXPECT_EQ(2345, reading.tempCenti);
+  EXPECT_EQ(0, reading.fields & ADV_READING_HUMID);
+}
+
+TEST(AdvDecoder, MiBeaconPlainGoldenFrame)
+{
+  AdvReading reading;
+  ASSERT_TRUE(decodeServiceData(ADV_UUID_MIBEACON, MIBEACON_FRAME, sizeof(MIBEACON_FRAME), reading));
+  EXPECT_EQ(VSERVESAFE_ADV_MIBEACON, reading.format);
+  EXPECT_EQ(GOLDEN_MAC, reading.mac);
+  EXPECT_EQ(2340, reading.tempCenti);
+  EXPECT_EQ(5600, reading.humidCenti);
+  EXPECT_EQ(0x12, reading.counter);
+}
+
+TEST(AdvDecoder, MiBeaconEncryptedNeedsBindKey)
+{
+  uint8_t frame[sizeof(MIBEACON_FRAME)];
+  memcpy(frame, MIBEACON_FRAME, sizeof(frame));
+  frame[0] |= 0x08;
+  AdvReading reading;
+  EXPECT_FALSE(decodeServiceData(ADV_UUID_MIBEACON, frame, sizeof(frame), reading));
+}
+
+TEST(AdvDecoder, DispatchByUuidAndLength)
+{
+  EXPECT_TRUE(findAdvDecoder(ADV_UUID_ENVIRONMENTAL_SENSING, 15) != NULL);
+  EXPECT_TRUE(findAdvDecoder(ADV_UUID_ENVIRONMENTAL_SENSING, 13) != NULL);
+  EXPECT_TRUE(findAdvDecoder(ADV_UUID_ENVIRONMENTAL_SENSING, 14) == NULL);
+  EXPECT_TRUE(findAdvDecoder(ADV_UUID_MIBEACON, 4) == NULL);
+  EXPECT_TRUE(findAdvDecoder(0x1234, 15) == NULL);
+}
+
+TEST(AdvDecoder, RawAdvertPayload)
+{
+  // Flags, then the pvvx service data
+  uint8_t payload[3 + 4 + sizeof(PVVX_FRAME)] = {0x02, 0x01, 0x06, 0x12, ADV_AD_TYPE_SERVICE_DATA16, 0x1A, 0x18};
+  memcpy(payload + 7, PVVX_FRAME, sizeof(PVVX_FRAME));
+  AdvReading reading;
+  ASSERT_TRUE(decodeAdvertPayload(payload, sizeof(payload), reading));
+  EXPECT_EQ(VSERVESAFE_ADV_PVVX, reading.format);
+  EXPECT_EQ(2345, reading.tempCenti);
+
+  const uint8_t *data;
+  size_t dataLen;
+  ASSERT_TRUE(findServiceData16(payload, sizeof(payload), ADV_UUID_ENVIRONMENTAL_SENSING, data, dataLen));
+  EXPECT_EQ(payload + 7, data);
+  EXPECT_EQ(sizeof(PVVX_FRAME), dataLen);
+  EXPECT_FALSE(findServiceData16(payload, sizeof(payload), ADV_UUID_BTHOME, data, dataLen));
+
+  // A field running past the end stops the walk
+  payload[3] = 0x40;
+  EXPECT_FALSE(decodeAdvertPayload(payload, sizeof(payload), reading));
+}
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,94 @@
+// Buzzer cadences against their schedule, through the native HAL shim
+
+#include <gtest/gtest.h>
+
+#include "Buzzer.h"
+#include "hal/HalBuzzer.h"
+
+// A switch may come this late on a loaded host
+static const int32_t LATE_MS = 20;
+
+class BuzzerTest : public ::testing::Test
+{
+protected:
+  // The sequence task runs for the life of the program, as on the board
+  static AlarmBuzzer &buzzer()
+  {
+    static AlarmBuzzer *buzzer = NULL;
+    if (!buzzer)
+    {
+      buzzer = new AlarmBuzzer();
+      EXPECT_TRUE(buzzer->begin(0));
+    }
+    return *buzzer;
+  }
+
+  HalNativeBuzzerEdge edges[32];
+
+  void SetUp() override
+  {
+    buzzer().play(VSERVESAFE_BUZZER_OFF);
+    vTaskDelay(pdMS_TO_TICKS(20));
+    halNativeBuzzerTakeEdges(this->edges, 32);
+  }
+
+  // Checks the switches from edges[first] against the cadence's steps (ms
+  // from start), alternating on and off
+  void expectSchedule(size_t first, uint32_t start, const uint32_t *steps, size_t nSteps)
+  {
+    for (size_t i = 0; i < nSteps; i++)
+    {
+      const HalNativeBuzzerEdge &edge = this->edges[first + i];
+      int32_t lateMs = (int32_t)(edge.ms - (start + steps[i]));
+      EXPECT_GE(lateMs, 0) << "switch " << i;
+      EXPECT_LE(lateMs, LATE_MS) << "switch " << i;
+      EXPECT_EQ(i % 2 == 0, edge.isOn) << "switch " << i;
+    }
+  }
+};
+
+TEST_F(BuzzerTest, PlaysTheCadenceOnSchedule)
+{
+  static const uint32_t highSteps[] = {0, 100, 200, 300, 400, 500, 1500};
+  static const uint32_t lowSteps[] = {0, 400};
+  const size_t nHigh = sizeof(highSteps) / sizeof(highSteps[0]);
+  const size_t nLow = sizeof(lowSteps) / sizeof(lowSteps[0]);
+
+  uint32_t highStart = xTaskGetTickCount();
+  buzzer().play(VSERVESAFE_BUZZER_HIGH);
+  vTaskDelay(pdMS_TO_TICKS(1550));
+  uint32_t lowStart = xTaskGetTickCount();
+  buzzer().play(VSERVESAFE_BUZZER_LOW);
+  vTaskDelay(pdMS_TO_TICKS(500));
+  buzzer().play(VSERVESAFE_BUZZER_OFF);
+  vTaskDelay(pdMS_TO_TICKS(50));
+
+  // Then switched off once when stopped
+  ASSERT_EQ(nHigh + nLow + 1, halNativeBuzzerTakeEdges(this->edges, 32));
+  this->expectSchedule(0, highStart, highSteps, nHigh);
+  this->expectSchedule(nHigh, lowStart, lowSteps, nLow);
+  EXPECT_FALSE(this->edges[nHigh + nLow].isOn);
+}
+
+TEST_F(BuzzerTest, SameCadenceKeepsPlaying)
+{
+  uint32_t start = xTaskGetTickCount();
+  buzzer().play(VSERVESAFE_BUZZER_LOW);
+  vTaskDelay(pdMS_TO_TICKS(200));
+  buzzer().play(VSERVESAFE_BUZZER_LOW);
+  vTaskDelay(pdMS_TO_TICKS(300));
+  buzzer().play(VSERVESAFE_BUZZER_OFF);
+  vTaskDelay(pdMS_TO_TICKS(50));
+
+  // Not restarted at 200 ms
+  static const uint32_t steps[] = {0, 400};
+  ASSERT_EQ(3u, halNativeBuzzerTakeEdges(this->edges, 32));
+  this->expectSchedule(0, start, steps, 2);
+  EXPECT_EQ(VSERVESAFE_BUZZER_OFF, buzzer().getPattern());
+}
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,370 @@
+// Gateway config records and versioned chunks, applied to a running scanner
+
+#include <gtest/gtest.h>
+#include <stdlib.h>
+#include <string.h>
+#include <freertos/task.h>
+
+#include "BLE.h"
+#include "GatewayConfig.h"
+
+static const String CONFIG_TOPIC = "gwcfg_A4C138000001";
+
+static String chunkTopic(int index)
+{
+  String topic = CONFIG_TOPIC;
+  topic += "/";
+  topic += index;
+  return topic;
+}
+
+class GatewayConfigTest : public ::testing::Test
+{
+protected:
+  // The scanner's tasks run for the life of the program, as on the board, so
+  // it is never destroyed
+  MiTagScanner &scanner;
+  GatewayConfigChunks chunks;
+  uint8_t counter = 0;
+
+  GatewayConfigTest() : scanner(*new MiTagScanner())
+  {
+  }
+
+  void SetUp() override
+  {
+    this->scanner.init(100);
+    ASSERT_TRUE(this->chunks.begin());
+  }
+
+  int apply(const char *payload)
+  {
+    return applyGatewayConfig(this->scanner, payload, strlen(payload));
+  }
+
+  int receive(const String &topic, const char *payload)
+  {
+    return this->chunks.receive(this->scanner, CONFIG_TOPIC, topic, payload, strlen(payload));
+  }
+
+  // Polls until the chunks in progress and the limits they queued are applied
+  int drain()
+  {
+    int applied = 0;
+    for (int i = 0; i < 1000 && (this->chunks.isApplying() || this->scanner.getTagNotifyPending() > 0); i++)
+    {
+      applied += this->chunks.poll(this->scanner);
+      vTaskDelay(1);
+    }
+    return applied;
+  }
+
+  // The notify result of a pvvx sample of the tag at tempCenti, as readers
+  // see it once stored
+  coldsenses_notify_result resultAt(mac_key_t mac, int16_t tempCenti)
+  {
+    uint8_t address[6];
+    for (int i = 0; i < 6; i++)
+    {
+      address[i] = (uint8_t)(mac >> (8 * i));
+    }
+    std::string rawData((const char *)address, sizeof(address));
+    rawData += (char)(tempCenti & 0xff);
+    rawData += (char)(tempCenti >> 8);
+    const char rest[] = {0x2E, 0x16, (char)0x86, 0x0B, 0x57};
+    rawData.append(rest, sizeof(rest));
+    rawData += (char)this->counter++;
+    rawData += (char)0;
+
+    NimBLEAdvertisedDevice device;
+    device.fakeSetAddress(address);
+    device.fakeSetRSSI(-60);
+    device.fakeAddServiceData(MiTagScanner::TARGET_UUID, rawData);
+    this->scanner.onResult(&device);
+    while (this->scanner.getIngestPending() > 0)
+    {
+      vTaskDelay(0);
+    }
+    return this->storedResult(mac);
+  }
+
+  // The tag's notify result in the snapshot, without a new sample
+  coldsenses_notify_result storedResult(mac_key_t mac)
+  {
+    while (!this->scanner.isSnapshotCurrent())
+    {
+      vTaskDelay(1);
+    }
+    coldsenses_notify_result result = VSERVESAFE_NOTIFY_NODATA;
+    const TagSnapshot *snapshot = this->scanner.acquireSnapshot();
+    for (int i = 0; i < snapshot->count; i++)
+    {
+      if (snapshot->tags[i].mac == mac)
+      {
+        result = this->scanner.getTagNotifyResult(&snapshot->tags[i]);
+      }
+    }
+    this->scanner.releaseSnapshot(snapshot);
+    return result;
+  }
+};
+
+TEST_F(GatewayConfigTest, AppliesRecords)
+{
+  EXPECT_EQ(4, this->apply("bindkey:A4C138F46606,e9ea895fac7cca6d30532432a516f3a8\n"
+                           "capacity:50;alarm:0.5,120,300\n"
+                           "allow:A4C138F46606,A4C138F46607"));
+  EXPECT_EQ(1, this->scanner.getBindKeyCount());
+  EXPECT_EQ(50, this->scanner.getTagCapacity());
+  EXPECT_EQ(2u, this->scanner.getAllowListCount());
+  TagAlarmConfig config = this->scanner.getAlarmConfig();
+  EXPECT_EQ(50, config.hysteresisCenti);
+  EXPECT_EQ(120000u, config.dwellMs);
+  EXPECT_EQ(300000u, config.rearmMs);
+
+  EXPECT_EQ(1, this->apply("unbindkey:A4C138F46606"));
+  EXPECT_EQ(0, this->scanner.getBindKeyCount());
+}
+
+TEST_F(GatewayConfigTest, SkipsMalformedRecords)
+{
+  EXPECT_EQ(1, this->apply("bindkey:A4C138F46606,e9ea\n"
+                           "bindkey:nonsense,e9ea895fac7cca6d30532432a516f3a8\n"
+                           "limit:A4C138F46606,8,2.555\n"
+                           "limits:2,8\n"
+                           "alarm:-0.5,120,300\n"
+                           "alarm:0.5,120\n"
+                           "rule:bad name,*,temp > 5\n"
+                           "rule:warm,*,temp >\n"
+                           "unknown:1\n"
+                           "capacity:60"));
+  EXPECT_EQ(0, this->scanner.getBindKeyCount());
+  EXPECT_EQ(60, this->scanner.getTagCapacity());
+  this->drain();
+  EXPECT_EQ(0, this->scanner.getTagNotifyDataCount());
+  EXPECT_EQ(0, this->scanner.getTagRuleCount());
+}
+
+TEST_F(GatewayConfigTest, RulesFollowTheSamples)
+{
+  EXPECT_EQ(2, this->apply("rule:warm,*,temp > 5\nrule:door,A4C138F46607,temp > 5"));
+  EXPECT_EQ(2, this->scanner.getTagRuleCount());
+  this->resultAt(0xA4C138F46606ULL, 500);
+  this->resultAt(0xA4C138F46606ULL, 501);
+  this->resultAt(0xA4C138F46606ULL, 502);
+  this->resultAt(0xA4C138F46606ULL, 400);
+
+  // An edge each time the rule starts or stops holding; the other rule is for
+  // another tag
+  TagRuleEvent event;
+  ASSERT_TRUE(this->scanner.pollRuleEvent(event));
+  EXPECT_EQ(0xA4C138F46606ULL, event.mac);
+  EXPECT_STREQ("warm", event.name);
+  EXPECT_TRUE(event.isActive);
+  ASSERT_TRUE(this->scanner.pollRuleEvent(event));
+  EXPECT_FALSE(event.isActive);
+  EXPECT_FALSE(this->scanner.pollRuleEvent(event));
+
+  // A rule removed while it holds stops holding
+  this->resultAt(0xA4C138F46606ULL, 600);
+  ASSERT_TRUE(this->scanner.pollRuleEvent(event));
+  EXPECT_EQ(1, this->apply("unrule:warm"));
+  ASSERT_TRUE(this->scanner.pollRuleEvent(event));
+  EXPECT_STREQ("warm", event.name);
+  EXPECT_FALSE(event.isActive);
+  EXPECT_EQ(1, this->apply("rules:clear"));
+  EXPECT_EQ(0, this->scanner.getTagRuleCount());
+}
+
+TEST_F(GatewayConfigTest, LimitsAreAppliedByTheIngestTask)
+{
+  // Without dwell or re-arm delay an alarm follows each sample
+  EXPECT_EQ(3, this->apply("alarm:0,0,0\n"
+                           "limit:A4C138F46606,2,8\n"
+                           "limits:-20,-15.5,A4C138F46607,A4C138F46608"));
+  this->drain();
+  EXPECT_EQ(0u, this->scanner.getTagNotifyPending());
+  EXPECT_EQ(3, this->scanner.getTagNotifyDataCount());
+  EXPECT_TRUE(this->scanner.isTagNotifyDataExists(0xA4C138F46607ULL));
+
+  // At or outside a limit alarms; decimals are parsed to hundredths
+  EXPECT_EQ(VSERVESAFE_NOTIFY_NORMAL, this->resultAt(0xA4C138F46606ULL, 500));
+  EXPECT_EQ(VSERVESAFE_NOTIFY_HIGH, this->resultAt(0xA4C138F46606ULL, 800));
+  // The high alarm clears before a low one can be raised
+  EXPECT_EQ(VSERVESAFE_NOTIFY_NORMAL, this->resultAt(0xA4C138F46606ULL, 200));
+  EXPECT_EQ(VSERVESAFE_NOTIFY_LOW, this->resultAt(0xA4C138F46606ULL, 200));
+  EXPECT_EQ(VSERVESAFE_NOTIFY_NORMAL, this->resultAt(0xA4C138F46608ULL, -1551));
+  EXPECT_EQ(VSERVESAFE_NOTIFY_HIGH, this->resultAt(0xA4C138F46608ULL, -1550));
+  EXPECT_EQ(VSERVESAFE_NOTIFY_NODATA, this->resultAt(0xA4C138F46609ULL, 500));
+
+  EXPECT_EQ(2, this->apply("unlimit:A4C138F46607\nunlimit:A4C138F46608"));
+  this->drain();
+  EXPECT_EQ(1, this->scanner.getTagNotifyDataCount());
+  // Stored tags are re-evaluated when their limits change
+  EXPECT_EQ(VSERVESAFE_NOTIFY_NODATA, this->storedResult(0xA4C138F46608ULL));
+  EXPECT_EQ(VSERVESAFE_NOTIFY_LOW, this->storedResult(0xA4C138F46606ULL));
+  EXPECT_EQ(1, this->apply("limits:clear"));
+  this->drain();
+  EXPECT_EQ(0, this->scanner.getTagNotifyDataCount());
+  EXPECT_EQ(VSERVESAFE_NOTIFY_NODATA, this->storedResult(0xA4C138F46606ULL));
+
+  // Each edge was queued once; losing its limits clears a raised alarm
+  const struct
+  {
+    mac_key_t mac;
+    uint8_t edge;
+  } edges[] = {
+      {0xA4C138F46606ULL, VSERVESAFE_ALARM_EDGE_HIGH},  {0xA4C138F46606ULL, VSERVESAFE_ALARM_EDGE_CLEAR},
+      {0xA4C138F46606ULL, VSERVESAFE_ALARM_EDGE_LOW},   {0xA4C138F46608ULL, VSERVESAFE_ALARM_EDGE_HIGH},
+      {0xA4C138F46608ULL, VSERVESAFE_ALARM_EDGE_CLEAR}, {0xA4C138F46606ULL, VSERVESAFE_ALARM_EDGE_CLEAR},
+  };
+  TagAlarmEvent event;
+  for (size_t i = 0; i < sizeof(edges) / sizeof(edges[0]); i++)
+  {
+    ASSERT_TRUE(this->scanner.pollAlarmEvent(event));
+    EXPECT_EQ(edges[i].mac, event.mac);
+    EXPECT_EQ(edges[i].edge, event.edge);
+  }
+  EXPECT_FALSE(this->scanner.pollAlarmEvent(event));
+}
+
+// What the buzzer sounds for follows the alarm and presence events
+TEST_F(GatewayConfigTest, AlarmCountsFollowTheEvents)
+{
+  const mac_key_t mac = 0xA4C138F46606ULL;
+  this->apply("alarm:0,0,0\nlimit:A4C138F46606,2,8");
+  this->drain();
+  this->resultAt(mac, 800);
+  MiTagAlarmCounts counts = this->scanner.getAlarmCounts();
+  EXPECT_EQ(1, counts.high);
+  EXPECT_EQ(0, counts.low);
+  this->resultAt(mac, 500);
+  this->resultAt(mac, 200);
+  counts = this->scanner.getAlarmCounts();
+  EXPECT_EQ(0, counts.high);
+  EXPECT_EQ(1, counts.low);
+  EXPECT_EQ(0, counts.offline);
+
+  // Silent past the timeout, then heard again
+  halNativeAdvanceMillis(TAG_ONLINE_TIEMOUT + 1000);
+  for (int i = 0; i < 1000 && this->scanner.getAlarmCounts().offline == 0; i++)
+  {
+    vTaskDelay(1);
+  }
+  EXPECT_EQ(1, this->scanner.getAlarmCounts().offline);
+  this->resultAt(mac, 200);
+  EXPECT_EQ(0, this->scanner.getAlarmCounts().offline);
+
+  // Losing its limits clears the tag's alarm
+  this->apply("unlimit:A4C138F46606");
+  this->drain();
+  counts = this->scanner.getAlarmCounts();
+  EXPECT_EQ(0, counts.high);
+  EXPECT_EQ(0, counts.low);
+  EXPECT_EQ(0, counts.offline);
+}
+
+TEST_F(GatewayConfigTest, LimitsBeyondTheQueueAreDropped)
+{
+  String config;
+  for (int i = 0; i < TAG_NOTIFY_QUEUE_LENGTH + 10; i++)
+  {
+    char record[32];
+    snprintf(record, sizeof(record), "limit:A4C13801%02X%02X,2,8\n", (uint8_t)(i >> 8), (uint8_t)i);
+    config += record;
+  }
+  // The ingest task may take some while they are queued
+  int applied = applyGatewayConfig(this->scanner, config.c_str(), config.length());
+  EXPECT_GE(applied, TAG_NOTIFY_QUEUE_LENGTH);
+  this->drain();
+  EXPECT_EQ(applied, this->scanner.getTagNotifyDataCount());
+  EXPECT_EQ((uint32_t)(TAG_NOTIFY_QUEUE_LENGTH + 10 - applied), this->scanner.getTagNotifyDropped());
+}
+
+TEST_F(GatewayConfigTest, AppliesAVersionOnceEveryChunkIsIn)
+{
+  // Retained chunks may arrive before or after the manifest
+  EXPECT_EQ(0, this->receive(chunkTopic(1), "chunk:7\nlimit:A4C138F46607,2,8"));
+  EXPECT_EQ(0, this->receive(CONFIG_TOPIC, "config:7,2"));
+  EXPECT_FALSE(this->chunks.isApplying());
+  EXPECT_EQ(0, this->receive(chunkTopic(0), "chunk:7\nlimits:clear\nlimit:A4C138F46606,2,8"));
+  EXPECT_TRUE(this->chunks.isApplying());
+
+  EXPECT_EQ(3, this->drain());
+  EXPECT_EQ(7u, this->chunks.getAppliedVersion());
+  EXPECT_EQ(2, this->scanner.getTagNotifyDataCount());
+
+  // The same manifest again is not applied twice
+  this->receive(CONFIG_TOPIC, "config:7,2");
+  EXPECT_FALSE(this->chunks.isApplying());
+}
+
+TEST_F(GatewayConfigTest, ChunksOfAnotherVersionWait)
+{
+  this->receive(CONFIG_TOPIC, "config:3,2");
+  this->receive(chunkTopic(0), "chunk:3\ncapacity:60");
+  this->receive(chunkTopic(1), "chunk:2\ncapacity:70");
+  EXPECT_FALSE(this->chunks.isApplying());
+  this->receive(chunkTopic(1), "chunk:3\nscan:adaptive");
+  EXPECT_TRUE(this->chunks.isApplying());
+  EXPECT_EQ(2, this->drain());
+  EXPECT_EQ(60, this->scanner.getTagCapacity());
+}
+
+TEST_F(GatewayConfigTest, NewerVersionReplacesTheOneInProgress)
+{
+  // Limits keep the notify queue busy, so version 1 is still being applied
+  this->receive(chunkTopic(0), "chunk:1\nlimit:A4C138F46606,2,8");
+  this->receive(chunkTopic(1), "chunk:1\ncapacity:10");
+  this->receive(CONFIG_TOPIC, "config:1,2");
+  this->chunks.poll(this->scanner);
+  ASSERT_TRUE(this->chunks.isApplying());
+
+  this->receive(CONFIG_TOPIC, "config:2,1");
+  EXPECT_FALSE(this->chunks.isApplying());
+  this->receive(chunkTopic(0), "chunk:2\ncapacity:20");
+  EXPECT_EQ(1, this->drain());
+  EXPECT_EQ(2u, this->chunks.getAppliedVersion());
+  EXPECT_EQ(20, this->scanner.getTagCapacity());
+}
+
+TEST_F(GatewayConfigTest, PlainRecordsAreAppliedAtOnce)
+{
+  EXPECT_EQ(1, this->receive(CONFIG_TOPIC, "capacity:42"));
+  EXPECT_EQ(42, this->scanner.getTagCapacity());
+  EXPECT_FALSE(this->chunks.isApplying());
+  // Not one of the config topics
+  EXPECT_EQ(0, this->receive(String("gwcfg_A4C138000001x/0"), "chunk:1\ncapacity:10"));
+  EXPECT_EQ(0, this->receive(chunkTopic(0), "capacity:10"));
+  EXPECT_EQ(42, this->scanner.getTagCapacity());
+}
+
+TEST_F(GatewayConfigTest, RestoresTheAppliedVersion)
+{
+  char dir[] = "/tmp/gwconfigXXXXXX";
+  ASSERT_TRUE(mkdtemp(dir) != NULL);
+  setenv("NATIVE_STORAGE_DIR", dir, 1);
+
+  this->receive(chunkTopic(0), "chunk:5\ncapacity:33");
+  this->receive(CONFIG_TOPIC, "config:5,1");
+  this->drain();
+  ASSERT_EQ(5u, this->chunks.getAppliedVersion());
+
+  MiTagScanner &restarted = *new MiTagScanner();
+  restarted.init(100);
+  GatewayConfigChunks restored;
+  ASSERT_TRUE(restored.begin());
+  ASSERT_TRUE(restored.restore());
+  EXPECT_TRUE(restored.isApplying());
+  EXPECT_EQ(1, restored.poll(restarted));
+  EXPECT_EQ(5u, restored.getAppliedVersion());
+  EXPECT_EQ(33, restarted.getTagCapacity());
+
+  unsetenv("NATIVE_STORAGE_DIR");
+}
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,198 @@
+// AES-CCM against the NIST SP 800-38C example, and encrypted MiBeacon frames.
+// The MiBeacon frames were encrypted with mbedtls 2.28, so decrypting them
+// checks the nonce, AAD and MIC layout the gateway uses, on the native AES
+// and on the board's mbedtls alike.
+
+#include <gtest/gtest.h>
+#include <string.h>
+#include <mbedtls/ccm.h>
+
+#include "MiBeacon.h"
+
+// NIST SP 800-38C, appendix C, example 1
+static const uint8_t NIST_KEY[] = {0x40, 0x41, 0x42, 0x43, 0x44, 0x45, 0x46, 0x47,
+                                   0x48, 0x49, 0x4a, 0x4b, 0x4c, 0x4d, 0x4e, 0x4f};
+static const uint8_t NIST_NONCE[] = {0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16};
+static const uint8_t NIST_AAD[] = {0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07};
+static const uint8_t NIST_PLAIN[] = {0x20, 0x21, 0x22, 0x23};
+static const uint8_t NIST_CIPHER[] = {0x71, 0x62, 0x01, 0x5b};
+static const uint8_t NIST_TAG[] = {0x4d, 0xac, 0x25, 0x5d};
+
+static const uint8_t BIND_KEY[MIBEACON_BINDKEY_SIZE] = {0xe9, 0xea, 0x89, 0x5f, 0xac, 0x7c, 0xca, 0x6d,
+                                                        0x30, 0x53, 0x24, 0x32, 0xa5, 0x16, 0xf3, 0xa8};
+static const uint8_t TAG_MAC_LE[] = {0x06, 0x66, 0xf4, 0x38, 0xc1, 0xa4};
+static const mac_key_t TAG_MAC = 0xA4C138F46606ULL;
+
+// v5, MAC included, counter 0x2a, extended counter 1: 23.4 C, 56.0 %
+static const uint8_t MIBEACON_WITH_MAC[] = {0x58, 0x58, 0x5b, 0x05, 0x2a, 0x06, 0x66, 0xf4, 0x38,
+                                            0xc1, 0xa4, 0xd9, 0x16, 0xe3, 0xfa, 0x14, 0x82, 0xad,
+                                            0x01, 0x00, 0x00, 0x02, 0xb9, 0x7c, 0xbd};
+// v5 without the MAC, counter 0x2b, extended counter 2: battery 87 %
+static const uint8_t MIBEACON_NO_MAC[] = {0x48, 0x58, 0x5b, 0x05, 0x2b, 0x03, 0xf6, 0x38,
+                                          0xed, 0x02, 0x00, 0x00, 0xad, 0xc3, 0x41, 0x6f};
+
+TEST(MiBeacon, CcmNistExample1)
+{
+  mbedtls_ccm_context ccm;
+  mbedtls_ccm_init(&ccm);
+  ASSERT_EQ(0, mbedtls_ccm_setkey(&ccm, MBEDTLS_CIPHER_ID_AES, NIST_KEY, 128));
+
+  uint8_t cipher[sizeof(NIST_PLAIN)];
+  uint8_t tag[sizeof(NIST_TAG)];
+  ASSERT_EQ(0, mbedtls_ccm_encrypt_and_tag(&ccm, sizeof(NIST_PLAIN), NIST_NONCE, sizeof(NIST_NONCE), NIST_AAD,
+                                           sizeof(NIST_AAD), NIST_PLAIN, cipher, tag, sizeof(tag)));
+  EXPECT_EQ(0, memcmp(cipher, NIST_CIPHER, sizeof(cipher)));
+  EXPECT_EQ(0, memcmp(tag, NIST_TAG, sizeof(tag)));
+
+  uint8_t plain[sizeof(NIST_PLAIN)];
+  ASSERT_EQ(0, mbedtls_ccm_auth_decrypt(&ccm, sizeof(NIST_CIPHER), NIST_NONCE, sizeof(NIST_NONCE), NIST_AAD,
+                                        sizeof(NIST_AAD), NIST_CIPHER, plain, NIST_TAG, sizeof(NIST_TAG)));
+  EXPECT_EQ(0, memcmp(plain, NIST_PLAIN, sizeof(plain)));
+
+  uint8_t badTag[sizeof(NIST_TAG)];
+  memcpy(badTag, NIST_TAG, sizeof(badTag));
+  badTag[0] ^= 1;
+  EXPECT_EQ(MBEDTLS_ERR_CCM_AUTH_FAILED,
+            mbedtls_ccm_auth_decrypt(&ccm, sizeof(NIST_CIPHER), NIST_NONCE, sizeof(NIST_NONCE), NIST_AAD,
+                                     sizeof(NIST_AAD), NIST_CIPHER, plain, badTag, sizeof(badTag)));
+  mbedtls_ccm_free(&ccm);
+}
+
+TEST(MiBeacon, ParseHeader)
+{
+  MiBeaconFrame frame;
+  ASSERT_TRUE(parseMiBeacon(MIBEACON_WITH_MAC, sizeof(MIBEACON_WITH_MAC), frame));
+  EXPECT_TRUE(frame.encrypted);
+  EXPECT_EQ(5, frame.version);
+  EXPECT_EQ(0x055b, frame.productId);
+  EXPECT_EQ(0x2a, frame.counter);
+  EXPECT_EQ(MIBEACON_WITH_MAC + 5, frame.macLE);
+  EXPECT_EQ(MIBEACON_WITH_MAC + 11, frame.objects);
+  EXPECT_EQ(14u, frame.objectsLen);
+
+  EXPECT_FALSE(parseMiBeacon(MIBEACON_WITH_MAC, 4, frame));
+  // MAC flagged but cut short
+  EXPECT_FALSE(parseMiBeacon(MIBEACON_WITH_MAC, 8, frame));
+}
+
+TEST(MiBeacon, DecryptWithMac)
+{
+  AdvReading reading;
+  ASSERT_TRUE(decryptMiBeacon(BIND_KEY, MIBEACON_WITH_MAC, sizeof(MIBEACON_WITH_MAC), NULL, reading));
+  EXPECT_EQ(VSERVESAFE_ADV_MIBEACON, reading.format);
+  EXPECT_EQ(TAG_MAC, reading.mac);
+  EXPECT_EQ(2340, reading.tempCenti);
+  EXPECT_EQ(5600, reading.humidCenti);
+  EXPECT_EQ(0x2a, reading.counter);
+  EXPECT_EQ(ADV_READING_COUNTER | ADV_READING_TEMP | ADV_READING_HUMID, reading.fields);
+}
+
+TEST(MiBeacon, DecryptWithAdvertiserAddress)
+{
+  AdvReading reading;
+  ASSERT_TRUE(decryptMiBeacon(BIND_KEY, MIBEACON_NO_MAC, sizeof(MIBEACON_NO_MAC), TAG_MAC_LE, reading));
+  EXPECT_EQ(TAG_MAC, reading.mac);
+  EXPECT_EQ(87, reading.battPercent);
+  EXPECT_EQ(0x2b, reading.counter);
+
+  // The address is part of the nonce
+  uint8_t otherMacLE[sizeof(TAG_MAC_LE)];
+  memcpy(otherMacLE, TAG_MAC_LE, sizeof(otherMacLE));
+  otherMacLE[0] ^= 1;
+  EXPECT_FALSE(decryptMiBeacon(BIND_KEY, MIBEACON_NO_MAC, sizeof(MIBEACON_NO_MAC), otherMacLE, reading));
+}
+
+TEST(MiBeacon, RejectsWrongKeyAndTampering)
+{
+  AdvReading reading;
+  uint8_t key[MIBEACON_BINDKEY_SIZE];
+  memcpy(key, BIND_KEY, sizeof(key));
+  key[15] ^= 0x80;
+  EXPECT_FALSE(decryptMiBeacon(key, MIBEACON_WITH_MAC, sizeof(MIBEACON_WITH_MAC), NULL, reading));
+
+  for (size_t i = 2; i < sizeof(MIBEACON_WITH_MAC); i++)
+  {
+    uint8_t frame[sizeof(MIBEACON_WITH_MAC)];
+    memcpy(frame, MIBEACON_WITH_MAC, sizeof(frame));
+    frame[i] ^= 0x01;
+    EXPECT_FALSE(decryptMiBeacon(BIND_KEY, frame, sizeof(frame), NULL, reading)) << "byte " << i;
+  }
+}
+
+// v5 frame with TAG_MAC and extended counter 1 around objects, encrypted as
+// a tag would. Returns the frame length.
+static size_t encryptMiBeacon(const uint8_t *objects, size_t objectsLen, uint8_t *frame)
+{
+  const uint8_t header[] = {0x58, 0x58, 0x5b, 0x05, 0x2a};
+  const uint8_t extCounter[] = {0x01, 0x00, 0x00};
+  const uint8_t aad[] = {0x11};
+  memcpy(frame, header, sizeof(header));
+  memcpy(frame + 5, TAG_MAC_LE, sizeof(TAG_MAC_LE));
+  memcpy(frame + 11 + objectsLen, extCounter, sizeof(extCounter));
+
+  uint8_t nonce[12];
+  memcpy(nonce, TAG_MAC_LE, 6);
+  memcpy(nonce + 6, header + 2, 3);
+  memcpy(nonce + 9, extCounter, sizeof(extCounter));
+  mbedtls_ccm_context ccm;
+  mbedtls_ccm_init(&ccm);
+  mbedtls_ccm_setkey(&ccm, MBEDTLS_CIPHER_ID_AES, BIND_KEY, 128);
+  mbedtls_ccm_encrypt_and_tag(&ccm, objectsLen, nonce, sizeof(nonce), aad, sizeof(aad), objects, frame + 11,
+                              frame + 14 + objectsLen, 4);
+  mbedtls_ccm_free(&ccm);
+  return 18 + objectsLen;
+}
+
+TEST(MiBeacon, RejectsFramesLongerThanAdvertData)
+{
+  // Eight battery 87 % objects, more than a frame can carry
+  uint8_t objects[32];
+  for (size_t i = 0; i + 4 <= sizeof(objects); i += 4)
+  {
+    const uint8_t battery[] = {0x0a, 0x10, 0x01, 87};
+    memcpy(objects + i, battery, sizeof(battery));
+  }
+  uint8_t frame[sizeof(objects) + 18];
+  AdvReading reading;
+
+  // Two fit
+  size_t len = encryptMiBeacon(objects, 8, frame);
+  ASSERT_TRUE(decryptMiBeacon(BIND_KEY, frame, len, NULL, reading));
+  EXPECT_EQ(87, reading.battPercent);
+
+  // Authentic but longer than the decrypt buffer
+  len = encryptMiBeacon(objects, sizeof(objects), frame);
+  EXPECT_FALSE(decryptMiBeacon(BIND_KEY, frame, len, NULL, reading));
+}
+
+TEST(MiBeacon, KeyStore)
+{
+  MiBeaconKeyStore keys;
+  uint8_t key[MIBEACON_BINDKEY_SIZE];
+  for (int i = 0; i < MAX_BINDKEYS_REMEMBER; i++)
+  {
+    memset(key, i, sizeof(key));
+    ASSERT_TRUE(keys.set(TAG_MAC + i, key));
+  }
+  memset(key, 0xff, sizeof(key));
+  EXPECT_FALSE(keys.set(TAG_MAC + MAX_BINDKEYS_REMEMBER, key));
+  EXPECT_EQ(MAX_BINDKEYS_REMEMBER, keys.count());
+
+  // Replacing keeps the count; removing moves the last key into the hole
+  EXPECT_TRUE(keys.set(TAG_MAC + 1, key));
+  EXPECT_EQ(MAX_BINDKEYS_REMEMBER, keys.count());
+  EXPECT_EQ(0xff, keys.keyAt(keys.find(TAG_MAC + 1))[0]);
+  EXPECT_TRUE(keys.remove(TAG_MAC));
+  EXPECT_FALSE(keys.remove(TAG_MAC));
+  EXPECT_EQ(-1, keys.find(TAG_MAC));
+  int last = keys.find(TAG_MAC + MAX_BINDKEYS_REMEMBER - 1);
+  ASSERT_NE(-1, last);
+  EXPECT_EQ((MAX_BINDKEYS_REMEMBER - 1) & 0xff, keys.keyAt(last)[0]);
+
+}
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,47 @@
+// RCU copies the host task reads its admission state from: a pinned copy is
+// never handed to the writer
+
+#include <gtest/gtest.h>
+
+#include "RcuBuffers.h"
+
+TEST(RcuBuffers, FirstCopyUntilPublished)
+{
+  RcuBuffers<int, 3> buffers;
+  buffers.at(0) = 7;
+  const int *value = buffers.acquire();
+  EXPECT_EQ(&buffers.at(0), value);
+  EXPECT_EQ(7, *value);
+  buffers.release(value);
+}
+
+TEST(RcuBuffers, WriterSkipsCurrentAndPinnedCopies)
+{
+  RcuBuffers<int, 3> buffers;
+  const int *first = buffers.acquire();
+
+  int *second = buffers.beginWrite();
+  ASSERT_EQ(&buffers.at(1), second);
+  *second = 1;
+  buffers.publish(second);
+  const int *current = buffers.acquire();
+  EXPECT_EQ(second, current);
+  EXPECT_EQ(1, *current);
+
+  // The first copy is pinned by an earlier reader, the second is current
+  int *third = buffers.beginWrite();
+  ASSERT_EQ(&buffers.at(2), third);
+  buffers.publish(third);
+
+  // Both older copies are still read, so there is nothing to write into
+  EXPECT_EQ(NULL, buffers.beginWrite());
+  buffers.release(first);
+  EXPECT_EQ(&buffers.at(0), buffers.beginWrite());
+  buffers.release(current);
+}
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
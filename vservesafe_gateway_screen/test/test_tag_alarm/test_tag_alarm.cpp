@@ -0,0 +1,113 @@
+// Alarm state machine: limits, dwell, hysteresis and re-arm
+
+#include <gtest/gtest.h>
+
+#include "TagAlarm.h"
+#include "TagData.h"
+
+// 2..8 C, clears 0.5 C inside, 2 min dwell, 5 min re-arm
+static const int16_t LOW_CENTI = 200;
+static const int16_t HIGH_CENTI = 800;
+static const TagAlarmConfig CONFIG = {50, 120000, 300000};
+
+class TagAlarmTest : public ::testing::Test
+{
+protected:
+  TagAlarmState alarm;
+
+  void SetUp() override
+  {
+    resetTagAlarm(this->alarm);
+  }
+
+  coldsenses_alarm_edge step(int16_t tempCenti, uint32_t ts, const TagAlarmConfig &config = CONFIG)
+  {
+    return updateTagAlarm(this->alarm, config, tempCenti, LOW_CENTI, HIGH_CENTI, ts);
+  }
+};
+
+TEST_F(TagAlarmTest, InsideLimitsStaysNormal)
+{
+  EXPECT_EQ(VSERVESAFE_ALARM_EDGE_NONE, this->step(500, 0));
+  EXPECT_EQ(VSERVESAFE_ALARM_EDGE_NONE, this->step(201, 1000000));
+  EXPECT_EQ(VSERVESAFE_ALARM_NORMAL, this->alarm.state);
+  EXPECT_FALSE(isTagAlarmRaised(this->alarm));
+}
+
+TEST_F(TagAlarmTest, RaisesAfterDwellAtOrBeyondLimit)
+{
+  EXPECT_EQ(VSERVESAFE_ALARM_EDGE_NONE, this->step(HIGH_CENTI, 1000));
+  EXPECT_EQ(VSERVESAFE_ALARM_PENDING_HIGH, this->alarm.state);
+  EXPECT_EQ(VSERVESAFE_ALARM_EDGE_NONE, this->step(900, 1000 + CONFIG.dwellMs - 1));
+  EXPECT_EQ(VSERVESAFE_ALARM_EDGE_HIGH, this->step(900, 1000 + CONFIG.dwellMs));
+  EXPECT_TRUE(isTagAlarmRaised(this->alarm));
+  // Raised once
+  EXPECT_EQ(VSERVESAFE_ALARM_EDGE_NONE, this->step(900, 1000 + CONFIG.dwellMs * 2));
+}
+
+TEST_F(TagAlarmTest, ShortExcursionDoesNotRaise)
+{
+  EXPECT_EQ(VSERVESAFE_ALARM_EDGE_NONE, this->step(LOW_CENTI, 0));
+  EXPECT_EQ(VSERVESAFE_ALARM_PENDING_LOW, this->alarm.state);
+  EXPECT_EQ(VSERVESAFE_ALARM_EDGE_NONE, this->step(LOW_CENTI + 1, 60000));
+  EXPECT_EQ(VSERVESAFE_ALARM_NORMAL, this->alarm.state);
+  // The dwell starts over on the next crossing
+  EXPECT_EQ(VSERVESAFE_ALARM_EDGE_NONE, this->step(LOW_CENTI, 100000));
+  EXPECT_EQ(VSERVESAFE_ALARM_EDGE_NONE, this->step(LOW_CENTI, 100000 + CONFIG.dwellMs - 1));
+  EXPECT_EQ(VSERVESAFE_ALARM_EDGE_LOW, this->step(LOW_CENTI, 100000 + CONFIG.dwellMs));
+}
+
+TEST_F(TagAlarmTest, CrossingToTheOtherLimitRestartsDwell)
+{
+  this->step(HIGH_CENTI, 0);
+  EXPECT_EQ(VSERVESAFE_ALARM_EDGE_NONE, this->step(LOW_CENTI, 100000));
+  EXPECT_EQ(VSERVESAFE_ALARM_PENDING_LOW, this->alarm.state);
+  EXPECT_EQ(VSERVESAFE_ALARM_EDGE_NONE, this->step(LOW_CENTI, 100000 + CONFIG.dwellMs - 1));
+  EXPECT_EQ(VSERVESAFE_ALARM_EDGE_LOW, this->step(LOW_CENTI, 100000 + CONFIG.dwellMs));
+}
+
+TEST_F(TagAlarmTest, ClearsPastHysteresisThenRearms)
+{
+  TagAlarmConfig noDwell = CONFIG;
+  noDwell.dwellMs = 0;
+  EXPECT_EQ(VSERVESAFE_ALARM_EDGE_HIGH, this->step(850, 0, noDwell));
+  // Inside the limit but within the hysteresis band
+  EXPECT_EQ(VSERVESAFE_ALARM_EDGE_NONE, this->step(HIGH_CENTI - 50, 1000, noDwell));
+  EXPECT_EQ(VSERVESAFE_ALARM_EDGE_CLEAR, this->step(HIGH_CENTI - 51, 2000, noDwell));
+  EXPECT_EQ(VSERVESAFE_ALARM_REARMING, this->alarm.state);
+
+  // No new alarm until the re-arm delay is over
+  EXPECT_EQ(VSERVESAFE_ALARM_EDGE_NONE, this->step(900, 2000 + CONFIG.rearmMs - 1, noDwell));
+  EXPECT_EQ(VSERVESAFE_ALARM_EDGE_HIGH, this->step(900, 2000 + CONFIG.rearmMs, noDwell));
+}
+
+TEST_F(TagAlarmTest, LowClearsAboveLowPlusHysteresis)
+{
+  TagAlarmConfig noDwell = CONFIG;
+  noDwell.dwellMs = 0;
+  EXPECT_EQ(VSERVESAFE_ALARM_EDGE_LOW, this->step(-100, 0, noDwell));
+  EXPECT_EQ(VSERVESAFE_ALARM_EDGE_NONE, this->step(LOW_CENTI + 50, 1000, noDwell));
+  EXPECT_EQ(VSERVESAFE_ALARM_EDGE_CLEAR, this->step(LOW_CENTI + 51, 2000, noDwell));
+}
+
+TEST_F(TagAlarmTest, SampleWithoutTemperatureChangesNothing)
+{
+  this->step(HIGH_CENTI, 0);
+  EXPECT_EQ(VSERVESAFE_ALARM_EDGE_NONE, this->step(TAG_TEMP_NONE, CONFIG.dwellMs * 10));
+  EXPECT_EQ(VSERVESAFE_ALARM_PENDING_HIGH, this->alarm.state);
+  EXPECT_EQ(0u, this->alarm.sinceTs);
+}
+
+TEST_F(TagAlarmTest, DwellSurvivesTickWrap)
+{
+  uint32_t start = 0xFFFFFFFFu - 1000;
+  this->step(HIGH_CENTI, start);
+  EXPECT_EQ(VSERVESAFE_ALARM_EDGE_NONE, this->step(HIGH_CENTI, start + CONFIG.dwellMs - 1));
+  EXPECT_EQ(VSERVESAFE_ALARM_EDGE_HIGH, this->step(HIGH_CENTI, start + CONFIG.dwellMs));
+}
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
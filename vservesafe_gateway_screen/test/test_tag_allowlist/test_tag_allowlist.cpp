@@ -0,0 +1,95 @@
+// Bloom filter allowlist: no false negatives, the false-positive rate at site
+// sizes, and the stored form
+
+#include <gtest/gtest.h>
+#include <vector>
+
+#include "TagAllowList.h"
+
+static const mac_key_t SITE_MAC = 0xA4C138000000ULL;
+static const mac_key_t NEIGHBOUR_MAC = 0x5C8AB1000000ULL;
+
+// Share of never-added MACs the filter lets through, in percent
+static double falsePositivePercent(const TagAllowList &allowList)
+{
+  const int nProbes = 100000;
+  int falsePositives = 0;
+  for (int i = 0; i < nProbes; i++)
+  {
+    falsePositives += allowList.mayContain(NEIGHBOUR_MAC | (mac_key_t)i);
+  }
+  return falsePositives * 100.0 / nProbes;
+}
+
+TEST(TagAllowList, EveryAddedMacIsAllowed)
+{
+  TagAllowList allowList;
+  ASSERT_TRUE(allowList.begin());
+  EXPECT_EQ(0u, allowList.count());
+  EXPECT_FALSE(allowList.mayContain(SITE_MAC));
+  for (int i = 0; i < 4000; i++)
+  {
+    allowList.add(SITE_MAC | (mac_key_t)i);
+  }
+  for (int i = 0; i < 4000; i++)
+  {
+    ASSERT_TRUE(allowList.mayContain(SITE_MAC | (mac_key_t)i)) << i;
+  }
+
+  // Re-sent MACs are not counted again
+  uint32_t count = allowList.count();
+  allowList.add(SITE_MAC);
+  EXPECT_EQ(count, allowList.count());
+
+  allowList.clear();
+  EXPECT_EQ(0u, allowList.count());
+  EXPECT_FALSE(allowList.mayContain(SITE_MAC));
+}
+
+TEST(TagAllowList, FalsePositiveRate)
+{
+  TagAllowList allowList;
+  ASSERT_TRUE(allowList.begin());
+  for (int i = 0; i < 500; i++)
+  {
+    allowList.add(SITE_MAC | (mac_key_t)i);
+  }
+  EXPECT_LT(falsePositivePercent(allowList), 0.01);
+  for (int i = 500; i < 2000; i++)
+  {
+    allowList.add(SITE_MAC | (mac_key_t)i);
+  }
+  EXPECT_LT(falsePositivePercent(allowList), 0.2);
+}
+
+TEST(TagAllowList, SerializeRoundTrip)
+{
+  TagAllowList allowList;
+  ASSERT_TRUE(allowList.begin());
+  for (int i = 0; i < 100; i++)
+  {
+    allowList.add(SITE_MAC | (mac_key_t)i);
+  }
+  std::vector<uint8_t> stored(allowList.serializedSize());
+  allowList.serialize(stored.data());
+
+  TagAllowList loaded;
+  ASSERT_TRUE(loaded.begin());
+  ASSERT_TRUE(loaded.deserialize(stored.data(), stored.size()));
+  EXPECT_EQ(allowList.count(), loaded.count());
+  for (int i = 0; i < 100; i++)
+  {
+    EXPECT_TRUE(loaded.mayContain(SITE_MAC | (mac_key_t)i));
+  }
+
+  // A different size or header is not loaded
+  EXPECT_FALSE(loaded.deserialize(stored.data(), stored.size() - 1));
+  stored[0] ^= 0xFF;
+  EXPECT_FALSE(loaded.deserialize(stored.data(), stored.size()));
+}
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,188 @@
+// Repeated adverts of one sample, told apart by frame counter, and the
+// publish and revision state they leave
+
+#include <gtest/gtest.h>
+
+#include "BLE.h"
+
+static const mac_key_t TAG_MAC = 0xA4C138F46606ULL;
+
+class TagDedupTest : public ::testing::Test
+{
+protected:
+  // The scanner's tasks run for the life of the program, as on the board, so
+  // it is never destroyed
+  MiTagScanner &scanner;
+
+  TagDedupTest() : scanner(*new MiTagScanner())
+  {
+  }
+
+  void SetUp() override
+  {
+    this->scanner.init(16);
+  }
+
+  // pvvx custom frame of TAG_MAC through the result callback
+  void hear(uint8_t counter, int16_t tempCenti, int rssi = -60)
+  {
+    const uint8_t address[6] = {0x06, 0x66, 0xF4, 0x38, 0xC1, 0xA4};
+    std::string rawData((const char *)address, sizeof(address));
+    rawData += (char)(tempCenti & 0xff);
+    rawData += (char)(tempCenti >> 8);
+    const char rest[] = {0x2E, 0x16, (char)0x86, 0x0B, 0x57};
+    rawData.append(rest, sizeof(rest));
+    rawData += (char)counter;
+    rawData += (char)0;
+
+    NimBLEAdvertisedDevice device;
+    device.fakeSetAddress(address);
+    device.fakeSetRSSI(rssi);
+    device.fakeAddServiceData(MiTagScanner::TARGET_UUID, rawData);
+    this->scanner.onResult(&device);
+    this->settle();
+  }
+
+  // Wait for the ingest task to store what the callback queued
+  void settle()
+  {
+    while (this->scanner.getIngestPending() > 0)
+    {
+      vTaskDelay(0);
+    }
+  }
+
+  // TAG_MAC as readers see it, once the snapshot has caught up
+  MiTagData tag()
+  {
+    while (!this->scanner.isSnapshotCurrent())
+    {
+      vTaskDelay(1);
+    }
+    MiTagData tagData = {};
+    const TagSnapshot *snapshot = this->scanner.acquireSnapshot();
+    for (int i = 0; i < snapshot->count; i++)
+    {
+      if (snapshot->tags[i].mac == TAG_MAC)
+      {
+        tagData = snapshot->tags[i];
+      }
+    }
+    this->scanner.releaseSnapshot(snapshot);
+    return tagData;
+  }
+
+  bool isTagDirty()
+  {
+    MiTagData tagData = this->tag();
+    return this->scanner.isTagDirty(&tagData);
+  }
+};
+
+TEST_F(TagDedupTest, CopiesOnlyRefreshLastSeen)
+{
+  hear(7, 2345);
+  ASSERT_EQ(TAG_MAC, tag().mac);
+  uint32_t revision = this->scanner.getRevision();
+  uint32_t heardTs = tag().ts;
+
+  halNativeAdvanceMillis(1000);
+  hear(7, 9999, -40);
+  EXPECT_EQ(2345, tag().tempCenti);
+  EXPECT_EQ(1u, tag().sampleSeq);
+  // No new revision, so readers keep the snapshot taken at the sample
+  EXPECT_EQ(revision, this->scanner.getRevision());
+  EXPECT_EQ(heardTs, tag().ts);
+  EXPECT_EQ(1u, this->scanner.getIngestStats().newSamples);
+  EXPECT_EQ(1u, this->scanner.getIngestStats().duplicates);
+
+  halNativeAdvanceMillis(1000);
+  hear(8, 2400);
+  EXPECT_EQ(2400, tag().tempCenti);
+  EXPECT_EQ(2u, tag().sampleSeq);
+  EXPECT_EQ(heardTs + 2000, tag().ts);
+  EXPECT_NE(revision, this->scanner.getRevision());
+  // The copy's RSSI was tracked in the store
+  EXPECT_EQ(-40, tagSignalMax(tag().signal));
+}
+
+TEST_F(TagDedupTest, LateCopyKeepsLastSeenAndSignal)
+{
+  uint32_t start = millis();
+  hear(4, 2345, -60);
+  halNativeAdvanceMillis(1000);
+  hear(5, 2350, -70);
+
+  // A copy of sample 5 queued before it but ingested after
+  halNativeSetMillis(start + 500);
+  hear(5, 2350, -40);
+  halNativeSetMillis(start + 1000);
+  EXPECT_EQ(1u, this->scanner.getIngestStats().duplicates);
+  EXPECT_EQ(start + 1000, tag().ts);
+  EXPECT_EQ(-70, tag().rssi);
+  EXPECT_EQ(-70, tagSignalMin(tag().signal));
+  EXPECT_EQ(-60, tagSignalMax(tag().signal));
+}
+
+TEST_F(TagDedupTest, WrappingCounterIsANewSample)
+{
+  hear(255, 2345);
+  hear(0, 2350);
+  EXPECT_EQ(2u, tag().sampleSeq);
+  EXPECT_EQ(2350, tag().tempCenti);
+  EXPECT_EQ(0u, this->scanner.getIngestStats().duplicates);
+}
+
+TEST_F(TagDedupTest, CounterRepeatedAfterTheWindowIsANewSample)
+{
+  hear(3, 2345);
+  halNativeAdvanceMillis(TAG_DUPLICATE_WINDOW + 1);
+  hear(3, 2360);
+  EXPECT_EQ(2u, tag().sampleSeq);
+  EXPECT_EQ(2360, tag().tempCenti);
+}
+
+TEST_F(TagDedupTest, DirtyUntilPublished)
+{
+  hear(1, 2345);
+  EXPECT_TRUE(this->isTagDirty());
+  this->scanner.markTagPublished(TAG_MAC, tag().sampleSeq);
+  EXPECT_FALSE(this->isTagDirty());
+
+  // A copy publishes nothing new, the next sample does
+  hear(1, 2345);
+  EXPECT_FALSE(this->isTagDirty());
+  hear(2, 2345);
+  EXPECT_TRUE(this->isTagDirty());
+}
+
+TEST_F(TagDedupTest, RejectedSampleIsNotCounted)
+{
+  this->scanner.setTagCapacity(1);
+  this->scanner.setEvictionPolicy(VSERVESAFE_EVICT_LRU_KEEP_NOTIFY);
+  hear(1, 2345);
+  MiTagNotifyData notifyData = {TAG_MAC, true, 200, 800};
+  this->scanner.addTagNotifyData(notifyData);
+  uint32_t revision = this->scanner.getRevision();
+
+  // Another tag cannot take the only, protected, slot
+  const uint8_t address[6] = {0x07, 0x66, 0xF4, 0x38, 0xC1, 0xA4};
+  std::string rawData((const char *)address, sizeof(address));
+  rawData.append(9, (char)1);
+  NimBLEAdvertisedDevice device;
+  device.fakeSetAddress(address);
+  device.fakeAddServiceData(MiTagScanner::TARGET_UUID, rawData);
+  this->scanner.onResult(&device);
+  this->settle();
+
+  EXPECT_EQ(1, this->scanner.getTagsCount());
+  EXPECT_EQ(1u, this->scanner.getIngestStats().newSamples);
+  EXPECT_EQ(1u, this->scanner.getEvictionStats().rejections);
+  EXPECT_EQ(revision, this->scanner.getRevision());
+}
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
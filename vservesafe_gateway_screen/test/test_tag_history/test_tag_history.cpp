@@ -0,0 +1,130 @@
+// Per-tag history rings: gaps, clamped deltas, replaced samples and reused
+// slots
+
+#include <gtest/gtest.h>
+
+#include "TagData.h"
+#include "TagHistory.h"
+
+static const mac_key_t TAG_MAC = 0xA4C138F46606ULL;
+
+class TagHistoryTest : public ::testing::Test
+{
+protected:
+  TagHistory history;
+  int slot = -1;
+  TagHistorySample samples[TAG_HISTORY_LENGTH];
+
+  void SetUp() override
+  {
+    ASSERT_TRUE(this->history.begin());
+  }
+
+  void append(uint32_t period, int16_t tempCenti, uint16_t humidCenti = 5000)
+  {
+    this->slot = this->history.append(this->slot, TAG_MAC, period * TAG_HISTORY_PERIOD, tempCenti, humidCenti);
+  }
+
+  int read(uint32_t fromPeriod, uint32_t toPeriod)
+  {
+    return this->history.read(this->slot, TAG_MAC, fromPeriod * TAG_HISTORY_PERIOD, toPeriod * TAG_HISTORY_PERIOD,
+                              this->samples, TAG_HISTORY_LENGTH);
+  }
+};
+
+TEST_F(TagHistoryTest, KeepsTenthsOfEachPeriod)
+{
+  append(10, 2345, 5678);
+  append(11, 1488, 6001);
+  ASSERT_EQ(2, read(0, 100));
+  EXPECT_EQ(10u * TAG_HISTORY_PERIOD, this->samples[0].ts);
+  EXPECT_EQ(2350, this->samples[0].tempCenti);
+  EXPECT_EQ(5680, this->samples[0].humidCenti);
+  EXPECT_EQ(11u * TAG_HISTORY_PERIOD, this->samples[1].ts);
+  EXPECT_EQ(1490, this->samples[1].tempCenti);
+  EXPECT_EQ(6000, this->samples[1].humidCenti);
+}
+
+TEST_F(TagHistoryTest, LaterSampleOfAPeriodReplacesTheFirst)
+{
+  append(10, 2000);
+  append(11, 2100);
+  append(11, 2300);
+  ASSERT_EQ(2, read(10, 11));
+  EXPECT_EQ(2000, this->samples[0].tempCenti);
+  EXPECT_EQ(2300, this->samples[1].tempCenti);
+}
+
+TEST_F(TagHistoryTest, ReadsAcrossGapPeriods)
+{
+  append(10, 2000);
+  append(13, 2100, TAG_HUMID_NONE);
+  append(14, 2200);
+  ASSERT_EQ(5, read(10, 14));
+  EXPECT_EQ(2000, this->samples[0].tempCenti);
+  EXPECT_EQ(TAG_TEMP_NONE, this->samples[1].tempCenti);
+  EXPECT_EQ(TAG_HUMID_NONE, this->samples[1].humidCenti);
+  EXPECT_EQ(TAG_TEMP_NONE, this->samples[2].tempCenti);
+  EXPECT_EQ(12u * TAG_HISTORY_PERIOD, this->samples[2].ts);
+  EXPECT_EQ(2100, this->samples[3].tempCenti);
+  // A field the sample did not carry is a gap on its own
+  EXPECT_EQ(TAG_HUMID_NONE, this->samples[3].humidCenti);
+  EXPECT_EQ(2200, this->samples[4].tempCenti);
+  EXPECT_EQ(5000, this->samples[4].humidCenti);
+
+  // A range that starts in a gap
+  ASSERT_EQ(3, read(12, 14));
+  EXPECT_EQ(TAG_TEMP_NONE, this->samples[0].tempCenti);
+  EXPECT_EQ(2100, this->samples[1].tempCenti);
+}
+
+TEST_F(TagHistoryTest, ClampedDeltaCatchesUp)
+{
+  append(10, 0);
+  append(11, 2000);
+  append(12, 2000);
+  ASSERT_EQ(3, read(10, 12));
+  EXPECT_EQ(0, this->samples[0].tempCenti);
+  // 20.0 degrees is more than one delta holds
+  EXPECT_EQ(1270, this->samples[1].tempCenti);
+  EXPECT_EQ(2000, this->samples[2].tempCenti);
+}
+
+TEST_F(TagHistoryTest, KeepsTheLastLengthPeriods)
+{
+  for (uint32_t period = 0; period < TAG_HISTORY_LENGTH + 10; period++)
+  {
+    append(period, 2000 + period * 10);
+  }
+  ASSERT_EQ(TAG_HISTORY_LENGTH, read(0, TAG_HISTORY_LENGTH + 9));
+  EXPECT_EQ(10u * TAG_HISTORY_PERIOD, this->samples[0].ts);
+  EXPECT_EQ(2100, this->samples[0].tempCenti);
+
+  // Silent for longer than the ring: only the new sample is left
+  append(3 * TAG_HISTORY_LENGTH, 1500);
+  ASSERT_EQ(1, read(0, 3 * TAG_HISTORY_LENGTH));
+  EXPECT_EQ(1500, this->samples[0].tempCenti);
+}
+
+TEST_F(TagHistoryTest, ReusedSlotReadsAsEmpty)
+{
+  append(0, 2000);
+  ASSERT_NE(-1, this->slot);
+  // Every other slot is empty, then this tag's has gone stale
+  for (int i = 1; i <= TAG_HISTORY_TAGS; i++)
+  {
+    this->history.append(-1, TAG_MAC + i, TAG_HISTORY_STALE * TAG_HISTORY_PERIOD, 2000, 5000);
+  }
+  EXPECT_EQ(0, read(0, TAG_HISTORY_STALE));
+
+  // The tag gets a new ring when it is heard again
+  append(TAG_HISTORY_STALE + 1, 2100);
+  ASSERT_EQ(1, read(0, TAG_HISTORY_STALE + 1));
+  EXPECT_EQ(2100, this->samples[0].tempCenti);
+}
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
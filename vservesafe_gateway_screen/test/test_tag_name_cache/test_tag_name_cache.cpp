@@ -0,0 +1,104 @@
+// Tag name pool: updates, replacement of the oldest slot and the stored form
+
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+#include "TagNameCache.h"
+
+static const mac_key_t SITE_MAC = 0xA4C138000000ULL;
+
+static const char *nameOf(const TagNameCache &names, mac_key_t mac)
+{
+  return names.nameAt(names.findSlot(mac), mac);
+}
+
+static std::string tagName(int i)
+{
+  return "ATC_" + std::to_string(i);
+}
+
+TEST(TagNameCache, SetReportsChanges)
+{
+  TagNameCache names;
+  ASSERT_TRUE(names.begin());
+  EXPECT_EQ(nullptr, nameOf(names, SITE_MAC));
+  EXPECT_TRUE(names.set(SITE_MAC, "ATC_F46606"));
+  EXPECT_FALSE(names.set(SITE_MAC, "ATC_F46606"));
+  EXPECT_FALSE(names.set(SITE_MAC, ""));
+  EXPECT_STREQ("ATC_F46606", nameOf(names, SITE_MAC));
+  EXPECT_TRUE(names.set(SITE_MAC, "Freezer 2"));
+  EXPECT_STREQ("Freezer 2", nameOf(names, SITE_MAC));
+  EXPECT_EQ(1, names.count());
+
+  // Longer names are cut to TAG_NAME_LENGTH
+  std::string longName(TAG_NAME_LENGTH + 8, 'x');
+  names.set(SITE_MAC, longName.c_str());
+  EXPECT_EQ((size_t)TAG_NAME_LENGTH, strlen(nameOf(names, SITE_MAC)));
+}
+
+TEST(TagNameCache, ReplacesOldestWhenFull)
+{
+  TagNameCache names;
+  ASSERT_TRUE(names.begin());
+  for (int i = 0; i < TAG_NAME_CACHE_SIZE + 2; i++)
+  {
+    names.set(SITE_MAC | (mac_key_t)i, tagName(i).c_str());
+  }
+  EXPECT_EQ(TAG_NAME_CACHE_SIZE, names.count());
+  EXPECT_EQ(nullptr, nameOf(names, SITE_MAC | 0));
+  EXPECT_EQ(nullptr, nameOf(names, SITE_MAC | 1));
+  for (int i = 2; i < TAG_NAME_CACHE_SIZE + 2; i++)
+  {
+    ASSERT_STREQ(tagName(i).c_str(), nameOf(names, SITE_MAC | (mac_key_t)i)) << i;
+  }
+}
+
+TEST(TagNameCache, ReusedSlotReadsAsUnnamed)
+{
+  TagNameCache names;
+  ASSERT_TRUE(names.begin());
+  names.set(SITE_MAC, "ATC_F46606");
+  int slot = names.findSlot(SITE_MAC);
+  ASSERT_NE(-1, slot);
+  for (int i = 1; i <= TAG_NAME_CACHE_SIZE; i++)
+  {
+    names.set(SITE_MAC | (mac_key_t)i, tagName(i).c_str());
+  }
+  // A tag still holding the old slot no longer gets the new owner's name
+  EXPECT_EQ(-1, names.findSlot(SITE_MAC));
+  EXPECT_EQ(nullptr, names.nameAt(slot, SITE_MAC));
+  EXPECT_EQ(nullptr, names.nameAt(-1, SITE_MAC));
+}
+
+TEST(TagNameCache, SerializeKeepsReplacementOrder)
+{
+  TagNameCache names;
+  ASSERT_TRUE(names.begin());
+  for (int i = 0; i < TAG_NAME_CACHE_SIZE + 5; i++)
+  {
+    names.set(SITE_MAC | (mac_key_t)i, tagName(i).c_str());
+  }
+  std::vector<uint8_t> stored(names.serializedSize());
+  size_t len = names.serialize(stored.data());
+
+  TagNameCache loaded;
+  ASSERT_TRUE(loaded.begin());
+  ASSERT_TRUE(loaded.deserialize(stored.data(), len));
+  EXPECT_EQ(TAG_NAME_CACHE_SIZE, loaded.count());
+
+  // The next new name replaces the oldest entry that survived the reload
+  loaded.set(SITE_MAC | 0xFFFF, "New");
+  EXPECT_EQ(nullptr, nameOf(loaded, SITE_MAC | 5));
+  EXPECT_STREQ(tagName(6).c_str(), nameOf(loaded, SITE_MAC | 6));
+
+  EXPECT_FALSE(loaded.deserialize(stored.data(), 4));
+  stored[0] ^= 0xFF;
+  EXPECT_FALSE(loaded.deserialize(stored.data(), len));
+}
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
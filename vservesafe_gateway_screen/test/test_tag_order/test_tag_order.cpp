@@ -0,0 +1,96 @@
+// Home-screen order of snapshot records
+
+#include <gtest/gtest.h>
+#include <vector>
+
+#include "BLE.h"
+#include "TagOrder.h"
+
+static MiTagData makeTag(int i, bool online, uint8_t notifyResult, int8_t rssi)
+{
+  MiTagData tagData = MiTagData();
+  tagData.mac = 0xA4C138020000ULL + i;
+  tagData.online = online;
+  tagData.notifyResult = notifyResult;
+  resetTagSignal(tagData.signal, rssi, 0);
+  return tagData;
+}
+
+class TagOrderTest : public ::testing::Test
+{
+protected:
+  // Never destroyed, like the gateway's
+  MiTagScanner &scanner;
+  std::vector<MiTagData> tags;
+
+  TagOrderTest() : scanner(*new MiTagScanner())
+  {
+  }
+
+  std::vector<int> order(coldsenses_scan_mode scanMode)
+  {
+    TagSnapshot snapshot = {1, (int)this->tags.size(), 0, this->tags.data(), (int)this->tags.size()};
+    std::vector<MiTagData *> ordered(this->tags.size());
+    EXPECT_EQ((int)this->tags.size(), orderTagsForHome(this->scanner, &snapshot, scanMode, ordered.data()));
+    std::vector<int> indexes;
+    for (size_t i = 0; i < ordered.size(); i++)
+    {
+      indexes.push_back(ordered[i] - this->tags.data());
+    }
+    return indexes;
+  }
+};
+
+TEST_F(TagOrderTest, NotifyThenOnlineThenSignal)
+{
+  this->tags.push_back(makeTag(0, false, VSERVESAFE_NOTIFY_NODATA, -40));
+  this->tags.push_back(makeTag(1, true, VSERVESAFE_NOTIFY_NODATA, -70));
+  this->tags.push_back(makeTag(2, true, VSERVESAFE_NOTIFY_HIGH, -90));
+  this->tags.push_back(makeTag(3, false, VSERVESAFE_NOTIFY_NORMAL, -30));
+  this->tags.push_back(makeTag(4, true, VSERVESAFE_NOTIFY_NODATA, -50));
+  this->tags.push_back(makeTag(5, true, VSERVESAFE_NOTIFY_LOW, -60));
+
+  EXPECT_EQ(std::vector<int>({5, 2, 3, 4, 1, 0}), this->order(VSERVESAFE_SCANMODE_SELECTED_SCAN));
+  // Notify data only counts in the selected scan
+  EXPECT_EQ(std::vector<int>({4, 5, 1, 2, 3, 0}), this->order(VSERVESAFE_SCANMODE_ALLSCAN));
+}
+
+TEST_F(TagOrderTest, EqualKeysKeepTableOrder)
+{
+  for (int i = 0; i < 4; i++)
+  {
+    this->tags.push_back(makeTag(i, true, VSERVESAFE_NOTIFY_NODATA, -60));
+  }
+  // Beyond the range of RSSI buckets
+  this->tags.push_back(makeTag(4, true, VSERVESAFE_NOTIFY_NODATA, -128));
+  this->tags.push_back(makeTag(5, true, VSERVESAFE_NOTIFY_NODATA, -127));
+  EXPECT_EQ(std::vector<int>({0, 1, 2, 3, 4, 5}), this->order(VSERVESAFE_SCANMODE_ALLSCAN));
+}
+
+TEST_F(TagOrderTest, LargeTableIsSorted)
+{
+  for (int i = 0; i < 1000; i++)
+  {
+    this->tags.push_back(makeTag(i, i % 7 != 0, i % 3 == 0 ? VSERVESAFE_NOTIFY_NODATA : VSERVESAFE_NOTIFY_NORMAL + i % 3,
+                                 -40 - (i * 37) % 60));
+  }
+  std::vector<int> ordered = this->order(VSERVESAFE_SCANMODE_SELECTED_SCAN);
+  for (size_t i = 1; i < ordered.size(); i++)
+  {
+    MiTagData &prev = this->tags[ordered[i - 1]];
+    MiTagData &next = this->tags[ordered[i]];
+    int prevGroup = (prev.notifyResult == VSERVESAFE_NOTIFY_NODATA) * 2 + !prev.online;
+    int nextGroup = (next.notifyResult == VSERVESAFE_NOTIFY_NODATA) * 2 + !next.online;
+    ASSERT_LE(prevGroup, nextGroup) << i;
+    if (prevGroup == nextGroup)
+    {
+      ASSERT_GE(tagSignalRssi(prev.signal), tagSignalRssi(next.signal)) << i;
+    }
+  }
+}
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,49 @@
+// MQTT topic and payload text of a tag record
+
+#include <gtest/gtest.h>
+#include "TagPayload.h"
+
+static MiTagData makeTag(int16_t tempCenti, uint16_t humidCenti)
+{
+  MiTagData tagData;
+  tagData.mac = 0xA4C138F46606ULL;
+  tagData.ts = 0;
+  tagData.tempCenti = tempCenti;
+  tagData.humidCenti = humidCenti;
+  tagData.battMv = 2950;
+  tagData.battPercent = 87;
+  tagData.counter = 0;
+  tagData.flag = 0;
+  resetTagSignal(tagData.signal, -67, 0);
+  return tagData;
+}
+
+TEST(TagPayload, TopicFromMac)
+{
+  MiTagData tagData = makeTag(2345, 5678);
+  EXPECT_STREQ("A4C138F46606", tagMacAddressKey(tagData).c_str());
+  EXPECT_STREQ("push_A4C138F46606", buildTagTopic(tagData).c_str());
+}
+
+TEST(TagPayload, Readings)
+{
+  MiTagData tagData = makeTag(2345, 5678);
+  EXPECT_STREQ("temp:23.45,humid:56.78,rssi:-67,rssimin:-67,rssimax:-67", buildTagPayload(tagData).c_str());
+  tagData = makeTag(-520, 10000);
+  EXPECT_STREQ("temp:-5.20,humid:100.00,rssi:-67,rssimin:-67,rssimax:-67", buildTagPayload(tagData).c_str());
+  // The sign survives a zero integer part
+  tagData = makeTag(-5, 0);
+  EXPECT_STREQ("temp:-0.05,humid:0.00,rssi:-67,rssimin:-67,rssimax:-67", buildTagPayload(tagData).c_str());
+}
+
+TEST(TagPayload, MissingReadings)
+{
+  MiTagData tagData = makeTag(TAG_TEMP_NONE, TAG_HUMID_NONE);
+  EXPECT_STREQ("temp:-,humid:-,rssi:-67,rssimin:-67,rssimax:-67", buildTagPayload(tagData).c_str());
+}
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,144 @@
+// Presence wheel and the tag store's online/offline transitions
+
+#include <gtest/gtest.h>
+
+#include "TagPresence.h"
+#include "TagStore.h"
+
+static const mac_key_t BASE_MAC = 0xA4C138000000ULL;
+
+class TagPresenceTest : public ::testing::Test
+{
+protected:
+  TagStore store;
+  int online = 0;
+  int offline = 0;
+
+  static void countPresence(void *context, MiTagData *tagData, bool isOnline)
+  {
+    TagPresenceTest *test = (TagPresenceTest *)context;
+    (isOnline ? test->online : test->offline) += 1;
+    EXPECT_EQ(isOnline, tagData->online);
+  }
+
+  void SetUp() override
+  {
+    ASSERT_TRUE(this->store.begin(64));
+    this->store.setPresenceCallback(countPresence, this);
+  }
+
+  int hear(int i, uint32_t ts)
+  {
+    MiTagData tagData = MiTagData();
+    tagData.mac = BASE_MAC + i;
+    tagData.ts = ts;
+    return this->store.upsert(tagData);
+  }
+};
+
+TEST_F(TagPresenceTest, ReArmedSlotFiresOnce)
+{
+  const uint32_t start = 1000;
+  int slot = hear(0, start);
+  EXPECT_EQ(1, this->online);
+  // Heard again before the timeout: no event now, and the first expiry
+  // re-arms the slot instead of taking the tag offline
+  hear(0, start + TAG_ONLINE_TIEMOUT / 2);
+  EXPECT_EQ(1, this->online);
+  this->store.expirePresence(start + TAG_ONLINE_TIEMOUT + TAG_PRESENCE_TICK);
+  EXPECT_EQ(0, this->offline);
+  EXPECT_TRUE(this->store.at(slot)->online);
+  EXPECT_EQ(1, this->store.onlineCount());
+
+  uint32_t expiry = start + TAG_ONLINE_TIEMOUT / 2 + TAG_ONLINE_TIEMOUT;
+  this->store.expirePresence(expiry + TAG_PRESENCE_TICK);
+  EXPECT_EQ(1, this->offline);
+  EXPECT_FALSE(this->store.at(slot)->online);
+  EXPECT_EQ(0, this->store.onlineCount());
+  this->store.expirePresence(expiry + 10 * TAG_ONLINE_TIEMOUT);
+  EXPECT_EQ(1, this->offline);
+}
+
+TEST_F(TagPresenceTest, ComesBackAfterAGapLongerThanTheTimeout)
+{
+  const uint32_t start = 1000;
+  hear(0, start);
+  // Longer than a turn of the wheel, in one step
+  uint32_t back = start + 3 * TAG_ONLINE_TIEMOUT;
+  this->store.expirePresence(back);
+  EXPECT_EQ(1, this->offline);
+  int slot = hear(0, back);
+  EXPECT_EQ(2, this->online);
+  EXPECT_TRUE(this->store.at(slot)->online);
+  EXPECT_EQ(1, this->store.onlineCount());
+  this->store.expirePresence(back + TAG_ONLINE_TIEMOUT + TAG_PRESENCE_TICK);
+  EXPECT_EQ(2, this->offline);
+}
+
+TEST_F(TagPresenceTest, ExpiresAcrossMillisWrap)
+{
+  const uint32_t start = UINT32_MAX - TAG_ONLINE_TIEMOUT / 2;
+  hear(0, start);
+  this->store.expirePresence(start + TAG_ONLINE_TIEMOUT / 2);
+  EXPECT_EQ(0, this->offline);
+  this->store.expirePresence(start + TAG_ONLINE_TIEMOUT + TAG_PRESENCE_TICK);
+  EXPECT_EQ(1, this->offline);
+}
+
+TEST_F(TagPresenceTest, LeavingTheTableGoesOffline)
+{
+  ASSERT_TRUE(this->store.setCapacity(2));
+  hear(0, 1000);
+  hear(1, 2000);
+  hear(2, 3000);
+  EXPECT_EQ(3, this->online);
+  EXPECT_EQ(1, this->offline);
+  EXPECT_EQ(2, this->store.onlineCount());
+
+  // The surviving tag keeps its timer after moving slots
+  ASSERT_TRUE(this->store.setCapacity(1));
+  EXPECT_EQ(2, this->offline);
+  EXPECT_EQ(1, this->store.onlineCount());
+  this->store.expirePresence(3000 + TAG_ONLINE_TIEMOUT + TAG_PRESENCE_TICK);
+  EXPECT_EQ(3, this->offline);
+
+  hear(3, 5000);
+  this->store.clear();
+  EXPECT_EQ(3, this->offline);
+  EXPECT_EQ(0, this->store.onlineCount());
+}
+
+// Ten minutes at one step a second: every tag is heard every 5 s and one in
+// ten falls silent after two minutes. The wheel must agree with polling every
+// record's ts at every step.
+TEST_F(TagPresenceTest, MatchesPollingEveryRecord)
+{
+  const int nTags = 60;
+  const uint32_t start = 1000;
+  for (int step = 0; step < 600; step++)
+  {
+    uint32_t now = start + step * 1000;
+    for (int i = step % 5; i < nTags; i += 5)
+    {
+      if (i % 10 != 0 || step < 120)
+      {
+        hear(i, now);
+      }
+    }
+    this->store.expirePresence(now);
+    int active = 0;
+    for (int slot = 0; slot < this->store.count(); slot++)
+    {
+      active += now - this->store.at(slot)->ts <= TAG_ONLINE_TIEMOUT;
+    }
+    ASSERT_EQ(active, this->store.onlineCount()) << "step " << step;
+  }
+  EXPECT_EQ(nTags, this->online);
+  EXPECT_EQ(nTags / 10, this->offline);
+}
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
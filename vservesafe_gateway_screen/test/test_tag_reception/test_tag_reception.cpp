@@ -0,0 +1,102 @@
+// Advert loss and inter-arrival time estimated from frame counter gaps
+
+#include <gtest/gtest.h>
+
+#include "TagReception.h"
+#include "vservesafe_conf.h"
+
+TEST(TagReception, NoLossWhileEveryCounterArrives)
+{
+  TagReceptionStats stats;
+  resetTagReception(stats, 1000);
+  EXPECT_EQ(1u, stats.received);
+  for (int i = 1; i <= 10; i++)
+  {
+    trackTagReception(stats, i - 1, i, 1000 + i * 2500);
+  }
+  EXPECT_EQ(11u, stats.received);
+  EXPECT_EQ(10u, stats.expected);
+  EXPECT_EQ(0u, stats.missed);
+  EXPECT_EQ(0.0, tagReceptionLossPercent(stats));
+  EXPECT_EQ(2500u, stats.intervalMs);
+  EXPECT_EQ(10, stats.interArrival[tagReceptionBucket(2500)]);
+}
+
+TEST(TagReception, CounterGapCountsMissedSamples)
+{
+  TagReceptionStats stats;
+  resetTagReception(stats, 0);
+  trackTagReception(stats, 10, 11, 2000);
+  // 12 and 13 were not heard
+  trackTagReception(stats, 11, 14, 8000);
+  EXPECT_EQ(4u, stats.expected);
+  EXPECT_EQ(2u, stats.missed);
+  EXPECT_DOUBLE_EQ(50.0, tagReceptionLossPercent(stats));
+  // Gaps are spread over the steps they cover
+  EXPECT_EQ(2000u, stats.intervalMs);
+}
+
+TEST(TagReception, CounterThatWraps)
+{
+  TagReceptionStats stats;
+  resetTagReception(stats, 0);
+  trackTagReception(stats, 254, 1, 6000);
+  EXPECT_EQ(3u, stats.expected);
+  EXPECT_EQ(2u, stats.missed);
+}
+
+TEST(TagReception, GapLongerThanOnlineTimeoutIsNotCounted)
+{
+  TagReceptionStats stats;
+  resetTagReception(stats, 0);
+  trackTagReception(stats, 0, 1, 2000);
+  // The counter may have wrapped unseen while the tag was away
+  trackTagReception(stats, 1, 5, 2000 + TAG_ONLINE_TIEMOUT + 1);
+  EXPECT_EQ(3u, stats.received);
+  EXPECT_EQ(1u, stats.expected);
+  EXPECT_EQ(0u, stats.missed);
+  EXPECT_EQ(2000 + TAG_ONLINE_TIEMOUT + 1, stats.lastSampleTs);
+
+  // Counting resumes from the sample after the gap
+  trackTagReception(stats, 5, 7, 2000 + TAG_ONLINE_TIEMOUT + 4001);
+  EXPECT_EQ(3u, stats.expected);
+  EXPECT_EQ(1u, stats.missed);
+}
+
+TEST(TagReception, RepeatedCounterSaysNothingAboutTheGap)
+{
+  TagReceptionStats stats;
+  resetTagReception(stats, 0);
+  trackTagReception(stats, 9, 9, 40000);
+  EXPECT_EQ(2u, stats.received);
+  EXPECT_EQ(0u, stats.expected);
+  EXPECT_EQ(0u, stats.intervalMs);
+}
+
+TEST(TagReception, IntervalIsSmoothed)
+{
+  TagReceptionStats stats;
+  resetTagReception(stats, 0);
+  trackTagReception(stats, 0, 1, 1000);
+  trackTagReception(stats, 1, 2, 1000 + 9000);
+  // 1000 + (9000 - 1000) / 8
+  EXPECT_EQ(2000u, stats.intervalMs);
+}
+
+TEST(TagReception, Buckets)
+{
+  EXPECT_EQ(0, tagReceptionBucket(0));
+  EXPECT_EQ(0, tagReceptionBucket(999));
+  EXPECT_EQ(1, tagReceptionBucket(1000));
+  EXPECT_EQ(1, tagReceptionBucket(1999));
+  EXPECT_EQ(2, tagReceptionBucket(2000));
+  EXPECT_EQ(6, tagReceptionBucket(63999));
+  EXPECT_EQ(TAG_RECEPTION_BUCKETS - 1, tagReceptionBucket(64000));
+  EXPECT_EQ(TAG_RECEPTION_BUCKETS - 1, tagReceptionBucket(UINT32_MAX));
+}
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
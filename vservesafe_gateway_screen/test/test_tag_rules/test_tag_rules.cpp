@@ -0,0 +1,205 @@
+// Rule expressions: compile errors, evaluation and the per-variable dispatch
+// of TagRuleSet
+
+#include <gtest/gtest.h>
+#include <string.h>
+
+#include "TagRules.h"
+
+static bool compile(const char *text, TagRuleProgram &program)
+{
+  return compileTagRule(text, strlen(text), program);
+}
+
+// Values as TagRuleSet loads them, in hundredths
+static bool eval(const char *text, int32_t temp, int32_t humid, tag_rule_inputs_t valid = TAG_RULE_INPUTS_ALL)
+{
+  TagRuleProgram program;
+  EXPECT_TRUE(compile(text, program)) << text;
+  int32_t values[VSERVESAFE_RULE_VAR_COUNT] = {};
+  values[VSERVESAFE_RULE_VAR_TEMP] = temp;
+  values[VSERVESAFE_RULE_VAR_HUMID] = humid;
+  return evalTagRule(program, values, valid);
+}
+
+static void countEdges(void *context, MiTagData *tagData, int rule, bool isActive)
+{
+  ((int *)context)[isActive ? 0 : 1] += 1;
+}
+
+static MiTagData makeTag(mac_key_t mac, int16_t tempCenti, uint16_t humidCenti)
+{
+  MiTagData tagData;
+  memset(&tagData, 0, sizeof(tagData));
+  tagData.mac = mac;
+  tagData.tempCenti = tempCenti;
+  tagData.humidCenti = humidCenti;
+  tagData.rateCenti = TAG_RATE_NONE;
+  return tagData;
+}
+
+TEST(TagRules, CompileErrors)
+{
+  TagRuleProgram program;
+  EXPECT_FALSE(compile("", program));
+  EXPECT_FALSE(compile("temp >", program));
+  EXPECT_FALSE(compile("(temp > 5", program));
+  EXPECT_FALSE(compile("temp > 5)", program));
+  EXPECT_FALSE(compile("pressure > 5", program));
+  EXPECT_FALSE(compile("temp > 5.123", program));
+  EXPECT_FALSE(compile("temp >> 5", program));
+  EXPECT_TRUE(compile("humid > 85 && temp > 5", program));
+  EXPECT_EQ((1 << VSERVESAFE_RULE_VAR_TEMP) | (1 << VSERVESAFE_RULE_VAR_HUMID), program.inputs);
+}
+
+TEST(TagRules, Comparisons)
+{
+  EXPECT_TRUE(eval("temp > 5", 501, 0));
+  EXPECT_FALSE(eval("temp > 5", 500, 0));
+  EXPECT_TRUE(eval("temp >= 5", 500, 0));
+  EXPECT_TRUE(eval("temp < -2.5", -251, 0));
+  EXPECT_TRUE(eval("temp == 4.25", 425, 0));
+  EXPECT_TRUE(eval("temp != 4.25", 424, 0));
+}
+
+TEST(TagRules, ArithmeticAndLogic)
+{
+  EXPECT_TRUE(eval("humid > 85 && temp > 5", 600, 8600));
+  EXPECT_FALSE(eval("humid > 85 && temp > 5", 400, 8600));
+  EXPECT_TRUE(eval("humid > 85 || temp > 5", 400, 8600));
+  EXPECT_TRUE(eval("!(temp > 5)", 400, 0));
+  EXPECT_TRUE(eval("(temp + 1) * 2 == 10", 400, 0));
+  EXPECT_TRUE(eval("temp - humid / 10 < 0", 400, 5000));
+  EXPECT_TRUE(eval("-temp > 0", -100, 0));
+  // Precedence: * before +, comparison before &&
+  EXPECT_TRUE(eval("1 + 2 * 3 == 7 && temp > 0", 1, 0));
+}
+
+TEST(TagRules, MissingValueOrDivisionByZeroDoesNotHold)
+{
+  EXPECT_FALSE(eval("humid > 50", 0, 9000, 1 << VSERVESAFE_RULE_VAR_TEMP));
+  EXPECT_FALSE(eval("humid / temp > 1", 0, 9000));
+  EXPECT_FALSE(eval("!(humid / temp > 1)", 0, 9000));
+}
+
+TEST(TagRules, SetDispatchesOnChangedInputs)
+{
+  TagRuleSet rules;
+  TagRuleProgram humid;
+  TagRuleProgram temp;
+  ASSERT_TRUE(compile("humid > 80", humid));
+  ASSERT_TRUE(compile("temp > 5", temp));
+  const mac_key_t mac = 0xA4C138F46606ULL;
+  int humidRule = rules.set("humid", MAC_KEY_EMPTY, humid);
+  int tempRule = rules.set("door", mac, temp);
+  ASSERT_NE(-1, humidRule);
+  ASSERT_NE(-1, tempRule);
+  EXPECT_EQ(2, rules.count());
+
+  EXPECT_EQ(1u << humidRule, rules.affected(mac + 1, 1 << VSERVESAFE_RULE_VAR_HUMID));
+  EXPECT_EQ(0u, rules.affected(mac + 1, 1 << VSERVESAFE_RULE_VAR_TEMP));
+  EXPECT_EQ(1u << tempRule, rules.affected(mac, 1 << VSERVESAFE_RULE_VAR_TEMP));
+  EXPECT_EQ((1u << humidRule) | (1u << tempRule), rules.affected(mac, TAG_RULE_INPUTS_ALL));
+
+  // Edges only when a rule starts or stops holding
+  int edges[2] = {0, 0};
+  MiTagData tagData = makeTag(mac, 600, 8500);
+  EXPECT_EQ(2, rules.evaluate(tagData, TAG_RULE_INPUTS_ALL, 0, countEdges, edges));
+  EXPECT_EQ(2, edges[0]);
+  EXPECT_EQ((1u << humidRule) | (1u << tempRule), tagData.ruleActive);
+  rules.evaluate(tagData, TAG_RULE_INPUTS_ALL, 0, countEdges, edges);
+  EXPECT_EQ(2, edges[0]);
+  tagData.tempCenti = 400;
+  EXPECT_EQ(1, rules.evaluate(tagData, 1 << VSERVESAFE_RULE_VAR_TEMP, 0, countEdges, edges));
+  EXPECT_EQ(1, edges[1]);
+  EXPECT_EQ(1u << humidRule, tagData.ruleActive);
+
+  // Removing a rule that holds stops it
+  EXPECT_EQ(humidRule, rules.remove("humid"));
+  rules.evaluateRule(tagData, humidRule, 0, countEdges, edges);
+  EXPECT_EQ(2, edges[1]);
+  EXPECT_EQ(0u, tagData.ruleActive);
+  EXPECT_EQ(-1, rules.remove("humid"));
+}
+
+TEST(TagRules, ReplacingKeepsTheName)
+{
+  TagRuleSet rules;
+  TagRuleProgram program;
+  ASSERT_TRUE(compile("temp > 5", program));
+  int rule = rules.set("cold", MAC_KEY_EMPTY, program);
+  ASSERT_TRUE(compile("temp < 0", program));
+  EXPECT_EQ(rule, rules.set("cold", MAC_KEY_EMPTY, program));
+  EXPECT_EQ(1, rules.count());
+  EXPECT_STREQ("cold", rules.name(rule));
+}
+
+TEST(TagRules, SetIsBounded)
+{
+  TagRuleSet rules;
+  TagRuleProgram program;
+  ASSERT_TRUE(compile("temp > 5", program));
+  char name[8];
+  for (int i = 0; i < MAX_TAG_RULES; i++)
+  {
+    snprintf(name, sizeof(name), "r%d", i);
+    ASSERT_NE(-1, rules.set(name, MAC_KEY_EMPTY, program));
+  }
+  EXPECT_EQ(-1, rules.set("extra", MAC_KEY_EMPTY, program));
+  rules.clear();
+  EXPECT_EQ(0, rules.count());
+  EXPECT_EQ(0u, rules.usedMask());
+}
+
+TEST(TagRules, ChangedInputsMatchRunningEveryRule)
+{
+  // One value per sample, as MiBeacon sends them
+  const char *const texts[] = {"temp >= 8 || temp <= 2", "humid > 85 && temp > 5", "batt < 2500"};
+  TagRuleSet rules;
+  for (int r = 0; r < 3; r++)
+  {
+    TagRuleProgram program;
+    ASSERT_TRUE(compile(texts[r], program));
+    char name[8];
+    snprintf(name, sizeof(name), "r%d", r);
+    rules.set(name, MAC_KEY_EMPTY, program);
+  }
+  MiTagData picked = makeTag(0xA4C138F46606ULL, TAG_TEMP_NONE, TAG_HUMID_NONE);
+  MiTagData every = picked;
+  int pickedEdges[2] = {0, 0};
+  int everyEdges[2] = {0, 0};
+  for (int i = 0; i < 300; i++)
+  {
+    tag_rule_inputs_t changed;
+    switch (i % 3)
+    {
+    case 0:
+      picked.tempCenti = (int16_t)(100 + i * 37 % 900);
+      changed = 1 << VSERVESAFE_RULE_VAR_TEMP;
+      break;
+    case 1:
+      picked.humidCenti = (uint16_t)(8000 + i * 53 % 1000);
+      changed = 1 << VSERVESAFE_RULE_VAR_HUMID;
+      break;
+    default:
+      picked.battMv = (uint16_t)(2400 + i * 11 % 300);
+      changed = 1 << VSERVESAFE_RULE_VAR_BATT;
+      break;
+    }
+    uint32_t ruleActive = every.ruleActive;
+    every = picked;
+    every.ruleActive = ruleActive;
+    EXPECT_GE(3, rules.evaluate(picked, changed, 0, countEdges, pickedEdges));
+    rules.evaluate(every, TAG_RULE_INPUTS_ALL, 0, countEdges, everyEdges);
+    ASSERT_EQ(every.ruleActive, picked.ruleActive) << "sample " << i;
+  }
+  EXPECT_EQ(everyEdges[0], pickedEdges[0]);
+  EXPECT_EQ(everyEdges[1], pickedEdges[1]);
+  EXPECT_GT(pickedEdges[0], 10);
+}
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,85 @@
+// Smoothed RSSI and the two-window min/max of a tag's signal
+
+#include <gtest/gtest.h>
+
+#include "TagSignal.h"
+#include "vservesafe_conf.h"
+
+TEST(TagSignal, ResetStartsFromTheFirstAdvert)
+{
+  TagSignalStats stats;
+  resetTagSignal(stats, -70, 1000);
+  EXPECT_EQ(-70, tagSignalRssi(stats));
+  EXPECT_EQ(-70, tagSignalMin(stats));
+  EXPECT_EQ(-70, tagSignalMax(stats));
+}
+
+TEST(TagSignal, EwmaMovesAnEighthOfTheWay)
+{
+  TagSignalStats stats;
+  resetTagSignal(stats, -80, 0);
+  trackTagSignal(stats, -40, 100);
+  // -80 + 40 / 8
+  EXPECT_EQ(-75, tagSignalRssi(stats));
+
+  // Converges on a steady signal
+  for (int i = 0; i < 100; i++)
+  {
+    trackTagSignal(stats, -40, 200 + i);
+  }
+  EXPECT_EQ(-40, tagSignalRssi(stats));
+}
+
+TEST(TagSignal, RoundsToWholeDbm)
+{
+  TagSignalStats stats;
+  stats.rssiEwma = -60 * 16 - 8;
+  EXPECT_EQ(-61, tagSignalRssi(stats));
+  stats.rssiEwma = -60 * 16 - 7;
+  EXPECT_EQ(-60, tagSignalRssi(stats));
+}
+
+TEST(TagSignal, MinMaxSpanCurrentAndPreviousWindow)
+{
+  TagSignalStats stats;
+  resetTagSignal(stats, -60, 0);
+  trackTagSignal(stats, -90, 1000);
+  trackTagSignal(stats, -50, 2000);
+  EXPECT_EQ(-90, tagSignalMin(stats));
+  EXPECT_EQ(-50, tagSignalMax(stats));
+
+  // The next window still reports the previous one's range
+  trackTagSignal(stats, -70, TAG_SIGNAL_WINDOW + 1);
+  EXPECT_EQ(-90, tagSignalMin(stats));
+  EXPECT_EQ(-50, tagSignalMax(stats));
+
+  // Two windows on, it has rolled out
+  trackTagSignal(stats, -65, 2 * TAG_SIGNAL_WINDOW + 2);
+  EXPECT_EQ(-70, tagSignalMin(stats));
+  EXPECT_EQ(-65, tagSignalMax(stats));
+}
+
+TEST(TagSignal, SilenceOfTwoWindowsDropsTheOldRange)
+{
+  TagSignalStats stats;
+  resetTagSignal(stats, -95, 0);
+  trackTagSignal(stats, -45, 1000);
+  trackTagSignal(stats, -70, 1000 + 2 * TAG_SIGNAL_WINDOW);
+  EXPECT_EQ(-70, tagSignalMin(stats));
+  EXPECT_EQ(-70, tagSignalMax(stats));
+}
+
+TEST(TagSignal, WindowSurvivesMillisWrap)
+{
+  TagSignalStats stats;
+  resetTagSignal(stats, -60, UINT32_MAX - 500);
+  trackTagSignal(stats, -80, 500);
+  EXPECT_EQ(-80, tagSignalMin(stats));
+  EXPECT_EQ(-60, tagSignalMax(stats));
+}
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,223 @@
+// MAC index, recency list and tag store: lookups, slot moves on removal and
+// eviction
+
+#include <gtest/gtest.h>
+
+#include "BLE.h"
+#include "MacIndex.h"
+#include "TagRecency.h"
+#include "TagStore.h"
+
+static const mac_key_t BASE_MAC = 0xA4C138000000ULL;
+
+static MiTagData makeTag(mac_key_t mac, uint32_t ts, int8_t rssi)
+{
+  MiTagData tagData = MiTagData();
+  tagData.mac = mac;
+  tagData.ts = ts;
+  tagData.rssi = rssi;
+  resetTagSignal(tagData.signal, rssi, ts);
+  return tagData;
+}
+
+static bool isProtected(void *context, mac_key_t mac)
+{
+  return mac < *(mac_key_t *)context;
+}
+
+TEST(MacIndex, KeyFromText)
+{
+  EXPECT_EQ(0xA4C138F46606ULL, MiTagScanner::toMacKey("A4:C1:38:F4:66:06"));
+  EXPECT_EQ(0xA4C138F46606ULL, MiTagScanner::toMacKey("a4c138f46606"));
+}
+
+TEST(MacIndex, InsertFindEraseToCapacity)
+{
+  static MacIndex<1024> index;
+  for (int i = 0; i < 1024; i++)
+  {
+    ASSERT_TRUE(index.insert(BASE_MAC + i * 7919, i));
+  }
+  EXPECT_FALSE(index.insert(BASE_MAC - 1, 0));
+  EXPECT_EQ(1024u, index.count());
+
+  // Erasing by backward shift must keep every other key reachable
+  for (int i = 0; i < 1024; i += 2)
+  {
+    ASSERT_TRUE(index.erase(BASE_MAC + i * 7919));
+  }
+  EXPECT_FALSE(index.erase(BASE_MAC));
+  for (int i = 0; i < 1024; i++)
+  {
+    EXPECT_EQ(i % 2 ? i : -1, index.find(BASE_MAC + i * 7919));
+  }
+
+  // Inserting a present key updates its value
+  EXPECT_TRUE(index.insert(BASE_MAC + 7919, 5));
+  EXPECT_EQ(5, index.find(BASE_MAC + 7919));
+  EXPECT_EQ(512u, index.count());
+}
+
+TEST(TagRecencyList, TouchMovesToNewest)
+{
+  TagRecencyList recency;
+  ASSERT_TRUE(recency.begin(4));
+  EXPECT_EQ(-1, recency.oldest());
+  for (int slot = 0; slot < 4; slot++)
+  {
+    recency.pushNewest(slot);
+  }
+  recency.touch(0);
+  recency.unlink(2);
+  recency.moveSlot(3, 2);
+
+  int order[] = {1, 2, 0};
+  int slot = recency.oldest();
+  for (int i = 0; i < 3; i++)
+  {
+    ASSERT_EQ(order[i], slot);
+    slot = recency.newerThan(slot);
+  }
+  EXPECT_EQ(-1, slot);
+}
+
+TEST(TagStore, UpsertFindAndUpdate)
+{
+  TagStore store;
+  ASSERT_TRUE(store.begin(100));
+  for (int i = 0; i < 100; i++)
+  {
+    MiTagData tagData = makeTag(BASE_MAC + i, 1000, -60);
+    tagData.tempCenti = i;
+    ASSERT_EQ(i, store.upsert(tagData));
+  }
+  EXPECT_EQ(100, store.count());
+  for (int i = 0; i < 100; i++)
+  {
+    int slot = store.find(BASE_MAC + i);
+    ASSERT_NE(-1, slot);
+    EXPECT_EQ(i, store.at(slot)->tempCenti);
+  }
+  EXPECT_EQ(-1, store.find(BASE_MAC + 100));
+
+  MiTagData tagData = makeTag(BASE_MAC + 42, 2000, -60);
+  tagData.tempCenti = -42;
+  EXPECT_EQ(42, store.upsert(tagData));
+  EXPECT_EQ(100, store.count());
+  EXPECT_EQ(-42, store.at(42)->tempCenti);
+}
+
+TEST(TagStore, EvictsLeastRecentlyHeard)
+{
+  TagStore store;
+  ASSERT_TRUE(store.begin(4));
+  store.setEvictionPolicy(VSERVESAFE_EVICT_LRU);
+  for (int i = 0; i < 4; i++)
+  {
+    MiTagData tagData = makeTag(BASE_MAC + i, 1000 + i, -60);
+    store.upsert(tagData);
+  }
+  // Hear tag 0 again, so tag 1 is now the oldest
+  MiTagData tagData = makeTag(BASE_MAC, 2000, -60);
+  store.upsert(tagData);
+
+  tagData = makeTag(BASE_MAC + 4, 2001, -60);
+  ASSERT_NE(-1, store.upsert(tagData));
+  EXPECT_EQ(4, store.count());
+  EXPECT_EQ(-1, store.find(BASE_MAC + 1));
+  EXPECT_NE(-1, store.find(BASE_MAC));
+  EXPECT_NE(-1, store.find(BASE_MAC + 4));
+  EXPECT_EQ(1u, store.getEvictionStats().evictions);
+
+  // Coming back is counted as a readmission
+  tagData = makeTag(BASE_MAC + 1, 2002, -60);
+  store.upsert(tagData);
+  EXPECT_EQ(1u, store.getEvictionStats().readmissions);
+}
+
+TEST(TagStore, EvictsWeakestSignal)
+{
+  TagStore store;
+  ASSERT_TRUE(store.begin(3));
+  store.setEvictionPolicy(VSERVESAFE_EVICT_LOWEST_RSSI);
+  int8_t rssi[] = {-50, -90, -70};
+  for (int i = 0; i < 3; i++)
+  {
+    MiTagData tagData = makeTag(BASE_MAC + i, 1000, rssi[i]);
+    store.upsert(tagData);
+  }
+  MiTagData tagData = makeTag(BASE_MAC + 3, 1001, -60);
+  store.upsert(tagData);
+  EXPECT_EQ(-1, store.find(BASE_MAC + 1));
+  EXPECT_EQ(3, store.count());
+}
+
+TEST(TagStore, KeepsProtectedAndRejectsWhenAllProtected)
+{
+  TagStore store;
+  ASSERT_TRUE(store.begin(3));
+  store.setEvictionPolicy(VSERVESAFE_EVICT_LRU_KEEP_NOTIFY);
+  mac_key_t protectBelow = BASE_MAC + 1;
+  store.setProtectCallback(isProtected, &protectBelow);
+  for (int i = 0; i < 3; i++)
+  {
+    MiTagData tagData = makeTag(BASE_MAC + i, 1000 + i, -60);
+    store.upsert(tagData);
+  }
+  MiTagData tagData = makeTag(BASE_MAC + 3, 2000, -60);
+  ASSERT_NE(-1, store.upsert(tagData));
+  EXPECT_NE(-1, store.find(BASE_MAC));
+  EXPECT_EQ(-1, store.find(BASE_MAC + 1));
+
+  // With every slot protected the new tag is turned away untouched
+  protectBelow = BASE_MAC + 100;
+  tagData = makeTag(BASE_MAC + 4, 2001, -60);
+  EXPECT_EQ(-1, store.upsert(tagData));
+  EXPECT_EQ(-1, store.find(BASE_MAC + 4));
+  EXPECT_EQ(3, store.count());
+  EXPECT_EQ(1u, store.getEvictionStats().rejections);
+}
+
+TEST(TagStore, ShrinkingKeepsSlotsDenseAndIndexed)
+{
+  TagStore store;
+  ASSERT_TRUE(store.begin(200));
+  for (int i = 0; i < 200; i++)
+  {
+    MiTagData tagData = makeTag(BASE_MAC + i, 1000 + i, -60);
+    int slot = store.upsert(tagData);
+    store.stateAt(slot)->reception.received = i;
+  }
+  ASSERT_TRUE(store.setCapacity(50));
+  EXPECT_EQ(50, store.getCapacity());
+  EXPECT_EQ(50, store.count());
+  for (int slot = 0; slot < store.count(); slot++)
+  {
+    EXPECT_EQ(slot, store.find(store.at(slot)->mac));
+    // States moved with their records
+    EXPECT_EQ(store.at(slot)->mac - BASE_MAC, store.stateAt(slot)->reception.received);
+  }
+  EXPECT_EQ(NULL, store.stateAt(store.count()));
+  // LRU: the most recently heard are kept
+  EXPECT_NE(-1, store.find(BASE_MAC + 199));
+  EXPECT_EQ(-1, store.find(BASE_MAC));
+}
+
+TEST(TagStore, MemoryGrowsInChunks)
+{
+  TagStore store;
+  ASSERT_TRUE(store.begin(TAG_STORE_CHUNK_TAGS * 4));
+  TagStoreMemoryUsage empty = store.getMemoryUsage();
+  MiTagData tagData = makeTag(BASE_MAC, 1000, -60);
+  store.upsert(tagData);
+  TagStoreMemoryUsage one = store.getMemoryUsage();
+  // Each chunk holds the records and their states
+  EXPECT_EQ(TAG_STORE_CHUNK_TAGS * (sizeof(MiTagData) + sizeof(MiTagState)), one.largeBytes - empty.largeBytes);
+  EXPECT_EQ(empty.internalBytes, one.internalBytes);
+}
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}